@@ -64,6 +64,20 @@ class BufferSyncHandler {
 
   virtual DisplayError SyncWait(int fd) = 0;
 
+  /*! @brief Method to check whether output buffer has been released.
+
+    @details This method checks if fd has been signaled by the producer/consumer without blocking.
+    Unlike SyncWait, fd is not closed and remains owned by the caller.
+
+    @param[in] fd
+
+    @return \link DisplayError \endlink kErrorTimeOut if fd has not been signaled yet.
+
+    @sa BufferManager::GetNextBuffer
+  */
+
+  virtual DisplayError SyncCheck(int fd) = 0;
+
   /*! @brief Method to merge two sync fds into one sync fd
 
     @details This method merges two buffer sync fds into one sync fd, if a producer/consumer
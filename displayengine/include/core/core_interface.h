@@ -66,7 +66,7 @@ class BufferSyncHandler;
   @sa CoreInterface::CreateCore
 */
 #define SDE_REVISION_MAJOR (1)
-#define SDE_REVISION_MINOR (0)
+#define SDE_REVISION_MINOR (1)
 
 #define SDE_VERSION_TAG ((uint32_t) ((SDE_REVISION_MAJOR << 24) | (SDE_REVISION_MINOR << 16) | \
                                     (sizeof(SDECompatibility) << 8) | sizeof(int *)))
@@ -191,6 +191,42 @@ class CoreInterface {
   */
   virtual DisplayError DestroyDisplay(DisplayInterface *interface) = 0;
 
+  /*! @brief Method to set the order in which display devices reserve resources in a draw cycle.
+
+    @details Client may prepare display devices concurrently from different threads. Display core
+    then lets each of the listed display devices reserve hardware resources only in its turn. The
+    first reservation attempt of every device is made in the given order, followed by the second
+    attempt of the devices which need one, and so on. Resource reservation stays deterministic
+    irrespective of thread scheduling, while rest of the prepare work of the devices overlaps.
+
+    Client shall set the order before preparing the listed devices of a draw cycle, and shall
+    invoke \link CoreInterface::EndPrepare \endlink for each of them, including the ones which
+    were not prepared. An empty order lets display devices reserve resources in call order. If a
+    device waits too long for its turn, the order is dropped for the rest of the draw cycle and
+    display devices reserve resources in call order.
+
+    @param[in] order list of \link DisplayInterface \endlink in reservation order
+    @param[in] count number of display devices in the list
+
+    @return \link DisplayError \endlink
+
+    @sa EndPrepare
+  */
+  virtual DisplayError SetPrepareOrder(DisplayInterface **order, uint32_t count) = 0;
+
+  /*! @brief Method to notify that a display device is done with prepare for this draw cycle.
+
+    @details Display devices which follow this device in the prepare order do not wait for its
+    reservations anymore.
+
+    @param[in] interface \link DisplayInterface \endlink
+
+    @return \link DisplayError \endlink
+
+    @sa SetPrepareOrder
+  */
+  virtual DisplayError EndPrepare(DisplayInterface *interface) = 0;
+
  protected:
   virtual ~CoreInterface() { }
 };
@@ -35,6 +35,15 @@
 
 namespace sde {
 
+/*! @brief This enum represents formats in which dump information can be generated.
+
+  @sa DumpInterface::GetDump
+*/
+enum DumpFormat {
+  kDumpFormatText,      //!< Human readable text, as printed by dumpsys.
+  kDumpFormatCompact,   //!< One "section.key=value" pair per line, for automated parsing.
+};
+
 /*! @brief Display dump interface.
 
   @details This class defines dump methods provided by display engine.
@@ -58,6 +67,36 @@ class DumpInterface {
   */
   static DisplayError GetDump(char *buffer, uint32_t length);
 
+  /*! @brief Method to get dump information in the given format.
+
+    @details Same as GetDump(char *, uint32_t), except that the caller chooses the format of the
+    dump and gets back the length of the generated string.
+
+    @param[inout] buffer String buffer allocated by the client. Filled with null terminated dump
+    information upon return.
+    @param[in] length Length of the string buffer.
+    @param[in] format \link DumpFormat \endlink
+    @param[out] filled Length of the dump string, excluding null termination.
+
+    @return \link DisplayError \endlink
+
+    @warning Client shall ensure that this interface is not used while a display is being either
+    created or destroyed through display core.
+  */
+  static DisplayError GetDump(char *buffer, uint32_t length, DumpFormat format, uint32_t *filled);
+
+  /*! @brief Method to reset statistics collected by display engine.
+
+    @details Client shall use this method to clear the statistics which are reported as part of
+    the dump, e.g. draw cycle stage latencies, before measuring a new use case.
+
+    @return \link DisplayError \endlink
+
+    @warning Client shall ensure that this interface is not used while a display is being either
+    created or destroyed through display core.
+  */
+  static DisplayError ResetStats();
+
  protected:
   virtual ~DumpInterface() { }
 };
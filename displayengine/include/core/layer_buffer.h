@@ -35,6 +35,8 @@
 
 namespace sde {
 
+class SharedFence;
+
 /*! @brief This enum represents different buffer formats supported by display engine.
 
   @sa LayerBuffer
@@ -166,10 +168,16 @@ struct LayerBuffer {
                                 //!< by display engine when buffer is already available for
                                 //!< read/write.
 
+  SharedFence *release_fence;   //!< Reference to a sync fence object shared by the buffers which
+                                //!< are released together. It is set by display engine during
+                                //!< Commit() instead of release_fence_fd, in which case client
+                                //!< shall duplicate the fence fd if needed and then drop the
+                                //!< reference using SharedFence::Release().
+
   LayerBufferFlags flags;       //!< Flags associated with this buffer.
 
   LayerBuffer() : width(0), height(0), format(kFormatRGBA8888), acquire_fence_fd(-1),
-                  release_fence_fd(-1) { }
+                  release_fence_fd(-1), release_fence(NULL) { }
 };
 
 }  // namespace sde
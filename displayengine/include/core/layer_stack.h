@@ -76,6 +76,27 @@ enum LayerComposition {
                           //!< Only one layer shall be marked as target buffer by the caller.
 };
 
+/*! @brief This enum represents the properties of a display layer which may change between two
+  consecutive Prepare() calls. Each value is a bit of the layer change mask.
+
+  @sa Layer
+*/
+enum LayerChange {
+  kLayerChangeBuffer        = 0x0001,  //!< Buffer handle or the buffer behind it has changed.
+  kLayerChangeBufferFormat  = 0x0002,  //!< Buffer width, height, format or flags have changed.
+  kLayerChangeFrameRate     = 0x0004,  //!< Frame rate has changed.
+  kLayerChangeComposition   = 0x0008,  //!< Composition type set by the client has changed.
+  kLayerChangeSrcRect       = 0x0010,  //!< Source rectangle has changed.
+  kLayerChangeDstRect       = 0x0020,  //!< Destination rectangle has changed.
+  kLayerChangeVisibleRegion = 0x0040,  //!< Visible region has changed.
+  kLayerChangeDirtyRegion   = 0x0080,  //!< Dirty region has changed.
+  kLayerChangeBlending      = 0x0100,  //!< Blending operation has changed.
+  kLayerChangeTransform     = 0x0200,  //!< Rotation or flip has changed.
+  kLayerChangePlaneAlpha    = 0x0400,  //!< Plane alpha has changed.
+  kLayerChangeFlags         = 0x0800,  //!< Skip flag has changed.
+  kLayerChangeAll           = 0xFFFF,  //!< All properties shall be considered as changed.
+};
+
 /*! @brief This structure defines rotation and flip values for a display layer.
 
   @sa Layer
@@ -199,8 +220,13 @@ struct Layer {
 
   uint32_t frame_rate;              //!< Rate at which frames are being updated for this layer.
 
+  uint32_t change_mask;             //!< Bit mask of \link LayerChange \endlink values which tells
+                                    //!< the properties that have changed since the previous
+                                    //!< Prepare() call. Clients which do not track changes shall
+                                    //!< leave it as kLayerChangeAll.
+
   Layer() : input_buffer(NULL), composition(kCompositionGPU), blending(kBlendingNone),
-            plane_alpha(0), frame_rate(0) { }
+            plane_alpha(0), frame_rate(0), change_mask(kLayerChangeAll) { }
 };
 
 /*! @brief This structure defines a layer stack that contains layers which need to be composed and
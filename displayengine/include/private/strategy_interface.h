@@ -75,7 +75,7 @@ namespace sde {
   @sa CreateStrategyInterface
 */
 #define STRATEGY_REVISION_MAJOR (1)
-#define STRATEGY_REVISION_MINOR (0)
+#define STRATEGY_REVISION_MINOR (2)
 
 #define STRATEGY_VERSION_TAG ((uint16_t) ((STRATEGY_REVISION_MAJOR << 8) | STRATEGY_REVISION_MINOR))
 
@@ -122,7 +122,11 @@ struct StrategyConstraints {
   uint32_t max_layers;    //!< Maximum number of layers that shall be programmed on hardware for the
                           //!< given layer stack.
 
-  StrategyConstraints() : safe_mode(false), max_layers(kMaxSDELayers) { }
+  bool idle_mode;         //!< In this mode, display content is expected to update at a slow cadence.
+                          //!< Strategy manager shall prefer the composition strategy that caches
+                          //!< the non-updating layers. i.e., cached GPU composition
+
+  StrategyConstraints() : safe_mode(false), max_layers(kMaxSDELayers), idle_mode(false) { }
 };
 
 /*! @brief This structure encapsulates information about the input layer stack and the layers which
@@ -139,6 +143,14 @@ struct HWLayersInfo {
 
   uint32_t count;           //!< Total number of layers which need to be set on hardware.
 
+  LayerRect left_partial_update;
+                            //!< Region of the left half of the display which needs to be updated.
+                            //!< Set by the resource manager.
+
+  LayerRect right_partial_update;
+                            //!< Region of the right half of the display which needs to be updated,
+                            //!< empty if the display is not split. Set by the resource manager.
+
   HWLayersInfo() : stack(NULL), count(0) { }
 };
 
@@ -35,6 +35,7 @@
 #define UINT8(exp) static_cast<uint8_t>(exp)
 #define UINT32(exp) static_cast<uint32_t>(exp)
 #define INT32(exp) static_cast<int32_t>(exp)
+#define UINT64(exp) static_cast<uint64_t>(exp)
 
 #define STRUCT_VAR(struct_name, var_name) \
           struct struct_name var_name; \
@@ -33,6 +33,7 @@
 #include <stdint.h>
 #include <core/sde_types.h>
 #include <core/debug_interface.h>
+#include <utils/trace.h>
 
 #define DLOG(tag, method, format, ...) Debug::Get()->method(tag, __CLASS__ "::%s: " format, \
                                                             __FUNCTION__, ##__VA_ARGS__)
@@ -49,7 +50,7 @@
 
 #define DTRACE_BEGIN(custom_string) Debug::Get()->BeginTrace(__CLASS__, __FUNCTION__, custom_string)
 #define DTRACE_END() Debug::Get()->EndTrace()
-#define DTRACE_SCOPED() ScopeTracer <Debug> scope_tracer(__CLASS__, __FUNCTION__)
+#define DTRACE_SCOPED() STRACE_SCOPED(kTagNone)
 
 namespace sde {
 
@@ -63,6 +64,8 @@ class Debug {
   static uint32_t GetSimulationFlag();
   static uint32_t GetHDMIResolution();
   static uint32_t GetIdleTimeoutMs();
+  static uint32_t GetRotatorBufferBudgetMB();
+  static bool IsPartialUpdateDisabled();
 
  private:
   Debug();
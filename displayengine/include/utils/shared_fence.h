@@ -0,0 +1,110 @@
+/*
+* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __SHARED_FENCE_H__
+#define __SHARED_FENCE_H__
+
+#include <stdint.h>
+#include <unistd.h>
+
+namespace sde {
+
+// Reference counted sync fence. A fence which is signaled for many buffers is shared among them,
+// and a file descriptor is duplicated only where a distinct one is needed.
+class SharedFence {
+ public:
+  // Takes ownership of the fence fd. Returns NULL for an invalid fd.
+  static inline SharedFence *Create(int fd) {
+    if (fd < 0) {
+      return NULL;
+    }
+
+    SharedFence *fence = new SharedFence(fd);
+    if (!fence) {
+      close(fd);
+    }
+
+    return fence;
+  }
+
+  static inline SharedFence *Acquire(SharedFence *fence) {
+    if (fence) {
+      __atomic_add_fetch(&fence->ref_count_, 1, __ATOMIC_RELAXED);
+    }
+
+    return fence;
+  }
+
+  // Drops a reference and resets it. Fence fd is closed along with the last reference.
+  static inline void Release(SharedFence **fence) {
+    if (*fence && !__atomic_sub_fetch(&(*fence)->ref_count_, 1, __ATOMIC_ACQ_REL)) {
+      delete *fence;
+    }
+    *fence = NULL;
+  }
+
+  // Drops a reference and resets it, returning a fence fd owned by the caller. Fence fd is handed
+  // over along with the last reference instead of being duplicated.
+  static inline int ReleaseFd(SharedFence **fence) {
+    SharedFence *shared_fence = *fence;
+    int fd = -1;
+
+    if (!shared_fence) {
+      return fd;
+    }
+
+    if (__atomic_load_n(&shared_fence->ref_count_, __ATOMIC_ACQUIRE) == 1) {
+      fd = shared_fence->fd_;
+      shared_fence->fd_ = -1;
+    } else {
+      fd = dup(shared_fence->fd_);
+    }
+    Release(fence);
+
+    return fd;
+  }
+
+  static inline int GetFd(const SharedFence *fence) { return fence ? fence->fd_ : -1; }
+
+ private:
+  explicit SharedFence(int fd) : fd_(fd), ref_count_(1) { }
+  ~SharedFence() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  int fd_;
+  uint32_t ref_count_;
+};
+
+}  // namespace sde
+
+#endif  // __SHARED_FENCE_H__
+
@@ -0,0 +1,156 @@
+/*
+* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <core/debug_interface.h>
+#include <utils/constants.h>
+
+// Bit mask of debug tags whose trace events are compiled in. Events of other tags are removed by
+// the compiler, e.g. build with -DSDE_TRACE_TAG_MASK=0 to remove all trace events.
+#ifndef SDE_TRACE_TAG_MASK
+#define SDE_TRACE_TAG_MASK 0xFFFFFFFF
+#endif
+
+#define STRACE_CONCAT_(prefix, line) prefix##line
+#define STRACE_CONCAT(prefix, line) STRACE_CONCAT_(prefix, line)
+#define STRACE_EVENT STRACE_CONCAT(trace_event_, __LINE__)
+#define STRACE_SCOPE STRACE_CONCAT(trace_scope_, __LINE__)
+
+#define STRACE_SCOPED(tag) \
+  static const TraceEvent STRACE_EVENT = { __CLASS__, __FUNCTION__ }; \
+  TraceScope<tag> STRACE_SCOPE(&STRACE_EVENT, 0, 0)
+
+#define STRACE_SCOPED_ARGS(tag, arg0, arg1) \
+  static const TraceEvent STRACE_EVENT = { __CLASS__, __FUNCTION__ }; \
+  TraceScope<tag> STRACE_SCOPE(&STRACE_EVENT, UINT64(arg0), UINT64(arg1))
+
+#define STRACE_INSTANT(tag, name, arg0, arg1) \
+  do { \
+    static const TraceEvent trace_event = { __CLASS__, name }; \
+    if (Trace::IsTagEnabled(tag)) { \
+      Trace::Record(tag, kTracePhaseInstant, &trace_event, UINT64(arg0), UINT64(arg1)); \
+    } \
+  } while (0)
+
+namespace sde {
+
+// Static description of a trace point. Its address serves as the event id of trace records.
+struct TraceEvent {
+  const char *class_name;
+  const char *name;
+};
+
+enum TracePhase {
+  kTracePhaseBegin,
+  kTracePhaseEnd,
+  kTracePhaseInstant,
+};
+
+struct TraceRecord {
+  uint64_t timestamp;         // CLOCK_MONOTONIC in nanoseconds
+  const TraceEvent *event;
+  uint64_t arg0;
+  uint64_t arg1;
+  uint16_t tag;
+  uint16_t phase;
+  int32_t tid;
+};
+
+// Always-on binary tracing of display engine and client events. Each thread logs fixed size
+// records into its own ring buffer without taking any lock, and oldest records are overwritten
+// once the ring is full. Rings of all threads can be exported in the Chrome trace event format,
+// which can be loaded in chrome://tracing.
+//
+// Scoped events are forwarded to atrace only if an atrace handler is set.
+class Trace {
+ public:
+  static inline bool IsTagEnabled(DebugTag tag) {
+    return IsTagCompiled(tag) && enabled_.load(std::memory_order_relaxed);
+  }
+  static inline bool IsTagCompiled(DebugTag tag) {
+    return ((SDE_TRACE_TAG_MASK & (1U << tag)) != 0);
+  }
+  static inline void SetEnabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+  }
+  static inline DebugHandler *GetAtraceHandler() { return atrace_handler_; }
+  static inline void SetAtraceHandler(DebugHandler *handler) { atrace_handler_ = handler; }
+  static void Record(DebugTag tag, TracePhase phase, const TraceEvent *event, uint64_t arg0,
+                     uint64_t arg1);
+  // Copies the records of all threads into an array allocated with new[], which the caller has
+  // to delete[]. Returns the number of records copied, or a negative errno on failure.
+  static int Snapshot(TraceRecord **records);
+  // Writes the records of a snapshot as Chrome trace JSON. Returns the number of records written,
+  // or a negative errno on failure.
+  static int ExportChromeJson(const TraceRecord *records, int count, FILE *fp);
+
+ private:
+  static std::atomic<bool> enabled_;   // Read on every trace point, set from any thread
+  static DebugHandler *atrace_handler_;
+};
+
+// Records begin and end of a scope. Tag is a template parameter, so that filtered out scopes
+// compile to nothing.
+template <DebugTag tag>
+class TraceScope {
+ public:
+  TraceScope(const TraceEvent *event, uint64_t arg0, uint64_t arg1)
+    : event_(event), active_(Trace::IsTagEnabled(tag)),
+      atrace_handler_(Trace::IsTagCompiled(tag) ? Trace::GetAtraceHandler() : NULL) {
+    if (active_) {
+      Trace::Record(tag, kTracePhaseBegin, event_, arg0, arg1);
+    }
+    if (atrace_handler_) {
+      atrace_handler_->BeginTrace(event_->class_name, event_->name, "");
+    }
+  }
+
+  ~TraceScope() {
+    if (atrace_handler_) {
+      atrace_handler_->EndTrace();
+    }
+    if (active_) {
+      Trace::Record(tag, kTracePhaseEnd, event_, 0, 0);
+    }
+  }
+
+ private:
+  const TraceEvent *event_;
+  bool active_;
+  DebugHandler *atrace_handler_;
+};
+
+}  // namespace sde
+
+#endif  // __TRACE_H__
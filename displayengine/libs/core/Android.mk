@@ -8,6 +8,9 @@ LOCAL_C_INCLUDES              := hardware/qcom/display/displayengine/include/
 LOCAL_CFLAGS                  := -Wno-missing-field-initializers -Wno-unused-parameter \
                                  -Wconversion -Wall -Werror \
                                  -DLOG_TAG=\"SDE\"
+ifeq ($(TARGET_USES_SDE_VIRTUAL_DRIVER),true)
+LOCAL_CFLAGS                  += -DDISPLAY_CORE_VIRTUAL_DRIVER
+endif
 LOCAL_HEADER_LIBRARIES        := generated_kernel_headers
 LOCAL_SHARED_LIBRARIES        := libdl libsdeutils
 LOCAL_SRC_FILES               := core_interface.cpp \
@@ -24,6 +27,9 @@ LOCAL_SRC_FILES               := core_interface.cpp \
                                  hw_interface.cpp \
                                  hw_framebuffer.cpp \
                                  dump_impl.cpp \
-                                 buffer_manager.cpp
+                                 buffer_manager.cpp \
+                                 virtual_driver.cpp
 
 include $(BUILD_SHARED_LIBRARY)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
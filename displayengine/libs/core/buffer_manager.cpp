@@ -31,8 +31,10 @@
 #include <utils/constants.h>
 #include <sys/mman.h>
 #include <fcntl.h>
+#include <inttypes.h>
 
 #include "buffer_manager.h"
+#include "dump_impl.h"
 
 #define __CLASS__ "BufferManager"
 
@@ -44,24 +46,31 @@ DisplayError BufferManager::BufferSlot::Init() {
   uint32_t buffer_count = hw_buffer_info.buffer_config.buffer_count;
   size_t buffer_size = hw_buffer_info.alloc_buffer_info.size;
 
-  release_fd = new int[buffer_count];
-  if (release_fd == NULL) {
+  release_fence = new SharedFence *[buffer_count];
+  if (release_fence == NULL) {
     return kErrorMemory;
   }
 
   offset = new uint32_t[buffer_count];
   if (offset == NULL) {
-    delete[] release_fd;
-    release_fd = NULL;
+    delete[] release_fence;
+    release_fence = NULL;
     return kErrorMemory;
   }
 
   for (uint32_t idx = 0; idx < buffer_count; idx++) {
-    release_fd[idx] = -1;
+    release_fence[idx] = NULL;
     offset[idx] = UINT32((buffer_size / buffer_count) * idx);
   }
   curr_index = 0;
 
+  for (uint32_t idx = 0; idx < kMaxRingBufferCount; idx++) {
+    content_key[idx] = 0;
+  }
+  pending_content_key = 0;
+  release_miss_count = 0;
+  content_cached = false;
+
   return kErrorNone;
 }
 
@@ -69,10 +78,7 @@ DisplayError BufferManager::BufferSlot::Deinit() {
   uint32_t buffer_count = hw_buffer_info.buffer_config.buffer_count;
 
   for (uint32_t idx = 0; idx < buffer_count; idx++) {
-    if (release_fd[idx] >= 0) {
-      close(release_fd[idx]);
-      release_fd[idx] = -1;
-    }
+    SharedFence::Release(&release_fence[idx]);
   }
 
   if (offset) {
@@ -80,9 +86,9 @@ DisplayError BufferManager::BufferSlot::Deinit() {
     offset = NULL;
   }
 
-  if (release_fd) {
-    delete[] release_fd;
-    release_fd = NULL;
+  if (release_fence) {
+    delete[] release_fence;
+    release_fence = NULL;
   }
 
   state = kBufferSlotFree;
@@ -91,6 +97,26 @@ DisplayError BufferManager::BufferSlot::Deinit() {
   return kErrorNone;
 }
 
+uint32_t BufferManager::BufferSlot::GetReleasedIndex(BufferSyncHandler *buffer_sync_handler) {
+  uint32_t buffer_count = hw_buffer_info.buffer_config.buffer_count;
+
+  // Poll the ring starting from the oldest buffer, without waiting on any of the release fences.
+  for (uint32_t i = 0; i < buffer_count; i++) {
+    uint32_t idx = (curr_index + i) % buffer_count;
+
+    if (!release_fence[idx]) {
+      return idx;
+    }
+
+    if (buffer_sync_handler->SyncCheck(SharedFence::GetFd(release_fence[idx])) != kErrorTimeOut) {
+      SharedFence::Release(&release_fence[idx]);
+      return idx;
+    }
+  }
+
+  return buffer_count;
+}
+
 // BufferManager State Transition
 // *******************************************************
 // Current State *             Next State
@@ -102,88 +128,133 @@ DisplayError BufferManager::BufferSlot::Deinit() {
 //  ACQUIRED     *    NA       Start()          NA
 //********************************************************
 
+// A ready slot is freed by Stop() only if it has not been acquired for kMaxSlotIdleFrames, or by
+// GetNextBuffer() in least recently used order if the allocated size exceeds the memory budget.
+
+// GetNextBuffer() never waits on a release fence. It picks a buffer of the ring whose release fence
+// has signaled. If all of them are still held by the display, the ring is replaced by a larger one
+// of up to kMaxRingBufferCount buffers, and the old slot is left to be freed as idle. Once the ring
+// can not grow, the oldest buffer is given out along with its release fence as the output acquire
+// fence, so that the rotator waits for it instead of the CPU. The fence stays owned by the buffer
+// slot until SetReleaseFence() replaces it.
+
+// Each buffer remembers the key of the content rotated into it. If the client allows it, a buffer
+// which already holds the requested content is given out again, and its rotation is skipped.
+// Display reads such a buffer without any acquire fence, as the commit which last read it has
+// already waited for the rotation to complete.
+
 // ------------------------------- BufferManager Implementation ------------------------------------
 
 BufferManager::BufferManager(BufferAllocator *buffer_allocator,
                              BufferSyncHandler *buffer_sync_handler)
     : buffer_allocator_(buffer_allocator), buffer_sync_handler_(buffer_sync_handler),
-      num_used_slot_(0) {
+      num_used_slot_(0), free_slot_mask_(0xFFFFFFFF), frame_count_(0), allocated_size_(0),
+      memory_budget_(UINT64(Debug::GetRotatorBufferBudgetMB()) * 1024 * 1024),
+      num_closed_session_(0), released_count_(0), fence_handoff_count_(0), ring_grow_count_(0),
+      content_hit_count_(0) {
+  memset(bucket_slot_mask_, 0, sizeof(bucket_slot_mask_));
 }
 
-void BufferManager::Start() {
-  uint32_t slot = 0, num_ready_slot = 0;
+void BufferManager::Start(uint64_t frame_count) {
+  uint32_t used_slot_mask = ~free_slot_mask_;
 
-  // Change the state of acquired buffer_slot to kBufferSlotReady
-  while ((num_ready_slot < num_used_slot_) && (slot < kMaxBufferSlotCount)) {
-    if (buffer_slot_[slot].state == kBufferSlotFree) {
-      slot++;
-      continue;
-    }
+  frame_count_ = frame_count;
 
-    buffer_slot_[slot++].state = kBufferSlotReady;
-    num_ready_slot++;
+  // Change the state of acquired buffer_slot to kBufferSlotReady
+  while (used_slot_mask) {
+    uint32_t slot = UINT32(__builtin_ctz(used_slot_mask));
+    used_slot_mask &= ~(1U << slot);
+    buffer_slot_[slot].state = kBufferSlotReady;
   }
 }
 
-DisplayError BufferManager::GetNextBuffer(HWBufferInfo *hw_buffer_info) {
+DisplayError BufferManager::GetNextBuffer(HWBufferInfo *hw_buffer_info, bool reuse_content) {
   DisplayError error = kErrorNone;
   const BufferConfig &buffer_config = hw_buffer_info->buffer_config;
+  uint32_t config_hash = GetConfigHash(buffer_config);
+  uint64_t content_key = hw_buffer_info->content_key;
 
   DLOGI_IF(kTagBufferManager, "Input: w = %d h = %d f = %d", buffer_config.width,
            buffer_config.height, buffer_config.format);
 
-  uint32_t free_slot = num_used_slot_;
-  uint32_t acquired_slot = kMaxBufferSlotCount;
-  uint32_t num_used_slot = 0;
-
-  // First look for a buffer slot in ready state, if no buffer slot found in ready state matching
-  // with current input config, assign a buffer slot in free state and allocate buffers for it.
-  for (uint32_t slot = 0; slot < kMaxBufferSlotCount && num_used_slot < num_used_slot_; slot++) {
-    HWBufferInfo &hw_buffer_info = buffer_slot_[slot].hw_buffer_info;
-
-    if (buffer_slot_[slot].state == kBufferSlotFree) {
-      free_slot = slot;
-    } else {
-      if ((buffer_slot_[slot].state == kBufferSlotReady)) {
-        if ((::memcmp(&buffer_config, &hw_buffer_info.buffer_config, sizeof(BufferConfig)) == 0)) {
-          buffer_slot_[slot].state = kBufferSlotAcquired;
-          acquired_slot = slot;
-          break;
-        }
-      }
-      num_used_slot++;
+  hw_buffer_info->content_cached = false;
+
+  // Look for a buffer which already holds the requested content.
+  if (reuse_content && content_key) {
+    uint32_t cached_index = 0;
+    uint32_t cached_slot = FindCachedSlot(buffer_config, config_hash, content_key, &cached_index);
+    if (cached_slot < kMaxBufferSlotCount) {
+      BufferSlot &buffer_slot = buffer_slot_[cached_slot];
+      const AllocatedBufferInfo &alloc_buffer_info = buffer_slot.hw_buffer_info.alloc_buffer_info;
+
+      buffer_slot.last_used_frame = frame_count_;
+      buffer_slot.curr_index = cached_index;
+      buffer_slot.content_cached = true;
+      content_hit_count_++;
+
+      hw_buffer_info->output_buffer.width = buffer_config.width;
+      hw_buffer_info->output_buffer.height = buffer_config.height;
+      hw_buffer_info->output_buffer.format = buffer_config.format;
+      hw_buffer_info->output_buffer.flags.secure = buffer_config.secure;
+      hw_buffer_info->output_buffer.planes[0].stride = alloc_buffer_info.stride;
+      hw_buffer_info->output_buffer.planes[0].fd = alloc_buffer_info.fd;
+      hw_buffer_info->output_buffer.planes[0].offset = buffer_slot.offset[cached_index];
+      hw_buffer_info->output_buffer.acquire_fence_fd = -1;
+      hw_buffer_info->slot = cached_slot;
+      hw_buffer_info->session_id = buffer_slot.hw_buffer_info.session_id;
+      hw_buffer_info->content_cached = true;
+
+      DLOGI_IF(kTagBufferManager, "Cached: session_id %d slot = %d index = %d",
+               hw_buffer_info->session_id, cached_slot, cached_index);
+
+      return kErrorNone;
     }
   }
 
-  // If the input config does not match with existing config, then allocate buffers for the new
+  // First look for a buffer slot in ready state matching with current input config.
+  uint32_t acquired_slot = FindReadySlot(buffer_config, config_hash);
+
+  // If the input config does not match with existing config, then allocate buffers for a free
   // buffer slot and change the state to kBufferSlotAcquired
   if (acquired_slot == kMaxBufferSlotCount) {
-    if (free_slot >= kMaxBufferSlotCount) {
-      return kErrorMemory;
-    }
-
-    buffer_slot_[free_slot].hw_buffer_info.buffer_config = hw_buffer_info->buffer_config;
-
-    error = buffer_allocator_->AllocateBuffer(&buffer_slot_[free_slot].hw_buffer_info);
+    error = AllocateBufferSlot(buffer_config, config_hash, &acquired_slot);
     if (error != kErrorNone) {
       return error;
     }
+  }
 
-    buffer_slot_[free_slot].Init();
-    buffer_slot_[free_slot].state = kBufferSlotAcquired;
-    acquired_slot = free_slot;
-    num_used_slot_++;
-
-    DLOGI_IF(kTagBufferManager, "Allocate Buffer acquired_slot = %d ", acquired_slot);
+  uint32_t curr_index = buffer_slot_[acquired_slot].GetReleasedIndex(buffer_sync_handler_);
+  uint32_t &release_miss_count = buffer_slot_[acquired_slot].release_miss_count;
+  if (curr_index == buffer_slot_[acquired_slot].hw_buffer_info.buffer_config.buffer_count) {
+    // None of the buffers are released by the display yet. A single miss is common on a loaded
+    // device and is covered by handing the release fence to the rotator, grow the ring only when
+    // the display keeps holding all of its buffers.
+    if ((++release_miss_count >= kRingGrowMissCount) &&
+        (GrowBufferSlot(&acquired_slot) == kErrorNone)) {
+      curr_index = 0;
+    }
+  } else {
+    release_miss_count = 0;
   }
 
-  const AllocatedBufferInfo &alloc_buffer_info =
-    buffer_slot_[acquired_slot].hw_buffer_info.alloc_buffer_info;
-  uint32_t curr_index = buffer_slot_[acquired_slot].curr_index;
+  BufferSlot &buffer_slot = buffer_slot_[acquired_slot];
+  const AllocatedBufferInfo &alloc_buffer_info = buffer_slot.hw_buffer_info.alloc_buffer_info;
+
+  buffer_slot.last_used_frame = frame_count_;
 
-  // Wait for the release fence fd before buffer slot being given to the client.
-  buffer_sync_handler_->SyncWait(buffer_slot_[acquired_slot].release_fd[curr_index]);
-  buffer_slot_[acquired_slot].release_fd[curr_index] = -1;
+  // Rotator waits for the release fence fd of the oldest buffer, if no buffer has been released.
+  if (curr_index == buffer_slot.hw_buffer_info.buffer_config.buffer_count) {
+    curr_index = buffer_slot.curr_index;
+    fence_handoff_count_++;
+  } else {
+    released_count_++;
+  }
+  buffer_slot.curr_index = curr_index;
+
+  // Content of the buffer is overwritten, it is known again once the rotation is committed.
+  buffer_slot.content_key[curr_index] = 0;
+  buffer_slot.pending_content_key = content_key;
+  buffer_slot.content_cached = false;
 
   hw_buffer_info->output_buffer.width = buffer_config.width;
   hw_buffer_info->output_buffer.height = buffer_config.height;
@@ -192,9 +263,14 @@ DisplayError BufferManager::GetNextBuffer(HWBufferInfo *hw_buffer_info) {
 
   hw_buffer_info->output_buffer.planes[0].stride = alloc_buffer_info.stride;
   hw_buffer_info->output_buffer.planes[0].fd = alloc_buffer_info.fd;
-  hw_buffer_info->output_buffer.planes[0].offset = buffer_slot_[acquired_slot].offset[curr_index];
+  hw_buffer_info->output_buffer.planes[0].offset = buffer_slot.offset[curr_index];
+  hw_buffer_info->output_buffer.acquire_fence_fd =
+    SharedFence::GetFd(buffer_slot.release_fence[curr_index]);
   hw_buffer_info->slot = acquired_slot;
 
+  // Rotator session belongs to the buffer slot, a new slot needs a new session.
+  hw_buffer_info->session_id = buffer_slot.hw_buffer_info.session_id;
+
   DLOGI_IF(kTagBufferManager, "Output: w = %d h = %d f = %d session_id %d acquired slot = %d " \
            "num_used_slot %d curr_index = %d offset %d", hw_buffer_info->output_buffer.width,
            hw_buffer_info->output_buffer.height, hw_buffer_info->output_buffer.format,
@@ -206,50 +282,71 @@ DisplayError BufferManager::GetNextBuffer(HWBufferInfo *hw_buffer_info) {
 
 DisplayError BufferManager::Stop(int *session_ids) {
   DisplayError error = kErrorNone;
-  uint32_t slot = 0, count = 0;
-
-  // Free all the buffer slots which were not acquired in the current cycle and deallocate the
-  // buffers associated with it.
-  while ((num_used_slot_ > 0) && (slot < kMaxBufferSlotCount)) {
-    if (buffer_slot_[slot].state == kBufferSlotReady) {
-      if (buffer_slot_[slot].hw_buffer_info.session_id != -1) {
-        session_ids[count++] = buffer_slot_[slot].hw_buffer_info.session_id;
-      }
+  uint32_t used_slot_mask = ~free_slot_mask_;
 
+  // Free the buffer slots which were not acquired for kMaxSlotIdleFrames and deallocate the
+  // buffers associated with them.
+  while (used_slot_mask) {
+    uint32_t slot = UINT32(__builtin_ctz(used_slot_mask));
+    used_slot_mask &= ~(1U << slot);
+
+    if ((buffer_slot_[slot].state == kBufferSlotReady) &&
+        ((frame_count_ - buffer_slot_[slot].last_used_frame) >= kMaxSlotIdleFrames)) {
       error = FreeBufferSlot(slot);
-      if (error != kErrorNone) {
+      if (error == kErrorResources) {
+        // Session queue is full, the slot is freed once its backlog has been reported.
+        break;
+      } else if (error != kErrorNone) {
         return error;
       }
-
-      num_used_slot_--;
     }
-    slot++;
   }
 
-  session_ids[count] = -1;
+  // Report sessions of the slots freed since the last call. Sessions which do not fit in the
+  // caller's list stay queued for the next call, so that every one of them gets closed.
+  uint32_t num_reported = MIN(num_closed_session_, kMaxReportedSessionCount);
+  for (uint32_t i = 0; i < num_reported; i++) {
+    session_ids[i] = closed_session_ids_[i];
+  }
+  session_ids[num_reported] = -1;
+  num_closed_session_ -= num_reported;
+  for (uint32_t i = 0; i < num_closed_session_; i++) {
+    closed_session_ids_[i] = closed_session_ids_[num_reported + i];
+  }
 
   return kErrorNone;
 }
 
-DisplayError BufferManager::SetReleaseFd(uint32_t slot, int fd) {
+DisplayError BufferManager::SetReleaseFence(uint32_t slot, SharedFence *fence) {
   if ((slot >= kMaxBufferSlotCount) || (buffer_slot_[slot].state != kBufferSlotAcquired)) {
-    DLOGE("Invalid Parameters slot %d state %s", slot, buffer_slot_[slot].state);
-    kErrorParameters;
+    DLOGE("Invalid Parameters slot %d", slot);
+    SharedFence::Release(&fence);
+    return kErrorParameters;
   }
 
   uint32_t &curr_index = buffer_slot_[slot].curr_index;
   const HWBufferInfo &hw_buffer_info = buffer_slot_[slot].hw_buffer_info;
   uint32_t buffer_count = hw_buffer_info.buffer_config.buffer_count;
 
-  // 1. Store the release fence fd, so that buffer manager waits for the release fence fd to be
-  //    signaled and gives the buffer slot to the client.
+  // 1. Store the release fence, so that buffer manager polls the release fence to be signaled
+  //    and gives the buffer slot to the client. A previous fence of this buffer has been given to
+  //    the rotator as its output acquire fence, and is not needed any more. Ownership of the
+  //    fence reference is taken over from the caller.
   // 2. Modify the curr_index to point to next buffer.
-  buffer_slot_[slot].release_fd[curr_index] = fd;
-  curr_index = (curr_index + 1) % buffer_count;
+  SharedFence *&release_fence = buffer_slot_[slot].release_fence[curr_index];
+  SharedFence::Release(&release_fence);
+  release_fence = fence;
+
+  // A buffer reused for its content is given out again as long as the content is requested.
+  if (!buffer_slot_[slot].content_cached) {
+    buffer_slot_[slot].content_key[curr_index] = buffer_slot_[slot].pending_content_key;
+    curr_index = (curr_index + 1) % buffer_count;
+  }
 
   DLOGI_IF(kTagBufferManager, "w = %d h = %d f = %d session_id %d slot = %d curr_index = %d " \
            "sync fd %d", hw_buffer_info.output_buffer.width, hw_buffer_info.output_buffer.height,
-           hw_buffer_info.output_buffer.format, hw_buffer_info.session_id, slot, curr_index, fd);
+           hw_buffer_info.output_buffer.format, hw_buffer_info.session_id, slot, curr_index,
+           SharedFence::GetFd(fence));
 
   return kErrorNone;
 }
@@ -257,8 +354,8 @@ DisplayError BufferManager::SetReleaseFd(uint32_t slot, int fd) {
 
 DisplayError BufferManager::SetSessionId(uint32_t slot, int session_id) {
   if ((slot >= kMaxBufferSlotCount) || (buffer_slot_[slot].state != kBufferSlotAcquired)) {
-    DLOGE("Invalid Parameters slot %d state %s", slot, buffer_slot_[slot].state);
-    kErrorParameters;
+    DLOGE("Invalid Parameters slot %d", slot);
+    return kErrorParameters;
   }
 
   HWBufferInfo *hw_buffer_info = &buffer_slot_[slot].hw_buffer_info;
@@ -272,10 +369,101 @@ DisplayError BufferManager::SetSessionId(uint32_t slot, int session_id) {
   return kErrorNone;
 }
 
+DisplayError BufferManager::AllocateBufferSlot(const BufferConfig &buffer_config,
+                                               uint32_t config_hash, uint32_t *slot) {
+  DisplayError error = kErrorNone;
+
+  if (!free_slot_mask_) {
+    return kErrorMemory;
+  }
+
+  uint32_t free_slot = UINT32(__builtin_ctz(free_slot_mask_));
+  BufferSlot &buffer_slot = buffer_slot_[free_slot];
+
+  buffer_slot.hw_buffer_info.buffer_config = buffer_config;
+
+  error = buffer_allocator_->AllocateBuffer(&buffer_slot.hw_buffer_info);
+  if (error != kErrorNone) {
+    buffer_slot.hw_buffer_info = HWBufferInfo();
+    return error;
+  }
+
+  buffer_slot.Init();
+  buffer_slot.state = kBufferSlotAcquired;
+  buffer_slot.config_hash = config_hash;
+  free_slot_mask_ &= ~(1U << free_slot);
+  bucket_slot_mask_[config_hash % kHashBucketCount] |= (1U << free_slot);
+  allocated_size_ += buffer_slot.hw_buffer_info.alloc_buffer_info.size;
+  num_used_slot_++;
+
+  DLOGI_IF(kTagBufferManager, "Allocate Buffer acquired_slot = %d ", free_slot);
+
+  error = FitMemoryBudget();
+  if (error != kErrorNone) {
+    FreeBufferSlot(free_slot);
+    return error;
+  }
+
+  *slot = free_slot;
+
+  return kErrorNone;
+}
+
+DisplayError BufferManager::GrowBufferSlot(uint32_t *slot) {
+  DisplayError error = kErrorNone;
+  BufferSlot &buffer_slot = buffer_slot_[*slot];
+  BufferConfig buffer_config = buffer_slot.hw_buffer_info.buffer_config;
+  uint32_t config_hash = buffer_slot.config_hash;
+  uint32_t grown_slot = kMaxBufferSlotCount;
+
+  if (buffer_config.buffer_count >= kMaxRingBufferCount) {
+    return kErrorNotSupported;
+  }
+
+  // Old slot stays allocated until it is idle, so the grown ring has to fit in the memory budget
+  // next to it. Other slots are not evicted to make room for growing.
+  uint64_t grown_size = UINT64(buffer_slot.hw_buffer_info.alloc_buffer_info.size /
+                                buffer_config.buffer_count) * (buffer_config.buffer_count + 1);
+  if (memory_budget_ && ((allocated_size_ + grown_size) > memory_budget_)) {
+    DLOGV_IF(kTagBufferManager, "Grow slot = %d exceeds memory budget %" PRIu64, *slot,
+             memory_budget_);
+    return kErrorMemory;
+  }
+
+  // Take the old slot out of the lookup, so that the grown slot is found for this config from now
+  // on. It stays acquired while allocating, hence it is not evicted for the memory budget here.
+  buffer_config.buffer_count++;
+  bucket_slot_mask_[config_hash % kHashBucketCount] &= ~(1U << *slot);
+
+  error = AllocateBufferSlot(buffer_config, config_hash, &grown_slot);
+  if (error != kErrorNone) {
+    bucket_slot_mask_[config_hash % kHashBucketCount] |= (1U << *slot);
+    return error;
+  }
+
+  // Old slot is freed by Stop() once it has been idle for kMaxSlotIdleFrames.
+  buffer_slot.state = kBufferSlotReady;
+
+  DLOGI_IF(kTagBufferManager, "Grow slot = %d to slot = %d buffer_count = %d", *slot, grown_slot,
+           buffer_config.buffer_count);
+
+  ring_grow_count_++;
+  *slot = grown_slot;
+
+  return kErrorNone;
+}
+
 DisplayError BufferManager::FreeBufferSlot(uint32_t slot) {
   DisplayError error = kErrorNone;
 
-  HWBufferInfo *hw_buffer_info = &buffer_slot_[slot].hw_buffer_info;
+  BufferSlot &buffer_slot = buffer_slot_[slot];
+  HWBufferInfo *hw_buffer_info = &buffer_slot.hw_buffer_info;
+
+  // Keep the slot rather than leaking its rotator session.
+  if ((hw_buffer_info->session_id != -1) && (num_closed_session_ >= kMaxClosedSessionCount)) {
+    DLOGW("Closed session queue full, slot = %d is not freed", slot);
+    return kErrorResources;
+  }
 
   error = buffer_allocator_->FreeBuffer(hw_buffer_info);
   if (error != kErrorNone) {
@@ -285,9 +473,184 @@ DisplayError BufferManager::FreeBufferSlot(uint32_t slot) {
   DLOGI_IF(kTagBufferManager, "session_id %d slot = %d num_used_slot %d",
            hw_buffer_info->session_id, slot, num_used_slot_);
 
-  buffer_slot_[slot].Deinit();
+  if (hw_buffer_info->session_id != -1) {
+    closed_session_ids_[num_closed_session_++] = hw_buffer_info->session_id;
+  }
+
+  allocated_size_ -= hw_buffer_info->alloc_buffer_info.size;
+  bucket_slot_mask_[buffer_slot.config_hash % kHashBucketCount] &= ~(1U << slot);
+  free_slot_mask_ |= (1U << slot);
+  num_used_slot_--;
+
+  buffer_slot.Deinit();
+  buffer_slot.config_hash = 0;
+  buffer_slot.last_used_frame = 0;
+
+  return kErrorNone;
+}
+
+uint32_t BufferManager::GetConfigHash(const BufferConfig &buffer_config) {
+  uint32_t hash = buffer_config.width;
+
+  hash = (hash * 31) + buffer_config.height;
+  hash = (hash * 31) + UINT32(buffer_config.format);
+  hash = (hash * 31) + UINT32(buffer_config.secure);
+  hash = (hash * 31) + UINT32(buffer_config.cache);
+
+  return hash;
+}
+
+// Slot config is compatible if it has at least as many buffers as requested, since its ring may
+// have been grown. Buffer count is therefore not part of the config hash.
+bool BufferManager::IsCompatibleConfig(const BufferConfig &buffer_config,
+                                       const BufferConfig &slot_config) {
+  return (buffer_config.width == slot_config.width) &&
+         (buffer_config.height == slot_config.height) &&
+         (buffer_config.format == slot_config.format) &&
+         (buffer_config.buffer_count <= slot_config.buffer_count) &&
+         (buffer_config.secure == slot_config.secure) && (buffer_config.cache == slot_config.cache);
+}
+
+uint32_t BufferManager::FindCachedSlot(const BufferConfig &buffer_config, uint32_t config_hash,
+                                       uint64_t content_key, uint32_t *index) {
+  uint32_t slot_mask = bucket_slot_mask_[config_hash % kHashBucketCount];
+
+  while (slot_mask) {
+    uint32_t slot = UINT32(__builtin_ctz(slot_mask));
+    slot_mask &= ~(1U << slot);
+
+    BufferSlot &buffer_slot = buffer_slot_[slot];
+    if ((buffer_slot.state != kBufferSlotReady) || (buffer_slot.config_hash != config_hash) ||
+        !IsCompatibleConfig(buffer_config, buffer_slot.hw_buffer_info.buffer_config)) {
+      continue;
+    }
+
+    for (uint32_t idx = 0; idx < buffer_slot.hw_buffer_info.buffer_config.buffer_count; idx++) {
+      if (buffer_slot.content_key[idx] == content_key) {
+        buffer_slot.state = kBufferSlotAcquired;
+        *index = idx;
+        return slot;
+      }
+    }
+  }
+
+  return kMaxBufferSlotCount;
+}
+
+uint32_t BufferManager::FindReadySlot(const BufferConfig &buffer_config, uint32_t config_hash) {
+  uint32_t slot_mask = bucket_slot_mask_[config_hash % kHashBucketCount];
+
+  while (slot_mask) {
+    uint32_t slot = UINT32(__builtin_ctz(slot_mask));
+    slot_mask &= ~(1U << slot);
+
+    BufferSlot &buffer_slot = buffer_slot_[slot];
+    if ((buffer_slot.state == kBufferSlotReady) && (buffer_slot.config_hash == config_hash) &&
+        IsCompatibleConfig(buffer_config, buffer_slot.hw_buffer_info.buffer_config)) {
+      buffer_slot.state = kBufferSlotAcquired;
+      return slot;
+    }
+  }
+
+  return kMaxBufferSlotCount;
+}
+
+uint32_t BufferManager::GetLRUReadySlot() {
+  uint32_t used_slot_mask = ~free_slot_mask_;
+  uint32_t lru_slot = kMaxBufferSlotCount;
+
+  while (used_slot_mask) {
+    uint32_t slot = UINT32(__builtin_ctz(used_slot_mask));
+    used_slot_mask &= ~(1U << slot);
+
+    if ((buffer_slot_[slot].state == kBufferSlotReady) &&
+        ((lru_slot == kMaxBufferSlotCount) ||
+         (buffer_slot_[slot].last_used_frame < buffer_slot_[lru_slot].last_used_frame))) {
+      lru_slot = slot;
+    }
+  }
+
+  return lru_slot;
+}
+
+DisplayError BufferManager::FitMemoryBudget() {
+  DisplayError error = kErrorNone;
+
+  if (!memory_budget_) {
+    return kErrorNone;
+  }
+
+  // Evict ready slots in least recently used order. Acquired slots are in use in this cycle.
+  while (allocated_size_ > memory_budget_) {
+    uint32_t slot = GetLRUReadySlot();
+    if (slot == kMaxBufferSlotCount) {
+      DLOGV_IF(kTagBufferManager, "Allocated size %" PRIu64 " exceeds memory budget %" PRIu64,
+               allocated_size_, memory_budget_);
+      return kErrorMemory;
+    }
+
+    error = FreeBufferSlot(slot);
+    if (error != kErrorNone) {
+      return error;
+    }
+  }
 
   return kErrorNone;
 }
 
+void BufferManager::AppendDump(DumpBuilder *builder) {
+  builder->AppendString("\nbuffer slots = %u, allocated size = %" PRIu64 ", budget = %" PRIu64,
+                        num_used_slot_, allocated_size_, memory_budget_);
+  builder->AppendString("\nreleased = %" PRIu64 ", fence handoffs = %" PRIu64
+                        ", ring grows = %" PRIu64, released_count_, fence_handoff_count_,
+                        ring_grow_count_);
+  builder->AppendString("\ncontent hits = %" PRIu64, content_hit_count_);
+
+  uint32_t used_slot_mask = ~free_slot_mask_;
+  while (used_slot_mask) {
+    uint32_t slot = UINT32(__builtin_ctz(used_slot_mask));
+    used_slot_mask &= ~(1U << slot);
+
+    const BufferSlot &buffer_slot = buffer_slot_[slot];
+    const HWBufferInfo &hw_buffer_info = buffer_slot.hw_buffer_info;
+    const BufferConfig &buffer_config = hw_buffer_info.buffer_config;
+    builder->AppendString("\nslot = %u, state = %d, w = %u, h = %u, f = %d, " \
+                          "count = %u, size = %u, session_id = %d, last used frame = %" PRIu64,
+                          slot, buffer_slot.state, buffer_config.width, buffer_config.height,
+                          buffer_config.format, buffer_config.buffer_count,
+                          hw_buffer_info.alloc_buffer_info.size, hw_buffer_info.session_id,
+                          buffer_slot.last_used_frame);
+  }
+}
+
+void BufferManager::AppendCompactDump(DumpBuilder *builder) {
+  builder->Add("buffer_slots", "%u", num_used_slot_);
+  builder->Add("allocated_size", "%" PRIu64, allocated_size_);
+  builder->Add("budget", "%" PRIu64, memory_budget_);
+  builder->Add("released", "%" PRIu64, released_count_);
+  builder->Add("fence_handoffs", "%" PRIu64, fence_handoff_count_);
+  builder->Add("ring_grows", "%" PRIu64, ring_grow_count_);
+  builder->Add("content_hits", "%" PRIu64, content_hit_count_);
+
+  uint32_t used_slot_mask = ~free_slot_mask_;
+  while (used_slot_mask) {
+    uint32_t slot = UINT32(__builtin_ctz(used_slot_mask));
+    used_slot_mask &= ~(1U << slot);
+
+    const BufferSlot &buffer_slot = buffer_slot_[slot];
+    const HWBufferInfo &hw_buffer_info = buffer_slot.hw_buffer_info;
+    const BufferConfig &buffer_config = hw_buffer_info.buffer_config;
+    builder->BeginSection("slot", slot);
+    builder->Add("state", "%d", buffer_slot.state);
+    builder->Add("w", "%u", buffer_config.width);
+    builder->Add("h", "%u", buffer_config.height);
+    builder->Add("f", "%d", buffer_config.format);
+    builder->Add("count", "%u", buffer_config.buffer_count);
+    builder->Add("size", "%u", hw_buffer_info.alloc_buffer_info.size);
+    builder->Add("session_id", "%d", hw_buffer_info.session_id);
+    builder->Add("last_used_frame", "%" PRIu64, buffer_slot.last_used_frame);
+    builder->EndSection();
+  }
+}
+
 }  // namespace sde
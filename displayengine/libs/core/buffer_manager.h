@@ -31,8 +31,10 @@
 #define __BUFFER_MANAGER_H__
 
 #include <utils/locker.h>
+#include <utils/shared_fence.h>
 #include <core/buffer_allocator.h>
 #include "hw_interface.h"
+#include "dump_impl.h"
 
 namespace sde {
 
@@ -40,14 +42,26 @@ class BufferManager {
  public:
   BufferManager(BufferAllocator *buffer_allocator, BufferSyncHandler *buffer_sync_handler);
 
-  void Start();
-  DisplayError GetNextBuffer(HWBufferInfo *hw_buffer_info);
+  void Start(uint64_t frame_count);
+  DisplayError GetNextBuffer(HWBufferInfo *hw_buffer_info, bool reuse_content);
   DisplayError Stop(int *session_ids);
-  DisplayError SetReleaseFd(uint32_t slot, int fd);
+  DisplayError SetReleaseFence(uint32_t slot, SharedFence *fence);
   DisplayError SetSessionId(uint32_t slot, int session_id);
+  void AppendDump(DumpBuilder *builder);
+  void AppendCompactDump(DumpBuilder *builder);
 
  private:
   static const uint32_t kMaxBufferSlotCount = 32;
+  static const uint32_t kMaxRingBufferCount = 4;  // Upper limit of buffers a ring grows to when
+                                                  // none of its buffers are released
+  static const uint32_t kHashBucketCount = 16;
+  static const uint64_t kMaxSlotIdleFrames = 8;  // Ready slots unused for these many frames are
+                                                 // freed
+  static const uint32_t kRingGrowMissCount = 3;  // Consecutive frames without a released buffer
+                                                 // before a ring grows
+  static const uint32_t kMaxClosedSessionCount = kMaxBufferSlotCount * 2;
+  static const uint32_t kMaxReportedSessionCount = kMaxSDELayers * 2 - 1;  // Fits the session
+                                                                         // list of HWLayers
 
   enum kBufferSlotState {
     kBufferSlotFree     = 0,
@@ -58,21 +72,51 @@ class BufferManager {
   struct BufferSlot {
     HWBufferInfo hw_buffer_info;
     kBufferSlotState state;
-    int *release_fd;
+    SharedFence **release_fence;
     uint32_t *offset;
     uint32_t curr_index;
+    uint32_t config_hash;
+    uint64_t last_used_frame;
+    uint64_t content_key[kMaxRingBufferCount];  // Key of the content held by each buffer, or 0
+    uint64_t pending_content_key;               // Key of the content being rotated in this frame
+    bool content_cached;                        // Buffer given out holds the requested content
+    uint32_t release_miss_count;                // Consecutive frames without a released buffer
 
-    BufferSlot() : state(kBufferSlotFree), release_fd(NULL), offset(NULL), curr_index(0) { }
+    BufferSlot() : state(kBufferSlotFree), release_fence(NULL), offset(NULL), curr_index(0),
+                   config_hash(0), last_used_frame(0), pending_content_key(0),
+                   content_cached(false), release_miss_count(0) { }
     DisplayError Init();
     DisplayError Deinit();
+    uint32_t GetReleasedIndex(BufferSyncHandler *buffer_sync_handler);
   };
 
+  DisplayError AllocateBufferSlot(const BufferConfig &buffer_config, uint32_t config_hash,
+                                  uint32_t *slot);
   DisplayError FreeBufferSlot(uint32_t index);
+  DisplayError GrowBufferSlot(uint32_t *slot);
+  uint32_t GetConfigHash(const BufferConfig &buffer_config);
+  bool IsCompatibleConfig(const BufferConfig &buffer_config, const BufferConfig &slot_config);
+  uint32_t FindReadySlot(const BufferConfig &buffer_config, uint32_t config_hash);
+  uint32_t FindCachedSlot(const BufferConfig &buffer_config, uint32_t config_hash,
+                          uint64_t content_key, uint32_t *index);
+  uint32_t GetLRUReadySlot();
+  DisplayError FitMemoryBudget();
 
   BufferSlot buffer_slot_[kMaxBufferSlotCount];
   BufferAllocator *buffer_allocator_;
   BufferSyncHandler *buffer_sync_handler_;
   uint32_t num_used_slot_;
+  uint32_t free_slot_mask_;                        // Bit mask of slots in free state
+  uint32_t bucket_slot_mask_[kHashBucketCount];    // Bit masks of used slots by config hash
+  uint64_t frame_count_;
+  uint64_t allocated_size_;                        // Total size of the buffers of used slots
+  uint64_t memory_budget_;                         // Upper limit of allocated_size_, 0 for none
+  int closed_session_ids_[kMaxClosedSessionCount];  // Sessions of freed slots, reported on Stop()
+  uint32_t num_closed_session_;
+  uint64_t released_count_;                        // Buffers given out with signaled release fence
+  uint64_t fence_handoff_count_;                   // Buffers given out with pending release fence
+  uint64_t ring_grow_count_;
+  uint64_t content_hit_count_;                     // Buffers given out with rotated content
 };
 
 }  // namespace sde
@@ -23,6 +23,8 @@
 */
 
 #include <dlfcn.h>
+#include <inttypes.h>
+#include <utils/clock.h>
 #include <utils/constants.h>
 #include <utils/debug.h>
 #include <core/buffer_allocator.h>
@@ -34,9 +36,39 @@
 
 namespace sde {
 
+// FNV-1a hash, used to compute the geometry signature of a layer stack.
+static const uint64_t kSignatureSeed = 0xcbf29ce484222325ULL;
+
+static uint64_t HashData(uint64_t hash, const void *data, size_t size) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+
+  return hash;
+}
+
+// Layer changes which affect the layer stack signature. Buffer content updates are accounted
+// separately through the updating flag of each layer.
+static const uint32_t kSignatureChangeMask = kLayerChangeBufferFormat | kLayerChangeComposition |
+                                             kLayerChangeSrcRect | kLayerChangeDstRect |
+                                             kLayerChangeBlending | kLayerChangeTransform |
+                                             kLayerChangePlaneAlpha | kLayerChangeFlags;
+
+// Idle governor tuning. Updates closer than the minimum period are considered as an animation, for
+// which no idle action is taken. Updates are steady if their jitter is within a fraction of their
+// period. An action is taken after being predicted by a number of consecutive updates, so that
+// the composition does not oscillate on the occasional odd update.
+static const int64_t kIdleMinUpdatePeriodNs = 250000000LL;
+static const int64_t kIdleJitterFraction = 4;
+static const uint32_t kIdleHysteresisCount = 3;
+
 CompManager::CompManager()
   : strategy_lib_(NULL), create_strategy_intf_(NULL), destroy_strategy_intf_(NULL),
-    registered_displays_(0), configured_displays_(0), safe_mode_(false) {
+    registered_displays_(0), configured_displays_(0), safe_mode_(false), decision_hits_(0),
+    decision_misses_(0), idle_fallbacks_(0), idle_action_changes_(0), prepare_order_count_(0),
+    reservation_waits_(0), reservation_timeouts_(0) {
 }
 
 DisplayError CompManager::Init(const HWResourceInfo &hw_res_info, BufferAllocator *buffer_allocator,
@@ -75,7 +107,7 @@ DisplayError CompManager::Init(const HWResourceInfo &hw_res_info, BufferAllocato
       res_mgr_.Deinit();
     }
   } else {
-    DLOGW("Unable to load = %s, using GPU only (default) composition", STRATEGY_LIBRARY_NAME);
+    DLOGW("Unable to load = %s, using default composition strategy", STRATEGY_LIBRARY_NAME);
     create_strategy_intf_ = StrategyDefault::CreateStrategyInterface;
     destroy_strategy_intf_ = StrategyDefault::DestroyStrategyInterface;
   }
@@ -144,6 +176,11 @@ DisplayError CompManager::UnregisterDisplay(Handle comp_handle) {
   DisplayCompositionContext *display_comp_ctx =
                              reinterpret_cast<DisplayCompositionContext *>(comp_handle);
 
+  // Displays still in the draw cycle must not wait for the reservations of this display.
+  if (display_comp_ctx->prepare_ordered) {
+    ClearPrepareOrder();
+  }
+
   res_mgr_.UnregisterDisplay(display_comp_ctx->display_resource_ctx);
   destroy_strategy_intf_(display_comp_ctx->strategy_intf);
 
@@ -174,14 +211,18 @@ void CompManager::PrepareStrategyConstraints(Handle comp_handle, HWLayers *hw_la
     constraints->max_layers = 2;
   }
 
-  // If a strategy fails after successfully allocating resources, then set safe mode
-  if (display_comp_ctx->remaining_strategies != display_comp_ctx->max_strategies) {
+  // If a strategy or a replayed decision fails after successfully allocating resources, then set
+  // safe mode
+  if (display_comp_ctx->attempted_strategies) {
     constraints->safe_mode = true;
   }
 
   if (display_comp_ctx->idle_fallback) {
     constraints->safe_mode = true;
   }
+
+  constraints->idle_mode =
+    (display_comp_ctx->idle_governor.action == kIdleActionCachedComposition);
 }
 
 void CompManager::PrePrepare(Handle display_ctx, HWLayers *hw_layers) {
@@ -191,6 +232,9 @@ void CompManager::PrePrepare(Handle display_ctx, HWLayers *hw_layers) {
   display_comp_ctx->strategy_intf->Start(&hw_layers->info,
                                          &display_comp_ctx->max_strategies);
   display_comp_ctx->remaining_strategies = display_comp_ctx->max_strategies;
+  display_comp_ctx->attempted_strategies = 0;
+  display_comp_ctx->first_prepare = true;
+  display_comp_ctx->acquire_time_ns = 0;
 
   // Avoid idle fallback, if there is only one app layer.
   // TODO(user): App layer count will change for hybrid composition
@@ -206,17 +250,65 @@ DisplayError CompManager::Prepare(Handle display_ctx, HWLayers *hw_layers) {
   DisplayCompositionContext *display_comp_ctx =
                              reinterpret_cast<DisplayCompositionContext *>(display_ctx);
   Handle &display_resource_ctx = display_comp_ctx->display_resource_ctx;
+  CompositionDecision &decision = display_comp_ctx->decision;
 
   DisplayError error = kErrorUndefined;
 
+  if (display_comp_ctx->prepare_ordered && !IsReservationTurn(display_comp_ctx)) {
+    reservation_waits_++;
+    int64_t deadline_ns = GetMonotonicTimeNs() + kReservationTimeoutNs;
+    do {
+      int64_t remaining_ns = deadline_ns - GetMonotonicTimeNs();
+      if (remaining_ns <= 0) {
+        // A display ahead in the order is stuck, or did not end its prepare. Do not stall this
+        // display on it, rest of the draw cycle reserves in call order.
+        DLOGW("Reservation turn of display %d timed out, dropping the prepare order",
+              display_comp_ctx->display_type);
+        reservation_timeouts_++;
+        ClearPrepareOrder();
+        break;
+      }
+      locker_.WaitFinite(INT(remaining_ns / 1000000) + 1);
+    } while (display_comp_ctx->prepare_ordered && !IsReservationTurn(display_comp_ctx));
+  }
+
   PrepareStrategyConstraints(display_ctx, hw_layers);
 
+  // Prepare is called again in the same draw cycle only if the previous decision failed after
+  // resources were allocated for it, so it shall not be reused.
+  bool first_prepare = display_comp_ctx->first_prepare;
+  display_comp_ctx->first_prepare = false;
+  if (!first_prepare) {
+    decision.valid = false;
+  }
+
+  uint64_t signature = GetLayerStackSignature(display_comp_ctx, *hw_layers->info.stack);
+
   // Select a composition strategy, and try to allocate resources for it.
   res_mgr_.Start(display_resource_ctx);
 
   bool exit = false;
+  if (decision.valid && decision.signature == signature) {
+    // Layer stack geometry is same as that of the last accepted decision, reuse it. A replay is a
+    // strategy attempt, but it does not use up any of the strategies of the strategy interface.
+    display_comp_ctx->attempted_strategies++;
+    exit = ReplayDecision(display_comp_ctx, hw_layers);
+    if (exit) {
+      error = kErrorNone;
+      decision_hits_++;
+    }
+  }
+
+  if (!exit) {
+    if (first_prepare) {
+      decision_misses_++;
+    }
+    decision.valid = false;
+  }
+
   uint32_t &count = display_comp_ctx->remaining_strategies;
   for (; !exit && count > 0; count--) {
+    display_comp_ctx->attempted_strategies++;
     error = display_comp_ctx->strategy_intf->GetNextStrategy(&display_comp_ctx->constraints);
     if (error != kErrorNone) {
       // Composition strategies exhausted. Resource Manager could not allocate resources even for
@@ -225,7 +317,7 @@ DisplayError CompManager::Prepare(Handle display_ctx, HWLayers *hw_layers) {
     }
 
     if (!exit) {
-      error = res_mgr_.Acquire(display_resource_ctx, hw_layers);
+      error = AcquireResources(display_comp_ctx, hw_layers);
       // Exit if successfully allocated resource, else try next strategy.
       exit = (error == kErrorNone);
     }
@@ -233,13 +325,186 @@ DisplayError CompManager::Prepare(Handle display_ctx, HWLayers *hw_layers) {
 
   if (error != kErrorNone) {
     DLOGE("Composition strategies exhausted for display = %d", display_comp_ctx->display_type);
+  } else if (!decision.valid) {
+    // Remember the decision. It is invalidated if it gets rejected later in this draw cycle.
+    decision.signature = signature;
+    decision.count = hw_layers->info.count;
+    for (uint32_t i = 0; i < decision.count; i++) {
+      decision.index[i] = hw_layers->info.index[i];
+    }
+    decision.valid = true;
   }
 
   res_mgr_.Stop(display_resource_ctx);
 
+  if (display_comp_ctx->prepare_ordered) {
+    display_comp_ctx->reserve_count++;
+    locker_.Broadcast();
+  }
+
+  return error;
+}
+
+// A display makes its n-th reservation of an ordered draw cycle after the displays ahead of it in
+// the order have made their n-th reservation, and the displays behind it their (n - 1)-th. Displays
+// which ended prepare do not hold back the others.
+bool CompManager::IsReservationTurn(DisplayCompositionContext *display_comp_ctx) {
+  uint32_t reserve_count = display_comp_ctx->reserve_count;
+  bool ahead = true;
+
+  for (uint32_t i = 0; i < prepare_order_count_; i++) {
+    DisplayCompositionContext *ordered_ctx = prepare_order_[i];
+
+    if (ordered_ctx == display_comp_ctx) {
+      ahead = false;
+    } else if (!ordered_ctx->prepare_ended &&
+               ordered_ctx->reserve_count < (ahead ? reserve_count + 1 : reserve_count)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void CompManager::SetPrepareOrder(Handle *display_ctx, uint32_t count) {
+  SCOPE_LOCK(locker_);
+
+  ClearPrepareOrder();
+
+  for (uint32_t i = 0; i < count; i++) {
+    DisplayCompositionContext *display_comp_ctx =
+                               reinterpret_cast<DisplayCompositionContext *>(display_ctx[i]);
+    display_comp_ctx->prepare_ordered = true;
+    display_comp_ctx->prepare_ended = false;
+    display_comp_ctx->reserve_count = 0;
+    prepare_order_[i] = display_comp_ctx;
+  }
+  prepare_order_count_ = count;
+}
+
+void CompManager::EndPrepare(Handle display_ctx) {
+  SCOPE_LOCK(locker_);
+
+  DisplayCompositionContext *display_comp_ctx =
+                             reinterpret_cast<DisplayCompositionContext *>(display_ctx);
+  display_comp_ctx->prepare_ended = true;
+  locker_.Broadcast();
+}
+
+void CompManager::ClearPrepareOrder() {
+  for (uint32_t i = 0; i < prepare_order_count_; i++) {
+    prepare_order_[i]->prepare_ordered = false;
+  }
+  prepare_order_count_ = 0;
+
+  // Let the waiting displays reserve resources in call order.
+  locker_.Broadcast();
+}
+
+bool CompManager::ReplayDecision(DisplayCompositionContext *display_comp_ctx,
+                                 HWLayers *hw_layers) {
+  CompositionDecision &decision = display_comp_ctx->decision;
+  HWLayersInfo &hw_layers_info = hw_layers->info;
+  LayerStack *layer_stack = hw_layers_info.stack;
+
+  // Layers which are programmed on hardware are composed by SDE, rest of them by GPU.
+  for (uint32_t i = 0; i < layer_stack->layer_count; i++) {
+    LayerComposition &composition = layer_stack->layers[i].composition;
+    if (composition != kCompositionGPUTarget) {
+      composition = kCompositionGPU;
+    }
+  }
+
+  for (uint32_t i = 0; i < decision.count; i++) {
+    LayerComposition &composition = layer_stack->layers[decision.index[i]].composition;
+    if (composition != kCompositionGPUTarget) {
+      composition = kCompositionSDE;
+    }
+    hw_layers_info.index[i] = decision.index[i];
+  }
+  hw_layers_info.count = decision.count;
+
+  DLOGV_IF(kTagCompManager, "Reusing last decision for display = %d, hw layer count = %d",
+           display_comp_ctx->display_type, decision.count);
+
+  return (AcquireResources(display_comp_ctx, hw_layers) == kErrorNone);
+}
+
+DisplayError CompManager::AcquireResources(DisplayCompositionContext *display_comp_ctx,
+                                           HWLayers *hw_layers) {
+  int64_t start = GetMonotonicTimeNs();
+  DisplayError error = res_mgr_.Acquire(display_comp_ctx->display_resource_ctx, hw_layers);
+  display_comp_ctx->acquire_time_ns += GetMonotonicTimeNs() - start;
+
   return error;
 }
 
+uint64_t CompManager::GetLayerStackSignature(DisplayCompositionContext *display_comp_ctx,
+                                             const LayerStack &layer_stack) {
+  const StrategyConstraints &constraints = display_comp_ctx->constraints;
+  uint64_t &layer_signature = display_comp_ctx->layer_signature;
+  bool layers_changed = !display_comp_ctx->layer_signature_valid ||
+                        (display_comp_ctx->layer_signature_count != layer_stack.layer_count);
+
+  for (uint32_t i = 0; !layers_changed && (i < layer_stack.layer_count); i++) {
+    layers_changed = ((layer_stack.layers[i].change_mask & kSignatureChangeMask) != 0);
+  }
+
+  // Layer properties are hashed again only if the client reported a change in any of them.
+  if (layers_changed) {
+    layer_signature = kSignatureSeed;
+    layer_signature = HashData(layer_signature, &layer_stack.layer_count,
+                               sizeof(layer_stack.layer_count));
+
+    for (uint32_t i = 0; i < layer_stack.layer_count; i++) {
+      const Layer &layer = layer_stack.layers[i];
+      const LayerBuffer *input_buffer = layer.input_buffer;
+      bool gpu_target = (layer.composition == kCompositionGPUTarget);
+      bool skip = layer.flags.skip;
+      uint64_t &hash = layer_signature;
+
+      hash = HashData(hash, &gpu_target, sizeof(gpu_target));
+      hash = HashData(hash, &skip, sizeof(skip));
+      hash = HashData(hash, &layer.src_rect, sizeof(layer.src_rect));
+      hash = HashData(hash, &layer.dst_rect, sizeof(layer.dst_rect));
+      hash = HashData(hash, &layer.blending, sizeof(layer.blending));
+      hash = HashData(hash, &layer.transform.rotation, sizeof(layer.transform.rotation));
+      hash = HashData(hash, &layer.transform.flip_horizontal,
+                      sizeof(layer.transform.flip_horizontal));
+      hash = HashData(hash, &layer.transform.flip_vertical, sizeof(layer.transform.flip_vertical));
+      hash = HashData(hash, &layer.plane_alpha, sizeof(layer.plane_alpha));
+
+      if (input_buffer) {
+        bool video = input_buffer->flags.video;
+        bool secure = input_buffer->flags.secure;
+        bool macro_tile = input_buffer->flags.macro_tile;
+
+        hash = HashData(hash, &input_buffer->width, sizeof(input_buffer->width));
+        hash = HashData(hash, &input_buffer->height, sizeof(input_buffer->height));
+        hash = HashData(hash, &input_buffer->format, sizeof(input_buffer->format));
+        hash = HashData(hash, &video, sizeof(video));
+        hash = HashData(hash, &secure, sizeof(secure));
+        hash = HashData(hash, &macro_tile, sizeof(macro_tile));
+      }
+    }
+
+    display_comp_ctx->layer_signature_count = layer_stack.layer_count;
+    display_comp_ctx->layer_signature_valid = true;
+  }
+
+  uint64_t hash = layer_signature;
+  hash = HashData(hash, &constraints.safe_mode, sizeof(constraints.safe_mode));
+  hash = HashData(hash, &constraints.max_layers, sizeof(constraints.max_layers));
+  hash = HashData(hash, &constraints.idle_mode, sizeof(constraints.idle_mode));
+
+  for (uint32_t i = 0; i < layer_stack.layer_count; i++) {
+    bool updating = layer_stack.layers[i].flags.updating;
+    hash = HashData(hash, &updating, sizeof(updating));
+  }
+
+  return hash;
+}
+
 DisplayError CompManager::PostPrepare(Handle display_ctx, HWLayers *hw_layers) {
   SCOPE_LOCK(locker_);
   DisplayCompositionContext *display_comp_ctx =
@@ -274,6 +539,7 @@ DisplayError CompManager::PostCommit(Handle display_ctx, HWLayers *hw_layers) {
   }
 
   display_comp_ctx->idle_fallback = false;
+  UpdateIdleGovernor(display_comp_ctx, *hw_layers->info.stack);
 
   DLOGV_IF(kTagCompManager, "registered display bit mask 0x%x, configured display bit mask 0x%x, " \
            "display type %d", registered_displays_, configured_displays_,
@@ -282,6 +548,17 @@ DisplayError CompManager::PostCommit(Handle display_ctx, HWLayers *hw_layers) {
   return kErrorNone;
 }
 
+void CompManager::GetPrepareStats(Handle display_ctx, uint32_t *strategy_count,
+                                  int64_t *acquire_time_ns) {
+  SCOPE_LOCK(locker_);
+
+  DisplayCompositionContext *display_comp_ctx =
+                             reinterpret_cast<DisplayCompositionContext *>(display_ctx);
+
+  *strategy_count = display_comp_ctx->attempted_strategies;
+  *acquire_time_ns = display_comp_ctx->acquire_time_ns;
+}
+
 void CompManager::Purge(Handle display_ctx) {
   SCOPE_LOCK(locker_);
 
@@ -289,6 +566,7 @@ void CompManager::Purge(Handle display_ctx) {
                              reinterpret_cast<DisplayCompositionContext *>(display_ctx);
 
   res_mgr_.Purge(display_comp_ctx->display_resource_ctx);
+  display_comp_ctx->decision.valid = false;
 }
 
 bool CompManager::ProcessIdleTimeout(Handle display_ctx) {
@@ -307,9 +585,16 @@ bool CompManager::ProcessIdleTimeout(Handle display_ctx) {
   //    update to the screen for specified amount of time.
   // 3. handle_idle_timeout flag helps us handle the very first idle timeout event and
   //    ignore the next idle timeout event on consecutive two idle timeout events.
+  // 4. Non-updating layers are already cached in the GPU target in cached composition, falling
+  //    back to GPU would only redraw them.
+  if (display_comp_ctx->idle_governor.action == kIdleActionCachedComposition) {
+    return false;
+  }
+
   if (display_comp_ctx->handle_idle_timeout) {
     display_comp_ctx->idle_fallback = true;
     display_comp_ctx->handle_idle_timeout = false;
+    idle_fallbacks_++;
 
     return true;
   }
@@ -317,8 +602,90 @@ bool CompManager::ProcessIdleTimeout(Handle display_ctx) {
   return false;
 }
 
-void CompManager::AppendDump(char *buffer, uint32_t length) {
+void CompManager::UpdateIdleGovernor(DisplayCompositionContext *display_comp_ctx,
+                                     const LayerStack &layer_stack) {
+  IdleGovernor &governor = display_comp_ctx->idle_governor;
+  bool updating = false;
+
+  for (uint32_t i = 0; i < layer_stack.layer_count && !updating; i++) {
+    const Layer &layer = layer_stack.layers[i];
+    updating = (layer.composition != kCompositionGPUTarget) && layer.flags.updating;
+  }
+
+  // Frames without any content update, like the redraw on idle timeout, do not affect cadence.
+  if (!updating) {
+    return;
+  }
+
+  int64_t now_ns = GetMonotonicTimeNs();
+  int64_t period_ns = now_ns - governor.last_update_ns;
+  governor.last_update_ns = now_ns;
+
+  if (governor.num_samples++ == 0) {
+    return;
+  }
+
+  if (governor.num_samples == 2) {
+    governor.update_period_ns = period_ns;
+    governor.update_jitter_ns = 0;
+  } else {
+    int64_t deviation_ns = period_ns - governor.update_period_ns;
+    deviation_ns = (deviation_ns < 0) ? -deviation_ns : deviation_ns;
+    governor.update_period_ns += (period_ns - governor.update_period_ns) / 4;
+    governor.update_jitter_ns += (deviation_ns - governor.update_jitter_ns) / 4;
+  }
+
+  // Predict the idle time ahead from the latest period, and its regularity from the averages.
+  IdleAction action = kIdleActionGPUFallback;
+  if (period_ns < kIdleMinUpdatePeriodNs) {
+    action = kIdleActionNone;
+  } else if (governor.update_jitter_ns * kIdleJitterFraction <= governor.update_period_ns) {
+    action = kIdleActionCachedComposition;
+  }
+
+  if (action != governor.predicted_action) {
+    governor.predicted_action = action;
+    governor.predicted_count = 0;
+  }
+
+  governor.predicted_count++;
+  if (governor.predicted_count >= kIdleHysteresisCount && governor.action != action) {
+    DLOGV_IF(kTagCompManager, "Display %d idle action %d -> %d, period %" PRId64 " ns, " \
+             "jitter %" PRId64 " ns", display_comp_ctx->display_type, governor.action, action,
+             governor.update_period_ns, governor.update_jitter_ns);
+    governor.action = action;
+    idle_action_changes_++;
+  }
+}
+
+void CompManager::AppendDump(DumpBuilder *builder) {
   SCOPE_LOCK(locker_);
+
+  builder->AppendString("\n\ncomposition decision hits: %u, misses: %u", decision_hits_,
+                        decision_misses_);
+  builder->AppendString("\ncomposition idle fallbacks: %u, action changes: %u", idle_fallbacks_,
+                        idle_action_changes_);
+  builder->AppendString("\nordered reservation waits: %u, timeouts: %u", reservation_waits_,
+                        reservation_timeouts_);
+}
+
+void CompManager::AppendCompactDump(DumpBuilder *builder) {
+  SCOPE_LOCK(locker_);
+
+  builder->BeginSection("composition_decision");
+  builder->Add("hits", "%u", decision_hits_);
+  builder->Add("misses", "%u", decision_misses_);
+  builder->EndSection();
+
+  builder->BeginSection("idle_governor");
+  builder->Add("fallbacks", "%u", idle_fallbacks_);
+  builder->Add("action_changes", "%u", idle_action_changes_);
+  builder->EndSection();
+
+  builder->BeginSection("prepare_order");
+  builder->Add("reservation_waits", "%u", reservation_waits_);
+  builder->Add("reservation_timeouts", "%u", reservation_timeouts_);
+  builder->EndSection();
 }
 
 }  // namespace sde
@@ -35,6 +35,9 @@ namespace sde {
 
 class CompManager : public DumpImpl {
  public:
+  static const uint32_t kMaxPrepareOrder = kVirtual + 1;  // One display of each type
+  static const int64_t kReservationTimeoutNs = 50000000;   // Longest wait for a reservation turn
+
   CompManager();
   DisplayError Init(const HWResourceInfo &hw_res_info_, BufferAllocator *buffer_allocator,
                     BufferSyncHandler *buffer_sync_handler_);
@@ -45,16 +48,54 @@ class CompManager : public DumpImpl {
   void PrePrepare(Handle display_ctx, HWLayers *hw_layers);
   DisplayError Prepare(Handle display_ctx, HWLayers *hw_layers);
   DisplayError PostPrepare(Handle display_ctx, HWLayers *hw_layers);
+  void SetPrepareOrder(Handle *display_ctx, uint32_t count);
+  void EndPrepare(Handle display_ctx);
   DisplayError PostCommit(Handle display_ctx, HWLayers *hw_layers);
+  void GetPrepareStats(Handle display_ctx, uint32_t *strategy_count, int64_t *acquire_time_ns);
   void Purge(Handle display_ctx);
   bool ProcessIdleTimeout(Handle display_ctx);
 
   // DumpImpl method
-  virtual void AppendDump(char *buffer, uint32_t length);
+  virtual void AppendDump(DumpBuilder *builder);
+  virtual void AppendCompactDump(DumpBuilder *builder);
 
  private:
   void PrepareStrategyConstraints(Handle display_ctx, HWLayers *hw_layers);
 
+  // Last composition decision which was accepted by resource manager and the hardware.
+  struct CompositionDecision {
+    bool valid;
+    uint64_t signature;           // Geometry signature of the layer stack
+    uint32_t index[kMaxSDELayers];
+    uint32_t count;
+
+    CompositionDecision() : valid(false), signature(0), count(0) { }
+  };
+
+  // Composition applied to a display, while its content is not updating.
+  enum IdleAction {
+    kIdleActionNone,              // Content updates continuously, keep the current composition.
+    kIdleActionCachedComposition, // Content updates at a slow and steady cadence, cache the
+                                  // non-updating layers in the GPU target.
+    kIdleActionGPUFallback,       // Content updates at irregular intervals, fall back to GPU
+                                  // composition on idle timeout.
+  };
+
+  // Learns the update cadence of a display from the commits which had updating layers.
+  struct IdleGovernor {
+    int64_t last_update_ns;       // Commit time of the last frame with updating layers
+    int64_t update_period_ns;     // Moving average of the period between updates
+    int64_t update_jitter_ns;     // Moving average of the deviation of periods from the average
+    uint32_t num_samples;
+    IdleAction action;
+    IdleAction predicted_action;  // Action predicted from the latest update
+    uint32_t predicted_count;     // Number of consecutive updates predicting the same action
+
+    IdleGovernor()
+      : last_update_ns(0), update_period_ns(0), update_jitter_ns(0), num_samples(0),
+        action(kIdleActionNone), predicted_action(kIdleActionNone), predicted_count(0) { }
+  };
+
   struct DisplayCompositionContext {
     StrategyInterface *strategy_intf;
     StrategyConstraints constraints;
@@ -62,14 +103,37 @@ class CompManager : public DumpImpl {
     DisplayType display_type;
     uint32_t max_strategies;
     uint32_t remaining_strategies;
+    uint32_t attempted_strategies;  // Strategies and replayed decisions tried in this draw cycle
     bool idle_fallback;
     bool handle_idle_timeout;
+    bool first_prepare;           // Set for the first Prepare() call of a draw cycle
+    CompositionDecision decision;
+    bool layer_signature_valid;
+    uint32_t layer_signature_count;  // Layer count of the layer stack the signature belongs to
+    uint64_t layer_signature;        // Signature of layer properties, excluding buffer updates
+    int64_t acquire_time_ns;         // Time spent in resource acquisition in this draw cycle
+    IdleGovernor idle_governor;
+    bool prepare_ordered;            // Reserves resources in its turn of the prepare order
+    bool prepare_ended;              // Done with prepare in the ordered draw cycle
+    uint32_t reserve_count;          // Reservation attempts made in the ordered draw cycle
 
     DisplayCompositionContext()
       : display_resource_ctx(NULL), display_type(kPrimary), max_strategies(0),
-        remaining_strategies(0), idle_fallback(false), handle_idle_timeout(true) { }
+        remaining_strategies(0), attempted_strategies(0), idle_fallback(false),
+        handle_idle_timeout(true), first_prepare(false), layer_signature_valid(false),
+        layer_signature_count(0), layer_signature(0), acquire_time_ns(0), prepare_ordered(false),
+        prepare_ended(false), reserve_count(0) { }
   };
 
+  uint64_t GetLayerStackSignature(DisplayCompositionContext *display_comp_ctx,
+                                  const LayerStack &layer_stack);
+  bool ReplayDecision(DisplayCompositionContext *display_comp_ctx, HWLayers *hw_layers);
+  DisplayError AcquireResources(DisplayCompositionContext *display_comp_ctx, HWLayers *hw_layers);
+  void UpdateIdleGovernor(DisplayCompositionContext *display_comp_ctx,
+                          const LayerStack &layer_stack);
+  bool IsReservationTurn(DisplayCompositionContext *display_comp_ctx);
+  void ClearPrepareOrder();
+
   Locker locker_;
   void *strategy_lib_;
   CreateStrategyInterface create_strategy_intf_;
@@ -80,6 +144,14 @@ class CompManager : public DumpImpl {
   bool safe_mode_;                      // Flag to notify all displays to be in resource crunch
                                         // mode, where strategy manager chooses the best strategy
                                         // that uses optimal number of pipes for each display
+  uint32_t decision_hits_;              // Number of draw cycles which reused the last decision
+  uint32_t decision_misses_;            // Number of draw cycles which iterated the strategies
+  uint32_t idle_fallbacks_;             // Number of idle timeouts which fell back to GPU
+  uint32_t idle_action_changes_;        // Number of idle action changes of all displays
+  DisplayCompositionContext *prepare_order_[kMaxPrepareOrder];  // Displays in reservation order
+  uint32_t prepare_order_count_;
+  uint32_t reservation_waits_;          // Number of reservations which waited for their turn
+  uint32_t reservation_timeouts_;       // Number of waits which timed out and dropped the order
 };
 
 }  // namespace sde
@@ -141,5 +141,37 @@ DisplayError CoreImpl::DestroyDisplay(DisplayInterface *intf) {
   return kErrorNone;
 }
 
+DisplayError CoreImpl::SetPrepareOrder(DisplayInterface **order, uint32_t count) {
+  SCOPE_LOCK(locker_);
+
+  if (UNLIKELY((count && !order) || count > CompManager::kMaxPrepareOrder)) {
+    return kErrorParameters;
+  }
+
+  Handle comp_handles[CompManager::kMaxPrepareOrder];
+  for (uint32_t i = 0; i < count; i++) {
+    if (UNLIKELY(!order[i])) {
+      return kErrorParameters;
+    }
+    comp_handles[i] = static_cast<DisplayBase *>(order[i])->GetCompManagerHandle();
+  }
+
+  comp_mgr_.SetPrepareOrder(comp_handles, count);
+
+  return kErrorNone;
+}
+
+DisplayError CoreImpl::EndPrepare(DisplayInterface *intf) {
+  SCOPE_LOCK(locker_);
+
+  if (UNLIKELY(!intf)) {
+    return kErrorParameters;
+  }
+
+  comp_mgr_.EndPrepare(static_cast<DisplayBase *>(intf)->GetCompManagerHandle());
+
+  return kErrorNone;
+}
+
 }  // namespace sde
 
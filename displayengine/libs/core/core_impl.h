@@ -39,8 +39,8 @@ namespace sde {
 
 class CoreImpl : public CoreInterface {
  public:
-  // This class implements display core interface revision 1.0.
-  static const uint16_t kRevision = SET_REVISION(1, 0);
+  // This class implements display core interface revision 1.1.
+  static const uint16_t kRevision = SET_REVISION(1, 1);
 
   CoreImpl(CoreEventHandler *event_handler, BufferAllocator *buffer_allocator,
            BufferSyncHandler *buffer_sync_handler);
@@ -56,6 +56,8 @@ class CoreImpl : public CoreInterface {
   virtual DisplayError CreateDisplay(DisplayType type, DisplayEventHandler *event_handler,
                                      DisplayInterface **intf);
   virtual DisplayError DestroyDisplay(DisplayInterface *intf);
+  virtual DisplayError SetPrepareOrder(DisplayInterface **order, uint32_t count);
+  virtual DisplayError EndPrepare(DisplayInterface *intf);
 
  protected:
   Locker locker_;
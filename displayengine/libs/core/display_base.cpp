@@ -22,6 +22,7 @@
 * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <utils/clock.h>
 #include <utils/constants.h>
 #include <utils/debug.h>
 
@@ -32,6 +33,13 @@
 
 namespace sde {
 
+static const char *kStageStatName[] = { "prepare", "strategy count", "comp manager prepare",
+                                        "resource acquire", "offline prepare", "hw validate",
+                                        "commit", "offline commit", "hw commit" };
+static const char *kStageStatKey[] = { "prepare", "strategy_count", "comp_manager_prepare",
+                                       "resource_acquire", "offline_prepare", "hw_validate",
+                                       "commit", "offline_commit", "hw_commit" };
+
 // TODO(user): Have a single structure handle carries all the interface pointers and variables.
 DisplayBase::DisplayBase(DisplayType display_type, DisplayEventHandler *event_handler,
                          HWDeviceType hw_device_type, HWInterface *hw_intf,
@@ -137,20 +145,33 @@ DisplayError DisplayBase::Prepare(LayerStack *layer_stack) {
   pending_commit_ = false;
 
   if (state_ == kStateOn) {
+    int64_t prepare_start = GetMonotonicTimeNs();
+    int64_t comp_manager_ns = 0;
+    int64_t offline_ns = 0;
+    int64_t validate_ns = 0;
+
     // Clean hw layers for reuse.
     hw_layers_.info = HWLayersInfo();
     hw_layers_.info.stack = layer_stack;
 
     comp_manager_->PrePrepare(display_comp_ctx_, &hw_layers_);
     while (true) {
+      int64_t start = GetMonotonicTimeNs();
       error = comp_manager_->Prepare(display_comp_ctx_, &hw_layers_);
+      int64_t end = GetMonotonicTimeNs();
+      comp_manager_ns += end - start;
       if (error != kErrorNone) {
         break;
       }
 
+      start = end;
       error = offline_ctrl_->Prepare(display_offline_ctx_, &hw_layers_);
+      end = GetMonotonicTimeNs();
+      offline_ns += end - start;
       if (error == kErrorNone) {
+        start = end;
         error = hw_intf_->Validate(hw_device_, &hw_layers_);
+        validate_ns += GetMonotonicTimeNs() - start;
         if (error == kErrorNone) {
           error = comp_manager_->PostPrepare(display_comp_ctx_, &hw_layers_);
           if (error == kErrorNone) {
@@ -162,6 +183,17 @@ DisplayError DisplayBase::Prepare(LayerStack *layer_stack) {
       }
     }
     comp_manager_->PostPrepare(display_comp_ctx_, &hw_layers_);
+
+    uint32_t strategy_count = 0;
+    int64_t acquire_ns = 0;
+    comp_manager_->GetPrepareStats(display_comp_ctx_, &strategy_count, &acquire_ns);
+
+    stage_stats_[kStatStrategyCount].Record(strategy_count);
+    RecordDuration(kStatResourceAcquire, acquire_ns);
+    RecordDuration(kStatCompManagerPrepare, comp_manager_ns);
+    RecordDuration(kStatOfflinePrepare, offline_ns);
+    RecordDuration(kStatHWValidate, validate_ns);
+    RecordStat(kStatPrepare, prepare_start, GetMonotonicTimeNs());
   } else {
     return kErrorNotSupported;
   }
@@ -184,9 +216,13 @@ DisplayError DisplayBase::Commit(LayerStack *layer_stack) {
       return kErrorUndefined;
     }
 
+    int64_t commit_start = GetMonotonicTimeNs();
     error = offline_ctrl_->Commit(display_offline_ctx_, &hw_layers_);
+    int64_t offline_end = GetMonotonicTimeNs();
+    RecordStat(kStatOfflineCommit, commit_start, offline_end);
     if (error == kErrorNone) {
       error = hw_intf_->Commit(hw_device_, &hw_layers_);
+      RecordStat(kStatHWCommit, offline_end, GetMonotonicTimeNs());
       if (error == kErrorNone) {
         error = comp_manager_->PostCommit(display_comp_ctx_, &hw_layers_);
         if (error != kErrorNone) {
@@ -196,6 +232,7 @@ DisplayError DisplayBase::Commit(LayerStack *layer_stack) {
         DLOGE("Unexpected error. Commit failed on driver.");
       }
     }
+    RecordStat(kStatCommit, commit_start, GetMonotonicTimeNs());
   } else {
     return kErrorNotSupported;
   }
@@ -434,17 +471,17 @@ void DisplayBase::IdleTimeout() {
   }
 }
 
-void DisplayBase::AppendDump(char *buffer, uint32_t length) {
+void DisplayBase::AppendDump(DumpBuilder *builder) {
   SCOPE_LOCK(locker_);
 
-  AppendString(buffer, length, "\n-----------------------");
-  AppendString(buffer, length, "\ndevice type: %u", display_type_);
-  AppendString(buffer, length, "\nstate: %u, vsync on: %u", state_, INT(vsync_enable_));
-  AppendString(buffer, length, "\nnum configs: %u, active config index: %u",
-                                num_modes_, active_mode_index_);
+  builder->AppendString("\n-----------------------");
+  builder->AppendString("\ndevice type: %u", display_type_);
+  builder->AppendString("\nstate: %u, vsync on: %u", state_, INT(vsync_enable_));
+  builder->AppendString("\nnum configs: %u, active config index: %u",
+                        num_modes_, active_mode_index_);
 
   DisplayConfigVariableInfo &info = display_attributes_[active_mode_index_];
-  AppendString(buffer, length, "\nres:%ux%u, dpi:%.2fx%.2f, fps:%.2f, vsync period: %u",
+  builder->AppendString("\nres:%ux%u, dpi:%.2fx%.2f, fps:%.2f, vsync period: %u",
       info.x_pixels, info.y_pixels, info.x_dpi, info.y_dpi, info.fps, info.vsync_period_ns);
 
   uint32_t num_layers = 0;
@@ -454,8 +491,10 @@ void DisplayBase::AppendDump(char *buffer, uint32_t length) {
     num_hw_layers = hw_layers_.info.count;
   }
 
-  AppendString(buffer, length, "\n\nnum actual layers: %u, num sde layers: %u",
-                                num_layers, num_hw_layers);
+  builder->AppendString("\n\nnum actual layers: %u, num sde layers: %u",
+                        num_layers, num_hw_layers);
+  AppendRect(builder, "\nleft_roi:", &hw_layers_.info.left_partial_update);
+  AppendRect(builder, "\nright_roi:", &hw_layers_.info.right_partial_update);
 
   for (uint32_t i = 0; i < num_hw_layers; i++) {
     Layer &layer = hw_layers_.info.stack->layers[hw_layers_.info.index[i]];
@@ -466,46 +505,241 @@ void DisplayBase::AppendDump(char *buffer, uint32_t length) {
     HWRotateInfo &left_rotate = hw_layers_.config[i].rotates[0];
     HWRotateInfo &right_rotate = hw_layers_.config[i].rotates[1];
 
-    AppendString(buffer, length, "\n\nsde idx: %u, actual idx: %u", i, hw_layers_.info.index[i]);
-    AppendString(buffer, length, "\nw: %u, h: %u, fmt: %u",
-                                  input_buffer->width, input_buffer->height, input_buffer->format);
-    AppendRect(buffer, length, "\nsrc_rect:", &layer.src_rect);
-    AppendRect(buffer, length, "\ndst_rect:", &layer.dst_rect);
+    builder->AppendString("\n\nsde idx: %u, actual idx: %u", i, hw_layers_.info.index[i]);
+    builder->AppendString("\nw: %u, h: %u, fmt: %u",
+                          input_buffer->width, input_buffer->height, input_buffer->format);
+    AppendRect(builder, "\nsrc_rect:", &layer.src_rect);
+    AppendRect(builder, "\ndst_rect:", &layer.dst_rect);
 
     if (left_rotate.valid) {
-      AppendString(buffer, length, "\n\tleft rotate =>");
-      AppendString(buffer, length, "\n\t  pipe id: 0x%x", left_rotate.pipe_id);
-      AppendRect(buffer, length, "\n\t  src_roi:", &left_rotate.src_roi);
-      AppendRect(buffer, length, "\n\t  dst_roi:", &left_rotate.dst_roi);
+      builder->AppendString("\n\tleft rotate =>");
+      builder->AppendString("\n\t  pipe id: 0x%x", left_rotate.pipe_id);
+      AppendRect(builder, "\n\t  src_roi:", &left_rotate.src_roi);
+      AppendRect(builder, "\n\t  dst_roi:", &left_rotate.dst_roi);
     }
 
     if (right_rotate.valid) {
-      AppendString(buffer, length, "\n\tright rotate =>");
-      AppendString(buffer, length, "\n\t  pipe id: 0x%x", right_rotate.pipe_id);
-      AppendRect(buffer, length, "\n\t  src_roi:", &right_rotate.src_roi);
-      AppendRect(buffer, length, "\n\t  dst_roi:", &right_rotate.dst_roi);
+      builder->AppendString("\n\tright rotate =>");
+      builder->AppendString("\n\t  pipe id: 0x%x", right_rotate.pipe_id);
+      AppendRect(builder, "\n\t  src_roi:", &right_rotate.src_roi);
+      AppendRect(builder, "\n\t  dst_roi:", &right_rotate.dst_roi);
     }
 
     if (left_pipe.valid) {
-      AppendString(buffer, length, "\n\tleft pipe =>");
-      AppendString(buffer, length, "\n\t  pipe id: 0x%x", left_pipe.pipe_id);
-      AppendRect(buffer, length, "\n\t  src_roi:", &left_pipe.src_roi);
-      AppendRect(buffer, length, "\n\t  dst_roi:", &left_pipe.dst_roi);
+      builder->AppendString("\n\tleft pipe =>");
+      builder->AppendString("\n\t  pipe id: 0x%x", left_pipe.pipe_id);
+      AppendRect(builder, "\n\t  src_roi:", &left_pipe.src_roi);
+      AppendRect(builder, "\n\t  dst_roi:", &left_pipe.dst_roi);
     }
 
     if (right_pipe.valid) {
-      AppendString(buffer, length, "\n\tright pipe =>");
-      AppendString(buffer, length, "\n\t  pipe id: 0x%x", right_pipe.pipe_id);
-      AppendRect(buffer, length, "\n\t  src_roi:", &right_pipe.src_roi);
-      AppendRect(buffer, length, "\n\t  dst_roi:", &right_pipe.dst_roi);
+      builder->AppendString("\n\tright pipe =>");
+      builder->AppendString("\n\t  pipe id: 0x%x", right_pipe.pipe_id);
+      AppendRect(builder, "\n\t  src_roi:", &right_pipe.src_roi);
+      AppendRect(builder, "\n\t  dst_roi:", &right_pipe.dst_roi);
+    }
+  }
+
+  AppendStatsDump(builder);
+}
+
+void DisplayBase::AppendCompactDump(DumpBuilder *builder) {
+  SCOPE_LOCK(locker_);
+
+  builder->BeginSection("display", display_type_);
+  builder->Add("state", "%u", state_);
+  builder->Add("vsync_on", "%u", INT(vsync_enable_));
+  builder->Add("num_configs", "%u", num_modes_);
+  builder->Add("active_config_index", "%u", active_mode_index_);
+
+  DisplayConfigVariableInfo &info = display_attributes_[active_mode_index_];
+  builder->Add("res", "%ux%u", info.x_pixels, info.y_pixels);
+  builder->Add("dpi", "%.2fx%.2f", info.x_dpi, info.y_dpi);
+  builder->Add("fps", "%.2f", info.fps);
+  builder->Add("vsync_period", "%u", info.vsync_period_ns);
+
+  uint32_t num_layers = 0;
+  uint32_t num_hw_layers = 0;
+  if (hw_layers_.info.stack) {
+    num_layers = hw_layers_.info.stack->layer_count;
+    num_hw_layers = hw_layers_.info.count;
+  }
+
+  builder->Add("num_actual_layers", "%u", num_layers);
+  builder->Add("num_sde_layers", "%u", num_hw_layers);
+  builder->AddRect("left_roi", hw_layers_.info.left_partial_update);
+  builder->AddRect("right_roi", hw_layers_.info.right_partial_update);
+
+  for (uint32_t i = 0; i < num_hw_layers; i++) {
+    Layer &layer = hw_layers_.info.stack->layers[hw_layers_.info.index[i]];
+    LayerBuffer *input_buffer = layer.input_buffer;
+    HWLayerConfig &layer_config = hw_layers_.config[i];
+
+    builder->BeginSection("sde_layer", i);
+    builder->Add("actual_idx", "%u", hw_layers_.info.index[i]);
+    builder->Add("w", "%u", input_buffer->width);
+    builder->Add("h", "%u", input_buffer->height);
+    builder->Add("fmt", "%u", input_buffer->format);
+    builder->AddRect("src_rect", layer.src_rect);
+    builder->AddRect("dst_rect", layer.dst_rect);
+
+    AppendCompactPipeDump(builder, "left_rotate", layer_config.rotates[0].valid,
+                          layer_config.rotates[0].pipe_id, layer_config.rotates[0].src_roi,
+                          layer_config.rotates[0].dst_roi);
+    AppendCompactPipeDump(builder, "right_rotate", layer_config.rotates[1].valid,
+                          layer_config.rotates[1].pipe_id, layer_config.rotates[1].src_roi,
+                          layer_config.rotates[1].dst_roi);
+    AppendCompactPipeDump(builder, "left_pipe", layer_config.left_pipe.valid,
+                          layer_config.left_pipe.pipe_id, layer_config.left_pipe.src_roi,
+                          layer_config.left_pipe.dst_roi);
+    AppendCompactPipeDump(builder, "right_pipe", layer_config.right_pipe.valid,
+                          layer_config.right_pipe.pipe_id, layer_config.right_pipe.src_roi,
+                          layer_config.right_pipe.dst_roi);
+    builder->EndSection();
+  }
+
+  AppendCompactStatsDump(builder);
+  builder->EndSection();
+}
+
+void DisplayBase::AppendCompactPipeDump(DumpBuilder *builder, const char *name, bool valid,
+                                        uint32_t pipe_id, const LayerRect &src_roi,
+                                        const LayerRect &dst_roi) {
+  if (!valid) {
+    return;
+  }
+
+  builder->BeginSection(name);
+  builder->Add("pipe_id", "0x%x", pipe_id);
+  builder->AddRect("src_roi", src_roi);
+  builder->AddRect("dst_roi", dst_roi);
+  builder->EndSection();
+}
+
+void DisplayBase::AppendStatsDump(DumpBuilder *builder) {
+  builder->AppendString("\n\nstage stats (us): count, avg, p50, p99, max");
+  for (uint32_t i = 0; i < kStatMax; i++) {
+    if (i != kStatStrategyCount) {
+      AppendHistogramDump(builder, kStageStatName[i], stage_stats_[i]);
+    }
+  }
+
+  builder->AppendString("\n\nstrategy stats: count, avg, p50, p99, max");
+  AppendHistogramDump(builder, kStageStatName[kStatStrategyCount],
+                      stage_stats_[kStatStrategyCount]);
+}
+
+void DisplayBase::AppendHistogramDump(DumpBuilder *builder, const char *name,
+                                      const StageHistogram &histogram) {
+  uint32_t average = histogram.count ? UINT32(histogram.total / histogram.count) : 0;
+
+  builder->AppendString("\n%s: %u, %u, %u, %u, %u", name, histogram.count, average,
+                        histogram.GetPercentile(50), histogram.GetPercentile(99), histogram.max);
+
+  for (uint32_t j = 0; j < StageHistogram::kNumBuckets; j++) {
+    if (!histogram.bucket[j]) {
+      continue;
+    }
+
+    if (j < StageHistogram::kNumBuckets - 1) {
+      builder->AppendString(" [<%u: %u]", 1U << j, histogram.bucket[j]);
+    } else {
+      builder->AppendString(" [>=%u: %u]", 1U << (j - 1), histogram.bucket[j]);
     }
   }
 }
 
-void DisplayBase::AppendRect(char *buffer, uint32_t length, const char *rect_name,
-                             LayerRect *rect) {
-  AppendString(buffer, length, "%s %.1f, %.1f, %.1f, %.1f",
-                                rect_name, rect->left, rect->top, rect->right, rect->bottom);
+void DisplayBase::AppendCompactStatsDump(DumpBuilder *builder) {
+  builder->BeginSection("stage_stats_us");
+  for (uint32_t i = 0; i < kStatMax; i++) {
+    if (i != kStatStrategyCount) {
+      AppendCompactHistogramDump(builder, kStageStatKey[i], stage_stats_[i]);
+    }
+  }
+  builder->EndSection();
+
+  builder->BeginSection("strategy_stats");
+  AppendCompactHistogramDump(builder, kStageStatKey[kStatStrategyCount],
+                             stage_stats_[kStatStrategyCount]);
+  builder->EndSection();
+}
+
+void DisplayBase::AppendCompactHistogramDump(DumpBuilder *builder, const char *key,
+                                             const StageHistogram &histogram) {
+  uint32_t average = histogram.count ? UINT32(histogram.total / histogram.count) : 0;
+
+  builder->BeginSection(key);
+  builder->Add("count", "%u", histogram.count);
+  builder->Add("avg", "%u", average);
+  builder->Add("p50", "%u", histogram.GetPercentile(50));
+  builder->Add("p99", "%u", histogram.GetPercentile(99));
+  builder->Add("max", "%u", histogram.max);
+
+  char bucket_key[16];
+  for (uint32_t j = 0; j < StageHistogram::kNumBuckets; j++) {
+    if (!histogram.bucket[j]) {
+      continue;
+    }
+
+    if (j < StageHistogram::kNumBuckets - 1) {
+      snprintf(bucket_key, sizeof(bucket_key), "lt%u", 1U << j);
+    } else {
+      snprintf(bucket_key, sizeof(bucket_key), "ge%u", 1U << (j - 1));
+    }
+    builder->Add(bucket_key, "%u", histogram.bucket[j]);
+  }
+  builder->EndSection();
+}
+
+void DisplayBase::ResetStats() {
+  SCOPE_LOCK(locker_);
+
+  for (uint32_t i = 0; i < kStatMax; i++) {
+    stage_stats_[i] = StageHistogram();
+  }
+}
+
+void DisplayBase::RecordStat(StageStat stat, int64_t start_ns, int64_t end_ns) {
+  RecordDuration(stat, end_ns - start_ns);
+}
+
+void DisplayBase::RecordDuration(StageStat stat, int64_t duration_ns) {
+  int64_t latency_us = duration_ns / 1000;
+
+  stage_stats_[stat].Record(UINT32(MAX(latency_us, 0)));
+}
+
+void DisplayBase::StageHistogram::Record(uint32_t value) {
+  // Index of the most significant bit set, plus one.
+  uint32_t index = value ? UINT32(32 - __builtin_clz(value)) : 0;
+
+  bucket[MIN(index, kNumBuckets - 1)]++;
+  count++;
+  max = MAX(max, value);
+  total += value;
+}
+
+uint32_t DisplayBase::StageHistogram::GetPercentile(uint32_t percent) const {
+  if (!count) {
+    return 0;
+  }
+
+  // Upper limit of the bucket which holds the requested percentile, bounded by the max value.
+  uint64_t target = (UINT64(count) * percent + 99) / 100;
+  uint64_t sum = 0;
+  for (uint32_t i = 0; i < kNumBuckets - 1; i++) {
+    sum += bucket[i];
+    if (sum >= target) {
+      return MIN((1U << i) - 1, max);
+    }
+  }
+
+  return max;
+}
+
+void DisplayBase::AppendRect(DumpBuilder *builder, const char *rect_name, LayerRect *rect) {
+  builder->AppendString("%s %.1f, %.1f, %.1f, %.1f",
+                        rect_name, rect->left, rect->top, rect->right, rect->bottom);
 }
 
 int DisplayBase::GetBestConfig() {
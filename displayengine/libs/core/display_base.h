@@ -60,6 +60,7 @@ class DisplayBase : public DisplayInterface, HWEventHandler, DumpImpl {
   virtual DisplayError SetActiveConfig(uint32_t index);
   virtual DisplayError SetVSyncState(bool enable);
   virtual void SetIdleTimeoutMs(uint32_t timeout_ms);
+  Handle GetCompManagerHandle() { return display_comp_ctx_; }
 
   // Implement the HWEventHandlers
   virtual DisplayError VSync(int64_t timestamp);
@@ -67,11 +68,52 @@ class DisplayBase : public DisplayInterface, HWEventHandler, DumpImpl {
   virtual void IdleTimeout();
 
   // DumpImpl method
-  virtual void AppendDump(char *buffer, uint32_t length);
-  void AppendRect(char *buffer, uint32_t length, const char *rect_name, LayerRect *rect);
+  virtual void AppendDump(DumpBuilder *builder);
+  virtual void AppendCompactDump(DumpBuilder *builder);
+  virtual void ResetStats();
+  void AppendRect(DumpBuilder *builder, const char *rect_name, LayerRect *rect);
 
  protected:
+  // Draw cycle stages whose statistics are collected. All of them are latencies in microseconds,
+  // except strategy count which is the number of strategies tried in a draw cycle.
+  enum StageStat {
+    kStatPrepare,
+    kStatStrategyCount,
+    kStatCompManagerPrepare,
+    kStatResourceAcquire,
+    kStatOfflinePrepare,
+    kStatHWValidate,
+    kStatCommit,
+    kStatOfflineCommit,
+    kStatHWCommit,
+    kStatMax,
+  };
+
+  // Log scale histogram. Bucket i counts values below 2^i, last bucket counts the rest.
+  struct StageHistogram {
+    static const uint32_t kNumBuckets = 16;
+
+    uint32_t bucket[kNumBuckets];
+    uint32_t count;
+    uint32_t max;
+    uint64_t total;
+
+    StageHistogram() : bucket(), count(0), max(0), total(0) { }
+    void Record(uint32_t value);
+    uint32_t GetPercentile(uint32_t percent) const;
+  };
+
   virtual int GetBestConfig();
+  void RecordStat(StageStat stat, int64_t start_ns, int64_t end_ns);
+  void RecordDuration(StageStat stat, int64_t duration_ns);
+  void AppendCompactPipeDump(DumpBuilder *builder, const char *name, bool valid,
+                             uint32_t pipe_id, const LayerRect &src_roi, const LayerRect &dst_roi);
+  void AppendStatsDump(DumpBuilder *builder);
+  void AppendCompactStatsDump(DumpBuilder *builder);
+  void AppendHistogramDump(DumpBuilder *builder, const char *name,
+                           const StageHistogram &histogram);
+  void AppendCompactHistogramDump(DumpBuilder *builder, const char *key,
+                                  const StageHistogram &histogram);
 
   Locker locker_;
   DisplayType display_type_;
@@ -90,6 +132,7 @@ class DisplayBase : public DisplayInterface, HWEventHandler, DumpImpl {
   HWLayers hw_layers_;
   bool pending_commit_;
   bool vsync_enable_;
+  StageHistogram stage_stats_[kStatMax];
 };
 
 }  // namespace sde
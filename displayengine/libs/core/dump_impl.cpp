@@ -35,16 +35,39 @@ DumpImpl* DumpImpl::dump_list_[] = { 0 };
 uint32_t DumpImpl::dump_count_ = 0;
 
 DisplayError DumpInterface::GetDump(char *buffer, uint32_t length) {
-  if (!buffer || !length) {
+  uint32_t filled = 0;
+
+  return GetDump(buffer, length, kDumpFormatText, &filled);
+}
+
+DisplayError DumpInterface::GetDump(char *buffer, uint32_t length, DumpFormat format,
+                                    uint32_t *filled) {
+  if (!buffer || !length || !filled) {
     return kErrorParameters;
   }
 
-  buffer[0] = '\0';
-  DumpImpl::AppendString(buffer, length, "\n-------- Snapdragon Display Engine --------");
+  DumpBuilder builder(buffer, length);
+  if (format == kDumpFormatCompact) {
+    for (uint32_t i = 0; i < DumpImpl::dump_count_; i++) {
+      DumpImpl::dump_list_[i]->AppendCompactDump(&builder);
+    }
+  } else {
+    builder.AppendString("\n-------- Snapdragon Display Engine --------");
+    for (uint32_t i = 0; i < DumpImpl::dump_count_; i++) {
+      DumpImpl::dump_list_[i]->AppendDump(&builder);
+    }
+    builder.AppendString("\n-------------------------------------------\n");
+  }
+
+  *filled = builder.GetFilled();
+
+  return kErrorNone;
+}
+
+DisplayError DumpInterface::ResetStats() {
   for (uint32_t i = 0; i < DumpImpl::dump_count_; i++) {
-    DumpImpl::dump_list_[i]->AppendDump(buffer, length);
+    DumpImpl::dump_list_[i]->ResetStats();
   }
-  DumpImpl::AppendString(buffer, length, "\n-------------------------------------------\n");
 
   return kErrorNone;
 }
@@ -57,16 +80,82 @@ DumpImpl::~DumpImpl() {
   Unregister(this);
 }
 
-void DumpImpl::AppendString(char *buffer, uint32_t length, const char *format, ...) {
-  uint32_t filled = UINT32(strlen(buffer));
-  if (filled >= length) {
-    return;
+DumpBuilder::DumpBuilder(char *buffer, uint32_t length)
+  : buffer_(buffer), length_(length), filled_(0), depth_(0) {
+  if (length_) {
+    buffer_[0] = '\0';
+  }
+  path_[0] = '\0';
+  path_length_[0] = 0;
+}
+
+void DumpBuilder::AppendString(const char *format, ...) {
+  va_list list;
+  va_start(list, format);
+  AppendV(format, list);
+  va_end(list);
+}
+
+void DumpBuilder::BeginSection(const char *name) {
+  PushPath(name, 0, false);
+  depth_++;
+}
+
+void DumpBuilder::BeginSection(const char *name, uint32_t index) {
+  PushPath(name, index, true);
+  depth_++;
+}
+
+void DumpBuilder::EndSection() {
+  if (depth_) {
+    depth_--;
   }
-  buffer += filled;
+
+  path_[path_length_[MIN(depth_, kMaxDepth)]] = '\0';
+}
+
+void DumpBuilder::Add(const char *key, const char *format, ...) {
+  AppendString(path_[0] ? "%s.%s=" : "%s%s=", path_, key);
 
   va_list list;
   va_start(list, format);
-  vsnprintf(buffer, length - filled, format, list);
+  AppendV(format, list);
+  va_end(list);
+
+  AppendString("\n");
+}
+
+void DumpBuilder::AddRect(const char *key, const LayerRect &rect) {
+  Add(key, "%.1f %.1f %.1f %.1f", rect.left, rect.top, rect.right, rect.bottom);
+}
+
+void DumpBuilder::AppendV(const char *format, va_list list) {
+  if ((filled_ + 1) >= length_) {
+    return;
+  }
+
+  int written = vsnprintf(buffer_ + filled_, length_ - filled_, format, list);
+  if (written > 0) {
+    filled_ = MIN(filled_ + UINT32(written), length_ - 1);
+  }
+}
+
+void DumpBuilder::PushPath(const char *name, uint32_t index, bool indexed) {
+  // Sections beyond the maximum depth are not reflected in the path.
+  if (depth_ >= kMaxDepth) {
+    return;
+  }
+
+  uint32_t base = path_length_[depth_];
+  uint32_t available = kMaxPathLength - base;
+  int written = 0;
+  if (indexed) {
+    written = snprintf(path_ + base, available, base ? ".%s[%u]" : "%s[%u]", name, index);
+  } else {
+    written = snprintf(path_ + base, available, base ? ".%s" : "%s", name);
+  }
+
+  path_length_[depth_ + 1] = (written > 0) ? MIN(base + UINT32(written), kMaxPathLength - 1) : base;
 }
 
 // Every object is created or destroyed through display core only, which itself protects the
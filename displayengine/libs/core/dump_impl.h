@@ -25,16 +25,50 @@
 #ifndef __DUMP_IMPL_H__
 #define __DUMP_IMPL_H__
 
+#include <stdarg.h>
 #include <core/dump_interface.h>
+#include <core/layer_stack.h>
 
 namespace sde {
 
+// Appends dump information to a fixed size buffer. Write position is tracked, so the cost of an
+// append does not depend on the size of the dump generated so far. Text dumps are appended as free
+// form strings. Compact dumps emit named values within nested sections, which are rendered as one
+// "section[index].key=value" line per value.
+class DumpBuilder {
+ public:
+  DumpBuilder(char *buffer, uint32_t length);
+  void AppendString(const char *format, ...);
+  void BeginSection(const char *name);
+  void BeginSection(const char *name, uint32_t index);
+  void EndSection();
+  void Add(const char *key, const char *format, ...);
+  void AddRect(const char *key, const LayerRect &rect);
+  inline uint32_t GetFilled() { return filled_; }
+
+ private:
+  static const uint32_t kMaxDepth = 8;
+  static const uint32_t kMaxPathLength = 128;
+
+  void AppendV(const char *format, va_list list);
+  void PushPath(const char *name, uint32_t index, bool indexed);
+
+  char *buffer_;
+  uint32_t length_;
+  uint32_t filled_;
+  uint32_t depth_;
+  char path_[kMaxPathLength];                  // Dot separated section names
+  uint32_t path_length_[kMaxDepth + 1];
+};
+
 class DumpImpl {
  public:
   // To be implemented in the modules which will add dump information to final dump buffer.
-  // buffer address & length will be already adjusted before calling into these modules.
-  virtual void AppendDump(char *buffer, uint32_t length) = 0;
-  static void AppendString(char *buffer, uint32_t length, const char *format, ...);
+  virtual void AppendDump(DumpBuilder *builder) = 0;
+  // Same information as AppendDump(), as named values for the compact dump format.
+  virtual void AppendCompactDump(DumpBuilder *builder) = 0;
+  // To be implemented in the modules which collect statistics reported in the dump.
+  virtual void ResetStats() { }
 
  protected:
   DumpImpl();
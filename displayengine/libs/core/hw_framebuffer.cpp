@@ -38,8 +38,10 @@
 #include <sys/resource.h>
 #include <sys/prctl.h>
 #include <pthread.h>
+#include <utils/clock.h>
 #include <utils/constants.h>
 #include <utils/debug.h>
+#include <utils/shared_fence.h>
 
 #include "hw_framebuffer.h"
 
@@ -65,9 +67,13 @@ extern ssize_t virtual_getline(char **lineptr, size_t *linelen, FILE *stream);
 namespace sde {
 
 HWFrameBuffer::HWFrameBuffer(BufferSyncHandler *buffer_sync_handler)
-  : event_thread_name_("SDE_EventThread"), fake_vsync_(false), exit_threads_(false),
-    fb_path_("/sys/devices/virtual/graphics/fb"), hotplug_enabled_(false),
-    buffer_sync_handler_(buffer_sync_handler) {
+  : event_thread_name_("SDE_EventThread"), vsync_thread_name_("SDE_VSyncThread"),
+    fake_vsync_(false), exit_threads_(false), fb_path_("/sys/devices/virtual/graphics/fb"),
+    hotplug_enabled_(false), buffer_sync_handler_(buffer_sync_handler) {
+  memset(idle_pending_, 0, sizeof(idle_pending_));
+  memset(validate_hits_, 0, sizeof(validate_hits_));
+  memset(validate_misses_, 0, sizeof(validate_misses_));
+
   // Pointer to actual driver interfaces.
   ioctl_ = ::ioctl;
   open_ = ::open;
@@ -164,9 +170,27 @@ DisplayError HWFrameBuffer::Init() {
   MSM_HDMI_MODES_INIT_TIMINGS(supported_video_modes_);
   MSM_HDMI_MODES_SET_SUPP_TIMINGS(supported_video_modes_, MSM_HDMI_MODES_ALL);
 
+  // Start the VSync thread ahead of the Event thread, which queues events for it
+  if (sem_init(&event_sem_, 0, 0) < 0) {
+    DLOGE("Failed to create event semaphore, error = %s", strerror(errno));
+    error = kErrorResources;
+    goto CleanupOnError;
+  }
+
+  if (pthread_create(&vsync_thread_, NULL, &VSyncThread, this) < 0) {
+    DLOGE("Failed to start %s", vsync_thread_name_);
+    sem_destroy(&event_sem_);
+    error = kErrorResources;
+    goto CleanupOnError;
+  }
+
   // Start the Event thread
   if (pthread_create(&event_thread_, NULL, &DisplayEventThread, this) < 0) {
     DLOGE("Failed to start %s, error = %s", event_thread_name_);
+    exit_threads_ = true;
+    sem_post(&event_sem_);
+    pthread_join(vsync_thread_, NULL);
+    sem_destroy(&event_sem_);
     error = kErrorResources;
     goto CleanupOnError;
   }
@@ -197,6 +221,9 @@ CleanupOnError:
 DisplayError HWFrameBuffer::Deinit() {
   exit_threads_ = true;
   pthread_join(event_thread_, NULL);
+  sem_post(&event_sem_);
+  pthread_join(vsync_thread_, NULL);
+  sem_destroy(&event_sem_);
 
   for (int display = 0; display < kNumPhysicalDisplays; display++) {
     for (int event = 0; event < kNumDisplayEvents; event++) {
@@ -345,6 +372,15 @@ DisplayError HWFrameBuffer::GetDisplayAttributes(Handle device,
           (var_screeninfo.xres > hw_resource_.max_mixer_width)) ? true : false;
       display_attributes->split_left = hw_resource_.split_info.left_split ?
           hw_resource_.split_info.left_split : display_attributes->x_pixels / 2;
+      display_attributes->partial_update = primary_panel_info_.partial_update &&
+          !Debug::IsPartialUpdateDisabled();
+      display_attributes->needs_roi_merge = primary_panel_info_.needs_roi_merge;
+      display_attributes->left_align = UINT32(primary_panel_info_.left_align);
+      display_attributes->width_align = UINT32(primary_panel_info_.width_align);
+      display_attributes->top_align = UINT32(primary_panel_info_.top_align);
+      display_attributes->height_align = UINT32(primary_panel_info_.height_align);
+      display_attributes->min_roi_width = UINT32(primary_panel_info_.min_roi_width);
+      display_attributes->min_roi_height = UINT32(primary_panel_info_.min_roi_height);
     }
     break;
 
@@ -391,6 +427,8 @@ DisplayError HWFrameBuffer::SetDisplayAttributes(Handle device, uint32_t index)
   HWContext *hw_context = reinterpret_cast<HWContext *>(device);
   DisplayError error = kErrorNone;
 
+  hw_context->hw_display.validated = false;
+
   switch (hw_context->type) {
   case kDevicePrimary:
   case kDeviceVirtual:
@@ -426,7 +464,7 @@ DisplayError HWFrameBuffer::SetDisplayAttributes(Handle device, uint32_t index)
       STRUCT_VAR(msmfb_metadata, metadata);
       metadata.op = metadata_op_vic;
       metadata.data.video_info_code = timing_mode->video_format;
-      if (ioctl(hw_context->device_fd, MSMFB_METADATA_SET, &metadata) < 0) {
+      if (ioctl_(hw_context->device_fd, MSMFB_METADATA_SET, &metadata) < 0) {
         IOCTL_LOGE(MSMFB_METADATA_SET, hw_context->type);
         return kErrorHardware;
       }
@@ -482,6 +520,7 @@ DisplayError HWFrameBuffer::PowerOn(Handle device) {
   DTRACE_SCOPED();
 
   HWContext *hw_context = reinterpret_cast<HWContext *>(device);
+  hw_context->hw_display.validated = false;
 
   if (ioctl_(hw_context->device_fd, FBIOBLANK, FB_BLANK_UNBLANK) < 0) {
     IOCTL_LOGE(FB_BLANK_UNBLANK, hw_context->type);
@@ -501,6 +540,7 @@ DisplayError HWFrameBuffer::PowerOff(Handle device) {
 
   HWContext *hw_context = reinterpret_cast<HWContext *>(device);
   HWDisplay *hw_display = &hw_context->hw_display;
+  hw_display->validated = false;
 
   switch (hw_context->type) {
   case kDevicePrimary:
@@ -739,6 +779,18 @@ DisplayError HWFrameBuffer::DisplayValidate(HWContext *hw_context, HWLayers *hw_
     }
   }
 
+  // Region of interest is programmed only for panels which support partial update. Right region is
+  // empty, if the display is not split.
+  if ((hw_context->type == kDevicePrimary) && primary_panel_info_.partial_update) {
+    SetRect(hw_layer_info.left_partial_update, &mdp_commit.left_roi);
+    SetRect(hw_layer_info.right_partial_update, &mdp_commit.right_roi);
+
+    DLOGV_IF(kTagDriverConfig, "left_roi [%d, %d, %d, %d], right_roi [%d, %d, %d, %d]",
+             mdp_commit.left_roi.x, mdp_commit.left_roi.y, mdp_commit.left_roi.w,
+             mdp_commit.left_roi.h, mdp_commit.right_roi.x, mdp_commit.right_roi.y,
+             mdp_commit.right_roi.w, mdp_commit.right_roi.h);
+  }
+
   if (hw_context->type == kDeviceVirtual) {
     LayerBuffer *output_buffer = hw_layers->info.stack->output_buffer;
     // TODO(user): Need to assign the writeback id from the resource manager, since the support
@@ -755,12 +807,33 @@ DisplayError HWFrameBuffer::DisplayValidate(HWContext *hw_context, HWLayers *hw_
     DLOGI_IF(kTagDriverConfig, "*************************************************************");
   }
 
+  // Skip the validation, if descriptors are same as that of the last successful validation. Driver
+  // validates the layers again during commit in any case.
+  if (hw_display->validated &&
+      !memcmp(&hw_display->mdp_disp_commit, &hw_display->validated_commit,
+              sizeof(hw_display->mdp_disp_commit)) &&
+      !memcmp(mdp_layers, hw_display->validated_in_layers, sizeof(*mdp_layers) * mdp_layer_count) &&
+      !memcmp(mdp_out_layer, &hw_display->validated_out_layer, sizeof(*mdp_out_layer))) {
+    validate_hits_[hw_context->type]++;
+    DLOGV_IF(kTagDriverConfig, "Layer descriptors are unchanged, skip validation");
+    return kErrorNone;
+  }
+
+  validate_misses_[hw_context->type]++;
+  hw_display->validated = false;
+
   mdp_commit.flags |= MDP_VALIDATE_LAYER;
   if (ioctl_(hw_context->device_fd, MSMFB_ATOMIC_COMMIT, &hw_display->mdp_disp_commit) < 0) {
     IOCTL_LOGE(MSMFB_ATOMIC_COMMIT, hw_context->type);
     return kErrorHardware;
   }
 
+  mdp_commit.flags &= ~MDP_VALIDATE_LAYER;
+  hw_display->validated_commit = hw_display->mdp_disp_commit;
+  memcpy(hw_display->validated_in_layers, mdp_layers, sizeof(*mdp_layers) * mdp_layer_count);
+  hw_display->validated_out_layer = *mdp_out_layer;
+  hw_display->validated = true;
+
   return kErrorNone;
 }
 
@@ -851,13 +924,15 @@ DisplayError HWFrameBuffer::DisplayCommit(HWContext *hw_context, HWLayers *hw_la
   mdp_commit.flags &= ~MDP_VALIDATE_LAYER;
   if (ioctl_(hw_context->device_fd, MSMFB_ATOMIC_COMMIT, &hw_display->mdp_disp_commit) < 0) {
     IOCTL_LOGE(MSMFB_ATOMIC_COMMIT, hw_context->type);
+    hw_display->validated = false;
     return kErrorHardware;
   }
 
   stack->retire_fence_fd = mdp_commit.retire_fence;
 
-  // MDP returns only one release fence for the entire layer stack. Duplicate this fence into all
+  // MDP returns only one release fence for the entire layer stack. Share this fence among all
   // layers being composed by MDP.
+  SharedFence *release_fence = SharedFence::Create(mdp_commit.release_fence);
   for (uint32_t i = 0; i < hw_layer_info.count; i++) {
     uint32_t layer_index = hw_layer_info.index[i];
     LayerBuffer *input_buffer = stack->layers[layer_index].input_buffer;
@@ -865,7 +940,7 @@ DisplayError HWFrameBuffer::DisplayCommit(HWContext *hw_context, HWLayers *hw_la
     HWRotateInfo *right_rotate = &hw_layers->config[i].rotates[1];
 
     if (!left_rotate->valid && !right_rotate->valid) {
-      input_buffer->release_fence_fd = dup(mdp_commit.release_fence);
+      input_buffer->release_fence = SharedFence::Acquire(release_fence);
       continue;
     }
 
@@ -873,7 +948,7 @@ DisplayError HWFrameBuffer::DisplayCommit(HWContext *hw_context, HWLayers *hw_la
       HWRotateInfo *rotate_info = &hw_layers->config[i].rotates[count];
       if (rotate_info->valid) {
         input_buffer = &rotate_info->hw_buffer_info.output_buffer;
-        input_buffer->release_fence_fd = dup(mdp_commit.release_fence);
+        input_buffer->release_fence = SharedFence::Acquire(release_fence);
         close_(input_buffer->acquire_fence_fd);
         input_buffer->acquire_fence_fd = -1;
       }
@@ -884,7 +959,7 @@ DisplayError HWFrameBuffer::DisplayCommit(HWContext *hw_context, HWLayers *hw_la
   DLOGI_IF(kTagDriverConfig, "retire_fence_fd %d", stack->retire_fence_fd);
   DLOGI_IF(kTagDriverConfig, "*************************************************************");
 
-  close_(mdp_commit.release_fence);
+  SharedFence::Release(&release_fence);
 
   return kErrorNone;
 }
@@ -906,7 +981,8 @@ DisplayError HWFrameBuffer::RotatorValidate(HWContext *hw_context, HWLayers *hw_
     for (uint32_t count = 0; count < 2; count++) {
       HWRotateInfo *rotate_info = &hw_layers->config[i].rotates[count];
 
-      if (rotate_info->valid) {
+      // Output buffer already holds the rotated content of this layer, no need to rotate again.
+      if (rotate_info->valid && !rotate_info->hw_buffer_info.content_cached) {
         HWBufferInfo *rot_buf_info = &rotate_info->hw_buffer_info;
         mdp_rotation_item *mdp_rot_item = &mdp_rot_request->list[rot_count];
         bool rot90 = (layer.transform.rotation == 90.0f);
@@ -984,7 +1060,7 @@ DisplayError HWFrameBuffer::RotatorCommit(HWContext *hw_context, HWLayers *hw_la
     for (uint32_t count = 0; count < 2; count++) {
       HWRotateInfo *rotate_info = &hw_layers->config[i].rotates[count];
 
-      if (rotate_info->valid) {
+      if (rotate_info->valid && !rotate_info->hw_buffer_info.content_cached) {
         HWBufferInfo *rot_buf_info = &rotate_info->hw_buffer_info;
         mdp_rotation_item *mdp_rot_item = &mdp_rot_request->list[rot_count];
 
@@ -1001,7 +1077,13 @@ DisplayError HWFrameBuffer::RotatorCommit(HWContext *hw_context, HWLayers *hw_la
                   rot_buf_info->output_buffer.planes[0].stride,
                   &mdp_rot_item->output.planes[0].stride);
         mdp_rot_item->output.plane_count = 1;
-        mdp_rot_item->output.fence = -1;
+        // Output buffer may still be held by the display, let the rotator wait for its release.
+        // The fd is borrowed from the SharedFence of the buffer slot without a dup. Like the input
+        // fence, the rotator driver only takes its own reference on the fence for the duration of
+        // the request and neither keeps nor closes the fd; on return the field holds the new
+        // output fence instead. The SharedFence outlives the request, it is released only when
+        // SetReleaseFence() stores the next fence of this buffer after the commit.
+        mdp_rot_item->output.fence = rot_buf_info->output_buffer.acquire_fence_fd;
 
         rot_count++;
 
@@ -1035,7 +1117,7 @@ DisplayError HWFrameBuffer::RotatorCommit(HWContext *hw_context, HWLayers *hw_la
     for (uint32_t count = 0; count < 2; count++) {
       HWRotateInfo *rotate_info = &hw_layers->config[i].rotates[count];
 
-      if (rotate_info->valid) {
+      if (rotate_info->valid && !rotate_info->hw_buffer_info.content_cached) {
         HWBufferInfo *rot_buf_info = &rotate_info->hw_buffer_info;
         mdp_rotation_item *mdp_rot_item = &mdp_rot_request->list[rot_count];
 
@@ -1058,6 +1140,7 @@ DisplayError HWFrameBuffer::Flush(Handle device) {
   HWDisplay *hw_display = &hw_context->hw_display;
 
   hw_display->Reset();
+  hw_display->validated = false;
   mdp_layer_commit_v1 &mdp_commit = hw_display->mdp_disp_commit.commit_v1;
   mdp_commit.input_layer_cnt = 0;
   mdp_commit.flags &= ~MDP_VALIDATE_LAYER;
@@ -1162,6 +1245,80 @@ void HWFrameBuffer::SyncMerge(const int &fd1, const int &fd2, int *target) {
   }
 }
 
+void HWFrameBuffer::AppendDump(DumpBuilder *builder) {
+  builder->AppendString("\nhw framebuffer validate state");
+  for (uint32_t i = 0; i < kDeviceRotator; i++) {
+    builder->AppendString("\n%s: skipped = %u, validated = %u",
+                          GetDeviceString(static_cast<HWDeviceType>(i)), validate_hits_[i],
+                          validate_misses_[i]);
+  }
+
+  builder->AppendString("\n\nhw framebuffer vsync events");
+  for (int display = 0; display < kNumPhysicalDisplays; display++) {
+    builder->AppendString("\n%s: dropped = %u",
+                          GetDeviceString(static_cast<HWDeviceType>(display)),
+                          vsync_ring_[display].dropped);
+    AppendLatencyDump(builder, "read", vsync_read_latency_[display]);
+    AppendLatencyDump(builder, "deliver", vsync_deliver_latency_[display]);
+  }
+}
+
+void HWFrameBuffer::AppendCompactDump(DumpBuilder *builder) {
+  builder->BeginSection("hw_framebuffer_validate");
+  for (uint32_t i = 0; i < kDeviceRotator; i++) {
+    builder->BeginSection("device", i);
+    builder->Add("name", "%s", GetDeviceString(static_cast<HWDeviceType>(i)));
+    builder->Add("skipped", "%u", validate_hits_[i]);
+    builder->Add("validated", "%u", validate_misses_[i]);
+    builder->EndSection();
+  }
+  builder->EndSection();
+
+  builder->BeginSection("hw_framebuffer_vsync");
+  for (int display = 0; display < kNumPhysicalDisplays; display++) {
+    builder->BeginSection("device", UINT32(display));
+    builder->Add("name", "%s", GetDeviceString(static_cast<HWDeviceType>(display)));
+    builder->Add("dropped", "%u", vsync_ring_[display].dropped);
+    AppendCompactLatencyDump(builder, "read_latency_us", vsync_read_latency_[display]);
+    AppendCompactLatencyDump(builder, "deliver_latency_us", vsync_deliver_latency_[display]);
+    builder->EndSection();
+  }
+  builder->EndSection();
+}
+
+void HWFrameBuffer::AppendLatencyDump(DumpBuilder *builder, const char *name,
+                                      const EventLatency &latency) {
+  uint64_t average_us = latency.count ? (latency.total_us / latency.count) : 0;
+
+  builder->AppendString("\n  %s latency: count = %u, avg = %" PRIu64 "us, max = %uus", name,
+                        latency.count, average_us, latency.max_us);
+  builder->AppendString("\n   ");
+  for (uint32_t i = 0; i < EventLatency::kNumBuckets - 1; i++) {
+    builder->AppendString(" <%uus: %u", EventLatency::kBucketLimitUs[i], latency.bucket[i]);
+  }
+  builder->AppendString(" >=%uus: %u",
+                        EventLatency::kBucketLimitUs[EventLatency::kNumBuckets - 2],
+                        latency.bucket[EventLatency::kNumBuckets - 1]);
+}
+
+void HWFrameBuffer::AppendCompactLatencyDump(DumpBuilder *builder, const char *name,
+                                             const EventLatency &latency) {
+  uint64_t average_us = latency.count ? (latency.total_us / latency.count) : 0;
+  char key[16];
+
+  builder->BeginSection(name);
+  builder->Add("count", "%u", latency.count);
+  builder->Add("avg", "%" PRIu64, average_us);
+  builder->Add("max", "%u", latency.max_us);
+  for (uint32_t i = 0; i < EventLatency::kNumBuckets - 1; i++) {
+    snprintf(key, sizeof(key), "lt%u", EventLatency::kBucketLimitUs[i]);
+    builder->Add(key, "%u", latency.bucket[i]);
+  }
+  snprintf(key, sizeof(key), "ge%u", EventLatency::kBucketLimitUs[EventLatency::kNumBuckets - 2]);
+  builder->Add(key, "%u", latency.bucket[EventLatency::kNumBuckets - 1]);
+  builder->EndSection();
+}
+
 const char *HWFrameBuffer::GetDeviceString(HWDeviceType type) {
   switch (type) {
   case kDevicePrimary:
@@ -1246,12 +1403,98 @@ void* HWFrameBuffer::DisplayEventThreadHandler() {
   return NULL;
 }
 
+void* HWFrameBuffer::VSyncThread(void *context) {
+  if (context) {
+    return reinterpret_cast<HWFrameBuffer *>(context)->VSyncThreadHandler();
+  }
+
+  return NULL;
+}
+
+void* HWFrameBuffer::VSyncThreadHandler() {
+  prctl(PR_SET_NAME, vsync_thread_name_, 0, 0, 0);
+  setpriority(PRIO_PROCESS, 0, kThreadPriorityUrgent);
+
+  while (!exit_threads_) {
+    if (sem_wait(&event_sem_) < 0) {
+      continue;
+    }
+
+    // A single wakeup drains everything queued so far, so later posts may find nothing to do.
+    for (int display = 0; display < kNumPhysicalDisplays; display++) {
+      int64_t timestamp = 0;
+      if (vsync_ring_[display].PopLatest(&timestamp)) {
+        if (timestamp > 0) {
+          vsync_deliver_latency_[display].Record(GetMonotonicTimeNs() - timestamp);
+        }
+        event_handler_[display]->VSync(timestamp);
+      }
+
+      if (__atomic_exchange_n(&idle_pending_[display], 0, __ATOMIC_ACQ_REL)) {
+        event_handler_[display]->IdleTimeout();
+      }
+    }
+  }
+
+  pthread_exit(0);
+
+  return NULL;
+}
+
+void HWFrameBuffer::VSyncRing::Push(int64_t ts) {
+  uint32_t current_head = __atomic_load_n(&head, __ATOMIC_RELAXED);
+
+  __atomic_store_n(&timestamp[current_head & (kSize - 1)], ts, __ATOMIC_RELAXED);
+  __atomic_store_n(&head, current_head + 1, __ATOMIC_RELEASE);
+}
+
+bool HWFrameBuffer::VSyncRing::PopLatest(int64_t *ts) {
+  uint32_t current_tail = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+  uint32_t current_head = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+
+  if (current_tail == current_head) {
+    return false;
+  }
+
+  // Slot may be overwritten by an even later timestamp meanwhile, which is as good to deliver.
+  *ts = __atomic_load_n(&timestamp[(current_head - 1) & (kSize - 1)], __ATOMIC_RELAXED);
+  dropped += current_head - current_tail - 1;
+  __atomic_store_n(&tail, current_head, __ATOMIC_RELEASE);
+
+  return true;
+}
+
+const uint32_t HWFrameBuffer::EventLatency::kBucketLimitUs[kNumBuckets - 1] = {
+  100, 250, 500, 1000, 2000, 4000, 8000 };
+
+void HWFrameBuffer::EventLatency::Record(int64_t latency_ns) {
+  int64_t latency = MAX(latency_ns / 1000, 0);
+  uint32_t latency_us = (latency > 0xFFFFFFFFLL) ? 0xFFFFFFFFU : UINT32(latency);
+
+  uint32_t index = 0;
+  while ((index < kNumBuckets - 1) && (latency_us >= kBucketLimitUs[index])) {
+    index++;
+  }
+
+  bucket[index]++;
+  count++;
+  total_us += latency_us;
+  max_us = MAX(max_us, latency_us);
+}
+
 void HWFrameBuffer::HandleVSync(int display_id, char *data) {
   int64_t timestamp = 0;
   if (!strncmp(data, "VSYNC=", strlen("VSYNC="))) {
     timestamp = strtoull(data + strlen("VSYNC="), NULL, 0);
   }
-  event_handler_[display_id]->VSync(timestamp);
+
+  if (timestamp > 0) {
+    vsync_read_latency_[display_id].Record(GetMonotonicTimeNs() - timestamp);
+  }
+
+  // Hand the timestamp to the vsync thread instead of calling into the display from here.
+  vsync_ring_[display_id].Push(timestamp);
+  sem_post(&event_sem_);
 }
 
 void HWFrameBuffer::HandleBlank(int display_id, char *data) {
@@ -1259,7 +1502,8 @@ void HWFrameBuffer::HandleBlank(int display_id, char *data) {
 }
 
 void HWFrameBuffer::HandleIdleTimeout(int display_id, char *data) {
-  event_handler_[display_id]->IdleTimeout();
+  __atomic_store_n(&idle_pending_[display_id], 1, __ATOMIC_RELEASE);
+  sem_post(&event_sem_);
 }
 
 void HWFrameBuffer::PopulateFBNodeIndex() {
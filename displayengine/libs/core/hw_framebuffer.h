@@ -33,12 +33,14 @@
 #include <linux/mdss_rotator.h>
 #include <poll.h>
 #include <pthread.h>
+#include <semaphore.h>
 
 #include "hw_interface.h"
+#include "dump_impl.h"
 
 namespace sde {
 
-class HWFrameBuffer : public HWInterface {
+class HWFrameBuffer : public HWInterface, public DumpImpl {
  public:
   explicit HWFrameBuffer(BufferSyncHandler *buffer_sync_handler);
   DisplayError Init();
@@ -63,13 +65,24 @@ class HWFrameBuffer : public HWInterface {
   virtual DisplayError Flush(Handle device);
   virtual void SetIdleTimeoutMs(Handle device, uint32_t timeout_ms);
 
+  // DumpImpl method
+  virtual void AppendDump(DumpBuilder *builder);
+  virtual void AppendCompactDump(DumpBuilder *builder);
+
  private:
   struct HWDisplay {
     mdp_layer_commit mdp_disp_commit;
     mdp_input_layer mdp_in_layers[kMaxSDELayers * 2];   // split panel (left + right)
     mdp_output_layer mdp_out_layer;
 
-    HWDisplay() { Reset(); }
+    // Descriptors of the last successful validation. Buffer fds and fences are not filled in
+    // until commit, so these hold only the layer configuration.
+    bool validated;
+    mdp_layer_commit validated_commit;
+    mdp_input_layer validated_in_layers[kMaxSDELayers * 2];
+    mdp_output_layer validated_out_layer;
+
+    HWDisplay() : validated(false) { Reset(); }
 
     void Reset() {
       memset(&mdp_disp_commit, 0, sizeof(mdp_disp_commit));
@@ -151,6 +164,37 @@ class HWFrameBuffer : public HWInterface {
       needs_roi_merge(false), dynamic_fps(false), min_fps(0), max_fps(0) { }
   };
 
+  // Lock free ring of vsync timestamps. The event thread is the only producer and the vsync thread
+  // the only consumer, so neither side ever waits on the other or on the display lock. Producer
+  // overwrites the oldest timestamps when the ring is full, and the consumer takes only the latest
+  // one, so that a late consumer never delivers stale vsyncs.
+  struct VSyncRing {
+    static const uint32_t kSize = 8;  // Must be a power of two
+
+    int64_t timestamp[kSize];
+    uint32_t head;     // Advanced by the event thread only
+    uint32_t tail;     // Advanced by the vsync thread only
+    uint32_t dropped;  // Timestamps skipped as the consumer fell behind
+
+    VSyncRing() : head(0), tail(0), dropped(0) { }
+    void Push(int64_t ts);
+    bool PopLatest(int64_t *ts);
+  };
+
+  // Histogram of event latencies, measured from the kernel timestamp in microseconds.
+  struct EventLatency {
+    static const uint32_t kNumBuckets = 8;
+    static const uint32_t kBucketLimitUs[kNumBuckets - 1];
+
+    uint32_t bucket[kNumBuckets];
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us;
+
+    EventLatency() : bucket(), count(0), max_us(0), total_us(0) { }
+    void Record(int64_t latency_ns);
+  };
+
   static const int kMaxStringLength = 1024;
   static const int kNumPhysicalDisplays = 2;
   static const int kNumDisplayEvents = 3;
@@ -170,11 +214,18 @@ class HWFrameBuffer : public HWInterface {
   inline void SyncMerge(const int &fd1, const int &fd2, int *target);
 
   inline const char *GetDeviceString(HWDeviceType type);
+  void AppendLatencyDump(DumpBuilder *builder, const char *name, const EventLatency &latency);
+  void AppendCompactLatencyDump(DumpBuilder *builder, const char *name,
+                                const EventLatency &latency);
 
   // Event Thread to receive vsync/blank events
   static void* DisplayEventThread(void *context);
   void* DisplayEventThreadHandler();
 
+  // VSync Thread to deliver vsync/idle events queued by the event thread
+  static void* VSyncThread(void *context);
+  void* VSyncThreadHandler();
+
   void HandleVSync(int display_id, char *data);
   void HandleBlank(int display_id, char *data);
   void HandleIdleTimeout(int display_id, char *data);
@@ -208,6 +259,13 @@ class HWFrameBuffer : public HWInterface {
   pollfd poll_fds_[kNumPhysicalDisplays][kNumDisplayEvents];
   pthread_t event_thread_;
   const char *event_thread_name_;
+  VSyncRing vsync_ring_[kNumPhysicalDisplays];
+  uint32_t idle_pending_[kNumPhysicalDisplays];               // Idle timeouts not yet delivered
+  EventLatency vsync_read_latency_[kNumPhysicalDisplays];     // Kernel timestamp to event read
+  EventLatency vsync_deliver_latency_[kNumPhysicalDisplays];  // Kernel timestamp to callback
+  sem_t event_sem_;                                           // Posted for each queued event
+  pthread_t vsync_thread_;
+  const char *vsync_thread_name_;
   bool fake_vsync_;
   bool exit_threads_;
   HWResourceInfo hw_resource_;
@@ -217,6 +275,8 @@ class HWFrameBuffer : public HWInterface {
   bool hotplug_enabled_;
   uint32_t hdmi_mode_count_;
   uint32_t hdmi_modes_[256];
+  uint32_t validate_hits_[kDeviceMax];     // Validations skipped, as descriptors were unchanged
+  uint32_t validate_misses_[kDeviceMax];   // Validations sent to the driver
   // Holds the hdmi timing information. Ex: resolution, fps etc.,
   msm_hdmi_mode_timing_info *supported_video_modes_;
   BufferSyncHandler *buffer_sync_handler_;
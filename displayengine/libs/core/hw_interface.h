@@ -101,8 +101,10 @@ struct HWBufferInfo : public BufferInfo {
   LayerBuffer output_buffer;
   int session_id;
   uint32_t slot;
+  uint64_t content_key;     // Identifies the rotated content of output buffer, 0 if unknown
+  bool content_cached;      // Output buffer already holds the content, rotation is not needed
 
-  HWBufferInfo() : session_id(-1), slot(0) { }
+  HWBufferInfo() : session_id(-1), slot(0), content_key(0), content_cached(false) { }
 };
 
 struct HWRotateInfo {
@@ -160,8 +162,19 @@ struct HWLayers {
 struct HWDisplayAttributes : DisplayConfigVariableInfo {
   bool is_device_split;
   uint32_t split_left;
-
-  HWDisplayAttributes() : is_device_split(false), split_left(0) { }
+  bool partial_update;      // Panel accepts the update of a region of interest
+  bool needs_roi_merge;     // Panel accepts one region of interest spanning across both halves
+  uint32_t left_align;      // Alignment and minimum size restrictions of the region of interest
+  uint32_t width_align;
+  uint32_t top_align;
+  uint32_t height_align;
+  uint32_t min_roi_width;
+  uint32_t min_roi_height;
+
+  HWDisplayAttributes()
+    : is_device_split(false), split_left(0), partial_update(false), needs_roi_merge(false),
+      left_align(0), width_align(0), top_align(0), height_align(0), min_roi_width(0),
+      min_roi_height(0) { }
 
   void Reset() { *this = HWDisplayAttributes(); }
 };
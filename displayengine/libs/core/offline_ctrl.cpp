@@ -81,6 +81,8 @@ void OfflineCtrl::UnregisterDisplay(Handle display_ctx) {
 
 
 DisplayError OfflineCtrl::Prepare(Handle display_ctx, HWLayers *hw_layers) {
+  SCOPE_LOCK(locker_);
+
   DisplayError error = kErrorNone;
 
   DisplayOfflineContext *disp_offline_ctx = reinterpret_cast<DisplayOfflineContext *>(display_ctx);
@@ -122,6 +124,8 @@ DisplayError OfflineCtrl::Prepare(Handle display_ctx, HWLayers *hw_layers) {
 }
 
 DisplayError OfflineCtrl::Commit(Handle display_ctx, HWLayers *hw_layers) {
+  SCOPE_LOCK(locker_);
+
   DisplayError error = kErrorNone;
 
   DisplayOfflineContext *disp_offline_ctx = reinterpret_cast<DisplayOfflineContext *>(display_ctx);
@@ -138,6 +142,7 @@ DisplayError OfflineCtrl::Commit(Handle display_ctx, HWLayers *hw_layers) {
   return kErrorNone;
 }
 
+// Rotation is skipped for the rotates whose output buffer already holds the rotated content.
 bool OfflineCtrl::IsRotationRequired(HWLayers *hw_layers) {
   HWLayersInfo &layer_info = hw_layers->info;
 
@@ -145,12 +150,12 @@ bool OfflineCtrl::IsRotationRequired(HWLayers *hw_layers) {
     Layer& layer = layer_info.stack->layers[layer_info.index[i]];
 
     HWRotateInfo *rotate = &hw_layers->config[i].rotates[0];
-    if (rotate->valid) {
+    if (rotate->valid && !rotate->hw_buffer_info.content_cached) {
       return true;
     }
 
     rotate = &hw_layers->config[i].rotates[1];
-    if (rotate->valid) {
+    if (rotate->valid && !rotate->hw_buffer_info.content_cached) {
       return true;
     }
   }
@@ -52,6 +52,7 @@ class OfflineCtrl {
 
   bool IsRotationRequired(HWLayers *hw_layers);
 
+  Locker locker_;                  // Rotator device is shared by concurrently prepared displays
   HWInterface *hw_intf_;
   Handle hw_rotator_device_;
 };
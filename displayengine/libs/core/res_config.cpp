@@ -32,6 +32,43 @@
 
 namespace sde {
 
+static bool IsValidRect(const LayerRect &rect) {
+  return (rect.left < rect.right) && (rect.top < rect.bottom);
+}
+
+static LayerRect GetIntersection(const LayerRect &rect1, const LayerRect &rect2) {
+  LayerRect res(MAX(rect1.left, rect2.left), MAX(rect1.top, rect2.top),
+                MIN(rect1.right, rect2.right), MIN(rect1.bottom, rect2.bottom));
+
+  return IsValidRect(res) ? res : LayerRect();
+}
+
+static LayerRect GetUnion(const LayerRect &rect1, const LayerRect &rect2) {
+  if (!IsValidRect(rect1)) {
+    return rect2;
+  }
+
+  if (!IsValidRect(rect2)) {
+    return rect1;
+  }
+
+  return LayerRect(MIN(rect1.left, rect2.left), MIN(rect1.top, rect2.top),
+                   MAX(rect1.right, rect2.right), MAX(rect1.bottom, rect2.bottom));
+}
+
+static bool IsSameRect(const LayerRect &rect1, const LayerRect &rect2) {
+  return (rect1.left == rect2.left) && (rect1.top == rect2.top) &&
+         (rect1.right == rect2.right) && (rect1.bottom == rect2.bottom);
+}
+
+static bool IsScaled(const Layer &layer) {
+  const LayerRect &src = layer.src_rect;
+  const LayerRect &dst = layer.dst_rect;
+
+  return ((src.right - src.left) != (dst.right - dst.left)) ||
+         ((src.bottom - src.top) != (dst.bottom - dst.top));
+}
+
 void ResManager::RotationConfig(const LayerTransform &transform, const float &scale_x,
                                 const float &scale_y, LayerRect *src_rect,
                                 struct HWLayerConfig *layer_config, uint32_t *rotate_count) {
@@ -92,28 +129,26 @@ DisplayError ResManager::SrcSplitConfig(DisplayResourceContext *display_resource
 DisplayError ResManager::DisplaySplitConfig(DisplayResourceContext *display_resource_ctx,
                                             const LayerTransform &transform,
                                             const LayerRect &src_rect, const LayerRect &dst_rect,
+                                            const LayerRect &left_roi, const LayerRect &right_roi,
                                             HWLayerConfig *layer_config) {
-  LayerRect scissor_dst_left, scissor_dst_right;
-  HWDisplayAttributes &display_attributes = display_resource_ctx->display_attributes;
-
   // for display split case
   HWPipeInfo *left_pipe = &layer_config->left_pipe;
   HWPipeInfo *right_pipe = &layer_config->right_pipe;
-  LayerRect scissor, dst_left, crop_left, crop_right, dst_right;
-  scissor.right = FLOAT(display_attributes.split_left);
-  scissor.bottom = FLOAT(display_attributes.y_pixels);
-
-  crop_left = src_rect;
-  dst_left = dst_rect;
-  crop_right = crop_left;
-  dst_right = dst_left;
-  CalculateCropRects(scissor, transform, &crop_left, &dst_left);
-
-  scissor.left = FLOAT(display_attributes.split_left);
-  scissor.top = 0.0f;
-  scissor.right = FLOAT(display_attributes.x_pixels);
-  scissor.bottom = FLOAT(display_attributes.y_pixels);
-  CalculateCropRects(scissor, transform, &crop_right, &dst_right);
+  LayerRect dst_left, crop_left, crop_right, dst_right;
+
+  // Each half of the layer is cropped to the region of that half of the display which needs to be
+  // updated, halves which do not overlap with it are left empty.
+  if (IsValidRect(GetIntersection(dst_rect, left_roi))) {
+    crop_left = src_rect;
+    dst_left = dst_rect;
+    CalculateCropRects(left_roi, transform, &crop_left, &dst_left);
+  }
+
+  if (IsValidRect(GetIntersection(dst_rect, right_roi))) {
+    crop_right = src_rect;
+    dst_right = dst_rect;
+    CalculateCropRects(right_roi, transform, &crop_right, &dst_right);
+  }
   if ((crop_left.right - crop_left.left) > kMaxSourcePipeWidth) {
     if (crop_right.right != crop_right.left) {
       DLOGV_IF(kTagResources, "Need more than 2 pipes: left width = %.0f, right width = %.0f",
@@ -170,10 +205,12 @@ DisplayError ResManager::DisplaySplitConfig(DisplayResourceContext *display_reso
 DisplayError ResManager::Config(DisplayResourceContext *display_resource_ctx, HWLayers *hw_layers,
                                 uint32_t *rotate_count) {
   HWBlockType hw_block_id = display_resource_ctx->hw_block_id;
-  HWDisplayAttributes &display_attributes = display_resource_ctx->display_attributes;
   HWLayersInfo &layer_info = hw_layers->info;
   DisplayError error = kErrorNone;
 
+  // Layers are cropped to the region of the display which needs to be updated.
+  LayerRect scissor = GetUnion(layer_info.left_partial_update, layer_info.right_partial_update);
+
   for (uint32_t i = 0; i < layer_info.count; i++) {
     Layer& layer = layer_info.stack->layers[layer_info.index[i]];
     float rot_scale_x = 1.0f, rot_scale_y = 1.0f;
@@ -184,16 +221,6 @@ DisplayError ResManager::Config(DisplayResourceContext *display_resource_ctx, HW
       return kErrorNotSupported;
     }
 
-    LayerRect scissor, src_rect, dst_rect;
-    src_rect = layer.src_rect;
-    dst_rect = layer.dst_rect;
-    scissor.right = FLOAT(display_attributes.x_pixels);
-    scissor.bottom = FLOAT(display_attributes.y_pixels);
-    CalculateCropRects(scissor, layer.transform, &src_rect, &dst_rect);
-
-    if (ValidateScaling(layer, src_rect, dst_rect, &rot_scale_x, &rot_scale_y))
-      return kErrorNotSupported;
-
     struct HWLayerConfig *layer_config = &hw_layers->config[i];
     HWPipeInfo &left_pipe = layer_config->left_pipe;
     HWPipeInfo &right_pipe = layer_config->right_pipe;
@@ -203,6 +230,22 @@ DisplayError ResManager::Config(DisplayResourceContext *display_resource_ctx, HW
     }
     layer_config->num_rotate = 0;
 
+    // Layers which lie outside of the region to be updated are not fetched at all.
+    if (!IsValidRect(GetIntersection(layer.dst_rect, scissor))) {
+      DLOGV_IF(kTagResources, "layer = %d is outside of the partial update region", i);
+      left_pipe.Reset();
+      right_pipe.Reset();
+      continue;
+    }
+
+    LayerRect src_rect, dst_rect;
+    src_rect = layer.src_rect;
+    dst_rect = layer.dst_rect;
+    CalculateCropRects(scissor, layer.transform, &src_rect, &dst_rect);
+
+    if (ValidateScaling(layer, src_rect, dst_rect, &rot_scale_x, &rot_scale_y))
+      return kErrorNotSupported;
+
     LayerTransform transform = layer.transform;
     if (IsRotationNeeded(transform.rotation) ||
         UINT32(rot_scale_x) != 1 || UINT32(rot_scale_y) != 1) {
@@ -216,8 +259,9 @@ DisplayError ResManager::Config(DisplayResourceContext *display_resource_ctx, HW
       error = SrcSplitConfig(display_resource_ctx, transform, src_rect,
                              dst_rect, layer_config);
     } else {
-      error = DisplaySplitConfig(display_resource_ctx, transform, src_rect,
-                                 dst_rect, layer_config);
+      error = DisplaySplitConfig(display_resource_ctx, transform, src_rect, dst_rect,
+                                 layer_info.left_partial_update,
+                                 layer_info.right_partial_update, layer_config);
     }
 
     if (error != kErrorNone)
@@ -257,9 +301,218 @@ DisplayError ResManager::Config(DisplayResourceContext *display_resource_ctx, HW
     }
   }
 
+  // Driver takes a single region of interest for a display which is not split.
+  if ((error == kErrorNone) && !display_resource_ctx->display_attributes.is_device_split) {
+    layer_info.left_partial_update = GetUnion(layer_info.left_partial_update,
+                                              layer_info.right_partial_update);
+    layer_info.right_partial_update = LayerRect();
+  }
+
   return error;
 }
 
+void ResManager::CalculatePartialUpdate(DisplayResourceContext *display_resource_ctx,
+                                        HWLayers *hw_layers) {
+  HWDisplayAttributes &display_attributes = display_resource_ctx->display_attributes;
+  HWLayersInfo &layer_info = hw_layers->info;
+  LayerStack *layer_stack = layer_info.stack;
+  LayerRect left_frame(0.0f, 0.0f, FLOAT(display_attributes.split_left),
+                       FLOAT(display_attributes.y_pixels));
+  LayerRect right_frame(FLOAT(display_attributes.split_left), 0.0f,
+                        FLOAT(display_attributes.x_pixels), FLOAT(display_attributes.y_pixels));
+
+  // Update the full frame, unless it is known that only a part of it has changed.
+  layer_info.left_partial_update = left_frame;
+  layer_info.right_partial_update = IsValidRect(right_frame) ? right_frame : LayerRect();
+
+  if (!IsPartialUpdatePossible(display_resource_ctx, layer_info)) {
+    return;
+  }
+
+  LayerRect left_roi, right_roi;
+  for (uint32_t i = 0; i < layer_stack->layer_count; i++) {
+    const Layer &layer = layer_stack->layers[i];
+
+    // Dirty regions of GPU composed layers cover the changes of the GPU target.
+    if ((layer.composition == kCompositionGPUTarget) || !layer.flags.updating) {
+      continue;
+    }
+
+    LayerRect dirty_rect;
+    GetLayerDirtyRect(layer, &dirty_rect);
+    left_roi = GetUnion(left_roi, GetIntersection(dirty_rect, left_frame));
+    right_roi = GetUnion(right_roi, GetIntersection(dirty_rect, right_frame));
+  }
+
+  // Panels which can not take a region of interest for each half need the same rows to be updated
+  // on both halves.
+  if (display_attributes.needs_roi_merge) {
+    LayerRect roi = GetUnion(left_roi, right_roi);
+    left_roi = GetIntersection(roi, left_frame);
+    right_roi = GetIntersection(roi, right_frame);
+  }
+
+  // No layer is updating, still the client wants the frame to be refreshed.
+  if (!IsValidRect(left_roi) && !IsValidRect(right_roi)) {
+    return;
+  }
+
+  AlignPartialUpdate(display_attributes, left_frame, &left_roi);
+  AlignPartialUpdate(display_attributes, right_frame, &right_roi);
+
+  // Cropping a scaled layer may change the filtering at the edges of the region, update the full
+  // frame if any of them is only partially inside the region.
+  for (uint32_t i = 0; i < layer_info.count; i++) {
+    const Layer &layer = layer_stack->layers[layer_info.index[i]];
+    LayerRect dst_rect = GetIntersection(layer.dst_rect, GetUnion(left_frame, right_frame));
+    LayerRect visible_rect = GetUnion(GetIntersection(dst_rect, left_roi),
+                                      GetIntersection(dst_rect, right_roi));
+
+    if (IsValidRect(visible_rect) && !IsSameRect(visible_rect, dst_rect) && IsScaled(layer)) {
+      DLOGV_IF(kTagResources, "Scaled layer = %d is cropped, updating full frame", i);
+      return;
+    }
+  }
+
+  layer_info.left_partial_update = left_roi;
+  layer_info.right_partial_update = right_roi;
+
+  LogRectVerbose("left partial update", left_roi);
+  LogRectVerbose("right partial update", right_roi);
+}
+
+bool ResManager::IsPartialUpdatePossible(DisplayResourceContext *display_resource_ctx,
+                                         const HWLayersInfo &layer_info) {
+  LayerStack *layer_stack = layer_info.stack;
+
+  if (!display_resource_ctx->display_attributes.partial_update ||
+      layer_stack->flags.geometry_changed || layer_stack->flags.skip_present) {
+    return false;
+  }
+
+  if (!display_resource_ctx->committed_valid ||
+      (display_resource_ctx->committed_layer_count != layer_stack->layer_count) ||
+      (display_resource_ctx->committed_count != layer_info.count)) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < layer_info.count; i++) {
+    if (display_resource_ctx->committed_index[i] != layer_info.index[i]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void ResManager::GetLayerDirtyRect(const Layer &layer, LayerRect *dirty_rect) {
+  const LayerRect &src_rect = layer.src_rect;
+  const LayerRect &dst_rect = layer.dst_rect;
+  const LayerTransform &transform = layer.transform;
+
+  *dirty_rect = dst_rect;
+
+  // Dirty regions are in buffer coordinates. They can be mapped to the display only if the layer is
+  // neither scaled nor transformed, otherwise the whole layer is considered to be dirty.
+  if (IsScaled(layer) || (transform.rotation != 0.0f) || transform.flip_horizontal ||
+      transform.flip_vertical) {
+    return;
+  }
+
+  float x_offset = dst_rect.left - src_rect.left;
+  float y_offset = dst_rect.top - src_rect.top;
+  LayerRect dirty;
+
+  for (uint32_t i = 0; i < layer.dirty_regions.count; i++) {
+    const LayerRect &rect = layer.dirty_regions.rect[i];
+    LayerRect moved_rect(rect.left + x_offset, rect.top + y_offset, rect.right + x_offset,
+                         rect.bottom + y_offset);
+    dirty = GetUnion(dirty, GetIntersection(moved_rect, dst_rect));
+  }
+
+  // Layers which do not tell their dirty regions are updating as a whole.
+  if (IsValidRect(dirty)) {
+    *dirty_rect = dirty;
+  }
+}
+
+void ResManager::AlignPartialUpdate(const HWDisplayAttributes &display_attributes,
+                                    const LayerRect &boundary, LayerRect *roi) {
+  if (!IsValidRect(*roi)) {
+    return;
+  }
+
+  const int left_align = INT(display_attributes.left_align);
+  const int width_align = INT(display_attributes.width_align);
+  const int top_align = INT(display_attributes.top_align);
+  const int height_align = INT(display_attributes.height_align);
+  const int min_width = INT(display_attributes.min_roi_width);
+  const int min_height = INT(display_attributes.min_roi_height);
+  int bound_left = INT(boundary.left);
+  int bound_top = INT(boundary.top);
+  int bound_right = INT(boundary.right);
+  int bound_bottom = INT(boundary.bottom);
+  int left = INT(floorf(roi->left));
+  int top = INT(floorf(roi->top));
+  int right = INT(ceilf(roi->right));
+  int bottom = INT(ceilf(roi->bottom));
+
+  // Grow the region to the minimum size recommended by the panel.
+  if ((right - left) < min_width) {
+    right = left + min_width;
+    if (right > bound_right) {
+      right = bound_right;
+      left = right - min_width;
+    }
+  }
+
+  if ((bottom - top) < min_height) {
+    bottom = top + min_height;
+    if (bottom > bound_bottom) {
+      bottom = bound_bottom;
+      top = bottom - min_height;
+    }
+  }
+
+  // Align left and width, then top and height to meet the panel restrictions.
+  if (left_align) {
+    left -= (left % left_align);
+  }
+
+  if (width_align) {
+    int width = width_align * ((right - left + width_align - 1) / width_align);
+    right = left + width;
+    if (right > bound_right) {
+      right = bound_right;
+      left = right - width;
+      if (left_align) {
+        left -= (left % left_align);
+      }
+    }
+  }
+
+  if (top_align) {
+    top -= (top % top_align);
+  }
+
+  if (height_align) {
+    int height = height_align * ((bottom - top + height_align - 1) / height_align);
+    bottom = top + height;
+    if (bottom > bound_bottom) {
+      bottom = bound_bottom;
+      top = bottom - height;
+      if (top_align) {
+        top -= (top % top_align);
+      }
+    }
+  }
+
+  roi->left = FLOAT(MAX(left, bound_left));
+  roi->top = FLOAT(MAX(top, bound_top));
+  roi->right = FLOAT(MIN(right, bound_right));
+  roi->bottom = FLOAT(MIN(bottom, bound_bottom));
+}
+
 DisplayError ResManager::ValidateScaling(const Layer &layer, const LayerRect &crop,
                                          const LayerRect &dst, float *rot_scale_x,
                                          float *rot_scale_y) {
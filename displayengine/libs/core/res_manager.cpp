@@ -23,6 +23,7 @@
 */
 
 #include <math.h>
+#include <string.h>
 #include <utils/constants.h>
 #include <utils/debug.h>
 
@@ -32,9 +33,21 @@
 
 namespace sde {
 
+static bool IsSameRect(const LayerRect &rect1, const LayerRect &rect2) {
+  return (rect1.left == rect2.left) && (rect1.top == rect2.top) &&
+         (rect1.right == rect2.right) && (rect1.bottom == rect2.bottom);
+}
+
 ResManager::ResManager()
-  : num_pipe_(0), vig_pipes_(NULL), rgb_pipes_(NULL), dma_pipes_(NULL), virtual_count_(0),
+  : num_pipe_(0), vig_pipes_(NULL), rgb_pipes_(NULL), dma_pipes_(NULL), at_right_mask_(0),
+    bw_claimed_(0.0f), clk_claimed_(0.0f), last_primary_bw_(0.0f), virtual_count_(0),
     buffer_allocator_(NULL), buffer_sync_handler_(NULL) {
+  memset(type_mask_, 0, sizeof(type_mask_));
+  memset(state_mask_, 0, sizeof(state_mask_));
+  memset(hw_block_mask_, 0, sizeof(hw_block_mask_));
+  memset(reserved_mask_, 0, sizeof(reserved_mask_));
+  memset(dedicated_mask_, 0, sizeof(dedicated_mask_));
+  memset(display_ctx_list_, 0, sizeof(display_ctx_list_));
 }
 
 DisplayError ResManager::Init(const HWResourceInfo &hw_res_info, BufferAllocator *buffer_allocator,
@@ -84,8 +97,14 @@ DisplayError ResManager::Init(const HWResourceInfo &hw_res_info, BufferAllocator
     dma_pipes_[i].mdss_pipe_id = GetMdssPipeId(dma_pipes_[i].type, i);
   }
 
+  // Pipe index is also the priority, so that the lowest set bit of a mask is the preferred pipe.
   for (uint32_t i = 0; i < num_pipe_; i++) {
     src_pipes_[i].priority = i;
+    SET_BIT(type_mask_[src_pipes_[i].type], i);
+    SET_BIT(state_mask_[kPipeStateIdle], i);
+    SET_BIT(hw_block_mask_[kHWBlockMax], i);
+    SET_BIT(reserved_mask_[kHWBlockMax], i);
+    SET_BIT(dedicated_mask_[kHWBlockMax], i);
   }
 
   DLOGI("hw_rev=%x, DMA=%d RGB=%d VIG=%d", hw_res_info_.hw_revision, hw_res_info_.num_dma_pipe,
@@ -109,8 +128,8 @@ DisplayError ResManager::Init(const HWResourceInfo &hw_res_info, BufferAllocator
   }
 
   // Used by splash screen
-  rgb_pipes_[0].state = kPipeStateOwnedByKernel;
-  rgb_pipes_[1].state = kPipeStateOwnedByKernel;
+  SetPipeState(rgb_pipes_[0].index, kPipeStateOwnedByKernel);
+  SetPipeState(rgb_pipes_[1].index, kPipeStateOwnedByKernel);
 
   return kErrorNone;
 }
@@ -165,6 +184,9 @@ DisplayError ResManager::RegisterDisplay(DisplayType type, const HWDisplayAttrib
   }
 
   hw_block_ctx_[hw_block_id].is_in_use = true;
+  if (!display_ctx_list_[hw_block_id]) {
+    display_ctx_list_[hw_block_id] = display_resource_ctx;
+  }
 
   display_resource_ctx->display_attributes = attributes;
   display_resource_ctx->display_type = type;
@@ -192,6 +214,10 @@ DisplayError ResManager::UnregisterDisplay(Handle display_ctx) {
   if (!hw_block_ctx_[display_resource_ctx->hw_block_id].is_in_use)
     Purge(display_ctx);
 
+  if (display_ctx_list_[display_resource_ctx->hw_block_id] == display_resource_ctx) {
+    display_ctx_list_[display_resource_ctx->hw_block_id] = NULL;
+  }
+
   delete display_resource_ctx;
 
   return kErrorNone;
@@ -203,6 +229,8 @@ DisplayError ResManager::Start(Handle display_ctx) {
   DisplayResourceContext *display_resource_ctx =
                           reinterpret_cast<DisplayResourceContext *>(display_ctx);
 
+  display_resource_ctx->bw_pending = false;
+
   if (display_resource_ctx->frame_start) {
     return kErrorNone;  // keep context locked.
   }
@@ -213,11 +241,11 @@ DisplayError ResManager::Start(Handle display_ctx) {
 
   // Release the pipes not used in the previous cycle
   HWBlockType hw_block_id = display_resource_ctx->hw_block_id;
-  for (uint32_t i = 0; i < num_pipe_; i++) {
-    if ((src_pipes_[i].hw_block_id == hw_block_id) &&
-        (src_pipes_[i].state == kPipeStateToRelease)) {
-      src_pipes_[i].state = kPipeStateIdle;
-    }
+  uint32_t release_mask = state_mask_[kPipeStateToRelease] & hw_block_mask_[hw_block_id];
+  while (release_mask) {
+    uint32_t index = GetFirstPipe(release_mask);
+    CLEAR_BIT(release_mask, index);
+    SetPipeState(index, kPipeStateIdle);
   }
 
   // Clear rotator usage
@@ -228,8 +256,8 @@ DisplayError ResManager::Start(Handle display_ctx) {
     if (rotators_[i].client_bit_mask == 0 &&
         src_pipes_[pipe_index].state == kPipeStateToRelease &&
         src_pipes_[pipe_index].hw_block_id == rotators_[i].writeback_id) {
-      src_pipes_[pipe_index].dedicated_hw_block = kHWBlockMax;
-      src_pipes_[pipe_index].state = kPipeStateIdle;
+      SetPipeDedicatedBlock(pipe_index, kHWBlockMax);
+      SetPipeState(pipe_index, kPipeStateIdle);
     }
   }
 
@@ -237,11 +265,17 @@ DisplayError ResManager::Start(Handle display_ctx) {
 }
 
 DisplayError ResManager::Stop(Handle display_ctx) {
-  locker_.Unlock();
-
   DisplayResourceContext *display_resource_ctx =
                           reinterpret_cast<DisplayResourceContext *>(display_ctx);
 
+  // Claim the bandwidth of a successful reservation before another display reserves resources, as
+  // displays may be prepared concurrently. This used to be done in PostPrepare(), which runs after
+  // the reservation turn is handed over, so the next display could check its bandwidth against
+  // claims that were not yet updated.
+  ClaimBandwidth(display_resource_ctx);
+
+  locker_.Unlock();
+
   return kErrorNone;
 }
 
@@ -256,21 +290,26 @@ DisplayError ResManager::Acquire(Handle display_ctx, HWLayers *hw_layers) {
     return kErrorResources;
   }
 
+  CalculatePartialUpdate(display_resource_ctx, hw_layers);
+
   uint32_t rotate_count = 0;
   error = Config(display_resource_ctx, hw_layers, &rotate_count);
   if (error != kErrorNone) {
     return error;
   }
 
+
   uint32_t left_index = kPipeIdMax;
   bool need_scale = false;
   HWBlockType hw_block_id = display_resource_ctx->hw_block_id;
   HWBlockType rotator_block = kHWBlockMax;
 
   // Clear reserved marking
-  for (uint32_t i = 0; i < num_pipe_; i++) {
-    if (src_pipes_[i].reserved_hw_block == hw_block_id)
-      src_pipes_[i].reserved_hw_block = kHWBlockMax;
+  uint32_t reserved_mask = reserved_mask_[hw_block_id];
+  while (reserved_mask) {
+    uint32_t index = GetFirstPipe(reserved_mask);
+    CLEAR_BIT(reserved_mask, index);
+    SetPipeReservedBlock(index, kHWBlockMax);
   }
 
   // allocate rotator
@@ -285,6 +324,11 @@ DisplayError ResManager::Acquire(Handle display_ctx, HWLayers *hw_layers) {
     struct HWLayerConfig &layer_config = hw_layers->config[i];
     bool use_non_dma_pipe = layer_config.use_non_dma_pipe;
 
+    // Layer lies outside of the partial update region, it needs no pipe.
+    if (!layer_config.left_pipe.valid && !layer_config.right_pipe.valid) {
+      continue;
+    }
+
     // TODO(user): set this from comp_manager
     if (hw_block_id == kHWPrimary) {
       use_non_dma_pipe = true;
@@ -306,7 +350,7 @@ DisplayError ResManager::Acquire(Handle display_ctx, HWLayers *hw_layers) {
       if (left_index >= num_pipe_) {
         goto CleanupOnError;
       }
-      src_pipes_[left_index].reserved_hw_block = hw_block_id;
+      SetPipeReservedBlock(left_index, hw_block_id);
     }
 
     error = SetDecimationFactor(pipe_info);
@@ -319,7 +363,7 @@ DisplayError ResManager::Acquire(Handle display_ctx, HWLayers *hw_layers) {
       // assign single pipe
       if (left_index < num_pipe_) {
         layer_config.left_pipe.pipe_id = src_pipes_[left_index].mdss_pipe_id;
-        src_pipes_[left_index].at_right = false;
+        SetPipeAtRight(left_index, false);
       }
       continue;
     }
@@ -339,10 +383,10 @@ DisplayError ResManager::Acquire(Handle display_ctx, HWLayers *hw_layers) {
 
     // assign dual pipes
     pipe_info->pipe_id = src_pipes_[right_index].mdss_pipe_id;
-    src_pipes_[right_index].reserved_hw_block = hw_block_id;
-    src_pipes_[right_index].at_right = true;
-    src_pipes_[left_index].reserved_hw_block = hw_block_id;
-    src_pipes_[left_index].at_right = false;
+    SetPipeReservedBlock(right_index, hw_block_id);
+    SetPipeAtRight(right_index, true);
+    SetPipeReservedBlock(left_index, hw_block_id);
+    SetPipeAtRight(left_index, false);
     layer_config.left_pipe.pipe_id = src_pipes_[left_index].mdss_pipe_id;
     error = SetDecimationFactor(pipe_info);
     if (error != kErrorNone) {
@@ -368,9 +412,12 @@ DisplayError ResManager::Acquire(Handle display_ctx, HWLayers *hw_layers) {
 
 CleanupOnError:
   DLOGV_IF(kTagResources, "Resource reserving failed! hw_block = %d", hw_block_id);
-  for (uint32_t i = 0; i < num_pipe_; i++) {
-    if (src_pipes_[i].reserved_hw_block == hw_block_id)
-      src_pipes_[i].reserved_hw_block = kHWBlockMax;
+  display_resource_ctx->bw_pending = false;
+  reserved_mask = reserved_mask_[hw_block_id];
+  while (reserved_mask) {
+    uint32_t index = GetFirstPipe(reserved_mask);
+    CLEAR_BIT(reserved_mask, index);
+    SetPipeReservedBlock(index, kHWBlockMax);
   }
   return kErrorResources;
 }
@@ -395,18 +442,29 @@ bool ResManager::CheckBandwidth(DisplayResourceContext *display_ctx, HWLayers *h
     float bpp = GetBpp(layer.input_buffer->format);
     HWPipeInfo *left_pipe = &hw_layers->config[i].left_pipe;
     HWPipeInfo *right_pipe = &hw_layers->config[i].right_pipe;
+    PipeBwInfo *left_bw_info = &display_ctx->pipe_bw_info[i][0];
+    PipeBwInfo *right_bw_info = &display_ctx->pipe_bw_info[i][1];
+
+    float left_clk = 0;
+    float right_clk = 0;
 
-    left_pipe_bw[i] = left_pipe->valid ? GetPipeBw(display_ctx, left_pipe, bpp) : 0;
-    right_pipe_bw[i] = right_pipe->valid ? GetPipeBw(display_ctx, right_pipe, bpp) : 0;
+    if (left_pipe->valid) {
+      GetPipeBwInfo(display_ctx, left_pipe, bpp, left_bw_info);
+      left_pipe_bw[i] = left_bw_info->bw;
+      left_clk = left_bw_info->clk;
+    }
+
+    if (right_pipe->valid) {
+      GetPipeBwInfo(display_ctx, right_pipe, bpp, right_bw_info);
+      right_pipe_bw[i] = right_bw_info->bw;
+      right_clk = right_bw_info->clk;
+    }
 
     if ((left_pipe_bw[i] > max_pipe_bw) || (right_pipe_bw[i] > max_pipe_bw)) {
       DLOGV_IF(kTagResources, "Pipe bandwidth exceeds limit for layer index = %d", i);
       return false;
     }
 
-    float left_clk = left_pipe->valid ? GetClockForPipe(display_ctx, left_pipe) : 0;
-    float right_clk = right_pipe->valid ? GetClockForPipe(display_ctx, right_pipe) : 0;
-
     left_max_clk = MAX(left_clk, left_max_clk);
     right_max_clk = MAX(right_clk, right_max_clk);
   }
@@ -418,7 +476,6 @@ bool ResManager::CheckBandwidth(DisplayResourceContext *display_ctx, HWLayers *h
   // Check system bandwidth (nth External + max(nth, n-1th) Primary)
   if (display_ctx->hw_block_id == kHWPrimary) {
     display_bw = MAX(display_bw, last_primary_bw_);
-    last_primary_bw_ = left_mixer_bw + right_mixer_bw;
   }
 
   // If system has Video mode panel, use max_bandwidth_low, else use max_bandwidth_high
@@ -439,16 +496,49 @@ bool ResManager::CheckBandwidth(DisplayResourceContext *display_ctx, HWLayers *h
     return false;
   }
 
+  // Bandwidth check does not change the system state, so that it can be called for every strategy
+  // attempt. Requirement of the display is claimed by Stop() at the end of every reservation which
+  // passed the check, even if the driver rejects the reservation later.
+  display_ctx->display_bw = left_mixer_bw + right_mixer_bw;
+  display_ctx->display_clk = display_clk;
+  display_ctx->bw_pending = true;
+
+  return true;
+}
+
+void ResManager::ClaimBandwidth(DisplayResourceContext *display_ctx) {
+  if (!display_ctx->bw_pending) {
+    return;
+  }
+
   // If Primary display, reset claimed bw & clk for next cycle
   if (display_ctx->hw_block_id == kHWPrimary) {
+    last_primary_bw_ = display_ctx->display_bw;
     bw_claimed_ = 0.0f;
     clk_claimed_ = 0.0f;
   } else {
-    bw_claimed_ = display_bw;
-    clk_claimed_ = display_clk;
+    bw_claimed_ = display_ctx->display_bw;
+    clk_claimed_ = display_ctx->display_clk;
   }
 
-  return true;
+  display_ctx->bw_pending = false;
+}
+
+void ResManager::GetPipeBwInfo(DisplayResourceContext *display_ctx, HWPipeInfo *pipe, float bpp,
+                               PipeBwInfo *bw_info) {
+  if (bw_info->valid && (bw_info->bpp == bpp) &&
+      (bw_info->vertical_decimation == pipe->vertical_decimation) &&
+      IsSameRect(bw_info->src_roi, pipe->src_roi) && IsSameRect(bw_info->dst_roi, pipe->dst_roi)) {
+    return;
+  }
+
+  bw_info->src_roi = pipe->src_roi;
+  bw_info->dst_roi = pipe->dst_roi;
+  bw_info->bpp = bpp;
+  bw_info->vertical_decimation = pipe->vertical_decimation;
+  bw_info->bw = GetPipeBw(display_ctx, pipe, bpp);
+  bw_info->clk = GetClockForPipe(display_ctx, pipe);
+  bw_info->valid = true;
 }
 
 float ResManager::GetPipeBw(DisplayResourceContext *display_ctx, HWPipeInfo *pipe, float bpp) {
@@ -497,15 +587,13 @@ float ResManager::GetClockForPipe(DisplayResourceContext *display_ctx, HWPipeInf
 
 float ResManager::GetOverlapBw(HWLayers *hw_layers, float *pipe_bw, bool left_mixer) {
   uint32_t count = hw_layers->info.count;
-  float overlap_bw[count][count];
+  float row_prev_max[kMaxSDELayers];
   float overall_max = 0;
 
-  memset(overlap_bw, 0, sizeof(overlap_bw));
-
   // Algorithm:
-  // 1.Create an 'n' by 'n' sized 2D array, overlap_bw[n][n] (n = # of layers).
-  // 2.Get overlap_bw between two layers, i and j, and account for other overlaps (prev_max) if any.
-  //   This will fill the bottom-left half of the array including diagonal (0 <= i < n, 0 <= j <= i)
+  // 1.Get overlap_bw between two layers, i and j, and account for other overlaps (prev_max) if any.
+  //   This covers the bottom-left half of an 'n' by 'n' matrix including diagonal
+  //   (n = # of layers, 0 <= i < n, 0 <= j <= i)
   //                      {1. pipe_bw[i],                         where i == j
   //   overlap_bw[i][j] = {2. 0,                                  where i != j && !Overlap(i, j)
   //                      {3. pipe_bw[i] + pipe_bw[j] + prev_max, where i != j && Overlap(i, j)
@@ -513,13 +601,17 @@ float ResManager::GetOverlapBw(HWLayers *hw_layers, float *pipe_bw, bool left_mi
   //   Overlap(i, j) = !(bottom_i <= top_j || top_i >= bottom_j)
   //   prev_max = max(prev_max, overlap_bw[j, k]), where 0 <= k < j and prev_max initially 0
   //   prev_max = prev_max ? (prev_max - pipe_bw[j]) : 0; (to account for "double counting")
-  // 3.Get the max value in 2D array, overlap_bw[n][n], for the final overall_max bandwidth.
+  // 2.Row j is complete before row i needs its prev_max, so only the max of each row below the
+  //   diagonal is kept in row_prev_max[j] instead of the whole matrix.
+  // 3.Get the max value in the matrix for the final overall_max bandwidth.
   //   overall_max = max(overlap_bw[i, j]), where 0 <= i < n, 0 <= j <= i
 
   for (uint32_t i = 0; i < count; i++) {
     HWPipeInfo &pipe1 = left_mixer ? hw_layers->config[i].left_pipe :
                         hw_layers->config[i].right_pipe;
 
+    row_prev_max[i] = 0;
+
     // Non existing pipe never overlaps
     if (pipe_bw[i] == 0)
       continue;
@@ -533,7 +625,6 @@ float ResManager::GetOverlapBw(HWLayers *hw_layers, float *pipe_bw, bool left_mi
                           hw_layers->config[j].right_pipe;
 
       if ((pipe_bw[j] == 0) || (i == j)) {
-        overlap_bw[i][j] = pipe_bw[j];
         row_max = MAX(pipe_bw[j], row_max);
         continue;
       }
@@ -542,19 +633,15 @@ float ResManager::GetOverlapBw(HWLayers *hw_layers, float *pipe_bw, bool left_mi
       float bottom2 = pipe2.dst_roi.bottom;
 
       if ((bottom1 <= top2) || (top1 >= bottom2)) {
-        overlap_bw[i][j] = 0;
         continue;
       }
 
-      overlap_bw[i][j] = pipe_bw[i] + pipe_bw[j];
+      float overlap_bw = pipe_bw[i] + pipe_bw[j];
 
-      float prev_max = 0;
-      for (uint32_t k = 0; k < j; k++) {
-        if (overlap_bw[j][k])
-          prev_max = MAX(overlap_bw[j][k], prev_max);
-      }
-      overlap_bw[i][j] += (prev_max > 0) ? (prev_max - pipe_bw[j]) : 0;
-      row_max = MAX(overlap_bw[i][j], row_max);
+      float prev_max = row_prev_max[j];
+      overlap_bw += (prev_max > 0) ? (prev_max - pipe_bw[j]) : 0;
+      row_max = MAX(overlap_bw, row_max);
+      row_prev_max[i] = MAX(overlap_bw, row_prev_max[i]);
     }
 
     overall_max = MAX(row_max, overall_max);
@@ -599,11 +686,15 @@ DisplayError ResManager::AllocRotatorBuffer(Handle display_ctx, HWLayers *hw_lay
 
   // TODO(user): Do session management during prepare and allocate buffer and associate that with
   // the session during commit.
-  buffer_manager->Start();
+  buffer_manager->Start(display_resource_ctx->frame_count);
 
   for (uint32_t i = 0; i < layer_info.count; i++) {
     Layer& layer = layer_info.stack->layers[layer_info.index[i]];
     HWRotateInfo *rotate = &hw_layers->config[i].rotates[0];
+    // Rotated output of the previous frame is valid only if the client did not update the buffer.
+    // Content key makes sure that it is also the same buffer with the same geometry.
+    bool reuse_content = !(layer.change_mask & (kLayerChangeBuffer | kLayerChangeBufferFormat)) &&
+                         !layer.flags.updating;
 
     if (rotate->valid) {
       LayerBufferFormat rot_ouput_format;
@@ -615,8 +706,9 @@ DisplayError ResManager::AllocRotatorBuffer(Handle display_ctx, HWLayers *hw_lay
       hw_buffer_info->buffer_config.format = rot_ouput_format;
       hw_buffer_info->buffer_config.buffer_count = 2;
       hw_buffer_info->buffer_config.secure = layer.input_buffer->flags.secure;
+      hw_buffer_info->content_key = GetRotateContentKey(layer, *rotate);
 
-      error = buffer_manager->GetNextBuffer(hw_buffer_info);
+      error = buffer_manager->GetNextBuffer(hw_buffer_info, reuse_content);
       if (error != kErrorNone) {
         return error;
       }
@@ -633,8 +725,9 @@ DisplayError ResManager::AllocRotatorBuffer(Handle display_ctx, HWLayers *hw_lay
       hw_buffer_info->buffer_config.format = rot_ouput_format;
       hw_buffer_info->buffer_config.buffer_count = 2;
       hw_buffer_info->buffer_config.secure = layer.input_buffer->flags.secure;
+      hw_buffer_info->content_key = GetRotateContentKey(layer, *rotate);
 
-      error = buffer_manager->GetNextBuffer(hw_buffer_info);
+      error = buffer_manager->GetNextBuffer(hw_buffer_info, reuse_content);
       if (error != kErrorNone) {
         return error;
       }
@@ -645,6 +738,34 @@ DisplayError ResManager::AllocRotatorBuffer(Handle display_ctx, HWLayers *hw_lay
   return kErrorNone;
 }
 
+uint64_t ResManager::GetRotateContentKey(const Layer &layer, const HWRotateInfo &rotate) {
+  const LayerBuffer *input_buffer = layer.input_buffer;
+  const BufferConfig &buffer_config = rotate.hw_buffer_info.buffer_config;
+  const float values[] = { rotate.src_roi.left, rotate.src_roi.top, rotate.src_roi.right,
+                           rotate.src_roi.bottom, rotate.dst_roi.left, rotate.dst_roi.top,
+                           rotate.dst_roi.right, rotate.dst_roi.bottom, layer.transform.rotation,
+                           rotate.downscale_ratio_x, rotate.downscale_ratio_y };
+
+  uint64_t key = UINT64(input_buffer->planes[0].fd);
+  key = (key * 31) + input_buffer->planes[0].offset;
+  key = (key * 31) + input_buffer->width;
+  key = (key * 31) + input_buffer->height;
+  key = (key * 31) + UINT64(input_buffer->format);
+  key = (key * 31) + UINT64(layer.transform.flip_horizontal);
+  key = (key * 31) + UINT64(layer.transform.flip_vertical);
+  key = (key * 31) + UINT64(buffer_config.format);
+  key = (key * 31) + UINT64(buffer_config.secure);
+
+  for (uint32_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    uint32_t bits = 0;
+    memcpy(&bits, &values[i], sizeof(bits));
+    key = (key * 31) + bits;
+  }
+
+  // Zero stands for unknown content.
+  return key ? key : 1;
+}
+
 DisplayError ResManager::PostPrepare(Handle display_ctx, HWLayers *hw_layers) {
   SCOPE_LOCK(locker_);
   DisplayResourceContext *display_resource_ctx =
@@ -693,14 +814,14 @@ DisplayError ResManager::PostCommit(Handle display_ctx, HWLayers *hw_layers) {
 
   for (uint32_t i = 0; i < num_pipe_; i++) {
     if (src_pipes_[i].reserved_hw_block == hw_block_id) {
-      src_pipes_[i].hw_block_id = hw_block_id;
-      src_pipes_[i].state = kPipeStateAcquired;
+      SetPipeHWBlock(i, hw_block_id);
+      SetPipeState(i, kPipeStateAcquired);
       src_pipes_[i].state_frame_count = frame_count;
       DLOGV_IF(kTagResources, "Pipe acquired index = %d, type = %d, pipe_id = %x", i,
                src_pipes_[i].type, src_pipes_[i].mdss_pipe_id);
     } else if ((src_pipes_[i].hw_block_id == hw_block_id) &&
                (src_pipes_[i].state == kPipeStateAcquired)) {
-      src_pipes_[i].state = kPipeStateToRelease;
+      SetPipeState(i, kPipeStateToRelease);
       src_pipes_[i].state_frame_count = frame_count;
       DLOGV_IF(kTagResources, "Pipe to release index = %d, type = %d, pipe_id = %x", i,
                src_pipes_[i].type, src_pipes_[i].mdss_pipe_id);
@@ -711,8 +832,8 @@ DisplayError ResManager::PostCommit(Handle display_ctx, HWLayers *hw_layers) {
   if ((frame_count == 1) && (hw_block_id == kHWPrimary)) {
     for (uint32_t i = 0; i < num_pipe_; i++) {
       if ((src_pipes_[i].state == kPipeStateOwnedByKernel)) {
-        src_pipes_[i].state = kPipeStateToRelease;
-        src_pipes_[i].hw_block_id = kHWPrimary;
+        SetPipeState(i, kPipeStateToRelease);
+        SetPipeHWBlock(i, kHWPrimary);
       }
     }
   }
@@ -721,17 +842,17 @@ DisplayError ResManager::PostCommit(Handle display_ctx, HWLayers *hw_layers) {
     uint32_t pipe_index = rotators_[i].pipe_index;
 
     if (IS_BIT_SET(rotators_[i].client_bit_mask, hw_block_id)) {
-      src_pipes_[pipe_index].hw_block_id = rotators_[i].writeback_id;
-      src_pipes_[pipe_index].state = kPipeStateAcquired;
+      SetPipeHWBlock(pipe_index, rotators_[i].writeback_id);
+      SetPipeState(pipe_index, kPipeStateAcquired);
     } else if (!rotators_[i].client_bit_mask &&
                src_pipes_[pipe_index].hw_block_id == rotators_[i].writeback_id &&
                src_pipes_[pipe_index].state == kPipeStateAcquired) {
-      src_pipes_[pipe_index].state = kPipeStateToRelease;
+      SetPipeState(pipe_index, kPipeStateToRelease);
       src_pipes_[pipe_index].state_frame_count = frame_count;
     }
     // If no request on the rotation, release the pipe.
     if (!rotators_[i].request_bit_mask) {
-      src_pipes_[pipe_index].dedicated_hw_block = kHWBlockMax;
+      SetPipeDedicatedBlock(pipe_index, kHWBlockMax);
     }
   }
   display_resource_ctx->frame_start = false;
@@ -739,6 +860,13 @@ DisplayError ResManager::PostCommit(Handle display_ctx, HWLayers *hw_layers) {
   BufferManager *buffer_manager = display_resource_ctx->buffer_manager;
   HWLayersInfo &layer_info = hw_layers->info;
 
+  display_resource_ctx->committed_layer_count = layer_info.stack->layer_count;
+  display_resource_ctx->committed_count = layer_info.count;
+  for (uint32_t i = 0; i < layer_info.count; i++) {
+    display_resource_ctx->committed_index[i] = layer_info.index[i];
+  }
+  display_resource_ctx->committed_valid = true;
+
   for (uint32_t i = 0; i < layer_info.count; i++) {
     Layer& layer = layer_info.stack->layers[layer_info.index[i]];
     HWRotateInfo *rotate = &hw_layers->config[i].rotates[0];
@@ -746,8 +874,9 @@ DisplayError ResManager::PostCommit(Handle display_ctx, HWLayers *hw_layers) {
     if (rotate->valid) {
       HWBufferInfo *rot_buf_info = &rotate->hw_buffer_info;
 
-      error = buffer_manager->SetReleaseFd(rot_buf_info->slot,
-                                                rot_buf_info->output_buffer.release_fence_fd);
+      error = buffer_manager->SetReleaseFence(rot_buf_info->slot,
+                                              rot_buf_info->output_buffer.release_fence);
+      rot_buf_info->output_buffer.release_fence = NULL;
       if (error != kErrorNone) {
         return error;
       }
@@ -757,8 +886,9 @@ DisplayError ResManager::PostCommit(Handle display_ctx, HWLayers *hw_layers) {
     if (rotate->valid) {
       HWBufferInfo *rot_buf_info = &rotate->hw_buffer_info;
 
-      error = buffer_manager->SetReleaseFd(rot_buf_info->slot,
-                                                rot_buf_info->output_buffer.release_fence_fd);
+      error = buffer_manager->SetReleaseFence(rot_buf_info->slot,
+                                              rot_buf_info->output_buffer.release_fence);
+      rot_buf_info->output_buffer.release_fence = NULL;
       if (error != kErrorNone) {
         return error;
       }
@@ -775,11 +905,14 @@ void ResManager::Purge(Handle display_ctx) {
                           reinterpret_cast<DisplayResourceContext *>(display_ctx);
   HWBlockType hw_block_id = display_resource_ctx->hw_block_id;
 
-  for (uint32_t i = 0; i < num_pipe_; i++) {
-    if (src_pipes_[i].hw_block_id == hw_block_id)
-      src_pipes_[i].ResetState();
+  uint32_t pipe_mask = hw_block_mask_[hw_block_id];
+  while (pipe_mask) {
+    uint32_t index = GetFirstPipe(pipe_mask);
+    CLEAR_BIT(pipe_mask, index);
+    ResetPipeState(index);
   }
   ClearRotator(display_resource_ctx);
+  display_resource_ctx->committed_valid = false;
 }
 
 uint32_t ResManager::GetMdssPipeId(PipeType type, uint32_t index) {
@@ -818,22 +951,16 @@ uint32_t ResManager::GetMdssPipeId(PipeType type, uint32_t index) {
   return (1 << mdss_id);
 }
 
-uint32_t ResManager::SearchPipe(HWBlockType hw_block_id, SourcePipe *src_pipes,
-                                uint32_t num_pipe, bool at_right) {
+uint32_t ResManager::SearchPipe(HWBlockType hw_block_id, uint32_t pipe_mask, bool at_right) {
   uint32_t index = kPipeIdMax;
-  SourcePipe *src_pipe;
-  HWBlockType dedicated_block;
+  uint32_t unreserved_mask = pipe_mask & reserved_mask_[kHWBlockMax];
+  uint32_t idle_mask = state_mask_[kPipeStateIdle];
+  uint32_t acquired_mask = state_mask_[kPipeStateAcquired] & hw_block_mask_[hw_block_id];
+  uint32_t side_mask = at_right ? at_right_mask_ : ~at_right_mask_;
+  uint32_t dedicated_mask = dedicated_mask_[hw_block_id] | dedicated_mask_[kHWBlockMax];
 
   // search dedicated idle pipes
-  for (uint32_t i = 0; i < num_pipe; i++) {
-    src_pipe = &src_pipes[i];
-    if (src_pipe->reserved_hw_block == kHWBlockMax &&
-        src_pipe->state == kPipeStateIdle &&
-        src_pipe->dedicated_hw_block == hw_block_id) {
-      index = src_pipe->index;
-      break;
-    }
-  }
+  index = GetFirstPipe(unreserved_mask & idle_mask & dedicated_mask_[hw_block_id]);
 
   // found
   if (index < num_pipe_) {
@@ -841,18 +968,7 @@ uint32_t ResManager::SearchPipe(HWBlockType hw_block_id, SourcePipe *src_pipes,
   }
 
   // search the pipe being used
-  for (uint32_t i = 0; i < num_pipe; i++) {
-    src_pipe = &src_pipes[i];
-    dedicated_block = src_pipe->dedicated_hw_block;
-    if (src_pipe->reserved_hw_block == kHWBlockMax &&
-        (src_pipe->state == kPipeStateAcquired) &&
-        (src_pipe->hw_block_id == hw_block_id) &&
-        (src_pipe->at_right == at_right) &&
-        (dedicated_block == hw_block_id || dedicated_block == kHWBlockMax)) {
-      index = src_pipe->index;
-      break;
-    }
-  }
+  index = GetFirstPipe(unreserved_mask & acquired_mask & side_mask & dedicated_mask);
 
   // found
   if (index < num_pipe_) {
@@ -860,41 +976,48 @@ uint32_t ResManager::SearchPipe(HWBlockType hw_block_id, SourcePipe *src_pipes,
   }
 
   // search the pipes idle or being used but not at the same side
-  for (uint32_t i = 0; i < num_pipe; i++) {
-    src_pipe = &src_pipes[i];
-    dedicated_block = src_pipe->dedicated_hw_block;
-    if (src_pipe->reserved_hw_block == kHWBlockMax &&
-        ((src_pipe->state == kPipeStateIdle) ||
-         (src_pipe->state == kPipeStateAcquired && src_pipe->hw_block_id == hw_block_id)) &&
-         (dedicated_block == hw_block_id || dedicated_block == kHWBlockMax)) {
-      index = src_pipe->index;
-      break;
-    }
-  }
-  return index;
+  return GetFirstPipe(unreserved_mask & (idle_mask | acquired_mask) & dedicated_mask);
 }
 
 uint32_t ResManager::NextPipe(PipeType type, HWBlockType hw_block_id, bool at_right) {
-  uint32_t num_pipe = 0;
-  SourcePipe *src_pipes = NULL;
+  return SearchPipe(hw_block_id, type_mask_[type], at_right);
+}
 
-  switch (type) {
-  case kPipeTypeVIG:
-    src_pipes = vig_pipes_;
-    num_pipe = hw_res_info_.num_vig_pipe;
-    break;
-  case kPipeTypeRGB:
-    src_pipes = rgb_pipes_;
-    num_pipe = hw_res_info_.num_rgb_pipe;
-    break;
-  case kPipeTypeDMA:
-  default:
-    src_pipes = dma_pipes_;
-    num_pipe = hw_res_info_.num_dma_pipe;
-    break;
+void ResManager::SetPipeState(uint32_t index, PipeState state) {
+  MovePipe(state_mask_, src_pipes_[index].state, state, index);
+  src_pipes_[index].state = state;
+}
+
+void ResManager::SetPipeHWBlock(uint32_t index, HWBlockType hw_block_id) {
+  MovePipe(hw_block_mask_, src_pipes_[index].hw_block_id, hw_block_id, index);
+  src_pipes_[index].hw_block_id = hw_block_id;
+}
+
+void ResManager::SetPipeReservedBlock(uint32_t index, HWBlockType hw_block_id) {
+  MovePipe(reserved_mask_, src_pipes_[index].reserved_hw_block, hw_block_id, index);
+  src_pipes_[index].reserved_hw_block = hw_block_id;
+}
+
+void ResManager::SetPipeDedicatedBlock(uint32_t index, HWBlockType hw_block_id) {
+  MovePipe(dedicated_mask_, src_pipes_[index].dedicated_hw_block, hw_block_id, index);
+  src_pipes_[index].dedicated_hw_block = hw_block_id;
+}
+
+void ResManager::SetPipeAtRight(uint32_t index, bool at_right) {
+  if (at_right) {
+    SET_BIT(at_right_mask_, index);
+  } else {
+    CLEAR_BIT(at_right_mask_, index);
   }
+  src_pipes_[index].at_right = at_right;
+}
 
-  return SearchPipe(hw_block_id, src_pipes, num_pipe, at_right);
+void ResManager::ResetPipeState(uint32_t index) {
+  SetPipeState(index, kPipeStateIdle);
+  SetPipeHWBlock(index, kHWBlockMax);
+  SetPipeAtRight(index, false);
+  SetPipeReservedBlock(index, kHWBlockMax);
+  SetPipeDedicatedBlock(index, kHWBlockMax);
 }
 
 uint32_t ResManager::GetPipe(HWBlockType hw_block_id, bool is_yuv, bool need_scale, bool at_right,
@@ -929,13 +1052,13 @@ bool ResManager::IsScalingNeeded(const HWPipeInfo *pipe_info) {
           ((dst_roi.bottom - dst_roi.top) != (src_roi.bottom - src_roi.top));
 }
 
-void ResManager::AppendDump(char *buffer, uint32_t length) {
+void ResManager::AppendDump(DumpBuilder *builder) {
   SCOPE_LOCK(locker_);
-  AppendString(buffer, length, "\nresource manager pipe state");
+  builder->AppendString("\nresource manager pipe state");
   uint32_t i;
   for (i = 0; i < num_pipe_; i++) {
     SourcePipe *src_pipe = &src_pipes_[i];
-    AppendString(buffer, length,
+    builder->AppendString(
                  "\nindex = %d, id = %x, reserved = %d, state = %d, hw_block = %d, dedicated = %d",
                  src_pipe->index, src_pipe->mdss_pipe_id, src_pipe->reserved_hw_block,
                  src_pipe->state, src_pipe->hw_block_id, src_pipe->dedicated_hw_block);
@@ -943,12 +1066,57 @@ void ResManager::AppendDump(char *buffer, uint32_t length) {
 
   for (i = 0; i < hw_res_info_.num_rotator; i++) {
     if (rotators_[i].client_bit_mask || rotators_[i].request_bit_mask) {
-      AppendString(buffer, length,
+      builder->AppendString(
                    "\nrotator = %d, pipe index = %x, client_bit_mask = %x, request_bit_mask = %x",
                    i, rotators_[i].pipe_index, rotators_[i].client_bit_mask,
                    rotators_[i].request_bit_mask);
     }
   }
+
+  for (i = 0; i < kHWBlockMax; i++) {
+    DisplayResourceContext *display_resource_ctx = display_ctx_list_[i];
+    if (display_resource_ctx) {
+      builder->AppendString("\nrotator buffers of display = %d",
+                            display_resource_ctx->display_type);
+      display_resource_ctx->buffer_manager->AppendDump(builder);
+    }
+  }
+}
+
+void ResManager::AppendCompactDump(DumpBuilder *builder) {
+  SCOPE_LOCK(locker_);
+  builder->BeginSection("resource_manager");
+  uint32_t i;
+  for (i = 0; i < num_pipe_; i++) {
+    SourcePipe *src_pipe = &src_pipes_[i];
+    builder->BeginSection("pipe", src_pipe->index);
+    builder->Add("id", "%x", src_pipe->mdss_pipe_id);
+    builder->Add("reserved", "%d", src_pipe->reserved_hw_block);
+    builder->Add("state", "%d", src_pipe->state);
+    builder->Add("hw_block", "%d", src_pipe->hw_block_id);
+    builder->Add("dedicated", "%d", src_pipe->dedicated_hw_block);
+    builder->EndSection();
+  }
+
+  for (i = 0; i < hw_res_info_.num_rotator; i++) {
+    if (rotators_[i].client_bit_mask || rotators_[i].request_bit_mask) {
+      builder->BeginSection("rotator", i);
+      builder->Add("pipe_index", "%x", rotators_[i].pipe_index);
+      builder->Add("client_bit_mask", "%x", rotators_[i].client_bit_mask);
+      builder->Add("request_bit_mask", "%x", rotators_[i].request_bit_mask);
+      builder->EndSection();
+    }
+  }
+
+  for (i = 0; i < kHWBlockMax; i++) {
+    DisplayResourceContext *display_resource_ctx = display_ctx_list_[i];
+    if (display_resource_ctx) {
+      builder->BeginSection("rotator_buffers", display_resource_ctx->display_type);
+      display_resource_ctx->buffer_manager->AppendCompactDump(builder);
+      builder->EndSection();
+    }
+  }
+  builder->EndSection();
 }
 
 DisplayError ResManager::AcquireRotator(DisplayResourceContext *display_resource_ctx,
@@ -972,7 +1140,7 @@ DisplayError ResManager::AcquireRotator(DisplayResourceContext *display_resource
 
     if (src_pipe->dedicated_hw_block != kHWBlockMax)
       DLOGV_IF(kTagResources, "Overwrite dedicated block %d", src_pipe->dedicated_hw_block);
-    src_pipe->dedicated_hw_block = rotators_[i].writeback_id;
+    SetPipeDedicatedBlock(rotate_pipe_index, rotators_[i].writeback_id);
     SET_BIT(rotators_[i].request_bit_mask, display_resource_ctx->hw_block_id);
   }
 
@@ -984,7 +1152,7 @@ DisplayError ResManager::AcquireRotator(DisplayResourceContext *display_resource
                src_pipes_[rotate_pipe_index].reserved_hw_block);
       return kErrorResources;
     }
-    pipe_index = SearchPipe(rotators_[i].writeback_id, &src_pipes_[rotate_pipe_index], 1, false);
+    pipe_index = SearchPipe(rotators_[i].writeback_id, UINT32(1 << rotate_pipe_index), false);
     if (pipe_index >= num_pipe_) {
       DLOGV_IF(kTagResources, "pipe %x is not ready for rotator",
                src_pipes_[rotate_pipe_index].mdss_pipe_id);
@@ -1021,9 +1189,9 @@ void ResManager::ClearRotator(DisplayResourceContext *display_resource_ctx) {
       continue;
 
     if (src_pipes_[pipe_index].hw_block_id == rotators_[i].writeback_id) {
-      src_pipes_[pipe_index].ResetState();
+      ResetPipeState(pipe_index);
     } else if (src_pipes_[pipe_index].dedicated_hw_block == rotators_[i].writeback_id) {
-      src_pipes_[pipe_index].dedicated_hw_block = kHWBlockMax;
+      SetPipeDedicatedBlock(pipe_index, kHWBlockMax);
     }
   }
 }
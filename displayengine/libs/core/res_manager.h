@@ -51,7 +51,11 @@ class ResManager : public DumpImpl {
   void Purge(Handle display_ctx);
 
   // DumpImpl method
-  virtual void AppendDump(char *buffer, uint32_t length);
+  virtual void AppendDump(DumpBuilder *builder);
+  virtual void AppendCompactDump(DumpBuilder *builder);
+
+  // Peak bandwidth of the pipes on one mixer which fetch on overlapping scan lines
+  static float GetOverlapBw(HWLayers *hw_layers, float *pipe_bw, bool left_mixer);
 
  private:
   enum PipeId {
@@ -81,6 +85,7 @@ class ResManager : public DumpImpl {
     kPipeStateAcquired,       // Pipe state after successful commit
     kPipeStateToRelease,      // Pipe state that can be moved to Idle when releasefence is signaled
     kPipeStateOwnedByKernel,  // Pipe state when pipe is owned by kernel
+    kPipeStateMax,
   };
 
   // todo: retrieve all these from kernel
@@ -107,9 +112,19 @@ class ResManager : public DumpImpl {
                    state(kPipeStateIdle), hw_block_id(kHWBlockMax), at_right(false),
                    state_frame_count(0), priority(0), reserved_hw_block(kHWBlockMax),
                    dedicated_hw_block(kHWBlockMax) { }
+  };
 
-    inline void ResetState() { state = kPipeStateIdle; hw_block_id = kHWBlockMax;
-        at_right = false; reserved_hw_block = kHWBlockMax; dedicated_hw_block = kHWBlockMax; }
+  // Bandwidth and clock requirement of a pipe, reused until any of the inputs changes
+  struct PipeBwInfo {
+    bool valid;
+    LayerRect src_roi;
+    LayerRect dst_roi;
+    float bpp;
+    uint8_t vertical_decimation;
+    float bw;
+    float clk;
+
+    PipeBwInfo() : valid(false), bpp(0.0f), vertical_decimation(0), bw(0.0f), clk(0.0f) { }
   };
 
   struct DisplayResourceContext {
@@ -121,9 +136,22 @@ class ResManager : public DumpImpl {
     int32_t session_id;  // applicable for virtual display sessions only
     uint32_t rotate_count;
     bool frame_start;
+    PipeBwInfo pipe_bw_info[kMaxSDELayers][2];  // left and right pipes of each hw layer
+    float display_bw;   // Bandwidth and clock of the last successful bandwidth check, which are
+    float display_clk;  // claimed only if the current drawing cycle gets prepared successfully
+    bool bw_pending;
+    // Layers programmed on hardware in the last committed frame. Partial update is possible only
+    // if the same layers are programmed again, as a layer which moves between SDE and GPU
+    // composition changes the GPU target outside of any dirty region.
+    bool committed_valid;
+    uint32_t committed_layer_count;
+    uint32_t committed_count;
+    uint32_t committed_index[kMaxSDELayers];
 
     DisplayResourceContext() : hw_block_id(kHWBlockMax), frame_count(0), session_id(-1),
-                    rotate_count(0), frame_start(false) { }
+                    rotate_count(0), frame_start(false), display_bw(0.0f), display_clk(0.0f),
+                    bw_pending(false), committed_valid(false), committed_layer_count(0),
+                    committed_count(0) { }
 
     ~DisplayResourceContext() {
       if (buffer_manager) {
@@ -154,16 +182,28 @@ class ResManager : public DumpImpl {
 
   uint32_t GetMdssPipeId(PipeType pipe_type, uint32_t index);
   uint32_t NextPipe(PipeType pipe_type, HWBlockType hw_block_id, bool at_right);
-  uint32_t SearchPipe(HWBlockType hw_block_id, SourcePipe *src_pipes, uint32_t num_pipe,
-                      bool at_right);
+  uint32_t SearchPipe(HWBlockType hw_block_id, uint32_t pipe_mask, bool at_right);
+  void SetPipeState(uint32_t index, PipeState state);
+  void SetPipeHWBlock(uint32_t index, HWBlockType hw_block_id);
+  void SetPipeReservedBlock(uint32_t index, HWBlockType hw_block_id);
+  void SetPipeDedicatedBlock(uint32_t index, HWBlockType hw_block_id);
+  void SetPipeAtRight(uint32_t index, bool at_right);
+  void ResetPipeState(uint32_t index);
   uint32_t GetPipe(HWBlockType hw_block_id, bool is_yuv, bool need_scale, bool at_right,
                    bool use_non_dma_pipe);
   bool IsScalingNeeded(const HWPipeInfo *pipe_info);
   DisplayError Config(DisplayResourceContext *display_resource_ctx, HWLayers *hw_layers,
                       uint32_t *rotate_count);
+  void CalculatePartialUpdate(DisplayResourceContext *display_resource_ctx, HWLayers *hw_layers);
+  bool IsPartialUpdatePossible(DisplayResourceContext *display_resource_ctx,
+                               const HWLayersInfo &layer_info);
+  void GetLayerDirtyRect(const Layer &layer, LayerRect *dirty_rect);
+  void AlignPartialUpdate(const HWDisplayAttributes &display_attributes, const LayerRect &boundary,
+                          LayerRect *roi);
   DisplayError DisplaySplitConfig(DisplayResourceContext *display_resource_ctx,
                                   const LayerTransform &transform, const LayerRect &src_rect,
-                                  const LayerRect &dst_rect, HWLayerConfig *layer_config);
+                                  const LayerRect &dst_rect, const LayerRect &left_roi,
+                                  const LayerRect &right_roi, HWLayerConfig *layer_config);
   DisplayError ValidateScaling(const Layer &layer, const LayerRect &crop,
                                const LayerRect &dst, float *rot_scale_x, float *rot_scale_y);
   DisplayError SrcSplitConfig(DisplayResourceContext *display_resource_ctx,
@@ -177,7 +217,9 @@ class ResManager : public DumpImpl {
   bool CheckBandwidth(DisplayResourceContext *display_ctx, HWLayers *hw_layers);
   float GetPipeBw(DisplayResourceContext *display_ctx, HWPipeInfo *pipe, float bpp);
   float GetClockForPipe(DisplayResourceContext *display_ctx, HWPipeInfo *pipe);
-  float GetOverlapBw(HWLayers *hw_layers, float *pipe_bw, bool left_mixer);
+  void GetPipeBwInfo(DisplayResourceContext *display_ctx, HWPipeInfo *pipe, float bpp,
+                     PipeBwInfo *bw_info);
+  void ClaimBandwidth(DisplayResourceContext *display_ctx);
   DisplayError SetDecimationFactor(HWPipeInfo *pipe);
   float GetBpp(LayerBufferFormat format);
   void SplitRect(bool flip_horizontal, const LayerRect &src_rect, const LayerRect &dst_rect,
@@ -197,9 +239,20 @@ class ResManager : public DumpImpl {
   void ClearRotator(DisplayResourceContext *display_resource_ctx);
   void NormalizeRect(const uint32_t &factor, LayerRect *rect);
   DisplayError AllocRotatorBuffer(Handle display_ctx, HWLayers *hw_layers);
+  uint64_t GetRotateContentKey(const Layer &layer, const HWRotateInfo &rotate);
   void SetRotatorOutputFormat(const LayerBufferFormat &input_format, bool bwc, bool rot90,
                               LayerBufferFormat *output_format);
 
+  // Returns the highest priority pipe index in the mask, i.e. the lowest set bit
+  inline uint32_t GetFirstPipe(uint32_t pipe_mask) {
+    return pipe_mask ? UINT32(__builtin_ctz(pipe_mask)) : kPipeIdMax;
+  }
+
+  inline void MovePipe(uint32_t *pipe_masks, uint32_t from, uint32_t to, uint32_t index) {
+    CLEAR_BIT(pipe_masks[from], index);
+    SET_BIT(pipe_masks[to], index);
+  }
+
   template <class T>
   inline void Swap(T &a, T &b) {
     T c(a);
@@ -221,11 +274,20 @@ class ResManager : public DumpImpl {
   Locker locker_;
   HWResourceInfo hw_res_info_;
   HWBlockContext hw_block_ctx_[kHWBlockMax];
+  DisplayResourceContext *display_ctx_list_[kHWBlockMax];  // Registered displays, for dump
   SourcePipe src_pipes_[kPipeIdMax];
   uint32_t num_pipe_;
   SourcePipe *vig_pipes_;
   SourcePipe *rgb_pipes_;
   SourcePipe *dma_pipes_;
+  // Bit masks of source pipe indexes, kept in sync with the fields of each source pipe. Masks of
+  // hw blocks are indexed by the block id, where kHWBlockMax stands for no block.
+  uint32_t type_mask_[kPipeTypeMax];
+  uint32_t state_mask_[kPipeStateMax];
+  uint32_t hw_block_mask_[kHWBlockMax + 1];
+  uint32_t reserved_mask_[kHWBlockMax + 1];
+  uint32_t dedicated_mask_[kHWBlockMax + 1];
+  uint32_t at_right_mask_;
   bool frame_start_;
   float bw_claimed_;  // Bandwidth claimed by other display
   float clk_claimed_;  // Clock claimed by other display
@@ -31,7 +31,17 @@
 
 namespace sde {
 
-StrategyDefault::StrategyDefault() : hw_layers_info_(NULL) {
+static bool IsVideoLayer(const Layer &layer) {
+  return (layer.input_buffer && layer.input_buffer->flags.video);
+}
+
+static bool IsUpdatingLayer(const Layer &layer) {
+  return layer.flags.updating;
+}
+
+StrategyDefault::StrategyDefault()
+  : hw_layers_info_(NULL), next_strategy_(kStrategyMax), gpu_target_index_(0),
+    app_layer_count_(0) {
 }
 
 DisplayError StrategyDefault::CreateStrategyInterface(uint16_t version, DisplayType type,
@@ -64,8 +74,26 @@ DisplayError StrategyDefault::Start(HWLayersInfo *hw_layers_info, uint32_t *max_
     return kErrorParameters;
   }
 
+  LayerStack *layer_stack = hw_layers_info->stack;
+  uint32_t gpu_target_count = 0;
+
+  gpu_target_index_ = layer_stack->layer_count;
+  for (uint32_t i = 0; i < layer_stack->layer_count; i++) {
+    if (layer_stack->layers[i].composition == kCompositionGPUTarget) {
+      gpu_target_index_ = i;
+      gpu_target_count++;
+    }
+  }
+
+  // There can be at most one GPU target buffer.
+  if (gpu_target_count > 1) {
+    return kErrorParameters;
+  }
+
   hw_layers_info_ = hw_layers_info;
-  *max_attempts = 1;
+  app_layer_count_ = layer_stack->layer_count - gpu_target_count;
+  next_strategy_ = kStrategyFullSDE;
+  *max_attempts = kStrategyMax;
 
   return kErrorNone;
 }
@@ -75,27 +103,169 @@ DisplayError StrategyDefault::Stop() {
 }
 
 DisplayError StrategyDefault::GetNextStrategy(StrategyConstraints *constraints) {
-  // Mark all layers for GPU composition. Find GPU target buffer and store its index for programming
-  // the hardware.
+  bool found = false;
+
+  // In safe mode, only try the strategies which need minimum number of pipes.
+  while (!found && next_strategy_ < kStrategyMax) {
+    switch (next_strategy_++) {
+    case kStrategyFullSDE:
+      found = !constraints->safe_mode && !constraints->idle_mode &&
+              FullSDEComposition(*constraints);
+      break;
+    case kStrategyVideoOnly:
+      found = VideoOnlyComposition(*constraints);
+      break;
+    case kStrategyCachedGPU:
+      found = !constraints->safe_mode && CachedGPUComposition(*constraints);
+      break;
+    case kStrategyGPUOnly:
+      found = GPUOnlyComposition(*constraints);
+      break;
+    default:
+      break;
+    }
+  }
+
+  if (!found) {
+    return kErrorUndefined;
+  }
+
+  DLOGV_IF(kTagStrategy, "Strategy = %d, hw layer count = %d, safe mode = %d, idle mode = %d",
+           next_strategy_ - 1, hw_layers_info_->count, constraints->safe_mode,
+           constraints->idle_mode);
+
+  return kErrorNone;
+}
+
+bool StrategyDefault::FullSDEComposition(const StrategyConstraints &constraints) {
   LayerStack *layer_stack = hw_layers_info_->stack;
   uint32_t &hw_layer_count = hw_layers_info_->count;
 
+  if (!app_layer_count_ || layer_stack->flags.skip_present ||
+      app_layer_count_ > constraints.max_layers || app_layer_count_ > UINT32(kMaxSDELayers)) {
+    return false;
+  }
+
   hw_layer_count = 0;
   for (uint32_t i = 0; i < layer_stack->layer_count; i++) {
-    LayerComposition &composition = layer_stack->layers[i].composition;
-    if (composition != kCompositionGPUTarget) {
-      composition = kCompositionGPU;
-    } else {
+    Layer &layer = layer_stack->layers[i];
+    if (i == gpu_target_index_) {
+      continue;
+    }
+
+    if (layer.flags.skip) {
+      return false;
+    }
+
+    layer.composition = kCompositionSDE;
+    hw_layers_info_->index[hw_layer_count++] = i;
+  }
+
+  return true;
+}
+
+bool StrategyDefault::VideoOnlyComposition(const StrategyConstraints &constraints) {
+  if (!hw_layers_info_->stack->flags.video_present) {
+    return false;
+  }
+
+  return MixedComposition(constraints, IsVideoLayer);
+}
+
+bool StrategyDefault::CachedGPUComposition(const StrategyConstraints &constraints) {
+  return MixedComposition(constraints, IsUpdatingLayer);
+}
+
+bool StrategyDefault::GPUOnlyComposition(const StrategyConstraints &constraints) {
+  LayerStack *layer_stack = hw_layers_info_->stack;
+  uint32_t &hw_layer_count = hw_layers_info_->count;
+
+  // Mark all layers for GPU composition and program only the GPU target buffer on hardware.
+  if (gpu_target_index_ >= layer_stack->layer_count) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < layer_stack->layer_count; i++) {
+    if (i != gpu_target_index_) {
+      layer_stack->layers[i].composition = kCompositionGPU;
+    }
+  }
+
+  hw_layer_count = 0;
+  hw_layers_info_->index[hw_layer_count++] = gpu_target_index_;
+
+  return true;
+}
+
+bool StrategyDefault::MixedComposition(const StrategyConstraints &constraints,
+                                       bool (*is_sde_layer)(const Layer &layer)) {
+  LayerStack *layer_stack = hw_layers_info_->stack;
+  uint32_t &hw_layer_count = hw_layers_info_->count;
+  uint32_t layer_count = layer_stack->layer_count;
+
+  if (gpu_target_index_ >= layer_count) {
+    return false;
+  }
+
+  // GPU target buffer is blended as a single layer, so all the layers lying in between the bottom
+  // most and top most GPU layers need to be composed by GPU as well.
+  uint32_t gpu_start = layer_count;
+  uint32_t gpu_end = 0;
+  for (uint32_t i = 0; i < layer_count; i++) {
+    Layer &layer = layer_stack->layers[i];
+    if (i != gpu_target_index_ && (layer.flags.skip || !is_sde_layer(layer))) {
+      gpu_start = MIN(gpu_start, i);
+      gpu_end = MAX(gpu_end, i);
+    }
+  }
+
+  // No layers for GPU composition, this is same as full SDE composition.
+  if (gpu_start == layer_count) {
+    return false;
+  }
+
+  uint32_t sde_layer_count = 0;
+  for (uint32_t i = 0; i < layer_count; i++) {
+    if (i != gpu_target_index_ && (i < gpu_start || i > gpu_end)) {
+      sde_layer_count++;
+    }
+  }
+
+  // No layers for SDE composition, this is same as GPU only composition.
+  if (!sde_layer_count) {
+    return false;
+  }
+
+  if ((sde_layer_count + 1) > constraints.max_layers ||
+      (sde_layer_count + 1) > UINT32(kMaxSDELayers)) {
+    return false;
+  }
+
+  // Program layers below GPU target, GPU target and layers above GPU target in z-order.
+  hw_layer_count = 0;
+  for (uint32_t i = 0; i < gpu_start; i++) {
+    if (i != gpu_target_index_) {
+      layer_stack->layers[i].composition = kCompositionSDE;
       hw_layers_info_->index[hw_layer_count++] = i;
     }
   }
 
-  // There can be one and only one GPU target buffer.
-  if (hw_layer_count != 1) {
-    return kErrorParameters;
+  for (uint32_t i = gpu_start; i <= gpu_end; i++) {
+    if (i != gpu_target_index_) {
+      layer_stack->layers[i].composition = kCompositionGPU;
+    }
   }
 
-  return kErrorNone;
+  hw_layers_info_->index[hw_layer_count++] = gpu_target_index_;
+
+  for (uint32_t i = gpu_end + 1; i < layer_count; i++) {
+    if (i != gpu_target_index_) {
+      layer_stack->layers[i].composition = kCompositionSDE;
+      hw_layers_info_->index[hw_layer_count++] = i;
+    }
+  }
+
+  return true;
 }
 
 }  // namespace sde
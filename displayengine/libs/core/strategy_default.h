@@ -43,7 +43,26 @@ class StrategyDefault : public StrategyInterface {
   virtual DisplayError Stop();
 
  private:
+  // Composition candidates in the order of preference. Each failed attempt moves to the next one.
+  enum StrategyType {
+    kStrategyFullSDE,     // All app layers are composed by SDE.
+    kStrategyVideoOnly,   // Video layers are composed by SDE, rest by GPU.
+    kStrategyCachedGPU,   // Updating layers are composed by SDE, non-updating layers by GPU.
+    kStrategyGPUOnly,     // All app layers are composed by GPU.
+    kStrategyMax,
+  };
+
+  bool FullSDEComposition(const StrategyConstraints &constraints);
+  bool VideoOnlyComposition(const StrategyConstraints &constraints);
+  bool CachedGPUComposition(const StrategyConstraints &constraints);
+  bool GPUOnlyComposition(const StrategyConstraints &constraints);
+  bool MixedComposition(const StrategyConstraints &constraints,
+                        bool (*is_sde_layer)(const Layer &layer));
+
   HWLayersInfo *hw_layers_info_;
+  uint32_t next_strategy_;
+  uint32_t gpu_target_index_;
+  uint32_t app_layer_count_;
 };
 
 }  // namespace sde
@@ -0,0 +1,63 @@
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE                  := sde_overlap_bw_test
+LOCAL_VENDOR_MODULE           := true
+LOCAL_MODULE_TAGS             := optional
+LOCAL_C_INCLUDES              := hardware/qcom/display/displayengine/include/
+LOCAL_CFLAGS                  := -Wno-missing-field-initializers -Wno-unused-parameter \
+                                 -Wconversion -Wall -Werror -Wno-vla \
+                                 -DLOG_TAG=\"SDE\"
+LOCAL_HEADER_LIBRARIES        := generated_kernel_headers
+LOCAL_SHARED_LIBRARIES        := libsde libsdeutils
+LOCAL_SRC_FILES               := overlap_bw_test.cpp
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE                  := sde_pipe_alloc_benchmark
+LOCAL_VENDOR_MODULE           := true
+LOCAL_MODULE_TAGS             := optional
+LOCAL_C_INCLUDES              := hardware/qcom/display/displayengine/include/
+LOCAL_CFLAGS                  := -Wno-missing-field-initializers -Wno-unused-parameter \
+                                 -Wconversion -Wall -Werror \
+                                 -DLOG_TAG=\"SDE\"
+LOCAL_HEADER_LIBRARIES        := generated_kernel_headers
+LOCAL_SHARED_LIBRARIES        := libsde libsdeutils
+LOCAL_SRC_FILES               := pipe_alloc_benchmark.cpp
+
+include $(BUILD_EXECUTABLE)
+
+ifeq ($(TARGET_USES_SDE_VIRTUAL_DRIVER),true)
+include $(CLEAR_VARS)
+
+LOCAL_MODULE                  := sde_frame_replay_benchmark
+LOCAL_VENDOR_MODULE           := true
+LOCAL_MODULE_TAGS             := optional
+LOCAL_C_INCLUDES              := hardware/qcom/display/displayengine/include/
+LOCAL_CFLAGS                  := -Wno-missing-field-initializers -Wno-unused-parameter \
+                                 -Wconversion -Wall -Werror \
+                                 -DLOG_TAG=\"SDE\"
+LOCAL_SHARED_LIBRARIES        := libsde libsdeutils
+LOCAL_SRC_FILES               := frame_replay_benchmark.cpp \
+                                 benchmark_utils.cpp
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE                  := sde_prepare_overlap_benchmark
+LOCAL_VENDOR_MODULE           := true
+LOCAL_MODULE_TAGS             := optional
+LOCAL_C_INCLUDES              := hardware/qcom/display/displayengine/include/
+LOCAL_CFLAGS                  := -Wno-missing-field-initializers -Wno-unused-parameter \
+                                 -Wconversion -Wall -Werror \
+                                 -DLOG_TAG=\"SDE\"
+LOCAL_SHARED_LIBRARIES        := libsde libsdeutils
+LOCAL_SRC_FILES               := prepare_overlap_benchmark.cpp \
+                                 benchmark_utils.cpp
+
+include $(BUILD_EXECUTABLE)
+endif
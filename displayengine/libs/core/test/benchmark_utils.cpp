@@ -0,0 +1,172 @@
+/*
+* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*  * Redistributions of source code must retain the above copyright
+*    notice, this list of conditions and the following disclaimer.
+*  * Redistributions in binary form must reproduce the above
+*    copyright notice, this list of conditions and the following
+*    disclaimer in the documentation and/or other materials provided
+*    with the distribution.
+*  * Neither the name of The Linux Foundation nor the names of its
+*    contributors may be used to endorse or promote products derived
+*    from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <utils/constants.h>
+
+#include "benchmark_utils.h"
+
+namespace sde {
+
+void BenchmarkDebugHandler::Error(DebugTag /*tag*/, const char *format, ...) {
+  va_list list;
+  va_start(list, format);
+  vfprintf(stderr, format, list);
+  va_end(list);
+  fputc('\n', stderr);
+}
+
+void BenchmarkDebugHandler::Warning(DebugTag /*tag*/, const char */*format*/, ...) {
+}
+
+void BenchmarkDebugHandler::Info(DebugTag /*tag*/, const char */*format*/, ...) {
+}
+
+void BenchmarkDebugHandler::Verbose(DebugTag /*tag*/, const char */*format*/, ...) {
+}
+
+void BenchmarkDebugHandler::BeginTrace(const char */*class_name*/,
+                                       const char */*function_name*/,
+                                       const char */*custom_string*/) {
+}
+
+void BenchmarkDebugHandler::EndTrace() {
+}
+
+DisplayError BenchmarkBufferAllocator::AllocateBuffer(BufferInfo *buffer_info) {
+  const BufferConfig &config = buffer_info->buffer_config;
+  uint32_t size = config.width * config.height * 4 * config.buffer_count;
+
+  buffer_info->private_data = malloc(size);
+  if (!buffer_info->private_data) {
+    return kErrorMemory;
+  }
+  buffer_info->alloc_buffer_info.fd = -1;
+  buffer_info->alloc_buffer_info.stride = config.width * 4;
+  buffer_info->alloc_buffer_info.size = size;
+
+  return kErrorNone;
+}
+
+DisplayError BenchmarkBufferAllocator::FreeBuffer(BufferInfo *buffer_info) {
+  free(buffer_info->private_data);
+  buffer_info->private_data = NULL;
+
+  return kErrorNone;
+}
+
+DisplayError BenchmarkBufferSyncHandler::SyncWait(int /*fd*/) {
+  return kErrorNone;
+}
+
+DisplayError BenchmarkBufferSyncHandler::SyncCheck(int /*fd*/) {
+  return kErrorNone;
+}
+
+DisplayError BenchmarkBufferSyncHandler::SyncMerge(int /*fd1*/, int /*fd2*/, int *merged_fd) {
+  *merged_fd = -1;
+
+  return kErrorNone;
+}
+
+DisplayError BenchmarkEventHandler::Hotplug(const CoreEventHotplug &/*hotplug*/) {
+  return kErrorNone;
+}
+
+DisplayError BenchmarkEventHandler::VSync(const DisplayEventVSync &/*vsync*/) {
+  return kErrorNone;
+}
+
+DisplayError BenchmarkEventHandler::Refresh() {
+  return kErrorNone;
+}
+
+LayerRect GetBenchmarkLayerRect(const BenchmarkLayer &layer, uint32_t width, uint32_t height,
+                                float shift) {
+  return LayerRect(layer.left * FLOAT(width) + shift, layer.top * FLOAT(height),
+                   layer.right * FLOAT(width), layer.bottom * FLOAT(height));
+}
+
+void InitBenchmarkLayers(const BenchmarkScenario &scenario, uint32_t width, uint32_t height,
+                         Layer *layers, LayerBuffer (*buffers)[2]) {
+  for (uint32_t i = 0; i < scenario.count; i++) {
+    const BenchmarkLayer &benchmark_layer = scenario.layers[i];
+    Layer &layer = layers[i];
+
+    for (uint32_t j = 0; j < 2; j++) {
+      LayerBuffer &buffer = buffers[i][j];
+      buffer.width = width;
+      buffer.height = height;
+      buffer.format = benchmark_layer.format;
+      buffer.planes[0].fd = INT(i * 2 + j);
+      buffer.planes[0].stride = width * 4;
+      buffer.flags.video = benchmark_layer.video;
+    }
+
+    layer.input_buffer = &buffers[i][0];
+    layer.composition = (i == scenario.count - 1) ? kCompositionGPUTarget : kCompositionGPU;
+    layer.dst_rect = GetBenchmarkLayerRect(benchmark_layer, width, height, 0.0f);
+    layer.src_rect = layer.dst_rect;
+    layer.visible_regions.rect = &layer.dst_rect;
+    layer.visible_regions.count = 1;
+    layer.dirty_regions.rect = &layer.dst_rect;
+    layer.dirty_regions.count = 1;
+    layer.blending = benchmark_layer.blending;
+    layer.plane_alpha = 0xFF;
+    layer.frame_rate = 60;
+    layer.flags.updating = benchmark_layer.updating;
+  }
+}
+
+static int CompareInt64(const void *lhs, const void *rhs) {
+  int64_t left = *reinterpret_cast<const int64_t *>(lhs);
+  int64_t right = *reinterpret_cast<const int64_t *>(rhs);
+
+  return (left > right) - (left < right);
+}
+
+int64_t PrintStat(const char *label, int64_t *samples, uint32_t count) {
+  int64_t total = 0;
+
+  qsort(samples, count, sizeof(*samples), CompareInt64);
+  for (uint32_t i = 0; i < count; i++) {
+    total += samples[i];
+  }
+
+  printf("%s mean %7" PRId64 " ns  p50 %7" PRId64 " ns  p99 %7" PRId64 " ns  max %8" PRId64
+         " ns\n", label, total / count, samples[count / 2], samples[(count * 99) / 100],
+         samples[count - 1]);
+
+  return total / count;
+}
+
+}  // namespace sde
@@ -0,0 +1,108 @@
+/*
+* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*  * Redistributions of source code must retain the above copyright
+*    notice, this list of conditions and the following disclaimer.
+*  * Redistributions in binary form must reproduce the above
+*    copyright notice, this list of conditions and the following
+*    disclaimer in the documentation and/or other materials provided
+*    with the distribution.
+*  * Neither the name of The Linux Foundation nor the names of its
+*    contributors may be used to endorse or promote products derived
+*    from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __BENCHMARK_UTILS_H__
+#define __BENCHMARK_UTILS_H__
+
+#include <stdint.h>
+#include <core/buffer_allocator.h>
+#include <core/buffer_sync_handler.h>
+#include <core/core_interface.h>
+#include <core/debug_interface.h>
+
+namespace sde {
+
+// Helpers shared by the benchmarks which drive CoreInterface on top of the virtual MDSS driver.
+
+class BenchmarkDebugHandler : public DebugHandler {
+ public:
+  virtual void Error(DebugTag tag, const char *format, ...);
+  virtual void Warning(DebugTag tag, const char *format, ...);
+  virtual void Info(DebugTag tag, const char *format, ...);
+  virtual void Verbose(DebugTag tag, const char *format, ...);
+  virtual void BeginTrace(const char *class_name, const char *function_name,
+                          const char *custom_string);
+  virtual void EndTrace();
+};
+
+// Rotator output buffers are never read back by the virtual driver, so plain memory is enough.
+class BenchmarkBufferAllocator : public BufferAllocator {
+ public:
+  virtual DisplayError AllocateBuffer(BufferInfo *buffer_info);
+  virtual DisplayError FreeBuffer(BufferInfo *buffer_info);
+};
+
+// All fences of the virtual driver are -1, i.e. already signaled.
+class BenchmarkBufferSyncHandler : public BufferSyncHandler {
+ public:
+  virtual DisplayError SyncWait(int fd);
+  virtual DisplayError SyncCheck(int fd);
+  virtual DisplayError SyncMerge(int fd1, int fd2, int *merged_fd);
+};
+
+class BenchmarkEventHandler : public CoreEventHandler, public DisplayEventHandler {
+ public:
+  virtual DisplayError Hotplug(const CoreEventHotplug &hotplug);
+  virtual DisplayError VSync(const DisplayEventVSync &vsync);
+  virtual DisplayError Refresh();
+};
+
+static const uint32_t kMaxBenchmarkLayers = 16;
+
+struct BenchmarkLayer {
+  float left, top, right, bottom;   // Fraction of the display size.
+  LayerBufferFormat format;
+  LayerBlending blending;
+  bool updating;
+  bool video;
+};
+
+// Last layer of a scenario is the GPU target.
+struct BenchmarkScenario {
+  const char *name;
+  uint32_t count;
+  BenchmarkLayer layers[kMaxBenchmarkLayers];
+};
+
+// Returns the rectangle of the layer on a display of the given size, moved right by shift pixels.
+LayerRect GetBenchmarkLayerRect(const BenchmarkLayer &layer, uint32_t width, uint32_t height,
+                                float shift);
+
+// Sets up the layers of the scenario for a display of the given size. Each layer alternates
+// between its two buffers.
+void InitBenchmarkLayers(const BenchmarkScenario &scenario, uint32_t width, uint32_t height,
+                         Layer *layers, LayerBuffer (*buffers)[2]);
+
+// Sorts the samples and prints their mean, median, 99th percentile and maximum after the label.
+// Returns the mean.
+int64_t PrintStat(const char *label, int64_t *samples, uint32_t count);
+
+}  // namespace sde
+
+#endif  // __BENCHMARK_UTILS_H__
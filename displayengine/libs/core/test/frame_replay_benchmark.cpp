@@ -0,0 +1,268 @@
+/*
+* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*  * Redistributions of source code must retain the above copyright
+*    notice, this list of conditions and the following disclaimer.
+*  * Redistributions in binary form must reproduce the above
+*    copyright notice, this list of conditions and the following
+*    disclaimer in the documentation and/or other materials provided
+*    with the distribution.
+*  * Neither the name of The Linux Foundation nor the names of its
+*    contributors may be used to endorse or promote products derived
+*    from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Replays synthetic layer stacks through CoreInterface on top of the virtual MDSS driver and
+// reports the CPU time spent by the calling thread in DisplayInterface::Prepare() and Commit().
+//
+// Usage: setprop displaycore.virtualdriver 1
+//        sde_frame_replay_benchmark [frames] [hdmi] [geometry]
+//
+// Only the buffers of updating layers change between frames by default. With "geometry", every
+// frame is flagged as a geometry change so that the full strategy selection is measured.
+//
+// Panel and MDSS limits of the virtual driver can be changed through SDE_VIRTUAL_DRIVER.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <core/buffer_allocator.h>
+#include <core/buffer_sync_handler.h>
+#include <core/core_interface.h>
+#include <utils/constants.h>
+#include <utils/debug.h>
+
+#include "benchmark_utils.h"
+
+namespace sde {
+
+static const BenchmarkScenario kScenarios[] = {
+  { "homescreen", 5, {
+    { 0.0f, 0.0f, 1.0f, 1.0f, kFormatRGBX8888, kBlendingNone, false, false },
+    { 0.0f, 0.0f, 1.0f, 1.0f, kFormatRGBA8888, kBlendingPremultiplied, true, false },
+    { 0.0f, 0.0f, 1.0f, 0.04f, kFormatRGBA8888, kBlendingPremultiplied, false, false },
+    { 0.0f, 0.92f, 1.0f, 1.0f, kFormatRGBA8888, kBlendingPremultiplied, false, false },
+    { 0.0f, 0.0f, 1.0f, 1.0f, kFormatRGBA8888, kBlendingPremultiplied, true, false },
+  } },
+  { "video", 4, {
+    { 0.0f, 0.2f, 1.0f, 0.8f, kFormatYCbCr420SemiPlanarVenus, kBlendingNone, true, true },
+    { 0.0f, 0.0f, 1.0f, 0.04f, kFormatRGBA8888, kBlendingPremultiplied, false, false },
+    { 0.0f, 0.7f, 1.0f, 0.8f, kFormatRGBA8888, kBlendingPremultiplied, true, false },
+    { 0.0f, 0.0f, 1.0f, 1.0f, kFormatRGBA8888, kBlendingPremultiplied, true, false },
+  } },
+  { "game", 2, {
+    { 0.0f, 0.0f, 1.0f, 1.0f, kFormatRGBX8888, kBlendingNone, true, false },
+    { 0.0f, 0.0f, 1.0f, 1.0f, kFormatRGBA8888, kBlendingPremultiplied, true, false },
+  } },
+  { "overlapping", 13, {
+    { 0.0f, 0.0f, 1.0f, 1.0f, kFormatRGBX8888, kBlendingNone, false, false },
+    { 0.0f, 0.0f, 0.6f, 0.5f, kFormatRGBA8888, kBlendingPremultiplied, false, false },
+    { 0.4f, 0.0f, 1.0f, 0.5f, kFormatRGBA8888, kBlendingPremultiplied, true, false },
+    { 0.0f, 0.5f, 0.6f, 1.0f, kFormatRGBA8888, kBlendingPremultiplied, false, false },
+    { 0.4f, 0.5f, 1.0f, 1.0f, kFormatRGBA8888, kBlendingPremultiplied, true, false },
+    { 0.2f, 0.2f, 0.8f, 0.8f, kFormatRGBA8888, kBlendingCoverage, false, false },
+    { 0.1f, 0.1f, 0.3f, 0.3f, kFormatRGB565, kBlendingNone, true, false },
+    { 0.7f, 0.1f, 0.9f, 0.3f, kFormatRGBA8888, kBlendingPremultiplied, false, false },
+    { 0.1f, 0.7f, 0.3f, 0.9f, kFormatRGBA8888, kBlendingPremultiplied, true, false },
+    { 0.7f, 0.7f, 0.9f, 0.9f, kFormatRGBA8888, kBlendingPremultiplied, false, false },
+    { 0.0f, 0.0f, 1.0f, 0.04f, kFormatRGBA8888, kBlendingPremultiplied, false, false },
+    { 0.0f, 0.92f, 1.0f, 1.0f, kFormatRGBA8888, kBlendingPremultiplied, false, false },
+    { 0.0f, 0.0f, 1.0f, 1.0f, kFormatRGBA8888, kBlendingPremultiplied, true, false },
+  } },
+};
+
+struct ReplayDisplay {
+  const char *name;
+  DisplayType type;
+  DisplayInterface *display;
+  uint32_t width;
+  uint32_t height;
+};
+
+static const uint32_t kDefaultFrames = 2000;
+
+static int64_t GetThreadCpuTimeNs() {
+  struct timespec time_now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time_now);
+  return (int64_t(time_now.tv_sec) * 1000000000LL) + time_now.tv_nsec;
+}
+
+static DisplayError Replay(const ReplayDisplay &replay_display, const BenchmarkScenario &scenario,
+                           uint32_t frames, bool geometry, int64_t *prepare_ns,
+                           int64_t *commit_ns) {
+  Layer layers[kMaxBenchmarkLayers];
+  LayerBuffer buffers[kMaxBenchmarkLayers][2];
+  LayerStack layer_stack;
+
+  InitBenchmarkLayers(scenario, replay_display.width, replay_display.height, layers, buffers);
+
+  layer_stack.layers = layers;
+  layer_stack.layer_count = scenario.count;
+  layer_stack.flags.video_present = scenario.layers[0].video;
+
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    layer_stack.flags.geometry_changed = (geometry || !frame);
+
+    for (uint32_t i = 0; i < scenario.count; i++) {
+      Layer &layer = layers[i];
+
+      layer.change_mask = layer_stack.flags.geometry_changed ? kLayerChangeAll : 0;
+      if (frame && scenario.layers[i].updating) {
+        layer.input_buffer = &buffers[i][frame % 2];
+        layer.change_mask |= kLayerChangeBuffer;
+      }
+      if (layer.composition != kCompositionGPUTarget) {
+        layer.composition = kCompositionGPU;
+      }
+    }
+
+    int64_t start = GetThreadCpuTimeNs();
+    DisplayError error = replay_display.display->Prepare(&layer_stack);
+    int64_t end = GetThreadCpuTimeNs();
+    if (error != kErrorNone) {
+      fprintf(stderr, "Prepare failed on %s frame %u, error %d\n", scenario.name, frame, error);
+      return error;
+    }
+    prepare_ns[frame] = end - start;
+
+    start = end;
+    error = replay_display.display->Commit(&layer_stack);
+    end = GetThreadCpuTimeNs();
+    if (error != kErrorNone) {
+      fprintf(stderr, "Commit failed on %s frame %u, error %d\n", scenario.name, frame, error);
+      return error;
+    }
+    commit_ns[frame] = end - start;
+
+    if (layer_stack.retire_fence_fd >= 0) {
+      close(layer_stack.retire_fence_fd);
+      layer_stack.retire_fence_fd = -1;
+    }
+  }
+
+  return kErrorNone;
+}
+
+}  // namespace sde
+
+using namespace sde;
+
+int main(int argc, char **argv) {
+  BenchmarkDebugHandler debug_handler;
+  BenchmarkBufferAllocator buffer_allocator;
+  BenchmarkBufferSyncHandler buffer_sync_handler;
+  BenchmarkEventHandler event_handler;
+  CoreInterface *core_intf = NULL;
+  ReplayDisplay displays[] = {
+    { "primary", kPrimary, NULL, 0, 0 },
+    { "hdmi", kHDMI, NULL, 0, 0 },
+  };
+  uint32_t num_displays = 1;
+  uint32_t frames = kDefaultFrames;
+  bool geometry = false;
+  int status = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "hdmi")) {
+      num_displays = 2;
+    } else if (!strcmp(argv[i], "geometry")) {
+      geometry = true;
+    } else {
+      frames = UINT32(atoi(argv[i]));
+    }
+  }
+
+  if (!frames) {
+    fprintf(stderr, "Usage: %s [frames] [hdmi] [geometry]\n", argv[0]);
+    return -1;
+  }
+
+  if (!Debug::IsVirtualDriver()) {
+    fprintf(stderr, "displaycore.virtualdriver is not set, refusing to drive MDSS hardware\n");
+    return -1;
+  }
+
+  DisplayError error = CoreInterface::CreateCore(&event_handler, &debug_handler,
+                                                 &buffer_allocator, &buffer_sync_handler,
+                                                 &core_intf);
+  if (error != kErrorNone) {
+    fprintf(stderr, "CreateCore failed, error %d\n", error);
+    return -1;
+  }
+
+  int64_t *prepare_ns = new int64_t[frames];
+  int64_t *commit_ns = new int64_t[frames];
+
+  for (uint32_t i = 0; i < num_displays && !status; i++) {
+    ReplayDisplay &replay_display = displays[i];
+    DisplayConfigVariableInfo variable_info;
+    uint32_t active_index = 0;
+
+    error = core_intf->CreateDisplay(replay_display.type, &event_handler,
+                                     &replay_display.display);
+    if (error != kErrorNone) {
+      fprintf(stderr, "CreateDisplay %s failed, error %d\n", replay_display.name, error);
+      status = -1;
+      break;
+    }
+
+    replay_display.display->GetActiveConfig(&active_index);
+    replay_display.display->GetConfig(active_index, &variable_info);
+    replay_display.width = variable_info.x_pixels;
+    replay_display.height = variable_info.y_pixels;
+
+    error = replay_display.display->SetDisplayState(kStateOn);
+    if (error != kErrorNone) {
+      fprintf(stderr, "SetDisplayState %s failed, error %d\n", replay_display.name, error);
+      status = -1;
+      break;
+    }
+
+    for (uint32_t j = 0; j < sizeof(kScenarios) / sizeof(kScenarios[0]); j++) {
+      error = Replay(replay_display, kScenarios[j], frames, geometry, prepare_ns, commit_ns);
+      if (error != kErrorNone) {
+        status = -1;
+        break;
+      }
+
+      char label[64];
+      snprintf(label, sizeof(label), "%-8s %-12s %-8s", replay_display.name, kScenarios[j].name,
+               "prepare");
+      PrintStat(label, prepare_ns, frames);
+      snprintf(label, sizeof(label), "%-8s %-12s %-8s", replay_display.name, kScenarios[j].name,
+               "commit");
+      PrintStat(label, commit_ns, frames);
+    }
+  }
+
+  for (uint32_t i = 0; i < num_displays; i++) {
+    if (displays[i].display) {
+      displays[i].display->SetDisplayState(kStateOff);
+      core_intf->DestroyDisplay(displays[i].display);
+    }
+  }
+
+  delete[] prepare_ns;
+  delete[] commit_ns;
+
+  CoreInterface::DestroyCore();
+
+  return status;
+}
@@ -0,0 +1,209 @@
+/*
+* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*  * Redistributions of source code must retain the above copyright
+*    notice, this list of conditions and the following disclaimer.
+*  * Redistributions in binary form must reproduce the above
+*    copyright notice, this list of conditions and the following
+*    disclaimer in the documentation and/or other materials provided
+*    with the distribution.
+*  * Neither the name of The Linux Foundation nor the names of its
+*    contributors may be used to endorse or promote products derived
+*    from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Compares ResManager::GetOverlapBw() against the original 2D array implementation on random
+// mixer configurations, and reports the time taken by both of them.
+//
+// Usage: sde_overlap_bw_test [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <utils/clock.h>
+#include <utils/constants.h>
+
+#include "../res_manager.h"
+
+namespace sde {
+
+static const uint32_t kDefaultIterations = 200000;
+
+// Original implementation, kept verbatim apart from being a free function.
+static float GetOverlapBwReference(HWLayers *hw_layers, float *pipe_bw, bool left_mixer) {
+  uint32_t count = hw_layers->info.count;
+  float overlap_bw[count][count];
+  float overall_max = 0;
+
+  memset(overlap_bw, 0, sizeof(overlap_bw));
+
+  for (uint32_t i = 0; i < count; i++) {
+    HWPipeInfo &pipe1 = left_mixer ? hw_layers->config[i].left_pipe :
+                        hw_layers->config[i].right_pipe;
+
+    // Non existing pipe never overlaps
+    if (pipe_bw[i] == 0)
+      continue;
+
+    float top1 = pipe1.dst_roi.top;
+    float bottom1 = pipe1.dst_roi.bottom;
+    float row_max = 0;
+
+    for (uint32_t j = 0; j <= i; j++) {
+      HWPipeInfo &pipe2 = left_mixer ? hw_layers->config[j].left_pipe :
+                          hw_layers->config[j].right_pipe;
+
+      if ((pipe_bw[j] == 0) || (i == j)) {
+        overlap_bw[i][j] = pipe_bw[j];
+        row_max = MAX(pipe_bw[j], row_max);
+        continue;
+      }
+
+      float top2 = pipe2.dst_roi.top;
+      float bottom2 = pipe2.dst_roi.bottom;
+
+      if ((bottom1 <= top2) || (top1 >= bottom2)) {
+        overlap_bw[i][j] = 0;
+        continue;
+      }
+
+      overlap_bw[i][j] = pipe_bw[i] + pipe_bw[j];
+
+      float prev_max = 0;
+      for (uint32_t k = 0; k < j; k++) {
+        if (overlap_bw[j][k])
+          prev_max = MAX(overlap_bw[j][k], prev_max);
+      }
+      overlap_bw[i][j] += (prev_max > 0) ? (prev_max - pipe_bw[j]) : 0;
+      row_max = MAX(overlap_bw[i][j], row_max);
+    }
+
+    overall_max = MAX(row_max, overall_max);
+  }
+
+  return overall_max;
+}
+
+static uint32_t NextRandom(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+// Dst rects are snapped to a coarse grid so that rects which touch, nest or share an edge are
+// frequent. About a quarter of the pipes are absent, as they are for layers which lie on the other
+// mixer.
+static void FillMixers(uint32_t *state, HWLayers *hw_layers, float *left_bw, float *right_bw) {
+  const uint32_t grid = 8;
+  const float line_step = 240.0f;
+
+  hw_layers->info.count = 1 + (NextRandom(state) % kMaxSDELayers);
+  for (uint32_t i = 0; i < hw_layers->info.count; i++) {
+    HWPipeInfo *pipes[] = { &hw_layers->config[i].left_pipe, &hw_layers->config[i].right_pipe };
+    float *pipe_bw[] = { &left_bw[i], &right_bw[i] };
+
+    for (uint32_t p = 0; p < 2; p++) {
+      uint32_t top = NextRandom(state) % grid;
+      uint32_t bottom = top + 1 + (NextRandom(state) % (grid - top));
+      pipes[p]->dst_roi.top = FLOAT(top) * line_step;
+      pipes[p]->dst_roi.bottom = FLOAT(bottom) * line_step;
+      if (NextRandom(state) % 4) {
+        *pipe_bw[p] = FLOAT(1 + NextRandom(state) % 4000) / 1000.0f;
+      } else {
+        *pipe_bw[p] = 0.0f;
+      }
+    }
+  }
+}
+
+static int64_t TimeOverlapBw(float (*get_overlap_bw)(HWLayers *, float *, bool),
+                             uint32_t iterations, float *checksum) {
+  HWLayers hw_layers;
+  float left_bw[kMaxSDELayers] = { 0 };
+  float right_bw[kMaxSDELayers] = { 0 };
+  uint32_t state = 0x2545f491;
+
+  int64_t total_ns = 0;
+  for (uint32_t i = 0; i < iterations; i++) {
+    FillMixers(&state, &hw_layers, left_bw, right_bw);
+    int64_t start_ns = GetMonotonicTimeNs();
+    *checksum += get_overlap_bw(&hw_layers, left_bw, true);
+    *checksum += get_overlap_bw(&hw_layers, right_bw, false);
+    total_ns += GetMonotonicTimeNs() - start_ns;
+  }
+
+  return total_ns;
+}
+
+static int Run(uint32_t iterations) {
+  HWLayers hw_layers;
+  float left_bw[kMaxSDELayers] = { 0 };
+  float right_bw[kMaxSDELayers] = { 0 };
+  uint32_t state = 0x9e3779b9;
+
+  for (uint32_t i = 0; i < iterations; i++) {
+    FillMixers(&state, &hw_layers, left_bw, right_bw);
+
+    for (uint32_t p = 0; p < 2; p++) {
+      bool left_mixer = (p == 0);
+      float *pipe_bw = left_mixer ? left_bw : right_bw;
+      float expected = GetOverlapBwReference(&hw_layers, pipe_bw, left_mixer);
+      float actual = ResManager::GetOverlapBw(&hw_layers, pipe_bw, left_mixer);
+
+      if (memcmp(&expected, &actual, sizeof(expected))) {
+        printf("FAIL iteration %u %s mixer: expected %f, got %f\n", i,
+               left_mixer ? "left" : "right", expected, actual);
+        for (uint32_t j = 0; j < hw_layers.info.count; j++) {
+          HWPipeInfo &pipe = left_mixer ? hw_layers.config[j].left_pipe :
+                             hw_layers.config[j].right_pipe;
+          printf("  pipe %u: top = %.0f, bottom = %.0f, bw = %f\n", j, pipe.dst_roi.top,
+                 pipe.dst_roi.bottom, pipe_bw[j]);
+        }
+        return 1;
+      }
+    }
+  }
+
+  float reference_checksum = 0;
+  float checksum = 0;
+  int64_t reference_ns = TimeOverlapBw(GetOverlapBwReference, iterations, &reference_checksum);
+  int64_t current_ns = TimeOverlapBw(ResManager::GetOverlapBw, iterations, &checksum);
+
+  printf("%u mixer pairs: original %.1f ns, current %.1f ns per pair (checksum %f %f)\n",
+         iterations, FLOAT(reference_ns) / FLOAT(iterations), FLOAT(current_ns) / FLOAT(iterations),
+         reference_checksum, checksum);
+  printf("PASS\n");
+
+  return 0;
+}
+
+}  // namespace sde
+
+int main(int argc, char **argv) {
+  uint32_t iterations = sde::kDefaultIterations;
+
+  if (argc > 1) {
+    iterations = UINT32(atoi(argv[1]));
+  }
+
+  return sde::Run(iterations);
+}
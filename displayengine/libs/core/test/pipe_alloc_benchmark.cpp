@@ -0,0 +1,220 @@
+/*
+* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*  * Redistributions of source code must retain the above copyright
+*    notice, this list of conditions and the following disclaimer.
+*  * Redistributions in binary form must reproduce the above
+*    copyright notice, this list of conditions and the following
+*    disclaimer in the documentation and/or other materials provided
+*    with the distribution.
+*  * Neither the name of The Linux Foundation nor the names of its
+*    contributors may be used to endorse or promote products derived
+*    from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Measures ResManager::Acquire() for a 16 layer stack on the primary and the external display.
+// Each frame searches for the largest bottom batch of layers which gets pipes, as the strategy
+// does when it has to fall back to GPU composition for the rest of the stack. So most of the calls
+// fail with all pipes of the display in use, which is the case the pipe masks have to be fast for.
+//
+// Usage: sde_pipe_alloc_benchmark [frames]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <utils/clock.h>
+#include <utils/constants.h>
+
+#include "../res_manager.h"
+
+namespace sde {
+
+static const uint32_t kDefaultFrames = 20000;
+static const uint32_t kStackLayers = 16;
+
+struct AllocDisplay {
+  const char *name;
+  DisplayType type;
+  uint32_t width;
+  uint32_t height;
+  bool split;
+  Handle ctx;
+  Layer layers[kStackLayers];
+  LayerStack stack;
+  HWLayers hw_layers;
+  int64_t acquire_ns;
+  uint32_t acquire_calls;
+  uint32_t acquired_layers;
+};
+
+// Full screen app and wallpaper, a 4x3 grid of widgets, status bar and navigation bar.
+static void SetupStack(AllocDisplay *display, LayerBuffer *input_buffer) {
+  const float width = FLOAT(display->width);
+  const float height = FLOAT(display->height);
+  const float tile_width = width / 4.0f;
+  const float tile_height = (height * 0.8f) / 3.0f;
+
+  for (uint32_t i = 0; i < kStackLayers; i++) {
+    Layer &layer = display->layers[i];
+    LayerRect &dst_rect = layer.dst_rect;
+
+    if (i < 2) {
+      dst_rect = LayerRect(0.0f, 0.0f, width, height);
+    } else if (i < 14) {
+      float column = FLOAT((i - 2) % 4);
+      float row = FLOAT((i - 2) / 4);
+      dst_rect = LayerRect(column * tile_width, (height * 0.1f) + (row * tile_height),
+                           (column + 1.0f) * tile_width,
+                           (height * 0.1f) + ((row + 1.0f) * tile_height));
+    } else if (i == 14) {
+      dst_rect = LayerRect(0.0f, 0.0f, width, height * 0.04f);
+    } else {
+      dst_rect = LayerRect(0.0f, height * 0.92f, width, height);
+    }
+
+    layer.input_buffer = input_buffer;
+    layer.composition = kCompositionSDE;
+    layer.src_rect = LayerRect(0.0f, 0.0f, dst_rect.right - dst_rect.left,
+                               dst_rect.bottom - dst_rect.top);
+    layer.blending = i ? kBlendingPremultiplied : kBlendingNone;
+    layer.plane_alpha = 0xFF;
+  }
+
+  display->stack.layers = display->layers;
+  display->stack.layer_count = kStackLayers;
+  display->hw_layers.info.stack = &display->stack;
+  for (uint32_t i = 0; i < kStackLayers; i++) {
+    display->hw_layers.info.index[i] = i;
+  }
+}
+
+static DisplayError RunFrame(ResManager *res_manager, AllocDisplay *display) {
+  HWLayers &hw_layers = display->hw_layers;
+  DisplayError error = kErrorResources;
+
+  res_manager->Start(display->ctx);
+
+  int64_t start_ns = GetMonotonicTimeNs();
+  for (uint32_t count = kStackLayers; count > 0; count--) {
+    hw_layers.info.count = count;
+    display->acquire_calls++;
+    error = res_manager->Acquire(display->ctx, &hw_layers);
+    if (error == kErrorNone) {
+      display->acquired_layers += count;
+      break;
+    }
+  }
+  display->acquire_ns += GetMonotonicTimeNs() - start_ns;
+
+  res_manager->Stop(display->ctx);
+
+  if (error == kErrorNone) {
+    res_manager->PostPrepare(display->ctx, &hw_layers);
+    res_manager->PostCommit(display->ctx, &hw_layers);
+  }
+
+  return error;
+}
+
+static int Run(uint32_t frames) {
+  AllocDisplay displays[] = {
+    { "primary", kPrimary, 2560, 1600, true },
+    { "external", kHDMI, 1920, 1080, false },
+  };
+  const uint32_t num_displays = sizeof(displays) / sizeof(displays[0]);
+
+  HWResourceInfo hw_res_info;
+  hw_res_info.num_vig_pipe = 4;
+  hw_res_info.num_rgb_pipe = 4;
+  hw_res_info.num_dma_pipe = 2;
+  hw_res_info.num_blending_stages = 7;
+  hw_res_info.max_scale_up = 20;
+  hw_res_info.max_scale_down = 4;
+  hw_res_info.max_mixer_width = 2048;
+  hw_res_info.max_bandwidth_low = 9600000;
+  hw_res_info.max_bandwidth_high = 9600000;
+  hw_res_info.max_pipe_bw = 4500000;
+  hw_res_info.max_sde_clk = 400000000;
+  hw_res_info.clk_fudge_factor = 1.05f;
+
+  // No layer is rotated, so the rotator buffers are never allocated.
+  ResManager res_manager;
+  if (res_manager.Init(hw_res_info, NULL, NULL) != kErrorNone) {
+    printf("FAIL ResManager::Init\n");
+    return 1;
+  }
+
+  LayerBuffer input_buffer;
+  input_buffer.width = 2560;
+  input_buffer.height = 1600;
+  input_buffer.format = kFormatRGBA8888;
+
+  for (uint32_t i = 0; i < num_displays; i++) {
+    AllocDisplay &display = displays[i];
+    HWDisplayAttributes attributes;
+    attributes.x_pixels = display.width;
+    attributes.y_pixels = display.height;
+    attributes.fps = 60.0f;
+    attributes.vsync_period_ns = 16666666;
+    attributes.v_total = display.height + 40;
+    attributes.is_device_split = display.split;
+    attributes.split_left = display.split ? (display.width / 2) : display.width;
+
+    if (res_manager.RegisterDisplay(display.type, attributes, &display.ctx) != kErrorNone) {
+      printf("FAIL ResManager::RegisterDisplay %s\n", display.name);
+      return 1;
+    }
+    SetupStack(&display, &input_buffer);
+    display.acquire_ns = 0;
+    display.acquire_calls = 0;
+    display.acquired_layers = 0;
+  }
+
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    for (uint32_t i = 0; i < num_displays; i++) {
+      if (RunFrame(&res_manager, &displays[i]) != kErrorNone) {
+        printf("FAIL %s got no pipes in frame %u\n", displays[i].name, frame);
+        return 1;
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < num_displays; i++) {
+    AllocDisplay &display = displays[i];
+    printf("%-8s: %u frames, %.1f layers on SDE, %.1f Acquire calls per frame, "
+           "%.0f ns per call, %.0f ns per frame\n", display.name, frames,
+           FLOAT(display.acquired_layers) / FLOAT(frames),
+           FLOAT(display.acquire_calls) / FLOAT(frames),
+           FLOAT(display.acquire_ns) / FLOAT(display.acquire_calls),
+           FLOAT(display.acquire_ns) / FLOAT(frames));
+    res_manager.UnregisterDisplay(display.ctx);
+  }
+
+  return 0;
+}
+
+}  // namespace sde
+
+int main(int argc, char **argv) {
+  uint32_t frames = sde::kDefaultFrames;
+
+  if (argc > 1) {
+    frames = UINT32(atoi(argv[1]));
+  }
+
+  return sde::Run(frames);
+}
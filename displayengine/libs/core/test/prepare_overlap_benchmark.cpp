@@ -0,0 +1,461 @@
+/*
+* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*  * Redistributions of source code must retain the above copyright
+*    notice, this list of conditions and the following disclaimer.
+*  * Redistributions in binary form must reproduce the above
+*    copyright notice, this list of conditions and the following
+*    disclaimer in the documentation and/or other materials provided
+*    with the distribution.
+*  * Neither the name of The Linux Foundation nor the names of its
+*    contributors may be used to endorse or promote products derived
+*    from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Measures the latency of preparing two and three displays in a draw cycle, on top of the virtual
+// MDSS driver. Displays are prepared one after another in the serial order of the HWC, i.e.
+// virtual, HDMI and then primary, or concurrently with the reservation order set through
+// CoreInterface::SetPrepareOrder(), the primary display on the calling thread and the others on
+// worker threads. Composition decisions of the concurrent run are checked against the serial run.
+//
+// Usage: setprop displaycore.virtualdriver 1
+//        SDE_VIRTUAL_DRIVER=validate_us=300 sde_prepare_overlap_benchmark [frames] [animation]
+//
+// Only the buffers of updating layers change between frames by default, so that the last decision
+// is reused and the driver validation is skipped. With "animation", updating layers also move every
+// frame, so that each frame goes through the full strategy selection and the driver validation,
+// whose latency is set through SDE_VIRTUAL_DRIVER.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <core/buffer_allocator.h>
+#include <core/buffer_sync_handler.h>
+#include <core/core_interface.h>
+#include <utils/clock.h>
+#include <utils/constants.h>
+#include <utils/debug.h>
+#include <utils/locker.h>
+
+#include "benchmark_utils.h"
+
+namespace sde {
+
+static const uint32_t kDefaultFrames = 1000;
+static const uint32_t kWarmupFrames = 10;
+static const uint32_t kMaxDisplays = 3;
+
+static const BenchmarkScenario kHomescreen = { "homescreen", 4, {
+  { 0.0f, 0.0f, 1.0f, 1.0f, kFormatRGBX8888, kBlendingNone, false, false },
+  { 0.25f, 0.25f, 0.75f, 0.75f, kFormatRGBA8888, kBlendingPremultiplied, true, false },
+  { 0.0f, 0.0f, 1.0f, 0.0625f, kFormatRGBA8888, kBlendingPremultiplied, false, false },
+  { 0.0f, 0.0f, 1.0f, 1.0f, kFormatRGBA8888, kBlendingPremultiplied, true, false },
+} };
+
+static const BenchmarkScenario kVideo = { "video", 3, {
+  { 0.0f, 0.0f, 1.0f, 1.0f, kFormatYCbCr420SemiPlanarVenus, kBlendingNone, true, true },
+  { 0.0f, 0.8f, 1.0f, 1.0f, kFormatRGBA8888, kBlendingPremultiplied, true, false },
+  { 0.0f, 0.0f, 1.0f, 1.0f, kFormatRGBA8888, kBlendingPremultiplied, true, false },
+} };
+
+struct BenchmarkDisplay {
+  const char *name;
+  DisplayType type;
+  const BenchmarkScenario *scenario;
+  DisplayInterface *display;
+  Layer layers[kMaxBenchmarkLayers];
+  LayerBuffer buffers[kMaxBenchmarkLayers][2];
+  LayerBuffer output_buffer;
+  LayerStack layer_stack;
+  uint32_t width;
+  uint32_t height;
+  DisplayError prepare_error;
+  LayerComposition *compositions;   // Composition of each layer of each frame
+};
+
+// Prepares a non-primary display concurrently with the primary display, like the prepare workers
+// of the HWC.
+struct PrepareWorker {
+  CoreInterface *core_intf;
+  BenchmarkDisplay *display;
+  pthread_t thread;
+  Locker locker;
+  bool pending;
+  bool exit;
+
+  PrepareWorker() : core_intf(NULL), display(NULL), pending(false), exit(false) { }
+};
+
+static void InitLayerStack(BenchmarkDisplay *display, uint32_t width, uint32_t height) {
+  const BenchmarkScenario &scenario = *display->scenario;
+  LayerStack &layer_stack = display->layer_stack;
+
+  display->width = width;
+  display->height = height;
+  InitBenchmarkLayers(scenario, width, height, display->layers, display->buffers);
+
+  display->output_buffer.width = width;
+  display->output_buffer.height = height;
+  display->output_buffer.format = kFormatRGBA8888;
+  display->output_buffer.planes[0].fd = -1;
+  display->output_buffer.planes[0].stride = width * 4;
+
+  layer_stack.layers = display->layers;
+  layer_stack.layer_count = scenario.count;
+  layer_stack.flags.video_present = scenario.layers[0].video;
+  layer_stack.output_buffer = (display->type == kVirtual) ? &display->output_buffer : NULL;
+}
+
+static void UpdateLayerStack(BenchmarkDisplay *display, uint32_t frame, bool animation) {
+  const BenchmarkScenario &scenario = *display->scenario;
+  LayerStack &layer_stack = display->layer_stack;
+
+  layer_stack.flags.geometry_changed = (animation || !frame);
+
+  for (uint32_t i = 0; i < scenario.count; i++) {
+    Layer &layer = display->layers[i];
+
+    layer.change_mask = frame ? 0 : kLayerChangeAll;
+    if (frame && scenario.layers[i].updating) {
+      layer.input_buffer = &display->buffers[i][frame % 2];
+      layer.change_mask |= kLayerChangeBuffer;
+    }
+    if (layer.composition != kCompositionGPUTarget) {
+      layer.composition = kCompositionGPU;
+
+      // Animated layers slide from left to right, one pixel per frame.
+      if (animation && scenario.layers[i].updating) {
+        layer.dst_rect = GetBenchmarkLayerRect(scenario.layers[i], display->width, display->height,
+                                               FLOAT(frame % 64));
+        layer.src_rect = layer.dst_rect;
+        layer.change_mask |= kLayerChangeSrcRect | kLayerChangeDstRect;
+      }
+    }
+  }
+}
+
+static void *PrepareThread(void *context) {
+  PrepareWorker *worker = reinterpret_cast<PrepareWorker *>(context);
+
+  worker->locker.Lock();
+  while (true) {
+    while (!worker->pending && !worker->exit) {
+      worker->locker.Wait();
+    }
+
+    if (worker->exit) {
+      break;
+    }
+
+    worker->locker.Unlock();
+    BenchmarkDisplay *display = worker->display;
+    display->prepare_error = display->display->Prepare(&display->layer_stack);
+    worker->core_intf->EndPrepare(display->display);
+    worker->locker.Lock();
+
+    worker->pending = false;
+    worker->locker.Signal();
+  }
+  worker->locker.Unlock();
+
+  return NULL;
+}
+
+// Displays are listed in the serial order, primary display last.
+static void PrepareSerial(BenchmarkDisplay **displays, uint32_t num_displays) {
+  for (uint32_t i = 0; i < num_displays; i++) {
+    displays[i]->prepare_error = displays[i]->display->Prepare(&displays[i]->layer_stack);
+  }
+}
+
+static void PrepareOverlapped(CoreInterface *core_intf, BenchmarkDisplay **displays,
+                              uint32_t num_displays, PrepareWorker *workers) {
+  DisplayInterface *order[kMaxDisplays];
+  uint32_t primary = num_displays - 1;
+
+  for (uint32_t i = 0; i < num_displays; i++) {
+    order[i] = displays[i]->display;
+  }
+  core_intf->SetPrepareOrder(order, num_displays);
+
+  for (uint32_t i = 0; i < primary; i++) {
+    SCOPE_LOCK(workers[i].locker);
+    workers[i].display = displays[i];
+    workers[i].pending = true;
+    workers[i].locker.Signal();
+  }
+
+  displays[primary]->prepare_error =
+    displays[primary]->display->Prepare(&displays[primary]->layer_stack);
+  core_intf->EndPrepare(displays[primary]->display);
+
+  for (uint32_t i = 0; i < primary; i++) {
+    SCOPE_LOCK(workers[i].locker);
+    while (workers[i].pending) {
+      workers[i].locker.Wait();
+    }
+  }
+
+  core_intf->SetPrepareOrder(NULL, 0);
+}
+
+// Prepares and commits the displays for the given number of frames, and records the latency of
+// the prepare of each draw cycle and the composition of each layer.
+static DisplayError Run(CoreInterface *core_intf, BenchmarkDisplay **displays,
+                        uint32_t num_displays, PrepareWorker *workers, bool overlapped,
+                        uint32_t frames, bool animation, int64_t *prepare_ns) {
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    for (uint32_t i = 0; i < num_displays; i++) {
+      UpdateLayerStack(displays[i], frame, animation);
+    }
+
+    int64_t start = GetMonotonicTimeNs();
+    if (overlapped) {
+      PrepareOverlapped(core_intf, displays, num_displays, workers);
+    } else {
+      PrepareSerial(displays, num_displays);
+    }
+    prepare_ns[frame] = GetMonotonicTimeNs() - start;
+
+    for (uint32_t i = 0; i < num_displays; i++) {
+      BenchmarkDisplay *display = displays[i];
+      LayerStack &layer_stack = display->layer_stack;
+
+      if (display->prepare_error != kErrorNone) {
+        fprintf(stderr, "Prepare failed on %s frame %u, error %d\n", display->name, frame,
+                display->prepare_error);
+        return display->prepare_error;
+      }
+
+      for (uint32_t j = 0; j < layer_stack.layer_count; j++) {
+        display->compositions[frame * kMaxBenchmarkLayers + j] = display->layers[j].composition;
+      }
+
+      DisplayError error = display->display->Commit(&layer_stack);
+      if (error != kErrorNone) {
+        fprintf(stderr, "Commit failed on %s frame %u, error %d\n", display->name, frame, error);
+        return error;
+      }
+
+      if (layer_stack.retire_fence_fd >= 0) {
+        close(layer_stack.retire_fence_fd);
+        layer_stack.retire_fence_fd = -1;
+      }
+    }
+  }
+
+  return kErrorNone;
+}
+
+static int Benchmark(CoreInterface *core_intf, BenchmarkDisplay **displays, uint32_t num_displays,
+                     PrepareWorker *workers, uint32_t frames, bool animation) {
+  int64_t *prepare_ns = new int64_t[MAX(frames, kWarmupFrames)];
+  LayerComposition *serial_compositions[kMaxDisplays] = { NULL };
+  int64_t mean_ns[2] = { 0 };
+  uint32_t mismatches = 0;
+  int status = 0;
+
+  // Displays which were just turned on are composed in safe mode for their first frames. Both runs
+  // shall start from the same state, so that their compositions can be compared.
+  if (Run(core_intf, displays, num_displays, workers, false, kWarmupFrames, animation,
+          prepare_ns) != kErrorNone) {
+    status = -1;
+  }
+
+  for (uint32_t mode = 0; mode < 2 && !status; mode++) {
+    bool overlapped = (mode == 1);
+
+    if (Run(core_intf, displays, num_displays, workers, overlapped, frames, animation,
+            prepare_ns) != kErrorNone) {
+      status = -1;
+      break;
+    }
+    char label[64];
+    snprintf(label, sizeof(label), "%u displays %-10s prepare", num_displays,
+             overlapped ? "overlapped" : "serial");
+    mean_ns[mode] = PrintStat(label, prepare_ns, frames);
+
+    for (uint32_t i = 0; i < num_displays; i++) {
+      LayerComposition *compositions = displays[i]->compositions;
+      uint32_t size = frames * kMaxBenchmarkLayers;
+
+      if (!overlapped) {
+        serial_compositions[i] = new LayerComposition[size];
+        memcpy(serial_compositions[i], compositions, size * sizeof(*compositions));
+      } else if (memcmp(serial_compositions[i], compositions, size * sizeof(*compositions))) {
+        fprintf(stderr, "Composition of %s differs from the serial prepare\n", displays[i]->name);
+        mismatches++;
+      }
+    }
+  }
+
+  if (!status) {
+    printf("%u displays speedup %.2fx, compositions %s the serial prepare\n", num_displays,
+           mean_ns[1] ? double(mean_ns[0]) / double(mean_ns[1]) : 0.0,
+           mismatches ? "differ from" : "match");
+    status = mismatches ? -1 : 0;
+  }
+
+  for (uint32_t i = 0; i < num_displays; i++) {
+    delete[] serial_compositions[i];
+  }
+  delete[] prepare_ns;
+
+  return status;
+}
+
+static int CreateBenchmarkDisplay(CoreInterface *core_intf, BenchmarkEventHandler *event_handler,
+                                  BenchmarkDisplay *display, uint32_t frames) {
+  DisplayConfigVariableInfo variable_info;
+  uint32_t active_index = 0;
+
+  DisplayError error = core_intf->CreateDisplay(display->type, event_handler, &display->display);
+  if (error != kErrorNone) {
+    fprintf(stderr, "CreateDisplay %s failed, error %d\n", display->name, error);
+    return -1;
+  }
+
+  if (display->type == kVirtual) {
+    // Virtual display takes the resolution of its output buffer, like a wireless display.
+    variable_info.x_pixels = 1280;
+    variable_info.y_pixels = 720;
+    variable_info.fps = 60;
+    error = display->display->SetActiveConfig(&variable_info);
+  } else {
+    display->display->GetActiveConfig(&active_index);
+    error = display->display->GetConfig(active_index, &variable_info);
+  }
+  if (error == kErrorNone) {
+    error = display->display->SetDisplayState(kStateOn);
+  }
+  if (error != kErrorNone) {
+    fprintf(stderr, "Configuring %s failed, error %d\n", display->name, error);
+    return -1;
+  }
+
+  InitLayerStack(display, variable_info.x_pixels, variable_info.y_pixels);
+  display->compositions = new LayerComposition[MAX(frames, kWarmupFrames) * kMaxBenchmarkLayers]();
+
+  return 0;
+}
+
+}  // namespace sde
+
+using namespace sde;
+
+int main(int argc, char **argv) {
+  BenchmarkDebugHandler debug_handler;
+  BenchmarkBufferAllocator buffer_allocator;
+  BenchmarkBufferSyncHandler buffer_sync_handler;
+  BenchmarkEventHandler event_handler;
+  CoreInterface *core_intf = NULL;
+  // Serial order of the HWC, primary display last.
+  BenchmarkDisplay displays[kMaxDisplays] = { };
+  displays[0].name = "virtual";
+  displays[0].type = kVirtual;
+  displays[0].scenario = &kVideo;
+  displays[1].name = "hdmi";
+  displays[1].type = kHDMI;
+  displays[1].scenario = &kVideo;
+  displays[2].name = "primary";
+  displays[2].type = kPrimary;
+  displays[2].scenario = &kHomescreen;
+  PrepareWorker workers[kMaxDisplays - 1];
+  uint32_t frames = kDefaultFrames;
+  bool animation = false;
+  int status = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "animation")) {
+      animation = true;
+    } else {
+      frames = UINT32(atoi(argv[i]));
+    }
+  }
+
+  if (!frames) {
+    fprintf(stderr, "Usage: %s [frames] [animation]\n", argv[0]);
+    return -1;
+  }
+
+  if (!Debug::IsVirtualDriver()) {
+    fprintf(stderr, "displaycore.virtualdriver is not set, refusing to drive MDSS hardware\n");
+    return -1;
+  }
+
+  DisplayError error = CoreInterface::CreateCore(&event_handler, &debug_handler,
+                                                 &buffer_allocator, &buffer_sync_handler,
+                                                 &core_intf);
+  if (error != kErrorNone) {
+    fprintf(stderr, "CreateCore failed, error %d\n", error);
+    return -1;
+  }
+
+  // Virtual display is created after the two display run, so that it does not keep the composition
+  // of the others in safe mode.
+  for (uint32_t i = 1; i < kMaxDisplays && !status; i++) {
+    status = CreateBenchmarkDisplay(core_intf, &event_handler, &displays[i], frames);
+  }
+
+  for (uint32_t i = 0; i < kMaxDisplays - 1 && !status; i++) {
+    workers[i].core_intf = core_intf;
+    if (pthread_create(&workers[i].thread, NULL, &PrepareThread, &workers[i])) {
+      fprintf(stderr, "Failed to start prepare worker\n");
+      workers[i].core_intf = NULL;
+      status = -1;
+    }
+  }
+
+  BenchmarkDisplay *active_displays[kMaxDisplays] = { &displays[0], &displays[1], &displays[2] };
+  if (!status) {
+    status = Benchmark(core_intf, &active_displays[1], 2, workers, frames, animation);
+  }
+
+  if (!status) {
+    status = CreateBenchmarkDisplay(core_intf, &event_handler, &displays[0], frames);
+  }
+
+  if (!status) {
+    status = Benchmark(core_intf, active_displays, 3, workers, frames, animation);
+  }
+
+  for (uint32_t i = 0; i < kMaxDisplays - 1; i++) {
+    if (workers[i].core_intf) {
+      {
+        SCOPE_LOCK(workers[i].locker);
+        workers[i].exit = true;
+        workers[i].locker.Signal();
+      }
+      pthread_join(workers[i].thread, NULL);
+    }
+  }
+
+  for (uint32_t i = 0; i < kMaxDisplays; i++) {
+    if (displays[i].display) {
+      displays[i].display->SetDisplayState(kStateOff);
+      core_intf->DestroyDisplay(displays[i].display);
+    }
+    delete[] displays[i].compositions;
+  }
+
+  CoreInterface::DestroyCore();
+
+  return status;
+}
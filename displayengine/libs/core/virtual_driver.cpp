@@ -0,0 +1,897 @@
+/*
+* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*  * Redistributions of source code must retain the above copyright
+*    notice, this list of conditions and the following disclaimer.
+*  * Redistributions in binary form must reproduce the above
+*    copyright notice, this list of conditions and the following
+*    disclaimer in the documentation and/or other materials provided
+*    with the distribution.
+*  * Neither the name of The Linux Foundation nor the names of its
+*    contributors may be used to endorse or promote products derived
+*    from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// In-process stand-in for the fb, MDSS rotator and sysfs nodes accessed by HWFrameBuffer. It is
+// used in place of the kernel driver when DISPLAY_CORE_VIRTUAL_DRIVER is defined and the
+// "displaycore.virtualdriver" property is set, so that the display engine runs without MDSS.
+//
+// Panel and MDSS limits default to a 1080p video mode panel and can be overridden through the
+// SDE_VIRTUAL_DRIVER environment variable, e.g. "rgb_pipes=2,max_bandwidth_high=4000000".
+// "validate_us" adds the latency of a kernel atomic validate, which runs concurrently on different
+// fb nodes.
+//
+// Fences are not emulated, all fences returned by the virtual driver are -1.
+
+#ifdef DISPLAY_CORE_VIRTUAL_DRIVER
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <linux/fb.h>
+#include <linux/msm_mdp_ext.h>
+#include <linux/mdss_rotator.h>
+#include <utils/clock.h>
+#include <utils/constants.h>
+#include <utils/debug.h>
+#include <utils/locker.h>
+
+#define __CLASS__ "VirtualDriver"
+
+namespace sde {
+
+class VirtualDriver {
+ public:
+  static VirtualDriver *Get() {
+    static VirtualDriver virtual_driver;
+    return &virtual_driver;
+  }
+
+  int Open(const char *file_name);
+  int Close(int fd);
+  int Ioctl(int fd, int cmd, void *arg);
+  int Poll(pollfd *fds, nfds_t num, int timeout);
+  ssize_t Pread(int fd, void *data, size_t count, off_t offset);
+  ssize_t Pwrite(int fd, const void *data, size_t count, off_t offset);
+  FILE *Fopen(const char *file_name);
+
+ private:
+  static const int kFdBase = 4096;
+  static const uint32_t kMaxFiles = 64;
+  static const uint32_t kNumFbNodes = 3;
+  static const uint32_t kMaxRotatorSessions = 16;
+  static const uint32_t kMaxInputLayers = 32;
+  static const int kMaxPollWaitMs = 100;  // Upper limit of a poll, so that event thread can exit
+  static const uint32_t kMaxString = 1024;
+
+  enum NodeType {
+    kNodeNone,
+    kNodeFbDevice,
+    kNodeRotator,
+    kNodeVSyncEvent,
+    kNodeBlankEvent,
+    kNodeIdleNotify,
+    kNodeHpd,
+    kNodeEdidModes,
+    kNodeIdleTime,
+  };
+
+  struct File {
+    NodeType node;
+    uint32_t fb_index;
+
+    File() : node(kNodeNone), fb_index(0) { }
+  };
+
+  struct Config {
+    uint64_t xres;
+    uint64_t yres;
+    uint64_t fps;
+    uint64_t partial_update;
+    uint64_t rgb_pipes;
+    uint64_t vig_pipes;
+    uint64_t dma_pipes;
+    uint64_t blending_stages;
+    uint64_t max_downscale_ratio;
+    uint64_t max_upscale_ratio;
+    uint64_t max_mixer_width;
+    uint64_t max_bandwidth_low;     // KBps
+    uint64_t max_bandwidth_high;    // KBps
+    uint64_t max_pipe_bw;           // KBps
+    uint64_t max_mdp_clk;           // Hz
+    uint64_t validate_us;           // Latency of an atomic validate
+  };
+
+  struct FbNode {
+    const char *panel_type;
+    bool powered_on;
+    bool vsync_enabled;
+    uint64_t last_vsync_ns;
+    uint64_t last_commit_ns;
+    uint32_t idle_time_ms;
+    bool idle_notified;
+    uint32_t pipe_mask;           // Pipes staged by the last commit
+    uint32_t xres;
+    uint32_t yres;
+    uint64_t commit_count;
+    uint64_t validate_count;
+    uint64_t reject_count;
+  };
+
+  VirtualDriver();
+  void ParseConfig(const char *config_string);
+  File *GetFile(int fd);
+  int FbIoctl(FbNode *fb_node, uint32_t fb_index, int cmd, void *arg);
+  int RotatorIoctl(int cmd, void *arg);
+  int AtomicCommit(FbNode *fb_node, uint32_t fb_index, mdp_layer_commit *commit);
+  int ValidateLayers(const FbNode &fb_node, uint32_t fb_index, const mdp_layer_commit_v1 &commit);
+  int ValidateRotation(const mdp_rotation_request &request);
+  bool IsEventReady(const File &file, uint64_t now_ns, uint64_t *deadline_ns);
+  uint64_t GetVSyncPeriodNs() { return 1000000000ULL / (config_.fps ? config_.fps : 60); }
+  uint32_t GetBitsPerPixel(uint32_t format);
+  int FormatNode(NodeType node, uint32_t fb_index, char *buffer, size_t length);
+
+  Locker locker_;
+  Config config_;
+  File files_[kMaxFiles];
+  FbNode fb_nodes_[kNumFbNodes];
+  bool rotator_sessions_[kMaxRotatorSessions];
+  uint32_t valid_pipe_mask_;
+  uint64_t rotation_count_;
+};
+
+VirtualDriver::VirtualDriver() : valid_pipe_mask_(0), rotation_count_(0) {
+  static const char *panel_type[kNumFbNodes] = { "mipi dsi video panel", "dtv panel",
+                                                 "writeback panel" };
+
+  config_.xres = 1080;
+  config_.yres = 1920;
+  config_.fps = 60;
+  config_.partial_update = 0;
+  config_.rgb_pipes = 4;
+  config_.vig_pipes = 4;
+  config_.dma_pipes = 2;
+  config_.blending_stages = 7;
+  config_.max_downscale_ratio = 4;
+  config_.max_upscale_ratio = 20;
+  config_.max_mixer_width = 2560;
+  config_.max_bandwidth_low = 9600000;
+  config_.max_bandwidth_high = 9600000;
+  config_.max_pipe_bw = 2300000;
+  config_.max_mdp_clk = 400000000;
+  config_.validate_us = 0;
+
+  ParseConfig(getenv("SDE_VIRTUAL_DRIVER"));
+
+  // Pipe ndx bits follow the MDSS pipe numbering, VIG0-2, RGB0-2, DMA0-1, VIG3 and RGB3.
+  for (uint32_t i = 0; i < MIN(config_.vig_pipes, 4); i++) {
+    valid_pipe_mask_ |= (1U << ((i < 3) ? i : 8));
+  }
+  for (uint32_t i = 0; i < MIN(config_.rgb_pipes, 4); i++) {
+    valid_pipe_mask_ |= (1U << ((i < 3) ? (3 + i) : 9));
+  }
+  for (uint32_t i = 0; i < MIN(config_.dma_pipes, 2); i++) {
+    valid_pipe_mask_ |= (1U << (6 + i));
+  }
+
+  for (uint32_t i = 0; i < kNumFbNodes; i++) {
+    FbNode &fb_node = fb_nodes_[i];
+
+    memset(&fb_node, 0, sizeof(fb_node));
+    fb_node.panel_type = panel_type[i];
+    fb_node.xres = UINT32(config_.xres);
+    fb_node.yres = UINT32(config_.yres);
+  }
+
+  memset(rotator_sessions_, 0, sizeof(rotator_sessions_));
+}
+
+void VirtualDriver::ParseConfig(const char *config_string) {
+  struct {
+    const char *name;
+    uint64_t *value;
+  } config_table[] = {
+    { "xres", &config_.xres },
+    { "yres", &config_.yres },
+    { "fps", &config_.fps },
+    { "pu_en", &config_.partial_update },
+    { "rgb_pipes", &config_.rgb_pipes },
+    { "vig_pipes", &config_.vig_pipes },
+    { "dma_pipes", &config_.dma_pipes },
+    { "blending_stages", &config_.blending_stages },
+    { "max_downscale_ratio", &config_.max_downscale_ratio },
+    { "max_upscale_ratio", &config_.max_upscale_ratio },
+    { "max_mixer_width", &config_.max_mixer_width },
+    { "max_bandwidth_low", &config_.max_bandwidth_low },
+    { "max_bandwidth_high", &config_.max_bandwidth_high },
+    { "max_pipe_bw", &config_.max_pipe_bw },
+    { "max_mdp_clk", &config_.max_mdp_clk },
+    { "validate_us", &config_.validate_us },
+  };
+  char buffer[kMaxString];
+  char *temp_ptr = NULL;
+
+  if (!config_string) {
+    return;
+  }
+
+  snprintf(buffer, sizeof(buffer), "%s", config_string);
+
+  for (char *token = strtok_r(buffer, ",", &temp_ptr); token;
+       token = strtok_r(NULL, ",", &temp_ptr)) {
+    char *value = strchr(token, '=');
+    if (!value) {
+      continue;
+    }
+    *value++ = '\0';
+
+    for (uint32_t i = 0; i < sizeof(config_table) / sizeof(config_table[0]); i++) {
+      if (!strcmp(token, config_table[i].name)) {
+        *config_table[i].value = strtoull(value, NULL, 0);
+        break;
+      }
+    }
+  }
+}
+
+VirtualDriver::File *VirtualDriver::GetFile(int fd) {
+  if ((fd < kFdBase) || (fd >= kFdBase + INT(kMaxFiles)) ||
+      (files_[fd - kFdBase].node == kNodeNone)) {
+    return NULL;
+  }
+
+  return &files_[fd - kFdBase];
+}
+
+int VirtualDriver::Open(const char *file_name) {
+  static const struct {
+    const char *name;
+    NodeType node;
+  } sysfs_nodes[] = {
+    { "vsync_event", kNodeVSyncEvent },
+    { "show_blank_event", kNodeBlankEvent },
+    { "idle_notify", kNodeIdleNotify },
+    { "hpd", kNodeHpd },
+    { "edid_modes", kNodeEdidModes },
+    { "idle_time", kNodeIdleTime },
+  };
+  const char *fb_sysfs_path = "/sys/devices/virtual/graphics/fb";
+  const char *fb_device_path = "/dev/graphics/fb";
+  NodeType node = kNodeNone;
+  uint32_t fb_index = 0;
+  char *node_name = NULL;
+
+  SCOPE_LOCK(locker_);
+
+  if (!strcmp(file_name, "/dev/mdss_rotator")) {
+    node = kNodeRotator;
+  } else if (!strncmp(file_name, fb_device_path, strlen(fb_device_path))) {
+    fb_index = UINT32(strtoul(file_name + strlen(fb_device_path), &node_name, 10));
+    if (!*node_name) {
+      node = kNodeFbDevice;
+    }
+  } else if (!strncmp(file_name, fb_sysfs_path, strlen(fb_sysfs_path))) {
+    fb_index = UINT32(strtoul(file_name + strlen(fb_sysfs_path), &node_name, 10));
+    for (uint32_t i = 0; (*node_name == '/') && (i < sizeof(sysfs_nodes) / sizeof(sysfs_nodes[0]));
+         i++) {
+      if (!strcmp(node_name + 1, sysfs_nodes[i].name)) {
+        node = sysfs_nodes[i].node;
+        break;
+      }
+    }
+  }
+
+  if ((node == kNodeNone) || (fb_index >= kNumFbNodes)) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  for (uint32_t i = 0; i < kMaxFiles; i++) {
+    if (files_[i].node == kNodeNone) {
+      files_[i].node = node;
+      files_[i].fb_index = fb_index;
+      return kFdBase + INT(i);
+    }
+  }
+
+  errno = EMFILE;
+  return -1;
+}
+
+int VirtualDriver::Close(int fd) {
+  SCOPE_LOCK(locker_);
+
+  File *file = GetFile(fd);
+  if (!file) {
+    errno = EBADF;
+    return -1;
+  }
+
+  // Rotator sessions belong to the process, release them along with the rotator node.
+  if (file->node == kNodeRotator) {
+    memset(rotator_sessions_, 0, sizeof(rotator_sessions_));
+  }
+
+  *file = File();
+
+  return 0;
+}
+
+int VirtualDriver::Ioctl(int fd, int cmd, void *arg) {
+  if (config_.validate_us && (cmd == MSMFB_ATOMIC_COMMIT) &&
+      (reinterpret_cast<mdp_layer_commit *>(arg)->commit_v1.flags & MDP_VALIDATE_LAYER)) {
+    usleep(UINT32(config_.validate_us));
+  }
+
+  SCOPE_LOCK(locker_);
+
+  File *file = GetFile(fd);
+  if (!file) {
+    errno = EBADF;
+    return -1;
+  }
+
+  switch (file->node) {
+  case kNodeFbDevice:
+    return FbIoctl(&fb_nodes_[file->fb_index], file->fb_index, cmd, arg);
+  case kNodeRotator:
+    return RotatorIoctl(cmd, arg);
+  default:
+    errno = ENOTTY;
+    return -1;
+  }
+}
+
+int VirtualDriver::FbIoctl(FbNode *fb_node, uint32_t fb_index, int cmd, void *arg) {
+  switch (cmd) {
+  case FBIOGET_VSCREENINFO:
+    {
+      fb_var_screeninfo *var_screeninfo = reinterpret_cast<fb_var_screeninfo *>(arg);
+      memset(var_screeninfo, 0, sizeof(*var_screeninfo));
+      var_screeninfo->xres = fb_node->xres;
+      var_screeninfo->yres = fb_node->yres;
+      var_screeninfo->upper_margin = 4;
+      var_screeninfo->lower_margin = 8;
+      var_screeninfo->vsync_len = 2;
+    }
+    return 0;
+
+  case FBIOPUT_VSCREENINFO:
+    {
+      fb_var_screeninfo *var_screeninfo = reinterpret_cast<fb_var_screeninfo *>(arg);
+      fb_node->xres = var_screeninfo->xres;
+      fb_node->yres = var_screeninfo->yres;
+    }
+    return 0;
+
+  case MSMFB_METADATA_GET:
+    {
+      msmfb_metadata *meta_data = reinterpret_cast<msmfb_metadata *>(arg);
+      if (meta_data->op != metadata_op_frame_rate) {
+        errno = EINVAL;
+        return -1;
+      }
+      meta_data->data.panel_frame_rate = UINT32(config_.fps);
+    }
+    return 0;
+
+  case MSMFB_METADATA_SET:
+    return 0;
+
+  case FBIOBLANK:
+    fb_node->powered_on = (UINT32(reinterpret_cast<uintptr_t>(arg)) == FB_BLANK_UNBLANK);
+    fb_node->pipe_mask = 0;
+    return 0;
+
+  case MSMFB_OVERLAY_VSYNC_CTRL:
+    fb_node->vsync_enabled = (*reinterpret_cast<int *>(arg) != 0);
+    // Wake up the event thread to deliver vsync on the new state.
+    locker_.Broadcast();
+    return 0;
+
+  case MSMFB_ATOMIC_COMMIT:
+    return AtomicCommit(fb_node, fb_index, reinterpret_cast<mdp_layer_commit *>(arg));
+
+  default:
+    errno = ENOTTY;
+    return -1;
+  }
+}
+
+int VirtualDriver::AtomicCommit(FbNode *fb_node, uint32_t fb_index, mdp_layer_commit *commit) {
+  mdp_layer_commit_v1 &commit_v1 = commit->commit_v1;
+  bool validate = (commit_v1.flags & MDP_VALIDATE_LAYER);
+
+  if (validate) {
+    fb_node->validate_count++;
+  }
+
+  // Driver validates the layers again on commit.
+  int error = ValidateLayers(*fb_node, fb_index, commit_v1);
+  if (error) {
+    fb_node->reject_count++;
+    DLOGV_IF(kTagDriverConfig, "fb%d %s rejected, error = %d", fb_index,
+             validate ? "validate" : "commit", error);
+    errno = error;
+    return -1;
+  }
+
+  if (validate) {
+    return 0;
+  }
+
+  fb_node->pipe_mask = 0;
+  for (uint32_t i = 0; i < commit_v1.input_layer_cnt; i++) {
+    fb_node->pipe_mask |= commit_v1.input_layers[i].pipe_ndx;
+  }
+
+  commit_v1.release_fence = -1;
+  commit_v1.retire_fence = -1;
+  fb_node->last_commit_ns = UINT64(GetMonotonicTimeNs());
+  fb_node->idle_notified = false;
+  fb_node->commit_count++;
+
+  // Wake up the event thread to schedule the idle notification.
+  locker_.Broadcast();
+
+  return 0;
+}
+
+int VirtualDriver::ValidateLayers(const FbNode &fb_node, uint32_t fb_index,
+                                  const mdp_layer_commit_v1 &commit) {
+  uint32_t pipe_mask = 0;
+  uint32_t busy_pipe_mask = 0;
+  uint64_t total_bw = 0;
+
+  if (commit.input_layer_cnt > kMaxInputLayers) {
+    return E2BIG;
+  }
+
+  for (uint32_t i = 0; i < kNumFbNodes; i++) {
+    if (i != fb_index) {
+      busy_pipe_mask |= fb_nodes_[i].pipe_mask;
+    }
+  }
+
+  for (uint32_t i = 0; i < commit.input_layer_cnt; i++) {
+    const mdp_input_layer &layer = commit.input_layers[i];
+    const mdp_rect &src = layer.src_rect;
+    const mdp_rect &dst = layer.dst_rect;
+
+    // Pipe should be a single pipe supported by MDSS, not staged on any other display and used
+    // only once in this commit.
+    if (!layer.pipe_ndx || (layer.pipe_ndx & (layer.pipe_ndx - 1)) ||
+        !(layer.pipe_ndx & valid_pipe_mask_) || (layer.pipe_ndx & pipe_mask)) {
+      return EINVAL;
+    }
+
+    if (layer.pipe_ndx & busy_pipe_mask) {
+      return EBUSY;
+    }
+    pipe_mask |= layer.pipe_ndx;
+
+    if (layer.z_order >= config_.blending_stages) {
+      return EINVAL;
+    }
+
+    if (!src.w || !src.h || !dst.w || !dst.h ||
+        ((src.x + src.w) > layer.buffer.width) || ((src.y + src.h) > layer.buffer.height)) {
+      return EINVAL;
+    }
+
+    if ((fb_index != 2) && (((dst.x + dst.w) > fb_node.xres) || ((dst.y + dst.h) > fb_node.yres))) {
+      return EINVAL;
+    }
+
+    uint32_t src_w = src.w >> layer.horz_deci;
+    uint32_t src_h = src.h >> layer.vert_deci;
+    if ((src_w > dst.w * config_.max_downscale_ratio) ||
+        (src_h > dst.h * config_.max_downscale_ratio) ||
+        (dst.w > src_w * config_.max_upscale_ratio) ||
+        (dst.h > src_h * config_.max_upscale_ratio)) {
+      return EINVAL;
+    }
+
+    // Fetch bandwidth in KBps, scaled by the vertical downscale as the pipe fetches the source
+    // lines in the time of destination lines.
+    uint64_t pipe_bw = (uint64_t(src_w) * src_h * GetBitsPerPixel(layer.buffer.format) / 8) *
+                       config_.fps / 1000;
+    if (src_h > dst.h) {
+      pipe_bw = pipe_bw * src_h / dst.h;
+    }
+
+    if (config_.max_pipe_bw && (pipe_bw > config_.max_pipe_bw)) {
+      return E2BIG;
+    }
+    total_bw += pipe_bw;
+  }
+
+  if (config_.max_bandwidth_high && (total_bw > config_.max_bandwidth_high)) {
+    return E2BIG;
+  }
+
+  return 0;
+}
+
+uint32_t VirtualDriver::GetBitsPerPixel(uint32_t format) {
+  switch (format) {
+  case MDP_ARGB_8888:
+  case MDP_RGBA_8888:
+  case MDP_BGRA_8888:
+  case MDP_RGBX_8888:
+  case MDP_BGRX_8888:
+  case MDP_RGBA_8888_UBWC:
+    return 32;
+  case MDP_RGB_888:
+    return 24;
+  case MDP_RGB_565:
+  case MDP_RGB_565_UBWC:
+  case MDP_YCBYCR_H2V1:
+    return 16;
+  default:
+    return 12;
+  }
+}
+
+int VirtualDriver::RotatorIoctl(int cmd, void *arg) {
+  switch (cmd) {
+  case MDSS_ROTATION_OPEN:
+    {
+      mdp_rotation_config *rot_config = reinterpret_cast<mdp_rotation_config *>(arg);
+      for (uint32_t i = 0; i < kMaxRotatorSessions; i++) {
+        if (!rotator_sessions_[i]) {
+          rotator_sessions_[i] = true;
+          rot_config->session_id = i;
+          return 0;
+        }
+      }
+      errno = EBUSY;
+      return -1;
+    }
+
+  case MDSS_ROTATION_CLOSE:
+    {
+      uint32_t session_id = UINT32(reinterpret_cast<uintptr_t>(arg));
+      if ((session_id >= kMaxRotatorSessions) || !rotator_sessions_[session_id]) {
+        errno = EINVAL;
+        return -1;
+      }
+      rotator_sessions_[session_id] = false;
+      return 0;
+    }
+
+  case MDSS_ROTATION_REQUEST:
+    {
+      mdp_rotation_request *request = reinterpret_cast<mdp_rotation_request *>(arg);
+      int error = ValidateRotation(*request);
+      if (error) {
+        errno = error;
+        return -1;
+      }
+
+      if (!(request->flags & MDSS_ROTATION_REQUEST_VALIDATE)) {
+        for (uint32_t i = 0; i < request->count; i++) {
+          request->list[i].output.fence = -1;
+        }
+        rotation_count_ += request->count;
+      }
+      return 0;
+    }
+
+  default:
+    errno = ENOTTY;
+    return -1;
+  }
+}
+
+int VirtualDriver::ValidateRotation(const mdp_rotation_request &request) {
+  if (request.count > kMaxInputLayers) {
+    return E2BIG;
+  }
+
+  for (uint32_t i = 0; i < request.count; i++) {
+    const mdp_rotation_item &item = request.list[i];
+    uint32_t dst_w = (item.flags & MDP_ROTATION_90) ? item.dst_rect.h : item.dst_rect.w;
+    uint32_t dst_h = (item.flags & MDP_ROTATION_90) ? item.dst_rect.w : item.dst_rect.h;
+
+    if (((item.src_rect.x + item.src_rect.w) > item.input.width) ||
+        ((item.src_rect.y + item.src_rect.h) > item.input.height) ||
+        ((item.dst_rect.x + item.dst_rect.w) > item.output.width) ||
+        ((item.dst_rect.y + item.dst_rect.h) > item.output.height)) {
+      return EINVAL;
+    }
+
+    // Rotator only downscales.
+    if ((dst_w > item.src_rect.w) || (dst_h > item.src_rect.h)) {
+      return EINVAL;
+    }
+  }
+
+  return 0;
+}
+
+bool VirtualDriver::IsEventReady(const File &file, uint64_t now_ns, uint64_t *deadline_ns) {
+  const FbNode &fb_node = fb_nodes_[file.fb_index];
+
+  switch (file.node) {
+  case kNodeVSyncEvent:
+    if (fb_node.powered_on && fb_node.vsync_enabled) {
+      uint64_t period_ns = GetVSyncPeriodNs();
+      uint64_t vsync_ns = now_ns - (now_ns % period_ns);
+      if (vsync_ns > fb_node.last_vsync_ns) {
+        return true;
+      }
+      *deadline_ns = MIN(*deadline_ns, vsync_ns + period_ns);
+    }
+    return false;
+
+  case kNodeIdleNotify:
+    if (fb_node.idle_time_ms && fb_node.last_commit_ns && !fb_node.idle_notified) {
+      uint64_t idle_ns = fb_node.last_commit_ns + uint64_t(fb_node.idle_time_ms) * 1000000ULL;
+      if (now_ns >= idle_ns) {
+        return true;
+      }
+      *deadline_ns = MIN(*deadline_ns, idle_ns);
+    }
+    return false;
+
+  default:
+    return false;
+  }
+}
+
+int VirtualDriver::Poll(pollfd *fds, nfds_t num, int timeout) {
+  SCOPE_LOCK(locker_);
+
+  uint64_t now_ns = UINT64(GetMonotonicTimeNs());
+  int timeout_ms = (timeout < 0) ? INT(kMaxPollWaitMs) : timeout;
+  uint64_t timeout_ns = now_ns + uint64_t(timeout_ms) * 1000000ULL;
+
+  while (true) {
+    uint64_t deadline_ns = timeout_ns;
+    int ready_count = 0;
+
+    for (nfds_t i = 0; i < num; i++) {
+      File *file = GetFile(fds[i].fd);
+      fds[i].revents = 0;
+      if (file && IsEventReady(*file, now_ns, &deadline_ns)) {
+        fds[i].revents = POLLPRI;
+        ready_count++;
+      }
+    }
+
+    // Poll is not restarted when the timeout is infinite, since event thread checks for exit
+    // only between the polls.
+    if (ready_count || (now_ns >= timeout_ns)) {
+      return ready_count;
+    }
+
+    int wait_ms = INT((deadline_ns - now_ns + 999999ULL) / 1000000ULL);
+    locker_.WaitFinite(MAX(wait_ms, 1));
+    now_ns = UINT64(GetMonotonicTimeNs());
+  }
+}
+
+ssize_t VirtualDriver::Pread(int fd, void *data, size_t count, off_t offset) {
+  char buffer[kMaxString];
+
+  SCOPE_LOCK(locker_);
+
+  File *file = GetFile(fd);
+  if (!file) {
+    errno = EBADF;
+    return -1;
+  }
+
+  FbNode &fb_node = fb_nodes_[file->fb_index];
+  uint64_t now_ns = UINT64(GetMonotonicTimeNs());
+
+  // Reading an event node acknowledges the event.
+  switch (file->node) {
+  case kNodeVSyncEvent:
+    fb_node.last_vsync_ns = now_ns - (now_ns % GetVSyncPeriodNs());
+    break;
+  case kNodeIdleNotify:
+    fb_node.idle_notified = (fb_node.last_commit_ns != 0);
+    break;
+  default:
+    break;
+  }
+
+  int length = FormatNode(file->node, file->fb_index, buffer, sizeof(buffer));
+  if (length < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  length++;  // Include the null terminator, readers parse the content as a string
+
+  if (offset >= length) {
+    return 0;
+  }
+
+  size_t read_count = MIN(count, size_t(length - offset));
+  memcpy(data, buffer + offset, read_count);
+
+  return ssize_t(read_count);
+}
+
+ssize_t VirtualDriver::Pwrite(int fd, const void *data, size_t count, off_t offset) {
+  char buffer[kMaxString] = { 0 };
+
+  SCOPE_LOCK(locker_);
+
+  File *file = GetFile(fd);
+  if (!file) {
+    errno = EBADF;
+    return -1;
+  }
+
+  memcpy(buffer, data, MIN(count, sizeof(buffer) - 1));
+
+  switch (file->node) {
+  case kNodeIdleTime:
+    fb_nodes_[file->fb_index].idle_time_ms = UINT32(strtoul(buffer, NULL, 0));
+    locker_.Broadcast();
+    break;
+  case kNodeHpd:
+    break;
+  default:
+    errno = EINVAL;
+    return -1;
+  }
+
+  return ssize_t(count);
+}
+
+int VirtualDriver::FormatNode(NodeType node, uint32_t fb_index, char *buffer, size_t length) {
+  const FbNode &fb_node = fb_nodes_[fb_index];
+
+  switch (node) {
+  case kNodeVSyncEvent:
+    return snprintf(buffer, length, "VSYNC=%" PRIu64, fb_node.last_vsync_ns);
+  case kNodeBlankEvent:
+    return snprintf(buffer, length, "panel_power_on = %d", fb_node.powered_on);
+  case kNodeIdleNotify:
+    return snprintf(buffer, length, "idle");
+  case kNodeEdidModes:
+    // 1080p60, 720p60 and 480p60
+    return (fb_index == 1) ? snprintf(buffer, length, "16 4 2") : -1;
+  case kNodeIdleTime:
+    return snprintf(buffer, length, "%u", fb_node.idle_time_ms);
+  case kNodeHpd:
+    return snprintf(buffer, length, "1");
+  default:
+    return -1;
+  }
+}
+
+FILE *VirtualDriver::Fopen(const char *file_name) {
+  const char *fb_sysfs_path = "/sys/devices/virtual/graphics/fb";
+  char buffer[kMaxString];
+  char *node_name = NULL;
+  int length = -1;
+
+  SCOPE_LOCK(locker_);
+
+  if (strncmp(file_name, fb_sysfs_path, strlen(fb_sysfs_path))) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  uint32_t fb_index = UINT32(strtoul(file_name + strlen(fb_sysfs_path), &node_name, 10));
+  if (fb_index >= kNumFbNodes) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  // Every fb node reports its type, only primary exposes panel info and MDSS capabilities.
+  if (!strcmp(node_name, "/msm_fb_type")) {
+    length = snprintf(buffer, sizeof(buffer), "%s\n", fb_nodes_[fb_index].panel_type);
+  } else if (!fb_index && !strcmp(node_name, "/msm_fb_panel_info")) {
+    length = snprintf(buffer, sizeof(buffer), "pu_en=%" PRIu64 "\nxstart=0\nwalign=0\nystart=0\n"
+                      "halign=0\nmin_w=0\nmin_h=0\nroi_merge=0\ndynamic_fps_en=0\n"
+                      "min_fps=%" PRIu64 "\nmax_fps=%" PRIu64 "\n", config_.partial_update,
+                      config_.fps, config_.fps);
+  } else if (!fb_index && !strcmp(node_name, "/mdp/caps")) {
+    length = snprintf(buffer, sizeof(buffer), "hw_rev=268763136\nrgb_pipes=%" PRIu64 "\n"
+                      "vig_pipes=%" PRIu64 "\ndma_pipes=%" PRIu64 "\nblending_stages=%" PRIu64 "\n"
+                      "max_downscale_ratio=%" PRIu64 "\nmax_upscale_ratio=%" PRIu64 "\n"
+                      "max_bandwidth_low=%" PRIu64 "\nmax_bandwidth_high=%" PRIu64 "\n"
+                      "max_mixer_width=%" PRIu64 "\nmax_pipe_bw=%" PRIu64 "\n"
+                      "max_mdp_clk=%" PRIu64 "\nclk_fudge_factor=105,100\n"
+                      "features=bwc decimation rotator_downscale\n", config_.rgb_pipes,
+                      config_.vig_pipes, config_.dma_pipes, config_.blending_stages,
+                      config_.max_downscale_ratio, config_.max_upscale_ratio,
+                      config_.max_bandwidth_low, config_.max_bandwidth_high,
+                      config_.max_mixer_width, config_.max_pipe_bw, config_.max_mdp_clk);
+  } else if (!fb_index && !strcmp(node_name, "/msm_fb_split")) {
+    length = snprintf(buffer, sizeof(buffer), "0 0\n");
+  }
+
+  if (length < 0) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  // Memory stream owns a copy of the node content, and is released by fclose.
+  FILE *fileptr = fmemopen(NULL, sizeof(buffer), "w+");
+  if (fileptr) {
+    fwrite(buffer, 1, size_t(length), fileptr);
+    fflush(fileptr);
+    rewind(fileptr);
+  }
+
+  return fileptr;
+}
+
+}  // namespace sde
+
+int virtual_ioctl(int fd, int cmd, ...) {
+  va_list args;
+
+  // Argument is either a pointer or an integer passed by value, as with the kernel ioctl.
+  va_start(args, cmd);
+  void *arg = va_arg(args, void *);
+  va_end(args);
+
+  return sde::VirtualDriver::Get()->Ioctl(fd, cmd, arg);
+}
+
+int virtual_open(const char *file_name, int access, ...) {
+  return sde::VirtualDriver::Get()->Open(file_name);
+}
+
+int virtual_close(int fd) {
+  return sde::VirtualDriver::Get()->Close(fd);
+}
+
+int virtual_poll(struct pollfd *fds, nfds_t num, int timeout) {
+  return sde::VirtualDriver::Get()->Poll(fds, num, timeout);
+}
+
+ssize_t virtual_pread(int fd, void *data, size_t count, off_t offset) {
+  return sde::VirtualDriver::Get()->Pread(fd, data, count, offset);
+}
+
+ssize_t virtual_pwrite(int fd, const void *data, size_t count, off_t offset) {
+  return sde::VirtualDriver::Get()->Pwrite(fd, data, count, offset);
+}
+
+FILE* virtual_fopen(const char *fname, const char *mode) {
+  return sde::VirtualDriver::Get()->Fopen(fname);
+}
+
+int virtual_fclose(FILE* fileptr) {
+  return fclose(fileptr);
+}
+
+ssize_t virtual_getline(char **lineptr, size_t *linelen, FILE *stream) {
+  return getline(lineptr, linelen, stream);
+}
+
+#endif  // DISPLAY_CORE_VIRTUAL_DRIVER
+
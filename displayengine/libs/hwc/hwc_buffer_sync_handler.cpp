@@ -53,6 +53,20 @@ DisplayError HWCBufferSyncHandler::SyncWait(int fd) {
   return kErrorNone;
 }
 
+DisplayError HWCBufferSyncHandler::SyncCheck(int fd) {
+  if (fd >= 0) {
+    if (sync_wait(fd, 0) < 0) {
+      if (errno == ETIME) {
+        return kErrorTimeOut;
+      }
+      DLOGE("sync_wait error errno = %d, desc = %s", errno,  strerror(errno));
+      return kErrorFileDescriptor;
+    }
+  }
+
+  return kErrorNone;
+}
+
 DisplayError HWCBufferSyncHandler::SyncMerge(int fd1, int fd2, int *merged_fd) {
   DisplayError error = kErrorNone;
 
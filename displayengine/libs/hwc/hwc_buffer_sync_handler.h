@@ -43,6 +43,7 @@ class HWCBufferSyncHandler : public BufferSyncHandler {
   HWCBufferSyncHandler() { }
 
   virtual DisplayError SyncWait(int fd);
+  virtual DisplayError SyncCheck(int fd);
   virtual DisplayError SyncMerge(int fd1, int fd2, int *merged_fd);
 };
 
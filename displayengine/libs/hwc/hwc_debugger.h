@@ -36,6 +36,7 @@
 #include <core/debug_interface.h>
 #include <cutils/log.h>
 #include <utils/Trace.h>
+#include <utils/trace.h>
 
 #define DLOG(Macro, format, ...) Macro(__CLASS__ "::%s: " format, __FUNCTION__, ##__VA_ARGS__)
 
@@ -47,7 +48,7 @@
 #define DTRACE_BEGIN(custom_string) HWCDebugHandler::Get()->BeginTrace(__CLASS__, __FUNCTION__, \
                                                                        custom_string)
 #define DTRACE_END() HWCDebugHandler::Get()->EndTrace()
-#define DTRACE_SCOPED() ScopeTracer<HWCDebugHandler> scope_tracer(__CLASS__, __FUNCTION__)
+#define DTRACE_SCOPED() STRACE_SCOPED(kTagNone)
 
 namespace sde {
 
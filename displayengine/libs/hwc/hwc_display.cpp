@@ -30,11 +30,12 @@
 #include <errno.h>
 #include <gralloc_priv.h>
 #include <utils/constants.h>
+#include <utils/shared_fence.h>
 #include <qdMetaData.h>
-#include <sync/sync.h>
 
 #include "hwc_display.h"
 #include "hwc_debugger.h"
+#include "hwc_frame_dump.h"
 
 #define __CLASS__ "HWCDisplay"
 
@@ -43,8 +44,9 @@ namespace sde {
 HWCDisplay::HWCDisplay(CoreInterface *core_intf, hwc_procs_t const **hwc_procs, DisplayType type,
                        int id)
   : core_intf_(core_intf), hwc_procs_(hwc_procs), type_(type), id_(id), display_intf_(NULL),
-    flush_(false), output_buffer_(NULL), dump_frame_count_(0), dump_frame_index_(0),
-    dump_input_layers_(false) {
+    layer_snapshots_(NULL), translate_all_layers_(true), flush_(false), output_buffer_(NULL),
+    dump_frame_count_(0), dump_frame_index_(0), dump_input_layers_(false), dump_delta_(false),
+    dump_pending_(false) {
 }
 
 int HWCDisplay::Init() {
@@ -59,6 +61,11 @@ int HWCDisplay::Init() {
 }
 
 int HWCDisplay::Deinit() {
+  if (dump_pending_) {
+    HWCFrameDump::Get()->WaitForCopy(UINT32(id_));
+    dump_pending_ = false;
+  }
+
   DisplayError error = core_intf_->DestroyDisplay(display_intf_);
   if (UNLIKELY(error != kErrorNone)) {
     DLOGE("Display destroy failed. Error = %d", error);
@@ -204,8 +211,10 @@ void HWCDisplay::SetFrameDumpConfig(uint32_t count, uint32_t bit_mask_layer_type
   dump_frame_count_ = count;
   dump_frame_index_ = 0;
   dump_input_layers_ = ((bit_mask_layer_type & (1 << INPUT_LAYER_DUMP)) != 0);
+  dump_delta_ = ((bit_mask_layer_type & (1 << DELTA_ENCODED_DUMP)) != 0);
 
-  DLOGI("num_frame_dump %d, input_layer_dump_enable %d", dump_frame_count_, dump_input_layers_);
+  DLOGI("num_frame_dump %d, input_layer_dump_enable %d, delta_encoding %d", dump_frame_count_,
+        dump_input_layers_, dump_delta_);
 }
 
 DisplayError HWCDisplay::VSync(const DisplayEventVSync &vsync) {
@@ -231,22 +240,29 @@ int HWCDisplay::AllocateLayerStack(hwc_display_contents_1_t *content_list) {
   }
 
   size_t num_hw_layers = content_list->numHwLayers;
+  uint32_t layer_count = static_cast<uint32_t>(num_hw_layers);
 
   // Allocate memory for a) total number of layers b) buffer handle for each layer c) number of
-  // visible rectangles in each layer d) dirty rectangle for each layer
-  size_t required_size = num_hw_layers * (sizeof(Layer) + sizeof(LayerBuffer));
+  // visible rectangles in each layer d) dirty rectangle for each layer e) snapshot of each layer
+  size_t required_size = num_hw_layers * (sizeof(Layer) + sizeof(LayerBuffer) +
+                                          sizeof(LayerSnapshot));
   for (size_t i = 0; i < num_hw_layers; i++) {
     // visible rectangles + 1 dirty rectangle
     size_t num_rects = content_list->hwLayers[i].visibleRegionScreen.numRects + 1;
     required_size += num_rects * sizeof(LayerRect);
   }
 
+  // Layers laid out for the previous frame are reused as long as the number of layers and visible
+  // rectangles of each layer remain same, so that only the changed properties are translated.
+  bool reuse_layers = (layer_stack_memory_.layer_count == layer_count);
+
   // Layer array may be large enough to hold current number of layers.
   // If not, re-allocate it now.
   if (UNLIKELY(layer_stack_memory_.size < required_size)) {
     if (LIKELY(layer_stack_memory_.raw)) {
       delete[] layer_stack_memory_.raw;
       layer_stack_memory_.size = 0;
+      layer_stack_memory_.layer_count = 0;
     }
 
     // Allocate in multiple of kSizeSteps.
@@ -258,6 +274,7 @@ int HWCDisplay::AllocateLayerStack(hwc_display_contents_1_t *content_list) {
     }
 
     layer_stack_memory_.size = required_size;
+    reuse_layers = false;
   }
 
   // Assign memory addresses now.
@@ -266,13 +283,27 @@ int HWCDisplay::AllocateLayerStack(hwc_display_contents_1_t *content_list) {
   // Layer array address
   layer_stack_ = LayerStack();
   layer_stack_.layers = reinterpret_cast<Layer *>(current_address);
-  layer_stack_.layer_count = static_cast<uint32_t>(num_hw_layers);
+  layer_stack_.layer_count = layer_count;
   current_address += num_hw_layers * sizeof(Layer);
 
+  for (size_t i = 0; reuse_layers && (i < num_hw_layers); i++) {
+    size_t num_rects = content_list->hwLayers[i].visibleRegionScreen.numRects;
+    reuse_layers = (layer_stack_.layers[i].visible_regions.count == num_rects);
+  }
+
+  if (reuse_layers) {
+    return 0;
+  }
+
+  // Layer snapshot array address
+  layer_snapshots_ = reinterpret_cast<LayerSnapshot *>(current_address);
+  current_address += num_hw_layers * sizeof(LayerSnapshot);
+
   for (size_t i = 0; i < num_hw_layers; i++) {
     hwc_layer_1_t &hwc_layer = content_list->hwLayers[i];
     Layer &layer = layer_stack_.layers[i];
     layer = Layer();
+    layer_snapshots_[i] = LayerSnapshot();
 
     // Layer buffer handle address
     layer.input_buffer = reinterpret_cast<LayerBuffer *>(current_address);
@@ -294,6 +325,9 @@ int HWCDisplay::AllocateLayerStack(hwc_display_contents_1_t *content_list) {
     current_address += sizeof(LayerRect);
   }
 
+  layer_stack_memory_.layer_count = layer_count;
+  translate_all_layers_ = true;
+
   return 0;
 }
 
@@ -309,57 +343,97 @@ int HWCDisplay::PrepareLayerStack(hwc_display_contents_1_t *content_list) {
     return 0;
   }
 
+  // Translate only the layer properties which have changed since the previous frame, and report
+  // them to the display engine through the change mask of each layer. If this frame does not make
+  // it through the display engine prepare, everything is translated again in the next frame.
+  bool translate_all = translate_all_layers_;
+  translate_all_layers_ = true;
+
   // Configure each layer
   for (size_t i = 0; i < num_hw_layers; i++) {
     hwc_layer_1_t &hwc_layer = content_list->hwLayers[i];
-    const private_handle_t *pvt_handle = static_cast<const private_handle_t *>(hwc_layer.handle);
-
     Layer &layer = layer_stack_.layers[i];
     LayerBuffer *layer_buffer = layer.input_buffer;
-
-    if (pvt_handle) {
-      layer_buffer->format = GetSDEFormat(pvt_handle->format, pvt_handle->flags);
-      if (layer_buffer->format == kFormatInvalid) {
-        return -EINVAL;
+    LayerSnapshot &snapshot = layer_snapshots_[i];
+    uint32_t change_mask = translate_all ? kLayerChangeAll : 0;
+
+    BufferSnapshot buffer;
+    GetBufferSnapshot(hwc_layer.handle, &buffer);
+    if (translate_all || (snapshot.buffer != buffer)) {
+      int status = SetLayerBuffer(hwc_layer, &layer, &change_mask);
+      if (status) {
+        return status;
       }
+      snapshot.buffer = buffer;
+      change_mask |= kLayerChangeBuffer;
+    }
 
-      layer_buffer->width = pvt_handle->width;
-      layer_buffer->height = pvt_handle->height;
-      if (pvt_handle->bufferType == BUFFER_TYPE_VIDEO) {
-        layer_stack_.flags.video_present = true;
-        layer_buffer->flags.video = true;
-      }
-      if (pvt_handle->flags & private_handle_t::PRIV_FLAGS_SECURE_BUFFER) {
-        layer_stack_.flags.secure_present = true;
-        layer_buffer->flags.secure = true;
-      }
+    // Fences are set afresh for every frame during Commit().
+    layer_buffer->acquire_fence_fd = -1;
+    layer_buffer->release_fence_fd = -1;
 
-      // TODO(user) : Initialize it to display refresh rate
-      layer.frame_rate = 60;
-      MetaData_t *meta_data = reinterpret_cast<MetaData_t *>(pvt_handle->base_metadata);
-      if (meta_data && meta_data->operation & UPDATE_REFRESH_RATE) {
-        layer.frame_rate = meta_data->refreshrate;
-      }
+    if (layer_buffer->flags.video) {
+      layer_stack_.flags.video_present = true;
+    }
+    if (layer_buffer->flags.secure) {
+      layer_stack_.flags.secure_present = true;
     }
 
-    SetRect(hwc_layer.displayFrame, &layer.dst_rect);
-    SetRect(hwc_layer.sourceCropf, &layer.src_rect);
+    LayerRect rect;
+    SetRect(hwc_layer.displayFrame, &rect);
+    if (UpdateRect(rect, &layer.dst_rect)) {
+      change_mask |= kLayerChangeDstRect;
+    }
+    SetRect(hwc_layer.sourceCropf, &rect);
+    if (UpdateRect(rect, &layer.src_rect)) {
+      change_mask |= kLayerChangeSrcRect;
+    }
     for (size_t j = 0; j < hwc_layer.visibleRegionScreen.numRects; j++) {
-        SetRect(hwc_layer.visibleRegionScreen.rects[j], &layer.visible_regions.rect[j]);
+      SetRect(hwc_layer.visibleRegionScreen.rects[j], &rect);
+      if (UpdateRect(rect, &layer.visible_regions.rect[j])) {
+        change_mask |= kLayerChangeVisibleRegion;
+      }
+    }
+    SetRect(hwc_layer.dirtyRect, &rect);
+    if (UpdateRect(rect, &layer.dirty_regions.rect[0])) {
+      change_mask |= kLayerChangeDirtyRegion;
     }
-    SetRect(hwc_layer.dirtyRect, &layer.dirty_regions.rect[0]);
+
+    // Composition is updated by the display engine during prepare, hence set it for every frame.
     SetComposition(hwc_layer.compositionType, &layer.composition);
-    SetBlending(hwc_layer.blending, &layer.blending);
+    if (snapshot.composition != layer.composition) {
+      snapshot.composition = layer.composition;
+      change_mask |= kLayerChangeComposition;
+    }
 
-    LayerTransform &layer_transform = layer.transform;
-    uint32_t &hwc_transform = hwc_layer.transform;
-    layer_transform.flip_horizontal = ((hwc_transform & HWC_TRANSFORM_FLIP_H) > 0);
-    layer_transform.flip_vertical = ((hwc_transform & HWC_TRANSFORM_FLIP_V) > 0);
-    layer_transform.rotation = ((hwc_transform & HWC_TRANSFORM_ROT_90) ? 90.0f : 0.0f);
+    if (translate_all || (snapshot.blending != hwc_layer.blending)) {
+      SetBlending(hwc_layer.blending, &layer.blending);
+      snapshot.blending = hwc_layer.blending;
+      change_mask |= kLayerChangeBlending;
+    }
+
+    if (translate_all || (snapshot.transform != hwc_layer.transform)) {
+      LayerTransform &layer_transform = layer.transform;
+      uint32_t &hwc_transform = hwc_layer.transform;
+      layer_transform.flip_horizontal = ((hwc_transform & HWC_TRANSFORM_FLIP_H) > 0);
+      layer_transform.flip_vertical = ((hwc_transform & HWC_TRANSFORM_FLIP_V) > 0);
+      layer_transform.rotation = ((hwc_transform & HWC_TRANSFORM_ROT_90) ? 90.0f : 0.0f);
+      snapshot.transform = hwc_transform;
+      change_mask |= kLayerChangeTransform;
+    }
+
+    if (layer.plane_alpha != hwc_layer.planeAlpha) {
+      layer.plane_alpha = hwc_layer.planeAlpha;
+      change_mask |= kLayerChangePlaneAlpha;
+    }
 
-    layer.plane_alpha = hwc_layer.planeAlpha;
-    layer.flags.skip = ((hwc_layer.flags & HWC_SKIP_LAYER) > 0);
+    bool skip = ((hwc_layer.flags & HWC_SKIP_LAYER) > 0);
+    if (layer.flags.skip != skip) {
+      layer.flags.skip = skip;
+      change_mask |= kLayerChangeFlags;
+    }
     layer.flags.updating = (layer_stack_cache_.layer_cache[i].handle != hwc_layer.handle);
+    layer.change_mask = change_mask;
 
     if (layer.flags.skip) {
       layer_stack_.flags.skip_present = true;
@@ -380,6 +454,8 @@ int HWCDisplay::PrepareLayerStack(hwc_display_contents_1_t *content_list) {
     return 0;
   }
 
+  translate_all_layers_ = false;
+
   bool needs_fb_refresh = NeedsFrameBufferRefresh(content_list);
 
   for (size_t i = 0; i < num_hw_layers; i++) {
@@ -406,6 +482,73 @@ int HWCDisplay::PrepareLayerStack(hwc_display_contents_1_t *content_list) {
   return 0;
 }
 
+void HWCDisplay::GetBufferSnapshot(buffer_handle_t handle, BufferSnapshot *buffer) {
+  const private_handle_t *pvt_handle = static_cast<const private_handle_t *>(handle);
+
+  *buffer = BufferSnapshot();
+  buffer->handle = handle;
+  if (pvt_handle) {
+    buffer->fd = pvt_handle->fd;
+    buffer->offset = pvt_handle->offset;
+    buffer->format = pvt_handle->format;
+    buffer->width = pvt_handle->width;
+    buffer->height = pvt_handle->height;
+    buffer->flags = pvt_handle->flags;
+    buffer->buffer_type = pvt_handle->bufferType;
+  }
+}
+
+int HWCDisplay::SetLayerBuffer(const hwc_layer_1_t &hwc_layer, Layer *layer,
+                               uint32_t *change_mask) {
+  const private_handle_t *pvt_handle = static_cast<const private_handle_t *>(hwc_layer.handle);
+  LayerBuffer *layer_buffer = layer->input_buffer;
+  LayerBuffer buffer;
+  uint32_t frame_rate = 0;
+
+  if (pvt_handle) {
+    buffer.format = GetSDEFormat(pvt_handle->format, pvt_handle->flags);
+    if (buffer.format == kFormatInvalid) {
+      return -EINVAL;
+    }
+
+    buffer.width = pvt_handle->width;
+    buffer.height = pvt_handle->height;
+    buffer.flags.video = (pvt_handle->bufferType == BUFFER_TYPE_VIDEO);
+
+    // Set here as well as in Commit(), so that the display engine can tell buffers apart during
+    // prepare, e.g. to reuse the rotated output of a buffer.
+    layer_buffer->planes[0].fd = pvt_handle->fd;
+    layer_buffer->planes[0].offset = pvt_handle->offset;
+    layer_buffer->planes[0].stride = pvt_handle->width;
+    buffer.flags.secure = ((pvt_handle->flags & private_handle_t::PRIV_FLAGS_SECURE_BUFFER) > 0);
+
+    // TODO(user) : Initialize it to display refresh rate
+    frame_rate = 60;
+    MetaData_t *meta_data = reinterpret_cast<MetaData_t *>(pvt_handle->base_metadata);
+    if (meta_data && meta_data->operation & UPDATE_REFRESH_RATE) {
+      frame_rate = meta_data->refreshrate;
+    }
+  }
+
+  if ((layer_buffer->format != buffer.format) || (layer_buffer->width != buffer.width) ||
+      (layer_buffer->height != buffer.height) ||
+      (layer_buffer->flags.video != buffer.flags.video) ||
+      (layer_buffer->flags.secure != buffer.flags.secure)) {
+    layer_buffer->format = buffer.format;
+    layer_buffer->width = buffer.width;
+    layer_buffer->height = buffer.height;
+    layer_buffer->flags = buffer.flags;
+    *change_mask |= kLayerChangeBufferFormat;
+  }
+
+  if (layer->frame_rate != frame_rate) {
+    layer->frame_rate = frame_rate;
+    *change_mask |= kLayerChangeFrameRate;
+  }
+
+  return 0;
+}
+
 int HWCDisplay::CommitLayerStack(hwc_display_contents_1_t *content_list) {
   if (!content_list || !content_list->numHwLayers) {
     DLOGW("Invalid content list");
@@ -416,6 +559,12 @@ int HWCDisplay::CommitLayerStack(hwc_display_contents_1_t *content_list) {
 
   size_t num_hw_layers = content_list->numHwLayers;
 
+  // Buffers of the last frame dumped are released once this frame is committed.
+  if (dump_pending_) {
+    HWCFrameDump::Get()->WaitForCopy(UINT32(id_));
+    dump_pending_ = false;
+  }
+
   DumpInputBuffers(content_list);
 
   if (!flush_) {
@@ -462,10 +611,16 @@ int HWCDisplay::PostCommitLayerStack(hwc_display_contents_1_t *content_list) {
     Layer &layer = layer_stack_.layers[i];
     LayerBuffer *layer_buffer = layer_stack_.layers[i].input_buffer;
 
+    // Release fence shared among the layers is materialized only for the layers which report it.
     if (!flush_ && (layer.composition == kCompositionSDE ||
                          layer.composition == kCompositionGPUTarget)) {
-      hwc_layer.releaseFenceFd = layer_buffer->release_fence_fd;
+      if (layer_buffer->release_fence_fd >= 0) {
+        hwc_layer.releaseFenceFd = layer_buffer->release_fence_fd;
+      } else {
+        hwc_layer.releaseFenceFd = SharedFence::ReleaseFd(&layer_buffer->release_fence);
+      }
     }
+    SharedFence::Release(&layer_buffer->release_fence);
 
     if (hwc_layer.acquireFenceFd >= 0) {
       close(hwc_layer.acquireFenceFd);
@@ -478,6 +633,9 @@ int HWCDisplay::PostCommitLayerStack(hwc_display_contents_1_t *content_list) {
     if (dump_frame_count_) {
       dump_frame_count_--;
       dump_frame_index_++;
+      if (!dump_frame_count_) {
+        HWCFrameDump::Get()->Release(UINT32(id_));
+      }
     }
   }
 
@@ -552,6 +710,17 @@ void HWCDisplay::SetRect(const hwc_frect_t &source, LayerRect *target) {
   target->bottom = source.bottom;
 }
 
+bool HWCDisplay::UpdateRect(const LayerRect &source, LayerRect *target) {
+  if ((source.left == target->left) && (source.top == target->top) &&
+      (source.right == target->right) && (source.bottom == target->bottom)) {
+    return false;
+  }
+
+  *target = source;
+
+  return true;
+}
+
 void HWCDisplay::SetComposition(const int32_t &source, LayerComposition *target) {
   switch (source) {
   case HWC_FRAMEBUFFER_TARGET:  *target = kCompositionGPUTarget;  break;
@@ -637,35 +806,33 @@ void HWCDisplay::DumpInputBuffers(hwc_display_contents_1_t *content_list) {
     return;
   }
 
-  for (uint32_t i = 0; i < num_hw_layers; i++) {
+  // Layers are copied and written by the frame dump threads. Frame is dropped as a whole if any of
+  // its layers is not ready.
+  HWCFrameDump::DumpFrame *frame = HWCFrameDump::Get()->BeginFrame(UINT32(id_), dump_frame_index_,
+                                                                   dump_delta_);
+  for (uint32_t i = 0; frame && i < num_hw_layers; i++) {
     hwc_layer_1_t &hwc_layer = content_list->hwLayers[i];
     const private_handle_t *pvt_handle = static_cast<const private_handle_t *>(hwc_layer.handle);
 
-    if (hwc_layer.acquireFenceFd >= 0) {
-      int error = sync_wait(hwc_layer.acquireFenceFd, 1000);
-      if (error < 0) {
-        DLOGW("sync_wait error errno = %d, desc = %s", errno, strerror(errno));
-        return;
-      }
-    }
-
     if (pvt_handle && pvt_handle->base) {
       char dump_file_name[PATH_MAX];
-      size_t result = 0;
 
-      snprintf(dump_file_name, sizeof(dump_file_name), "%s/input_layer%d_%dx%d_%s_frame%d.raw",
+      snprintf(dump_file_name, sizeof(dump_file_name), "%s/input_layer%d_%dx%d_%s_frame%d.dump",
                dir_path, i, pvt_handle->width, pvt_handle->height,
                GetHALPixelFormatString(pvt_handle->format), dump_frame_index_);
 
-      FILE* fp = fopen(dump_file_name, "w+");
-      if (fp) {
-        result = fwrite(reinterpret_cast<void *>(pvt_handle->base), pvt_handle->size, 1, fp);
-        fclose(fp);
+      if (!HWCFrameDump::Get()->QueueLayer(frame, dump_file_name, pvt_handle,
+                                           hwc_layer.acquireFenceFd, i)) {
+        break;
       }
-
-      DLOGI("Frame Dump %s: is %s", dump_file_name, result ? "Successful" : "Failed");
     }
   }
+
+  if (HWCFrameDump::Get()->EndFrame(frame)) {
+    dump_pending_ = true;
+  } else {
+    DLOGW("Frame Dump of frame %d: Failed", dump_frame_index_);
+  }
 }
 
 const char *HWCDisplay::GetHALPixelFormatString(int format) {
@@ -45,6 +45,7 @@ class HWCDisplay : public DisplayEventHandler {
   virtual void SetIdleTimeoutMs(uint32_t timeout_ms);
   virtual int SetActiveConfig(hwc_display_contents_1_t *content_list);
   virtual void SetFrameDumpConfig(uint32_t count, uint32_t bit_mask_layer_type);
+  DisplayInterface *GetDisplayInterface() { return display_intf_; }
 
  protected:
   // Maximum number of layers supported by display engine.
@@ -55,8 +56,42 @@ class HWCDisplay : public DisplayEventHandler {
     static const size_t kSizeSteps = 1024;  // Default memory allocation.
     uint8_t *raw;  // Pointer to byte array.
     size_t size;  // Current number of allocated bytes.
+    uint32_t layer_count;  // Number of layers laid out in the byte array.
 
-    LayerStackMemory() : raw(NULL), size(0) { }
+    LayerStackMemory() : raw(NULL), size(0), layer_count(0) { }
+  };
+
+  // Identity of a layer buffer. A handle can be freed and another buffer be allocated at the same
+  // address, so the properties of the buffer are compared along with the handle.
+  struct BufferSnapshot {
+    buffer_handle_t handle;
+    int fd;
+    uint32_t offset;
+    int format;
+    int width;
+    int height;
+    int flags;
+    int buffer_type;
+
+    BufferSnapshot() : handle(NULL), fd(-1), offset(0), format(0), width(0), height(0), flags(0),
+                       buffer_type(0) { }
+
+    bool operator!=(const BufferSnapshot &buffer) const {
+      return (handle != buffer.handle) || (fd != buffer.fd) || (offset != buffer.offset) ||
+             (format != buffer.format) || (width != buffer.width) || (height != buffer.height) ||
+             (flags != buffer.flags) || (buffer_type != buffer.buffer_type);
+    }
+  };
+
+  // Input properties of a layer as of its last translation, which are not directly comparable with
+  // the translated layer itself.
+  struct LayerSnapshot {
+    BufferSnapshot buffer;
+    LayerComposition composition;
+    int32_t blending;
+    uint32_t transform;
+
+    LayerSnapshot() : composition(kCompositionGPU), blending(0), transform(0) { }
   };
 
   struct LayerCache {
@@ -84,10 +119,13 @@ class HWCDisplay : public DisplayEventHandler {
   virtual int PrepareLayerStack(hwc_display_contents_1_t *content_list);
   virtual int CommitLayerStack(hwc_display_contents_1_t *content_list);
   virtual int PostCommitLayerStack(hwc_display_contents_1_t *content_list);
+  void GetBufferSnapshot(buffer_handle_t handle, BufferSnapshot *buffer);
+  int SetLayerBuffer(const hwc_layer_1_t &hwc_layer, Layer *layer, uint32_t *change_mask);
   bool NeedsFrameBufferRefresh(hwc_display_contents_1_t *content_list);
   void CacheLayerStackInfo(hwc_display_contents_1_t *content_list);
   inline void SetRect(const hwc_rect_t &source, LayerRect *target);
   inline void SetRect(const hwc_frect_t &source, LayerRect *target);
+  inline bool UpdateRect(const LayerRect &source, LayerRect *target);
   inline void SetComposition(const int32_t &source, LayerComposition *target);
   inline void SetComposition(const int32_t &source, int32_t *target);
   inline void SetBlending(const int32_t &source, LayerBlending *target);
@@ -100,6 +138,7 @@ class HWCDisplay : public DisplayEventHandler {
   enum {
     INPUT_LAYER_DUMP,
     OUTPUT_LAYER_DUMP,
+    DELTA_ENCODED_DUMP,
   };
 
   CoreInterface *core_intf_;
@@ -109,12 +148,16 @@ class HWCDisplay : public DisplayEventHandler {
   DisplayInterface *display_intf_;
   LayerStackMemory layer_stack_memory_;
   LayerStack layer_stack_;
+  LayerSnapshot *layer_snapshots_;
+  bool translate_all_layers_;
   LayerStackCache layer_stack_cache_;
   bool flush_;
   LayerBuffer *output_buffer_;
   uint32_t dump_frame_count_;
   uint32_t dump_frame_index_;
   bool dump_input_layers_;
+  bool dump_delta_;
+  bool dump_pending_;           // Last frame dumped is to be copied before its buffers are released
 };
 
 }  // namespace sde
@@ -29,10 +29,10 @@
 
 #include <utils/constants.h>
 #include <gralloc_priv.h>
-#include <sync/sync.h>
 
 #include "hwc_display_virtual.h"
 #include "hwc_debugger.h"
+#include "hwc_frame_dump.h"
 
 #define __CLASS__ "HWCDisplayVirtual"
 
@@ -201,29 +201,25 @@ void HWCDisplayVirtual::DumpOutputBuffer(hwc_display_contents_1_t *content_list)
     return;
   }
 
+  // Buffer is copied and written by the frame dump threads.
   if (output_handle && output_handle->base) {
     char dump_file_name[PATH_MAX];
-    size_t result = 0;
 
-    if (content_list->outbufAcquireFenceFd >= 0) {
-      int error = sync_wait(content_list->outbufAcquireFenceFd, 1000);
-      if (error < 0) {
-        DLOGW("sync_wait error errno = %d, desc = %s", errno,  strerror(errno));
-        return;
-      }
-    }
-
-    snprintf(dump_file_name, sizeof(dump_file_name), "%s/output_layer_%dx%d_%s_frame%d.raw",
+    snprintf(dump_file_name, sizeof(dump_file_name), "%s/output_layer_%dx%d_%s_frame%d.dump",
              dir_path, output_handle->width, output_handle->height,
              GetHALPixelFormatString(output_handle->format), dump_frame_index_);
 
-    FILE* fp = fopen(dump_file_name, "w+");
-    if (fp) {
-      result = fwrite(reinterpret_cast<void *>(output_handle->base), output_handle->size, 1, fp);
-      fclose(fp);
+    HWCFrameDump::DumpFrame *frame = HWCFrameDump::Get()->BeginFrame(UINT32(id_),
+                                                                     dump_frame_index_,
+                                                                     dump_delta_);
+    HWCFrameDump::Get()->QueueLayer(frame, dump_file_name, output_handle,
+                                    content_list->outbufAcquireFenceFd,
+                                    HWCFrameDump::kOutputLayerId);
+    if (HWCFrameDump::Get()->EndFrame(frame)) {
+      dump_pending_ = true;
+    } else {
+      DLOGW("Frame Dump %s: Failed", dump_file_name);
     }
-
-    DLOGI("Frame Dump of %s is %s", dump_file_name, result ? "Successful" : "Failed");
   }
 }
 
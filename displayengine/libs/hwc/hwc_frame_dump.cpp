@@ -0,0 +1,587 @@
+/*
+* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/prctl.h>
+#include <gralloc_priv.h>
+#include <sync/sync.h>
+#include <utils/clock.h>
+#include <utils/constants.h>
+
+#include "hwc_frame_dump.h"
+#include "hwc_debugger.h"
+
+#define __CLASS__ "HWCFrameDump"
+
+namespace sde {
+
+HWCFrameDump *HWCFrameDump::frame_dump_ = NULL;
+Locker HWCFrameDump::instance_locker_;
+
+HWCFrameDump::HWCFrameDump()
+  : copy_thread_created_(false), copy_thread_name_("HWC_FrameCopy"), dump_thread_created_(false),
+    dump_thread_name_("HWC_FrameDump"), slots_(NULL), head_(0), count_(0), active_streams_(0),
+    released_streams_(0), queued_frames_(0), written_frames_(0), delta_layers_(0),
+    dropped_frames_(0), unsignaled_frames_(0), write_failures_(0) {
+}
+
+HWCFrameDump* HWCFrameDump::Get() {
+  // Never destroyed, as the threads are not stopped for the lifetime of the process.
+  HWCFrameDump *frame_dump = __atomic_load_n(&frame_dump_, __ATOMIC_ACQUIRE);
+  if (!frame_dump) {
+    SCOPE_LOCK(instance_locker_);
+
+    frame_dump = frame_dump_;
+    if (!frame_dump) {
+      frame_dump = new HWCFrameDump();
+      __atomic_store_n(&frame_dump_, frame_dump, __ATOMIC_RELEASE);
+    }
+  }
+
+  return frame_dump;
+}
+
+// Frame dump is created by the first frame dumped, there is nothing to report before.
+void HWCFrameDump::AppendDump(char *buffer, uint32_t length) {
+  HWCFrameDump *frame_dump = __atomic_load_n(&frame_dump_, __ATOMIC_ACQUIRE);
+  if (!frame_dump) {
+    return;
+  }
+
+  SCOPE_LOCK(frame_dump->locker_);
+
+  snprintf(buffer, length, "\nhwc frame dump: queued = %u, written = %u (delta layers = %u), "
+           "dropped = %u, unsignaled = %u, write failures = %u, pending = %u\n",
+           frame_dump->queued_frames_, frame_dump->written_frames_, frame_dump->delta_layers_,
+           frame_dump->dropped_frames_, frame_dump->unsignaled_frames_,
+           frame_dump->write_failures_, frame_dump->count_);
+}
+
+HWCFrameDump::DumpFrame* HWCFrameDump::BeginFrame(uint32_t stream_id, uint32_t frame_index,
+                                                  bool delta) {
+  if (stream_id >= kMaxStreams) {
+    return NULL;
+  }
+
+  SCOPE_LOCK(locker_);
+
+  if (!StartThreads()) {
+    return NULL;
+  }
+
+  if (count_ == kMaxQueuedFrames) {
+    dropped_frames_++;
+    return NULL;
+  }
+
+  // Slots hold the layers of several frames, they are allocated only once a display dumps.
+  if (!slots_) {
+    slots_ = new DumpFrame[kMaxQueuedFrames];
+    if (!slots_) {
+      return NULL;
+    }
+  }
+
+  DumpFrame *frame = &slots_[head_];
+  frame->state = kSlotQueuing;
+  frame->dropped = false;
+  frame->stream_id = stream_id;
+  frame->frame_index = frame_index;
+  frame->delta = delta;
+  frame->num_layers = 0;
+
+  head_ = (head_ + 1) % kMaxQueuedFrames;
+  count_++;
+  active_streams_ |= (1U << stream_id);
+  released_streams_ &= ~(1U << stream_id);
+
+  return frame;
+}
+
+// A queuing slot is not touched by the other threads, hence the layer is added without the lock.
+bool HWCFrameDump::QueueLayer(DumpFrame *frame, const char *file_name,
+                              const private_handle_t *handle, int acquire_fence_fd,
+                              uint32_t layer_id) {
+  if (!frame || frame->dropped) {
+    return false;
+  }
+
+  if (!handle || !handle->base || frame->num_layers == kMaxFrameLayers) {
+    frame->dropped = true;
+    return false;
+  }
+
+  DumpLayer &layer = frame->layers[frame->num_layers];
+  layer.fence_fd = -1;
+  if (acquire_fence_fd >= 0) {
+    layer.fence_fd = dup(acquire_fence_fd);
+    if (layer.fence_fd < 0) {
+      DLOGW("Failed to duplicate fence %d, errno = %d, desc = %s", acquire_fence_fd, errno,
+            strerror(errno));
+      frame->dropped = true;
+      return false;
+    }
+  }
+
+  snprintf(layer.file_name, sizeof(layer.file_name), "%s", file_name);
+  layer.layer_id = layer_id;
+  layer.source = reinterpret_cast<const uint8_t *>(handle->base);
+
+  FrameDumpHeader &header = layer.header;
+  header = FrameDumpHeader();
+  header.magic = kFrameDumpMagic;
+  header.version = kFrameDumpVersion;
+  header.width = UINT32(handle->width);
+  header.height = UINT32(handle->height);
+  header.format = UINT32(handle->format);
+  header.encoding = kEncodingRaw;
+  header.frame_index = frame->frame_index;
+  header.base_frame_index = frame->frame_index;
+  header.size = handle->size;
+
+  frame->num_layers++;
+
+  return true;
+}
+
+bool HWCFrameDump::EndFrame(DumpFrame *frame) {
+  if (!frame) {
+    return false;
+  }
+
+  SCOPE_LOCK(locker_);
+
+  // A dropped frame keeps its place in the queue, the dump thread frees it in order.
+  if (frame->dropped || !frame->num_layers) {
+    CloseFences(frame);
+    frame->dropped = true;
+    frame->state = kSlotCopied;
+    dropped_frames_++;
+  } else {
+    frame->state = kSlotQueued;
+    queued_frames_++;
+  }
+  locker_.Broadcast();
+
+  return !frame->dropped;
+}
+
+// Copy thread waits on the fences of a frame for a bounded time, hence so does the caller.
+void HWCFrameDump::WaitForCopy(uint32_t stream_id) {
+  SCOPE_LOCK(locker_);
+
+  while (IsCopyPending(stream_id)) {
+    locker_.Wait();
+  }
+}
+
+void HWCFrameDump::Release(uint32_t stream_id) {
+  SCOPE_LOCK(locker_);
+
+  if (stream_id < kMaxStreams) {
+    released_streams_ |= (1U << stream_id);
+    locker_.Broadcast();
+  }
+}
+
+bool HWCFrameDump::StartThreads() {
+  if (!copy_thread_created_) {
+    int error = pthread_create(&copy_thread_, NULL, &CopyThread, this);
+    if (error) {
+      DLOGE("Failed to start = %s, error = %s", copy_thread_name_, strerror(error));
+      return false;
+    }
+    copy_thread_created_ = true;
+  }
+
+  if (!dump_thread_created_) {
+    int error = pthread_create(&dump_thread_, NULL, &DumpThread, this);
+    if (error) {
+      DLOGE("Failed to start = %s, error = %s", dump_thread_name_, strerror(error));
+      return false;
+    }
+    dump_thread_created_ = true;
+  }
+
+  return true;
+}
+
+void* HWCFrameDump::CopyThread(void *context) {
+  if (context) {
+    return reinterpret_cast<HWCFrameDump *>(context)->CopyThreadHandler();
+  }
+
+  return NULL;
+}
+
+void* HWCFrameDump::CopyThreadHandler() {
+  prctl(PR_SET_NAME, copy_thread_name_, 0, 0, 0);
+
+  locker_.Lock();
+  while (true) {
+    // Frames of different displays are queued in any order, the oldest queued one is copied first.
+    uint32_t tail = (head_ + kMaxQueuedFrames - count_) % kMaxQueuedFrames;
+    DumpFrame *frame = NULL;
+    for (uint32_t i = 0; i < count_ && !frame; i++) {
+      DumpFrame *slot = &slots_[(tail + i) % kMaxQueuedFrames];
+      frame = (slot->state == kSlotQueued) ? slot : NULL;
+    }
+
+    if (!frame) {
+      locker_.Wait();
+      continue;
+    }
+
+    // A copying slot is not touched by the other threads, hence it is copied without the lock.
+    frame->state = kSlotCopying;
+    locker_.Unlock();
+
+    bool unsignaled = false;
+    bool copied = CopyFrame(frame, &unsignaled);
+    CloseFences(frame);
+
+    locker_.Lock();
+    if (!copied) {
+      frame->dropped = true;
+      if (unsignaled) {
+        unsignaled_frames_++;
+      } else {
+        write_failures_++;
+      }
+    }
+    frame->state = kSlotCopied;
+    locker_.Broadcast();
+  }
+
+  locker_.Unlock();
+
+  return NULL;
+}
+
+void* HWCFrameDump::DumpThread(void *context) {
+  if (context) {
+    return reinterpret_cast<HWCFrameDump *>(context)->DumpThreadHandler();
+  }
+
+  return NULL;
+}
+
+void* HWCFrameDump::DumpThreadHandler() {
+  prctl(PR_SET_NAME, dump_thread_name_, 0, 0, 0);
+
+  locker_.Lock();
+  while (true) {
+    DumpFrame *frame = count_ ? &slots_[(head_ + kMaxQueuedFrames - count_) % kMaxQueuedFrames] :
+                                NULL;
+    if (!frame || frame->state != kSlotCopied) {
+      ReleaseStreams();
+      locker_.Wait();
+      continue;
+    }
+
+    // Copied slots are not touched by the other threads, hence the oldest one is written without
+    // the lock.
+    locker_.Unlock();
+
+    uint32_t delta_layers = 0;
+    bool written = !frame->dropped && WriteFrame(frame, &delta_layers);
+
+    locker_.Lock();
+    if (written) {
+      written_frames_++;
+      delta_layers_ += delta_layers;
+    } else if (!frame->dropped) {
+      write_failures_++;
+    }
+    frame->state = kSlotFree;
+    count_--;
+
+    ReleaseStreams();
+  }
+
+  locker_.Unlock();
+
+  return NULL;
+}
+
+bool HWCFrameDump::IsCopyPending(uint32_t stream_id) {
+  uint32_t tail = (head_ + kMaxQueuedFrames - count_) % kMaxQueuedFrames;
+
+  for (uint32_t i = 0; i < count_; i++) {
+    const DumpFrame &frame = slots_[(tail + i) % kMaxQueuedFrames];
+    if ((frame.stream_id == stream_id) &&
+        (frame.state == kSlotQueued || frame.state == kSlotCopying)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Fences of all layers share one timeout, so that a frame is copied or dropped in a bounded time.
+bool HWCFrameDump::CopyFrame(DumpFrame *frame, bool *unsignaled) {
+  int64_t deadline_ns = GetMonotonicTimeNs() + kFenceTimeoutNs;
+
+  for (uint32_t i = 0; i < frame->num_layers; i++) {
+    DumpLayer &layer = frame->layers[i];
+
+    if (layer.fence_fd >= 0) {
+      int64_t timeout_ns = MAX(deadline_ns - GetMonotonicTimeNs(), 0);
+      if (sync_wait(layer.fence_fd, INT(timeout_ns / 1000000)) < 0) {
+        DLOGW("Frame Dump %s: Acquire fence did not signal", layer.file_name);
+        *unsignaled = true;
+        return false;
+      }
+    }
+
+    if (!CopyLayer(&layer)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool HWCFrameDump::CopyLayer(DumpLayer *layer) {
+  size_t size = size_t(layer->header.size);
+  if (layer->capacity < size) {
+    delete[] layer->buffer;
+    layer->buffer = new uint8_t[size];
+    layer->capacity = layer->buffer ? size : 0;
+  }
+
+  if (!layer->buffer) {
+    return false;
+  }
+
+  memcpy(layer->buffer, layer->source, size);
+
+  return true;
+}
+
+void HWCFrameDump::CloseFences(DumpFrame *frame) {
+  for (uint32_t i = 0; i < frame->num_layers; i++) {
+    DumpLayer &layer = frame->layers[i];
+    if (layer.fence_fd >= 0) {
+      close(layer.fence_fd);
+      layer.fence_fd = -1;
+    }
+    layer.source = NULL;
+  }
+}
+
+// Files of a frame which fails to write are removed, so that only complete frames are left.
+bool HWCFrameDump::WriteFrame(DumpFrame *frame, uint32_t *delta_layers) {
+  for (uint32_t i = 0; i < frame->num_layers; i++) {
+    bool delta = false;
+
+    if (!WriteLayer(*frame, &frame->layers[i], &delta)) {
+      for (uint32_t j = 0; j <= i; j++) {
+        unlink(frame->layers[j].file_name);
+      }
+
+      // Layers written before the failure are the delta base of no frame on disk anymore.
+      FreeDeltaStreams(1U << frame->stream_id);
+
+      return false;
+    }
+
+    *delta_layers += delta ? 1 : 0;
+  }
+
+  return true;
+}
+
+bool HWCFrameDump::WriteLayer(const DumpFrame &frame, DumpLayer *layer, bool *delta_written) {
+  FrameDumpHeader &header = layer->header;
+  size_t size = size_t(header.size);
+  DeltaStream *stream = frame.delta ? GetDeltaStream(frame.stream_id, layer->layer_id) : NULL;
+  bool delta = (stream && stream->valid && (stream->size == header.size));
+
+  FILE *fp = fopen(layer->file_name, "w+");
+  if (!fp) {
+    DLOGW("Failed to open %s, errno = %d, desc = %s", layer->file_name, errno, strerror(errno));
+    return false;
+  }
+
+  bool written = false;
+  if (delta) {
+    header.encoding = kEncodingDelta;
+    header.base_frame_index = stream->frame_index;
+    written = (fwrite(&header, sizeof(header), 1, fp) == 1);
+    if (written) {
+      header.payload_size = WriteDelta(fp, layer->buffer, stream->buffer, size);
+
+      // Header is written again now that the payload size is known.
+      written = !fseek(fp, 0, SEEK_SET) && (fwrite(&header, sizeof(header), 1, fp) == 1);
+    }
+  } else {
+    header.payload_size = header.size;
+    written = (fwrite(&header, sizeof(header), 1, fp) == 1) &&
+              (fwrite(layer->buffer, size, 1, fp) == 1);
+  }
+
+  written = written && !ferror(fp);
+  fclose(fp);
+
+  if (!written) {
+    DLOGW("Frame Dump %s: Failed", layer->file_name);
+    return false;
+  }
+
+  DLOGI("Frame Dump %s: Successful", layer->file_name);
+  *delta_written = delta;
+
+  // The written frame becomes the base of the next delta frame of the stream. Buffers are swapped
+  // to avoid a copy, the slot reuses the previous base buffer.
+  if (stream) {
+    uint8_t *buffer = stream->buffer;
+    size_t capacity = stream->capacity;
+    stream->buffer = layer->buffer;
+    stream->capacity = layer->capacity;
+    stream->size = header.size;
+    stream->frame_index = header.frame_index;
+    stream->valid = true;
+    layer->buffer = buffer;
+    layer->capacity = capacity;
+  }
+
+  return true;
+}
+
+size_t HWCFrameDump::WriteDelta(FILE *fp, const uint8_t *buffer, const uint8_t *base,
+                                size_t size) {
+  const size_t word_size = 4;
+  size_t payload_size = 0;
+  size_t offset = 0;
+
+  while (offset < size) {
+    // Skip the unchanged words.
+    while ((offset < size) &&
+           !memcmp(buffer + offset, base + offset, MIN(size - offset, word_size))) {
+      offset += word_size;
+    }
+
+    if (offset >= size) {
+      break;
+    }
+
+    // Find the end of the changed run.
+    size_t end = offset;
+    while ((end < size) && memcmp(buffer + end, base + end, MIN(size - end, word_size))) {
+      end += word_size;
+    }
+    end = MIN(end, size);
+
+    uint32_t run[2] = { UINT32(offset), UINT32(end - offset) };
+    fwrite(run, sizeof(run), 1, fp);
+    fwrite(buffer + offset, end - offset, 1, fp);
+    payload_size += sizeof(run) + end - offset;
+    offset = end;
+  }
+
+  return payload_size;
+}
+
+HWCFrameDump::DeltaStream *HWCFrameDump::GetDeltaStream(uint32_t stream_id, uint32_t layer_id) {
+  DeltaStream *free_stream = NULL;
+
+  for (uint32_t i = 0; i < kMaxDeltaStreams; i++) {
+    DeltaStream &stream = streams_[i];
+    if (stream.valid && (stream.stream_id == stream_id) && (stream.layer_id == layer_id)) {
+      return &stream;
+    }
+
+    if (!stream.valid && !free_stream) {
+      free_stream = &stream;
+    }
+  }
+
+  // Frames of the new layer are written raw if there is no room to track it.
+  if (free_stream) {
+    free_stream->stream_id = stream_id;
+    free_stream->layer_id = layer_id;
+  }
+
+  return free_stream;
+}
+
+void HWCFrameDump::ReleaseStreams() {
+  // A released stream keeps its buffers until its queued frames are written.
+  uint32_t tail = (head_ + kMaxQueuedFrames - count_) % kMaxQueuedFrames;
+  uint32_t pending_streams = 0;
+  for (uint32_t i = 0; i < count_; i++) {
+    pending_streams |= (1U << slots_[(tail + i) % kMaxQueuedFrames].stream_id);
+  }
+
+  uint32_t released_streams = released_streams_ & ~pending_streams;
+  if (!released_streams) {
+    return;
+  }
+
+  FreeDeltaStreams(released_streams);
+
+  released_streams_ &= ~released_streams;
+  active_streams_ &= ~released_streams;
+
+  // Slots are shared by all streams, they are freed once none of the streams is dumping.
+  if (!active_streams_ && !count_) {
+    FreeSlots();
+  }
+}
+
+void HWCFrameDump::FreeDeltaStreams(uint32_t stream_mask) {
+  for (uint32_t i = 0; i < kMaxDeltaStreams; i++) {
+    if (streams_[i].valid && (stream_mask & (1U << streams_[i].stream_id))) {
+      delete[] streams_[i].buffer;
+      streams_[i] = DeltaStream();
+    }
+  }
+}
+
+void HWCFrameDump::FreeSlots() {
+  if (!slots_) {
+    return;
+  }
+
+  for (uint32_t i = 0; i < kMaxQueuedFrames; i++) {
+    for (uint32_t j = 0; j < kMaxFrameLayers; j++) {
+      delete[] slots_[i].layers[j].buffer;
+    }
+  }
+
+  delete[] slots_;
+  slots_ = NULL;
+}
+
+}  // namespace sde
@@ -0,0 +1,200 @@
+/*
+* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __HWC_FRAME_DUMP_H__
+#define __HWC_FRAME_DUMP_H__
+
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <utils/locker.h>
+
+struct private_handle_t;
+
+namespace sde {
+
+// Writes frame dumps on background threads, so that neither buffer copies nor file writes stall the
+// commit path. A frame reserves one of a fixed number of slots for all of its layers, and is
+// dropped as a whole if all slots are in use. The slot keeps a duplicate of the acquire fence of
+// each layer. The copy thread waits on the fences for a bounded time and copies the layers into
+// the slot, and the caller waits for the copy before the buffers may be released to the client,
+// so that a dumped buffer is never read after it is released. A frame which cannot copy all of its
+// layers is dropped, hence every frame written is complete.
+//
+// Frames queued by one display form a stream, identified by the display id. Within a stream, each
+// layer is delta encoded against the last frame written for it.
+//
+// Each dump file starts with a FrameDumpHeader. Raw payload is the buffer as is. Delta payload is
+// the list of 4 byte aligned runs which differ from the last frame written for the same layer,
+// each stored as a uint32_t offset, a uint32_t length and the bytes of the run.
+class HWCFrameDump {
+ public:
+  enum Encoding {
+    kEncodingRaw,
+    kEncodingDelta,
+  };
+
+  struct FrameDumpHeader {
+    uint32_t magic;             // kFrameDumpMagic
+    uint32_t version;           // kFrameDumpVersion
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;            // HAL pixel format
+    uint32_t encoding;          // Encoding of the payload
+    uint32_t frame_index;
+    uint32_t base_frame_index;  // Frame which the delta payload is to be applied on
+    uint64_t size;              // Size of the buffer
+    uint64_t payload_size;      // Size of the payload following the header
+  };
+
+  struct DumpFrame;
+
+  static const uint32_t kFrameDumpMagic = 0x46454453;  // "SDEF"
+  static const uint32_t kFrameDumpVersion = 1;
+  static const uint32_t kMaxStreams = 32;
+  static const uint32_t kMaxFrameLayers = 32;
+  static const uint32_t kOutputLayerId = 0xFF;   // Layer id of the output buffer of a display
+
+  static HWCFrameDump* Get();
+
+  // Reports the counters of the frame dump, if it has been used.
+  static void AppendDump(char *buffer, uint32_t length);
+
+  // Reserves a slot for a frame of the stream. Returns NULL if the frame is dropped.
+  DumpFrame* BeginFrame(uint32_t stream_id, uint32_t frame_index, bool delta);
+  // Adds the buffer to the frame, to be copied once its acquire fence signals. Caller retains the
+  // ownership of the fence. Returns false if the frame is dropped.
+  bool QueueLayer(DumpFrame *frame, const char *file_name, const private_handle_t *handle,
+                  int acquire_fence_fd, uint32_t layer_id);
+  // Hands the frame over to the copy thread, or frees its slot if the frame is dropped. Returns
+  // false if the frame is dropped.
+  bool EndFrame(DumpFrame *frame);
+  // Waits until the buffers of the frames queued by the stream are copied. Caller has to wait
+  // before the buffers of a queued frame are released to the client.
+  void WaitForCopy(uint32_t stream_id);
+  // Frees the buffers held for the stream, once its queued frames are written.
+  void Release(uint32_t stream_id);
+
+ private:
+  static const uint32_t kMaxQueuedFrames = 3;
+  static const uint32_t kMaxDeltaStreams = 16;
+  static const int64_t kFenceTimeoutNs = 100000000LL;  // Wait for the acquire fences of a frame
+
+  enum SlotState {
+    kSlotFree,
+    kSlotQueuing,             // Owned by the display queuing the frame
+    kSlotQueued,              // Waiting for the copy thread
+    kSlotCopying,             // Owned by the copy thread
+    kSlotCopied,              // Copied or dropped, owned by the dump thread
+  };
+
+  struct DumpLayer {
+    char file_name[PATH_MAX];
+    uint32_t layer_id;
+    FrameDumpHeader header;
+    const uint8_t *source;    // Buffer held by the display until the copy is done
+    int fence_fd;             // Duplicate of the acquire fence of the buffer
+    uint8_t *buffer;          // Copy of the buffer content
+    size_t capacity;
+
+    DumpLayer() : layer_id(0), source(NULL), fence_fd(-1), buffer(NULL), capacity(0) { }
+  };
+
+  // Last frame written for a layer of a stream, base of the next delta encoded frame.
+  struct DeltaStream {
+    bool valid;
+    uint32_t stream_id;
+    uint32_t layer_id;
+    uint32_t frame_index;
+    uint64_t size;
+    uint8_t *buffer;
+    size_t capacity;
+
+    DeltaStream() : valid(false), stream_id(0), layer_id(0), frame_index(0), size(0),
+                    buffer(NULL), capacity(0) { }
+  };
+
+  HWCFrameDump();
+  bool StartThreads();
+  static void* CopyThread(void *context);
+  void* CopyThreadHandler();
+  static void* DumpThread(void *context);
+  void* DumpThreadHandler();
+  bool IsCopyPending(uint32_t stream_id);
+  bool CopyFrame(DumpFrame *frame, bool *unsignaled);
+  bool CopyLayer(DumpLayer *layer);
+  void CloseFences(DumpFrame *frame);
+  bool WriteFrame(DumpFrame *frame, uint32_t *delta_layers);
+  bool WriteLayer(const DumpFrame &frame, DumpLayer *layer, bool *delta);
+  size_t WriteDelta(FILE *fp, const uint8_t *buffer, const uint8_t *base, size_t size);
+  DeltaStream *GetDeltaStream(uint32_t stream_id, uint32_t layer_id);
+  void ReleaseStreams();
+  void FreeDeltaStreams(uint32_t stream_mask);
+  void FreeSlots();
+
+  static HWCFrameDump *frame_dump_;
+  static Locker instance_locker_;
+
+  Locker locker_;
+  pthread_t copy_thread_;
+  bool copy_thread_created_;
+  const char *copy_thread_name_;
+  pthread_t dump_thread_;
+  bool dump_thread_created_;
+  const char *dump_thread_name_;
+  DumpFrame *slots_;            // Allocated on the first frame, freed once all streams release
+  uint32_t head_;               // Slot to be reserved next
+  uint32_t count_;              // Number of reserved slots, starting from the oldest one
+  uint32_t active_streams_;     // Bit mask of streams which queued frames since their release
+  uint32_t released_streams_;   // Bit mask of streams whose buffers are to be freed
+  DeltaStream streams_[kMaxDeltaStreams];
+  uint32_t queued_frames_;
+  uint32_t written_frames_;
+  uint32_t delta_layers_;
+  uint32_t dropped_frames_;     // Writer was behind, all slots were in use
+  uint32_t unsignaled_frames_;  // Acquire fence of a layer did not signal within the timeout
+  uint32_t write_failures_;
+};
+
+struct HWCFrameDump::DumpFrame {
+  SlotState state;
+  bool dropped;
+  uint32_t stream_id;
+  uint32_t frame_index;
+  bool delta;
+  uint32_t num_layers;
+  DumpLayer layers[kMaxFrameLayers];
+
+  DumpFrame() : state(kSlotFree), dropped(false), stream_id(0), frame_index(0), delta(false),
+                num_layers(0) { }
+};
+
+}  // namespace sde
+
+#endif  // __HWC_FRAME_DUMP_H__
@@ -41,6 +41,7 @@
 #include "hwc_buffer_sync_handler.h"
 #include "hwc_session.h"
 #include "hwc_debugger.h"
+#include "hwc_frame_dump.h"
 
 #define __CLASS__ "HWCSession"
 
@@ -66,7 +67,8 @@ Locker HWCSession::locker_;
 
 HWCSession::HWCSession(const hw_module_t *module) : core_intf_(NULL), hwc_procs_(NULL),
             display_primary_(NULL), display_external_(NULL), display_virtual_(NULL),
-            hotplug_thread_exit_(false), hotplug_thread_name_("HWC_HotPlugThread") {
+            hotplug_thread_exit_(false), hotplug_thread_name_("HWC_HotPlugThread"),
+            prepare_thread_name_("HWC_PrepareThread") {
   hwc_composer_device_1_t::common.tag = HARDWARE_DEVICE_TAG;
   hwc_composer_device_1_t::common.version = HWC_DEVICE_API_VERSION_1_4;
   hwc_composer_device_1_t::common.module = const_cast<hw_module_t*>(module);
@@ -141,8 +143,17 @@ int HWCSession::Init() {
     return status;
   }
 
+  status = StartPrepareWorkers();
+  if (status) {
+    display_primary_->Deinit();
+    delete display_primary_;
+    CoreInterface::DestroyCore();
+    return status;
+  }
+
   if (pthread_create(&hotplug_thread_, NULL, &HWCHotPlugThread, this) < 0) {
     DLOGE("Failed to start = %s, error = %s HDMI display Not supported", hotplug_thread_name_);
+    StopPrepareWorkers();
     display_primary_->Deinit();
     delete display_primary_;
     CoreInterface::DestroyCore();
@@ -158,6 +169,7 @@ int HWCSession::Deinit() {
   delete display_primary_;
   hotplug_thread_exit_ = true;
   pthread_join(hotplug_thread_, NULL);
+  StopPrepareWorkers();
 
   DisplayError error = CoreInterface::DestroyCore();
   if (error != kErrorNone) {
@@ -217,18 +229,19 @@ int HWCSession::Prepare(hwc_composer_device_1 *device, size_t num_displays,
   }
 
   HWCSession *hwc_session = static_cast<HWCSession *>(device);
+  HWCDisplay *hwc_display[HWC_NUM_DISPLAY_TYPES] = { NULL };
+
+  num_displays = MIN(num_displays, HWC_NUM_DISPLAY_TYPES);
 
   for (ssize_t i = (num_displays-1); i >= 0; i--) {
     hwc_display_contents_1_t *content_list = displays[i];
 
     switch (i) {
     case HWC_DISPLAY_PRIMARY:
-      hwc_session->display_primary_->Prepare(content_list);
+      hwc_display[i] = hwc_session->display_primary_;
       break;
     case HWC_DISPLAY_EXTERNAL:
-      if (hwc_session->display_external_) {
-        hwc_session->display_external_->Prepare(content_list);
-      }
+      hwc_display[i] = hwc_session->display_external_;
       break;
     case HWC_DISPLAY_VIRTUAL:
       if (hwc_session->ValidateContentList(content_list)) {
@@ -237,19 +250,152 @@ int HWCSession::Prepare(hwc_composer_device_1 *device, size_t num_displays,
         hwc_session->DestroyVirtualDisplay(hwc_session);
       }
 
-      if (hwc_session->display_virtual_) {
-        hwc_session->display_virtual_->Prepare(content_list);
-      }
+      hwc_display[i] = hwc_session->display_virtual_;
       break;
     default:
       break;
     }
   }
 
+  hwc_session->PrepareDisplays(hwc_display, displays, num_displays);
+
   // Return 0, else client will go into bad state
   return 0;
 }
 
+void HWCSession::PrepareDisplays(HWCDisplay **hwc_display, hwc_display_contents_1_t **displays,
+                                 size_t num_displays) {
+  DisplayInterface *prepare_order[HWC_NUM_DISPLAY_TYPES];
+  uint32_t num_active_displays = 0;
+
+  // Display engine reserves resources for the displays in the serial order of virtual, external
+  // and then primary display, while rest of their prepare overlaps.
+  for (ssize_t i = (num_displays-1); i >= 0; i--) {
+    if (hwc_display[i]) {
+      prepare_order[num_active_displays++] = hwc_display[i]->GetDisplayInterface();
+    }
+  }
+
+  if (num_active_displays <= 1) {
+    for (ssize_t i = (num_displays-1); i >= 0; i--) {
+      if (hwc_display[i]) {
+        hwc_display[i]->Prepare(displays[i]);
+      }
+    }
+
+    return;
+  }
+
+  core_intf_->SetPrepareOrder(prepare_order, num_active_displays);
+
+  for (size_t i = 0; i < num_displays; i++) {
+    if (hwc_display[i] && i != HWC_DISPLAY_PRIMARY) {
+      PrepareWorker &worker = prepare_workers_[i];
+      SCOPE_LOCK(worker.locker);
+      worker.display = hwc_display[i];
+      worker.content_list = displays[i];
+      worker.pending = true;
+      worker.locker.Signal();
+    }
+  }
+
+  // Primary display is prepared on the caller thread.
+  if (hwc_display[HWC_DISPLAY_PRIMARY]) {
+    hwc_display[HWC_DISPLAY_PRIMARY]->Prepare(displays[HWC_DISPLAY_PRIMARY]);
+    core_intf_->EndPrepare(hwc_display[HWC_DISPLAY_PRIMARY]->GetDisplayInterface());
+  }
+
+  for (size_t i = 0; i < num_displays; i++) {
+    if (hwc_display[i] && i != HWC_DISPLAY_PRIMARY) {
+      PrepareWorker &worker = prepare_workers_[i];
+      SCOPE_LOCK(worker.locker);
+      while (worker.pending) {
+        worker.locker.Wait();
+      }
+    }
+  }
+
+  core_intf_->SetPrepareOrder(NULL, 0);
+}
+
+int HWCSession::StartPrepareWorkers() {
+  for (int i = 0; i < HWC_NUM_DISPLAY_TYPES; i++) {
+    PrepareWorker &worker = prepare_workers_[i];
+
+    if (i == HWC_DISPLAY_PRIMARY) {
+      continue;
+    }
+
+    worker.hwc_session = this;
+    worker.exit = false;
+    int error = pthread_create(&worker.thread, NULL, &HWCPrepareThread, &worker);
+    if (error) {
+      DLOGE("Failed to start = %s, error = %s", prepare_thread_name_, strerror(error));
+      StopPrepareWorkers();
+      return -error;
+    }
+    worker.thread_created = true;
+  }
+
+  return 0;
+}
+
+void HWCSession::StopPrepareWorkers() {
+  for (int i = 0; i < HWC_NUM_DISPLAY_TYPES; i++) {
+    PrepareWorker &worker = prepare_workers_[i];
+
+    if (!worker.thread_created) {
+      continue;
+    }
+
+    {
+      SCOPE_LOCK(worker.locker);
+      worker.exit = true;
+      worker.locker.Signal();
+    }
+
+    pthread_join(worker.thread, NULL);
+    worker.thread_created = false;
+  }
+}
+
+void* HWCSession::HWCPrepareThread(void *context) {
+  if (context) {
+    PrepareWorker *worker = reinterpret_cast<PrepareWorker *>(context);
+    return worker->hwc_session->HWCPrepareThreadHandler(worker);
+  }
+
+  return NULL;
+}
+
+void* HWCSession::HWCPrepareThreadHandler(PrepareWorker *worker) {
+  prctl(PR_SET_NAME, prepare_thread_name_, 0, 0, 0);
+  setpriority(PRIO_PROCESS, 0, HAL_PRIORITY_URGENT_DISPLAY);
+
+  worker->locker.Lock();
+  while (true) {
+    while (!worker->pending && !worker->exit) {
+      worker->locker.Wait();
+    }
+
+    if (worker->exit) {
+      break;
+    }
+
+    worker->locker.Unlock();
+    worker->display->Prepare(worker->content_list);
+    // Displays behind this one in the reservation order proceed, even if prepare bailed out early.
+    core_intf_->EndPrepare(worker->display->GetDisplayInterface());
+    worker->locker.Lock();
+
+    worker->pending = false;
+    worker->locker.Signal();
+  }
+  worker->locker.Unlock();
+
+  return NULL;
+}
+
 int HWCSession::Set(hwc_composer_device_1 *device, size_t num_displays,
                     hwc_display_contents_1_t **displays) {
   DTRACE_SCOPED();
@@ -373,7 +519,12 @@ void HWCSession::Dump(hwc_composer_device_1 *device, char *buffer, int length) {
     return;
   }
 
-  DumpInterface::GetDump(buffer, length);
+  uint32_t dump_length = 0;
+  DumpInterface::GetDump(buffer, UINT32(length), kDumpFormatText, &dump_length);
+
+  if (dump_length < UINT32(length)) {
+    HWCFrameDump::AppendDump(buffer + dump_length, UINT32(length) - dump_length);
+  }
 }
 
 int HWCSession::GetDisplayConfigs(hwc_composer_device_1 *device, int disp, uint32_t *configs,
@@ -558,7 +709,12 @@ DisplayError HWCSession::Hotplug(const CoreEventHotplug &hotplug) {
 }
 
 android::status_t HWCSession::notifyCallback(uint32_t command, const android::Parcel *input_parcel,
-                                             android::Parcel */*output_parcel*/) {
+                                             android::Parcel *output_parcel) {
+  // Trace export writes a file, it takes the lock only while the trace is being copied.
+  if (command == qService::IQService::DUMP_TRACE) {
+    return DumpTrace(input_parcel, output_parcel);
+  }
+
   SEQUENCE_WAIT_SCOPE_LOCK(locker_);
 
   switch (command) {
@@ -581,6 +737,13 @@ android::status_t HWCSession::notifyCallback(uint32_t command, const android::Pa
     SetFrameDumpConfig(input_parcel);
     break;
 
+  case qService::IQService::RESET_DISPLAY_STATS:
+    DumpInterface::ResetStats();
+    break;
+
+  case qService::IQService::GET_DISPLAY_DUMP:
+    return GetDisplayDump(input_parcel, output_parcel);
+
   default:
     DLOGW("QService command = %d is not supported", command);
     return -EINVAL;
@@ -613,6 +776,92 @@ void HWCSession::SetFrameDumpConfig(const android::Parcel *input_parcel) {
   }
 }
 
+android::status_t HWCSession::GetDisplayDump(const android::Parcel *input_parcel,
+                                             android::Parcel *output_parcel) {
+  DumpFormat format = kDumpFormatText;
+  if (input_parcel->readInt32() == qService::IQService::DUMP_FORMAT_COMPACT) {
+    format = kDumpFormatCompact;
+  }
+
+  if (!output_parcel) {
+    return -EINVAL;
+  }
+
+  char *buffer = new char[kMaxDumpLength];
+  if (!buffer) {
+    return -ENOMEM;
+  }
+
+  uint32_t dump_length = 0;
+  DumpInterface::GetDump(buffer, kMaxDumpLength, format, &dump_length);
+  output_parcel->writeCString(buffer);
+
+  delete[] buffer;
+
+  return 0;
+}
+
+android::status_t HWCSession::DumpTrace(const android::Parcel *input_parcel,
+                                        android::Parcel *output_parcel) {
+  int mode = input_parcel->readInt32();
+
+  switch (mode) {
+  case qService::IQService::TRACE_DISABLE:
+  case qService::IQService::TRACE_ENABLE:
+    Trace::SetEnabled(mode == qService::IQService::TRACE_ENABLE);
+    break;
+
+  case qService::IQService::TRACE_ATRACE_DISABLE:
+  case qService::IQService::TRACE_ATRACE_ENABLE:
+    Trace::SetAtraceHandler((mode == qService::IQService::TRACE_ATRACE_ENABLE) ?
+                            HWCDebugHandler::Get() : NULL);
+    break;
+
+  case qService::IQService::TRACE_EXPORT:
+    {
+      TraceRecord *records = NULL;
+      int count = 0;
+      {
+        SEQUENCE_WAIT_SCOPE_LOCK(locker_);
+        count = Trace::Snapshot(&records);
+      }
+      if (count < 0) {
+        DLOGE("Failed to copy trace records, error = %d", count);
+        return count;
+      }
+
+      const char *file_name = "/data/misc/display/sde_trace.json";
+      FILE *fp = fopen(file_name, "w");
+      if (!fp) {
+        int error = errno;
+        DLOGE("Failed to open %s, error = %s", file_name, strerror(error));
+        delete[] records;
+        return -error;
+      }
+
+      count = Trace::ExportChromeJson(records, count, fp);
+      fclose(fp);
+      delete[] records;
+      if (count < 0) {
+        DLOGE("Failed to export trace to %s, error = %d", file_name, count);
+        return count;
+      }
+
+      DLOGI("Exported %d trace records to %s", count, file_name);
+      if (output_parcel) {
+        output_parcel->writeInt32(count);
+      }
+    }
+    break;
+
+  default:
+    DLOGW("Trace mode = %d is not supported", mode);
+    return -EINVAL;
+  }
+
+  return 0;
+}
+
 void HWCSession::DynamicDebug(const android::Parcel *input_parcel) {
   int type = input_parcel->readInt32();
   bool enable = (input_parcel->readInt32() > 0);
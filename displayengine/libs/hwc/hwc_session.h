@@ -49,6 +49,23 @@ class HWCSession : hwc_composer_device_1_t, CoreEventHandler, public qClient::Bn
   int Deinit();
 
  private:
+  static const uint32_t kMaxDumpLength = 64 * 1024;
+
+  // Worker thread which prepares a non-primary display concurrently with the primary display.
+  struct PrepareWorker {
+    HWCSession *hwc_session;
+    pthread_t thread;
+    bool thread_created;
+    Locker locker;
+    HWCDisplay *display;
+    hwc_display_contents_1_t *content_list;
+    bool pending;
+    bool exit;
+
+    PrepareWorker() : hwc_session(NULL), thread_created(false), display(NULL), content_list(NULL),
+                      pending(false), exit(false) { }
+  };
+
   // hwc methods
   static int Open(const hw_module_t *module, const char* name, hw_device_t **device);
   static int Close(hw_device_t *device);
@@ -68,6 +85,14 @@ class HWCSession : hwc_composer_device_1_t, CoreEventHandler, public qClient::Bn
   static int GetActiveConfig(hwc_composer_device_1 *device, int disp);
   static int SetActiveConfig(hwc_composer_device_1 *device, int disp, int index);
 
+  // Prepare threads for external and virtual displays
+  static void* HWCPrepareThread(void *context);
+  void* HWCPrepareThreadHandler(PrepareWorker *worker);
+  int StartPrepareWorkers();
+  void StopPrepareWorkers();
+  void PrepareDisplays(HWCDisplay **hwc_display, hwc_display_contents_1_t **displays,
+                       size_t num_displays);
+
   // Hotplug thread for HDMI connect/disconnect
   static void* HWCHotPlugThread(void *context);
   void* HWCHotPlugThreadHandler();
@@ -85,6 +110,10 @@ class HWCSession : hwc_composer_device_1_t, CoreEventHandler, public qClient::Bn
                                            android::Parcel *output_parcel);
   void DynamicDebug(const android::Parcel *input_parcel);
   void SetFrameDumpConfig(const android::Parcel *input_parcel);
+  android::status_t GetDisplayDump(const android::Parcel *input_parcel,
+                                   android::Parcel *output_parcel);
+  android::status_t DumpTrace(const android::Parcel *input_parcel,
+                              android::Parcel *output_parcel);
 
   static Locker locker_;
   CoreInterface *core_intf_;
@@ -97,6 +126,8 @@ class HWCSession : hwc_composer_device_1_t, CoreEventHandler, public qClient::Bn
   const char *hotplug_thread_name_;
   HWCBufferAllocator *buffer_allocator_;
   HWCBufferSyncHandler *buffer_sync_handler_;
+  PrepareWorker prepare_workers_[HWC_NUM_DISPLAY_TYPES];   // Not used for primary display
+  const char *prepare_thread_name_;
 };
 
 }  // namespace sde
@@ -0,0 +1,18 @@
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE                  := hwc_frame_dump_test
+LOCAL_VENDOR_MODULE           := true
+LOCAL_MODULE_TAGS             := optional
+LOCAL_C_INCLUDES              := hardware/qcom/display/displayengine/include/ \
+                                 hardware/qcom/display/libgralloc/
+LOCAL_CFLAGS                  := -Wno-missing-field-initializers -Wno-unused-parameter \
+                                 -Wconversion -Wall -Werror \
+                                 -DLOG_TAG=\"SDE\"
+LOCAL_SHARED_LIBRARIES        := libsde libutils libcutils libsync libsdeutils
+LOCAL_SRC_FILES               := frame_dump_test.cpp \
+                                 ../hwc_frame_dump.cpp \
+                                 ../hwc_debugger.cpp
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,358 @@
+/*
+* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Dumps frames of several displays concurrently through HWCFrameDump. Each display thread cycles
+// every layer through a few buffers at display rate, and overwrites the buffers of a frame as soon
+// as they are released, like a client which reuses a buffer once it gets it back. One display
+// queues without waiting, so that frames which do not fit the queue are dropped. Every dump file is
+// then decoded, applying delta payloads on the last frame written for the layer, and compared
+// against the content the buffer had when its acquire fence signaled. Every frame is either written
+// with all of its layers or not at all. Frames with an acquire fence which never signals are
+// dropped, frames with a fence which signals after the frame is queued are copied once it signals.
+//
+// Usage: hwc_frame_dump_test [output directory]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <gralloc_priv.h>
+#include <utils/constants.h>
+
+#include "../hwc_frame_dump.h"
+
+namespace sde {
+
+static const uint32_t kNumDisplays = 3;
+static const uint32_t kNumLayers = 6;
+static const uint32_t kNumFrames = 20;
+static const uint32_t kNumBuffers = 3;
+static const uint32_t kFramePeriodUs = 16667;
+static const uint32_t kWidth = 64;
+static const uint32_t kHeight = 64;
+static const uint32_t kBufferSize = kWidth * kHeight * 4;
+
+static const char *output_dir_ = "/data/local/tmp";
+static uint8_t expected_[kNumDisplays][kNumLayers][kNumFrames][kBufferSize];
+
+static void GetFileName(uint32_t display, uint32_t layer, uint32_t frame, char *name,
+                        size_t length) {
+  snprintf(name, length, "%s/frame_dump_test_%u_%u_%u.dump", output_dir_, display, layer, frame);
+}
+
+// One row changes every frame, rest of the buffer stays the same, so that most frames are delta
+// encoded.
+static void FillBuffer(uint8_t *buffer, uint32_t display, uint32_t layer, uint32_t frame) {
+  uint32_t row_size = kWidth * 4;
+  uint32_t changed_row = frame % kHeight;
+
+  for (uint32_t i = 0; i < kBufferSize; i++) {
+    if ((i / row_size) == changed_row) {
+      buffer[i] = UINT8(frame * 7 + layer);
+    } else {
+      buffer[i] = UINT8(display * 31 + layer + (i >> 10));
+    }
+  }
+}
+
+// Every few frames, a layer of the frame waits on a fence which never signals.
+static bool IsUnsignaledFrame(uint32_t display, uint32_t frame) {
+  return (frame % 7) == (display + 3);
+}
+
+// Every few other frames, a layer of the frame is rendered after the frame is queued, and its fence
+// signals then.
+static bool IsLateFrame(uint32_t display, uint32_t frame) {
+  return (frame % 5) == (display + 1);
+}
+
+static uint8_t *GetBuffer(uint8_t *buffers, uint32_t layer, uint32_t frame) {
+  return buffers + ((frame % kNumBuffers) * kNumLayers + layer) * kBufferSize;
+}
+
+static void* QueueFrames(void *context) {
+  uint32_t display = UINT32(reinterpret_cast<uintptr_t>(context));
+  uint8_t *buffers = new uint8_t[kNumBuffers * kNumLayers * kBufferSize];
+  int unsignaled_fence[2] = { -1, -1 };
+  int late_fence[2] = { -1, -1 };
+
+  // Read end of an empty pipe never becomes readable, like a fence which never signals. Writing
+  // to the pipe signals it.
+  if (pipe(unsignaled_fence) < 0) {
+    delete[] buffers;
+    return NULL;
+  }
+
+  for (uint32_t frame = 0; frame < kNumFrames; frame++) {
+    // Buffers of the previous frame are released by this commit, and overwritten by the client.
+    HWCFrameDump::Get()->WaitForCopy(display);
+    if (frame) {
+      memset(GetBuffer(buffers, 0, frame - 1), 0xA5, kNumLayers * kBufferSize);
+    }
+    if (late_fence[0] >= 0) {
+      close(late_fence[0]);
+      close(late_fence[1]);
+      late_fence[0] = late_fence[1] = -1;
+    }
+
+    bool late = IsLateFrame(display, frame) && (pipe(late_fence) == 0);
+    HWCFrameDump::DumpFrame *dump_frame = HWCFrameDump::Get()->BeginFrame(display, frame, true);
+
+    for (uint32_t layer = 0; layer < kNumLayers; layer++) {
+      uint8_t *buffer = GetBuffer(buffers, layer, frame);
+      bool late_layer = late && (layer == kNumLayers / 2);
+      int fence_fd = late_layer ? late_fence[0] : -1;
+      char file_name[PATH_MAX];
+
+      if (IsUnsignaledFrame(display, frame) && layer == kNumLayers / 2) {
+        fence_fd = unsignaled_fence[0];
+      }
+
+      FillBuffer(buffer, display, layer, frame);
+      memcpy(expected_[display][layer][frame], buffer, kBufferSize);
+      if (late_layer) {
+        // Not rendered yet, a dump which read it before its fence signaled would differ.
+        memset(buffer, 0xA5, kBufferSize);
+      }
+      GetFileName(display, layer, frame, file_name, sizeof(file_name));
+
+      private_handle_t handle(-1, kBufferSize, 0, 0, HAL_PIXEL_FORMAT_RGBA_8888, kWidth, kHeight);
+      handle.base = reinterpret_cast<uintptr_t>(buffer);
+      HWCFrameDump::Get()->QueueLayer(dump_frame, file_name, &handle, fence_fd, layer);
+    }
+
+    HWCFrameDump::Get()->EndFrame(dump_frame);
+
+    if (late) {
+      usleep(2000);
+      memcpy(GetBuffer(buffers, kNumLayers / 2, frame),
+             expected_[display][kNumLayers / 2][frame], kBufferSize);
+      char signal = 0;
+      if (write(late_fence[1], &signal, sizeof(signal)) != sizeof(signal)) {
+        printf("FAIL display %u frame %u: failed to signal the fence\n", display, frame);
+      }
+    }
+
+    if (display) {
+      usleep(kFramePeriodUs);
+    }
+  }
+
+  HWCFrameDump::Get()->WaitForCopy(display);
+  HWCFrameDump::Get()->Release(display);
+  close(unsignaled_fence[0]);
+  close(unsignaled_fence[1]);
+  if (late_fence[0] >= 0) {
+    close(late_fence[0]);
+    close(late_fence[1]);
+  }
+  delete[] buffers;
+
+  return NULL;
+}
+
+struct FrameDumpStats {
+  uint32_t queued;
+  uint32_t written;
+  uint32_t delta_layers;
+  uint32_t dropped;
+  uint32_t unsignaled;
+  uint32_t write_failures;
+  uint32_t pending;
+};
+
+// Frame dump reports its counters only through the dumpsys text.
+static bool GetStats(FrameDumpStats *stats) {
+  char dump[256] = { 0 };
+
+  HWCFrameDump::AppendDump(dump, sizeof(dump));
+
+  return sscanf(dump, "\nhwc frame dump: queued = %u, written = %u (delta layers = %u), "
+                "dropped = %u, unsignaled = %u, write failures = %u, pending = %u",
+                &stats->queued, &stats->written, &stats->delta_layers, &stats->dropped,
+                &stats->unsignaled, &stats->write_failures, &stats->pending) == 7;
+}
+
+static bool WaitForWriter(FrameDumpStats *stats) {
+  for (uint32_t i = 0; i < 1000; i++) {
+    if (GetStats(stats) && !stats->pending) {
+      return true;
+    }
+    usleep(10000);
+  }
+
+  return false;
+}
+
+// Returns false if the frame is malformed or differs. Dropped frames have no file, and leave the
+// content of the layer as it was.
+static bool CheckFile(uint32_t display, uint32_t layer, uint32_t frame, uint8_t *content,
+                      int32_t *last_frame, bool *found) {
+  char file_name[PATH_MAX];
+  HWCFrameDump::FrameDumpHeader header;
+  bool valid = true;
+
+  GetFileName(display, layer, frame, file_name, sizeof(file_name));
+  FILE *fp = fopen(file_name, "r");
+  *found = (fp != NULL);
+  if (!fp) {
+    return true;
+  }
+
+  valid = (fread(&header, sizeof(header), 1, fp) == 1) && (header.size == kBufferSize) &&
+          (header.frame_index == frame);
+
+  if (valid && header.encoding == HWCFrameDump::kEncodingDelta) {
+    // Content still holds the last frame written for the layer.
+    uint32_t run[2];
+    valid = (INT32(header.base_frame_index) == *last_frame);
+    while (valid && fread(run, sizeof(run), 1, fp) == 1) {
+      valid = (run[0] + run[1] <= kBufferSize) && (fread(content + run[0], run[1], 1, fp) == 1);
+    }
+  } else if (valid) {
+    valid = (fread(content, kBufferSize, 1, fp) == 1);
+  }
+
+  fclose(fp);
+  unlink(file_name);
+  *last_frame = INT32(frame);
+
+  if (!valid || memcmp(content, expected_[display][layer][frame], kBufferSize)) {
+    printf("FAIL display %u layer %u frame %u: %s\n", display, layer, frame,
+           valid ? "content differs" : "malformed dump");
+    return false;
+  }
+
+  return true;
+}
+
+static int Run() {
+  pthread_t threads[kNumDisplays];
+  uint32_t total_frames = kNumDisplays * kNumFrames;
+  uint32_t unsignaled_frames = 0;
+  FrameDumpStats stats;
+
+  // Nothing is reported, nor allocated, before the first frame is dumped.
+  if (GetStats(&stats)) {
+    printf("FAIL frame dump reported before the first frame\n");
+    return 1;
+  }
+
+  for (uint32_t i = 0; i < kNumDisplays; i++) {
+    pthread_create(&threads[i], NULL, QueueFrames, reinterpret_cast<void *>(uintptr_t(i)));
+  }
+
+  for (uint32_t i = 0; i < kNumDisplays; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  if (!WaitForWriter(&stats)) {
+    printf("FAIL writer did not finish\n");
+    return 1;
+  }
+
+  // Queued frames whose fences never signal are dropped by the copy thread.
+  if ((stats.queued + stats.dropped != total_frames) ||
+      (stats.written + stats.unsignaled != stats.queued) || stats.write_failures) {
+    printf("FAIL %u frames: queued = %u, written = %u, dropped = %u, write failures = %u\n",
+           total_frames, stats.queued, stats.written, stats.dropped, stats.write_failures);
+    return 1;
+  }
+
+  // Layers of a frame are read after their fences signal and before they are released, and frames
+  // waiting on a fence which never signals are never written.
+  uint8_t *content[kNumLayers];
+  int32_t last_frame[kNumLayers];
+  uint32_t frames = 0;
+  bool valid = true;
+  for (uint32_t display = 0; display < kNumDisplays; display++) {
+    for (uint32_t layer = 0; layer < kNumLayers; layer++) {
+      content[layer] = new uint8_t[kBufferSize];
+      last_frame[layer] = -1;
+    }
+
+    for (uint32_t frame = 0; frame < kNumFrames; frame++) {
+      uint32_t layers = 0;
+      for (uint32_t layer = 0; layer < kNumLayers; layer++) {
+        bool found = false;
+        valid = CheckFile(display, layer, frame, content[layer], &last_frame[layer], &found) &&
+                valid;
+        layers += found ? 1 : 0;
+      }
+
+      if (layers && layers != kNumLayers) {
+        printf("FAIL display %u frame %u: %u of %u layers written\n", display, frame, layers,
+               kNumLayers);
+        valid = false;
+      }
+
+      if (IsUnsignaledFrame(display, frame)) {
+        unsignaled_frames++;
+        if (layers) {
+          printf("FAIL display %u frame %u: written before its fence signaled\n", display, frame);
+          valid = false;
+        }
+      }
+
+      frames += layers ? 1 : 0;
+    }
+
+    for (uint32_t layer = 0; layer < kNumLayers; layer++) {
+      delete[] content[layer];
+    }
+  }
+
+  if (!valid) {
+    return 1;
+  }
+
+  // Unsignaled frames which found no free slot are dropped before their fences are checked.
+  if (frames != stats.written || !stats.unsignaled || stats.unsignaled > unsignaled_frames) {
+    printf("FAIL %u frames written, %u complete frames found, %u of %u unsignaled frames dropped\n",
+           stats.written, frames, stats.unsignaled, unsignaled_frames);
+    return 1;
+  }
+
+  printf("%u frames: written = %u (delta layers = %u), dropped = %u, unsignaled = %u\n",
+         total_frames, stats.written, stats.delta_layers, stats.dropped, stats.unsignaled);
+  printf("PASS\n");
+
+  return 0;
+}
+
+}  // namespace sde
+
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    sde::output_dir_ = argv[1];
+  }
+
+  return sde::Run();
+}
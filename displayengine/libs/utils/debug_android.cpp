@@ -70,5 +70,23 @@ uint32_t Debug::GetIdleTimeoutMs() {
   return 0;
 }
 
+uint32_t Debug::GetRotatorBufferBudgetMB() {
+  char property[PROPERTY_VALUE_MAX];
+  if (property_get("debug.sde.rotator_budget_mb", property, NULL) > 0) {
+    return atoi(property);
+  }
+
+  return 0;
+}
+
+bool Debug::IsPartialUpdateDisabled() {
+  char property[PROPERTY_VALUE_MAX];
+  if (property_get("debug.sde.partial_update_disable", property, NULL) > 0) {
+    return (atoi(property) == 1);
+  }
+
+  return false;
+}
+
 }  // namespace sde
 
@@ -0,0 +1,414 @@
+/*
+* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Exercises the per thread trace rings. Writer threads wrap their rings many times while snapshots
+// are taken concurrently, and every snapshot has to hold only whole, consecutive records of each
+// ring. Rings of exited threads have to be reused by new threads instead of growing the list of
+// rings. Snapshots exported as Chrome trace JSON have to parse, with one trace event per record.
+//
+// Depends on nothing but libc and pthreads, so that it is also built as a host executable. Outside
+// of the Android build it can be built from this directory with:
+//   g++ -std=c++11 -I../../../include trace_test.cpp ../trace.cpp -o sde_trace_test -lpthread
+//
+// Usage: sde_trace_test
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <utils/constants.h>
+#include <utils/trace.h>
+
+namespace sde {
+
+static const uint32_t kNumWriters = 4;
+static const uint32_t kRingSize = 2048;      // Records in the ring of each thread
+// The oldest record of a full ring is the one its owner overwrites next, so snapshots skip it.
+static const uint32_t kSnapshotSize = kRingSize - 1;
+static const uint32_t kNumSnapshots = 200;
+
+static const TraceEvent kWriteEvent = { "TraceTest", "Write" };
+static const TraceEvent kReuseEvent = { "TraceTest", "Reuse" };
+
+static uint32_t started_writers_ = 0;
+static bool stop_writers_ = false;
+static uint64_t written_[kNumWriters];
+
+// Records sequence numbers until stopped, at least enough to wrap the ring a few times.
+static void* WriteRecords(void *context) {
+  uint64_t writer = UINT64(reinterpret_cast<uintptr_t>(context));
+  uint64_t sequence = 0;
+
+  Trace::Record(kTagNone, kTracePhaseInstant, &kWriteEvent, writer, sequence++);
+  __atomic_add_fetch(&started_writers_, 1, __ATOMIC_RELEASE);
+
+  while (sequence < 4 * kRingSize || !__atomic_load_n(&stop_writers_, __ATOMIC_ACQUIRE)) {
+    Trace::Record(kTagNone, kTracePhaseInstant, &kWriteEvent, writer, sequence++);
+  }
+  written_[writer] = sequence;
+
+  return NULL;
+}
+
+static void* WriteReuseRecord(void *context) {
+  Trace::Record(kTagNone, kTracePhaseInstant, &kReuseEvent, 0, 0);
+
+  return NULL;
+}
+
+// Records of a ring are contiguous in a snapshot. At most kSnapshotSize records of each ring are
+// taken, which are consecutive sequence numbers of one writer. When writers are done, the snapshot
+// of each ring holds the last kSnapshotSize records of its writer.
+static bool CheckSnapshot(const TraceRecord *records, int count, bool done) {
+  uint32_t rings[kNumWriters] = { 0 };
+  int start = 0;
+
+  while (start < count) {
+    const TraceRecord &first = records[start];
+    if (first.event != &kWriteEvent || first.arg0 >= kNumWriters) {
+      printf("FAIL record %d: unexpected event\n", start);
+      return false;
+    }
+
+    int end = start + 1;
+    while (end < count && records[end].tid == first.tid && records[end].arg0 == first.arg0) {
+      const TraceRecord &previous = records[end - 1];
+      const TraceRecord &record = records[end];
+      if (record.event != &kWriteEvent || record.arg1 != previous.arg1 + 1 ||
+          record.timestamp < previous.timestamp) {
+        printf("FAIL writer %" PRIu64 ": record %" PRIu64 " follows %" PRIu64 "\n", first.arg0,
+               record.arg1, previous.arg1);
+        return false;
+      }
+      end++;
+    }
+
+    uint32_t length = UINT32(end - start);
+    uint64_t last = records[end - 1].arg1;
+    if (length > kSnapshotSize) {
+      printf("FAIL writer %" PRIu64 ": %u records in a ring\n", first.arg0, length);
+      return false;
+    }
+    if (done && (length != kSnapshotSize || last + 1 != written_[first.arg0])) {
+      printf("FAIL writer %" PRIu64 ": %u records up to %" PRIu64 ", %" PRIu64 " written\n",
+             first.arg0, length, last, written_[first.arg0]);
+      return false;
+    }
+
+    rings[first.arg0]++;
+    start = end;
+  }
+
+  for (uint32_t i = 0; done && i < kNumWriters; i++) {
+    if (rings[i] != 1) {
+      printf("FAIL writer %u: %u rings\n", i, rings[i]);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool TestConcurrentWriters() {
+  pthread_t threads[kNumWriters];
+  bool valid = true;
+
+  for (uint32_t i = 0; i < kNumWriters; i++) {
+    if (pthread_create(&threads[i], NULL, WriteRecords, reinterpret_cast<void *>(uintptr_t(i)))) {
+      printf("FAIL failed to start writer %u\n", i);
+      return false;
+    }
+  }
+
+  // No writer may exit before all of them own a ring, or a later one would reuse its ring.
+  while (__atomic_load_n(&started_writers_, __ATOMIC_ACQUIRE) < kNumWriters) {
+    sched_yield();
+  }
+
+  for (uint32_t i = 0; i < kNumSnapshots && valid; i++) {
+    TraceRecord *records = NULL;
+    int count = Trace::Snapshot(&records);
+    valid = CheckSnapshot(records, count, false);
+    delete[] records;
+  }
+
+  __atomic_store_n(&stop_writers_, true, __ATOMIC_RELEASE);
+  for (uint32_t i = 0; i < kNumWriters; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  if (!valid) {
+    return false;
+  }
+
+  TraceRecord *records = NULL;
+  int count = Trace::Snapshot(&records);
+  valid = CheckSnapshot(records, count, true);
+  delete[] records;
+
+  if (valid && count != INT(kNumWriters * kSnapshotSize)) {
+    printf("FAIL %d records of %u writers\n", count, kNumWriters);
+    return false;
+  }
+
+  return valid;
+}
+
+// Rings of the writers, which have exited, are taken over by new threads. Each new thread
+// overwrites the oldest record of the ring it reuses, so the number of records does not change.
+static bool TestRingReuse() {
+  pthread_t threads[kNumWriters];
+
+  for (uint32_t i = 0; i < kNumWriters; i++) {
+    if (pthread_create(&threads[i], NULL, WriteReuseRecord, NULL)) {
+      printf("FAIL failed to start thread %u\n", i);
+      return false;
+    }
+  }
+
+  for (uint32_t i = 0; i < kNumWriters; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  TraceRecord *records = NULL;
+  int count = Trace::Snapshot(&records);
+  int32_t tids[kNumWriters];
+  uint32_t reused = 0;
+
+  for (int i = 0; i < count; i++) {
+    if (records[i].event != &kReuseEvent) {
+      continue;
+    }
+
+    for (uint32_t j = 0; j < reused; j++) {
+      if (tids[j] == records[i].tid) {
+        printf("FAIL thread %d recorded twice\n", records[i].tid);
+        count = -1;
+      }
+    }
+    if (reused < kNumWriters) {
+      tids[reused] = records[i].tid;
+    }
+    reused++;
+  }
+  delete[] records;
+
+  if (count != INT(kNumWriters * kSnapshotSize) || reused != kNumWriters) {
+    printf("FAIL %d records, %u of %u new threads found, rings were not reused\n", count, reused,
+           kNumWriters);
+    return false;
+  }
+
+  return true;
+}
+
+static void SkipSpace(const char **json) {
+  while (**json == ' ' || **json == '\n' || **json == '\r' || **json == '\t') {
+    (*json)++;
+  }
+}
+
+static bool ParseValue(const char **json, int depth, int *events);
+
+static bool ParseString(const char **json) {
+  if (**json != '"') {
+    return false;
+  }
+
+  for ((*json)++; **json != '"'; (*json)++) {
+    if (!**json || UINT8(**json) < 0x20) {
+      return false;
+    }
+    if (**json == '\\') {
+      (*json)++;
+      if (!strchr("\"\\/bfnrtu", **json) || !**json) {
+        return false;
+      }
+    }
+  }
+  (*json)++;
+
+  return true;
+}
+
+static bool ParseNumber(const char **json) {
+  char *end = NULL;
+
+  if (**json != '-' && (**json < '0' || **json > '9')) {
+    return false;
+  }
+  strtod(*json, &end);
+  *json = end;
+
+  return true;
+}
+
+// Counts the elements of the arrays directly inside the top level object, i.e. traceEvents.
+static bool ParseContainer(const char **json, int depth, int *events, bool object) {
+  char close = object ? '}' : ']';
+
+  (*json)++;
+  SkipSpace(json);
+  if (**json == close) {
+    (*json)++;
+    return true;
+  }
+
+  while (true) {
+    if (object) {
+      if (!ParseString(json)) {
+        return false;
+      }
+      SkipSpace(json);
+      if (**json != ':') {
+        return false;
+      }
+      (*json)++;
+      SkipSpace(json);
+    }
+
+    if (!ParseValue(json, depth + 1, events)) {
+      return false;
+    }
+    if (!object && depth == 1) {
+      (*events)++;
+    }
+
+    SkipSpace(json);
+    if (**json == close) {
+      (*json)++;
+      return true;
+    }
+    if (**json != ',') {
+      return false;
+    }
+    (*json)++;
+    SkipSpace(json);
+  }
+}
+
+static bool ParseValue(const char **json, int depth, int *events) {
+  static const char *kLiterals[] = { "true", "false", "null" };
+
+  SkipSpace(json);
+
+  switch (**json) {
+  case '{':
+    return ParseContainer(json, depth, events, true);
+  case '[':
+    return ParseContainer(json, depth, events, false);
+  case '"':
+    return ParseString(json);
+  case 't':
+  case 'f':
+  case 'n':
+    for (uint32_t i = 0; i < sizeof(kLiterals) / sizeof(kLiterals[0]); i++) {
+      size_t length = strlen(kLiterals[i]);
+      if (!strncmp(*json, kLiterals[i], length)) {
+        *json += length;
+        return true;
+      }
+    }
+    return false;
+  default:
+    return ParseNumber(json);
+  }
+}
+
+static bool CheckChromeJson(const TraceRecord *records, int count) {
+  FILE *fp = tmpfile();
+  if (!fp) {
+    printf("FAIL failed to create a temporary file, errno = %d\n", errno);
+    return false;
+  }
+
+  int exported = Trace::ExportChromeJson(records, count, fp);
+  long size = ftell(fp);
+  char *json = new char[size + 1];
+  rewind(fp);
+  size_t read = fread(json, 1, size_t(size), fp);
+  json[read] = '\0';
+  fclose(fp);
+
+  const char *cursor = json;
+  int events = 0;
+  bool valid = ParseValue(&cursor, 0, &events);
+  SkipSpace(&cursor);
+  valid = valid && !*cursor;
+  delete[] json;
+
+  if (exported != count || !valid || events != count) {
+    printf("FAIL %d of %d records exported, %s JSON with %d trace events\n", exported, count,
+           valid ? "valid" : "invalid", events);
+    return false;
+  }
+
+  return true;
+}
+
+static bool TestChromeJson() {
+  static const TraceEvent kScopeEvent = { "TraceTest", "Scope" };
+  TraceRecord *records = NULL;
+
+  // Every phase is exported, on top of the records of the other tests.
+  Trace::Record(kTagStrategy, kTracePhaseBegin, &kScopeEvent, 1, UINT64(-1));
+  Trace::Record(kTagStrategy, kTracePhaseEnd, &kScopeEvent, 0, 0);
+  Trace::Record(kTagOfflineCtrl, kTracePhaseInstant, &kScopeEvent, 2, 3);
+
+  int count = Trace::Snapshot(&records);
+  bool valid = (count > 0) && CheckChromeJson(records, count) && CheckChromeJson(records, 0);
+  delete[] records;
+
+  if (Trace::Snapshot(NULL) != -EINVAL || Trace::ExportChromeJson(NULL, 1, stdout) != -EINVAL) {
+    printf("FAIL invalid arguments are not rejected\n");
+    return false;
+  }
+
+  return valid;
+}
+
+static int Run() {
+  if (!TestConcurrentWriters() || !TestRingReuse() || !TestChromeJson()) {
+    return 1;
+  }
+
+  printf("PASS\n");
+
+  return 0;
+}
+
+}  // namespace sde
+
+int main() {
+  return sde::Run();
+}
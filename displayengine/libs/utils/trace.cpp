@@ -0,0 +1,221 @@
+/*
+* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <utils/clock.h>
+#include <utils/trace.h>
+
+namespace sde {
+
+// Number of records in the ring of each thread, must be a power of two.
+static const uint32_t kTraceRecordCount = 2048;
+
+struct TraceBuffer {
+  TraceRecord records[kTraceRecordCount];
+  uint32_t head;              // Number of records ever written, advanced by the owner thread only
+  bool in_use;                // Owned by a live thread
+  int32_t tid;                // Owner thread
+  TraceBuffer *next;
+};
+
+static const char *kTraceTagName[] = { "sde", "resources", "strategy", "comp_manager",
+                                       "driver_config", "buffer_manager", "offline_ctrl" };
+
+static const char kTracePhaseName[] = { 'B', 'E', 'i' };
+
+std::atomic<bool> Trace::enabled_(true);
+DebugHandler *Trace::atrace_handler_ = NULL;
+
+// Buffers are never freed. A buffer is handed over to a new thread once its owner thread exits.
+static TraceBuffer *trace_buffers_ = NULL;
+static __thread TraceBuffer *thread_trace_buffer_ = NULL;
+static pthread_key_t trace_buffer_key_;
+static pthread_once_t trace_buffer_key_once_ = PTHREAD_ONCE_INIT;
+
+static void ReleaseTraceBuffer(void *buffer) {
+  __atomic_store_n(&reinterpret_cast<TraceBuffer *>(buffer)->in_use, false, __ATOMIC_RELEASE);
+}
+
+static void CreateTraceBufferKey() {
+  pthread_key_create(&trace_buffer_key_, ReleaseTraceBuffer);
+}
+
+static TraceBuffer *AcquireTraceBuffer() {
+  TraceBuffer *buffer = __atomic_load_n(&trace_buffers_, __ATOMIC_ACQUIRE);
+
+  // Reuse the buffer of an exited thread, if any.
+  for (; buffer; buffer = buffer->next) {
+    bool in_use = false;
+    if (__atomic_compare_exchange_n(&buffer->in_use, &in_use, true, false, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_RELAXED)) {
+      break;
+    }
+  }
+
+  if (!buffer) {
+    buffer = reinterpret_cast<TraceBuffer *>(calloc(1, sizeof(TraceBuffer)));
+    if (!buffer) {
+      return NULL;
+    }
+
+    buffer->in_use = true;
+    buffer->next = __atomic_load_n(&trace_buffers_, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&trace_buffers_, &buffer->next, buffer, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+  }
+
+  buffer->tid = INT32(syscall(SYS_gettid));
+
+  pthread_once(&trace_buffer_key_once_, CreateTraceBufferKey);
+  pthread_setspecific(trace_buffer_key_, buffer);
+  thread_trace_buffer_ = buffer;
+
+  return buffer;
+}
+
+void Trace::Record(DebugTag tag, TracePhase phase, const TraceEvent *event, uint64_t arg0,
+                   uint64_t arg1) {
+  TraceBuffer *buffer = thread_trace_buffer_;
+  if (UNLIKELY(!buffer)) {
+    buffer = AcquireTraceBuffer();
+    if (!buffer) {
+      return;
+    }
+  }
+
+  uint32_t head = buffer->head;
+  TraceRecord &record = buffer->records[head & (kTraceRecordCount - 1)];
+  record.timestamp = UINT64(GetMonotonicTimeNs());
+  record.event = event;
+  record.arg0 = arg0;
+  record.arg1 = arg1;
+  record.tag = static_cast<uint16_t>(tag);
+  record.phase = static_cast<uint16_t>(phase);
+  record.tid = buffer->tid;
+
+  // Publish the record to the exporter.
+  __atomic_store_n(&buffer->head, head + 1, __ATOMIC_RELEASE);
+}
+
+int Trace::Snapshot(TraceRecord **records) {
+  if (!records) {
+    return -EINVAL;
+  }
+
+  // Buffers are only ever added at the head of the list, so the list starting at the head loaded
+  // here does not change while being copied.
+  TraceBuffer *buffers = __atomic_load_n(&trace_buffers_, __ATOMIC_ACQUIRE);
+  uint32_t num_buffers = 0;
+  for (TraceBuffer *buffer = buffers; buffer; buffer = buffer->next) {
+    num_buffers++;
+  }
+
+  *records = new TraceRecord[num_buffers * kTraceRecordCount];
+  if (!*records) {
+    return -ENOMEM;
+  }
+
+  int count = 0;
+  for (TraceBuffer *buffer = buffers; buffer; buffer = buffer->next) {
+    TraceRecord *copy = *records + count;
+    uint32_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+    uint32_t start = (head > kTraceRecordCount) ? (head - kTraceRecordCount) : 0;
+    for (uint32_t i = start; i < head; i++) {
+      copy[i - start] = buffer->records[i & (kTraceRecordCount - 1)];
+    }
+
+    // Records which the owner thread may have overwritten while being copied are discarded.
+    uint32_t new_head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+    uint32_t valid_start = start;
+    if ((new_head + 1) > (start + kTraceRecordCount)) {
+      valid_start = new_head + 1 - kTraceRecordCount;
+    }
+
+    if (valid_start >= head) {
+      continue;
+    }
+
+    uint32_t valid_count = head - valid_start;
+    memmove(copy, copy + (valid_start - start), valid_count * sizeof(TraceRecord));
+    count += INT(valid_count);
+  }
+
+  return count;
+}
+
+int Trace::ExportChromeJson(const TraceRecord *records, int count, FILE *fp) {
+  if (!fp || (count && !records)) {
+    return -EINVAL;
+  }
+
+  int pid = INT(getpid());
+  const char *separator = "";
+  uint32_t num_tags = UINT32(sizeof(kTraceTagName) / sizeof(kTraceTagName[0]));
+
+  fprintf(fp, "{\"traceEvents\":[");
+
+  for (int i = 0; i < count; i++) {
+    const TraceRecord &record = records[i];
+    const TraceEvent *event = record.event;
+    const char *tag_name = (record.tag < num_tags) ? kTraceTagName[record.tag] : "sde";
+    char phase = (record.phase < sizeof(kTracePhaseName)) ? kTracePhaseName[record.phase] : 'i';
+
+    fprintf(fp, "%s\n{\"name\":\"%s::%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%" PRIu64 ".%03u,"
+            "\"pid\":%d,\"tid\":%d", separator, event->class_name, event->name, tag_name, phase,
+            record.timestamp / 1000, UINT32(record.timestamp % 1000), pid, record.tid);
+    if (record.phase == kTracePhaseInstant) {
+      fprintf(fp, ",\"s\":\"t\"");
+    }
+    if (record.phase != kTracePhaseEnd) {
+      fprintf(fp, ",\"args\":{\"arg0\":%" PRIu64 ",\"arg1\":%" PRIu64 "}", record.arg0,
+              record.arg1);
+    }
+    fprintf(fp, "}");
+
+    separator = ",";
+  }
+
+  fprintf(fp, "\n],\"displayTimeUnit\":\"ns\"}\n");
+
+  if (ferror(fp)) {
+    return -EIO;
+  }
+
+  return count;
+}
+
+}  // namespace sde
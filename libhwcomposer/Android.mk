@@ -35,3 +35,5 @@ LOCAL_SRC_FILES               := hwc.cpp          \
                                  hwc_ad.cpp \
                                  hwc_virtual.cpp
 include $(BUILD_SHARED_LIBRARY)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
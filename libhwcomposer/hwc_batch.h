@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2012-2013, 2015, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are retained
+ * for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HWC_BATCH_H
+#define HWC_BATCH_H
+
+#include <stdint.h>
+
+namespace qhwc {
+
+/* Finds the largest batch of cached layers that can be composed on FB.
+ * Layers are given as bitmasks indexed by z-order, so at most 32 of them;
+ * dropped layers are in neither cachedMask nor updatingMask. overlap[i] holds
+ * the updating layers intersecting cached layer i, and vice versa.
+ *
+ * A batch spans [batchStart, batchEnd] and carries the cached layers in that
+ * range; updating layers in the range stay on MDP and are either staged
+ * below the FB (a prefix of them in z-order) or above it (the remaining
+ * suffix). An updating layer can go below the FB only if no cached layer
+ * under it in the batch intersects it, and above the FB only if no cached
+ * layer over it in the batch does. Both conditions only get stricter as the
+ * batch grows, so for every start the batch is extended until it turns
+ * illegal, which keeps the search at O(n^2) bit operations.
+ *
+ * maxBatchCount is only updated by a larger batch. Returns the z-order of
+ * the FB, or -1 if no batch was found */
+inline int findFBBatch(int layerCount, uint32_t cachedMask,
+        uint32_t updatingMask, const uint32_t* overlap,
+        int& maxBatchStart, int& maxBatchEnd, int& maxBatchCount) {
+    int fbZOrder = -1;
+    int nonDroppedBelow = 0;
+
+    for(int start = 0; start < layerCount; start++) {
+        if(!(cachedMask & (1u << start))) {
+            nonDroppedBelow += !!(updatingMask & (1u << start));
+            continue;
+        }
+
+        uint32_t batchCached = 0;
+        uint32_t batchUpdating = 0;
+        //Updating layers that cannot be staged below/above the FB
+        uint32_t notBelow = 0;
+        uint32_t notAbove = 0;
+        int batchCount = 0;
+
+        for(int end = start; end < layerCount; end++) {
+            const uint32_t bit = 1u << end;
+            if(cachedMask & bit) {
+                notAbove |= overlap[end] & batchUpdating;
+                batchCached |= bit;
+                batchCount++;
+            } else if(updatingMask & bit) {
+                if(overlap[end] & batchCached)
+                    notBelow |= bit;
+                batchUpdating |= bit;
+            } else {
+                continue;
+            }
+
+            //Updating layers up to the highest one that cannot go above the
+            //FB must all be able to go below it.
+            const int split = notAbove ? (32 - __builtin_clz(notAbove)) : start;
+            if(notBelow && split > __builtin_ctz(notBelow))
+                break;
+
+            if((cachedMask & bit) && batchCount > maxBatchCount) {
+                maxBatchCount = batchCount;
+                maxBatchStart = start;
+                maxBatchEnd = end;
+                fbZOrder = nonDroppedBelow + __builtin_popcount(batchUpdating &
+                        ((split < 32) ? ((1u << split) - 1) : ~0u));
+            }
+        }
+        nonDroppedBelow++;
+    }
+    return fbZOrder;
+}
+
+}; //namespace
+#endif
@@ -27,6 +27,7 @@
 #include <overlayRotator.h>
 #include <overlayCursor.h>
 #include "hwc_copybit.h"
+#include "hwc_batch.h"
 #include "qd_utils.h"
 
 using namespace overlay;
@@ -36,6 +37,9 @@ namespace ovutils = overlay::utils;
 
 namespace qhwc {
 
+//getBatch tracks the app layers in 32 bit masks
+static_assert(MAX_NUM_APP_LAYERS <= 32, "getBatch needs a mask bit per layer");
+
 //==============MDPComp========================================================
 
 IdleInvalidator *MDPComp::sIdleInvalidator = NULL;
@@ -68,7 +72,8 @@ MDPComp* MDPComp::getObject(hwc_context_t *ctx, const int& dpy) {
     return new MDPCompNonSplit(dpy);
 }
 
-MDPComp::MDPComp(int dpy) : mDpy(dpy), mModeOn(false), mPrevModeOn(false) {
+MDPComp::MDPComp(int dpy) : mDpy(dpy), mFrameSig(0), mLoadBasedAttempts(0),
+        mLoadBasedPruned(0), mModeOn(false), mPrevModeOn(false) {
 };
 
 void MDPComp::dump(android::String8& buf, hwc_context_t *ctx)
@@ -101,6 +106,21 @@ void MDPComp::dump(android::String8& buf, hwc_context_t *ctx)
                 ctx->listStats[mDpy].lRoi.right,
                 ctx->listStats[mDpy].lRoi.bottom);
     }
+    dumpsys_log(buf, "Strategy: %s (%s) \n",
+                getStrategyName(mPlan.selected), mPlan.reason);
+    for(int i = 0; i < mPlan.count; i++) {
+        const StrategyCost& cand = mPlan.candidates[i];
+        dumpsys_log(buf, "  %-15s mdpKB:%6llu gpuKPix:%6llu pipes:%d "
+                    "rot:%d costKB:%6llu %s \n",
+                    getStrategyName(cand.strategy),
+                    (unsigned long long)(cand.mdpBytes / 1024),
+                    (unsigned long long)(cand.gpuPixels / 1024),
+                    cand.pipeCount, cand.rotCount,
+                    (unsigned long long)(cand.cost / 1024),
+                    cand.result ? cand.result : "not attempted");
+    }
+    dumpsys_log(buf, "Load based batches: validated:%d pruned:%d \n",
+                mLoadBasedAttempts, mLoadBasedPruned);
     dumpsys_log(buf," ---------------------------------------------  \n");
     dumpsys_log(buf," listIdx | cached? | mdpIndex | comptype  |  Z  \n");
     dumpsys_log(buf," ---------------------------------------------  \n");
@@ -333,15 +353,8 @@ MDPComp::FrameInfo::FrameInfo() {
 }
 
 void MDPComp::FrameInfo::reset(const int& numLayers) {
-    for(int i = 0 ; i < MAX_NUM_BLEND_STAGES; i++ ) {
-        if(mdpToLayer[i].pipeInfo) {
-            delete mdpToLayer[i].pipeInfo;
-            mdpToLayer[i].pipeInfo = NULL;
-            //We dont own the rotator
-            mdpToLayer[i].rot = NULL;
-        }
-    }
-
+    //Pipe infos live in the per display pools and we dont own the rotator,
+    //dropping the references is enough.
     memset(&mdpToLayer, 0, sizeof(mdpToLayer));
     memset(&layerToMDP, -1, sizeof(layerToMDP));
     memset(&isFBComposed, 1, sizeof(isFBComposed));
@@ -372,12 +385,20 @@ void MDPComp::LayerCache::reset() {
     memset(&isFBComposed, true, sizeof(isFBComposed));
     memset(&drop, false, sizeof(drop));
     layerCount = 0;
+    fbCount = 0;
+    mdpCount = 0;
+    fbZ = -1;
+    frameSig = 0;
+    strategy = MDPCOMP_STRAT_NONE;
 }
 
 void MDPComp::LayerCache::updateCounts(const FrameInfo& curFrame) {
     layerCount = curFrame.layerCount;
     memcpy(&isFBComposed, &curFrame.isFBComposed, sizeof(isFBComposed));
     memcpy(&drop, &curFrame.drop, sizeof(drop));
+    fbCount = curFrame.fbCount;
+    mdpCount = curFrame.mdpCount;
+    fbZ = curFrame.fbZ;
 }
 
 bool MDPComp::LayerCache::isSameFrame(const FrameInfo& curFrame,
@@ -417,6 +438,22 @@ bool MDPComp::LayerCache::isSameFrame(hwc_context_t *ctx, int dpy,
     return true;
 }
 
+MDPComp::StrategyPlan::StrategyPlan() {
+    reset();
+}
+
+void MDPComp::StrategyPlan::reset() {
+    memset(&candidates, 0, sizeof(candidates));
+    count = 0;
+    selected = MDPCOMP_STRAT_NONE;
+    reason = "not planned";
+}
+
+void MDPComp::StrategyPlan::select(eStrategy strategy, const char *why) {
+    selected = strategy;
+    reason = why;
+}
+
 bool MDPComp::isSupportedForMDPComp(hwc_context_t *ctx, hwc_layer_1_t* layer) {
     private_handle_t *hnd = (private_handle_t *)layer->handle;
     if((has90Transform(layer) and (not isRotationDoable(ctx, hnd))) ||
@@ -915,16 +952,28 @@ bool MDPComp::tryFullFrame(hwc_context_t *ctx,
     }
 
     //If all above hard conditions are met we can do full or partial MDP comp.
-    bool ret = false;
-    if(fullMDPComp(ctx, list)) {
-        ret = true;
-    } else if(fullMDPCompWithPTOR(ctx, list)) {
-        ret = true;
-    } else if(partialMDPComp(ctx, list)) {
-        ret = true;
+    //Nothing but buffers changed since the last frame, skip the search.
+    if(tryPreviousStrategy(ctx, list)) {
+        return true;
     }
 
-    return ret;
+    //Attempt the candidates cheapest first, the first one to pass
+    //postHeuristicsHandling wins.
+    planStrategies(ctx, list);
+    for(int i = 0; i < mPlan.count; i++) {
+        StrategyCost& candidate = mPlan.candidates[i];
+        if(candidate.result)
+            continue;
+        if(tryStrategy(ctx, list, candidate.strategy)) {
+            candidate.result = "selected";
+            mPlan.select(candidate.strategy, (i == 0) ?
+                    "lowest estimated cost" : "cheaper candidates failed");
+            return true;
+        }
+        candidate.result = "failed";
+    }
+
+    return false;
 }
 
 bool MDPComp::fullMDPComp(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
@@ -1200,24 +1249,314 @@ bool MDPComp::fullMDPCompWithPTOR(hwc_context_t *ctx,
     return result;
 }
 
-bool MDPComp::partialMDPComp(hwc_context_t *ctx, hwc_display_contents_1_t* list)
-{
-    if(!sEnableMixedMode) {
-        //Mixed mode is disabled. No need to even try caching.
+/* Cost model weights. Costs are expressed in bytes of memory traffic:
+ * a GPU composed pixel is read, blended against the FB target and written
+ * back, and every pipe staged on the mixer carries a fixed setup and
+ * latency overhead, approximated as a fraction of a full screen fetch */
+static const uint64_t kGpuPixelCost = 8;
+static const uint64_t kPipeCostDivisor = 16;
+
+/* Bytes fetched by MDP for a layer. Color fill layers do not fetch any
+ * memory and YUV buffers are accounted as 4:2:0 */
+static uint64_t getLayerFetchBytes(hwc_layer_1_t const* layer) {
+    private_handle_t *hnd = (private_handle_t *)layer->handle;
+    if(!hnd || (layer->flags & HWC_COLOR_FILL))
+        return 0;
+    hwc_rect_t crop = integerizeSourceCrop(layer->sourceCropf);
+    uint64_t area = (uint64_t)(crop.right - crop.left) *
+            (crop.bottom - crop.top);
+    return isYuvBuffer(hnd) ? (area * 3 / 2) : (area * 4);
+}
+
+void MDPComp::planStrategies(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list) {
+    const int numAppLayers = ctx->listStats[mDpy].numAppLayers;
+    const int stagesForMDP = min(sMaxPipesPerMixer,
+            ctx->mOverlay->availablePipes(mDpy, Overlay::MIXER_DEFAULT));
+    const uint64_t fbBytes = (uint64_t)ctx->dpyAttr[mDpy].xres *
+            ctx->dpyAttr[mDpy].yres * 4;
+    const uint64_t pipeCost = fbBytes / kPipeCostDivisor;
+
+    uint64_t fetchBytes[MAX_NUM_APP_LAYERS];
+    uint64_t dstPixels[MAX_NUM_APP_LAYERS];
+    bool rotated[MAX_NUM_APP_LAYERS];
+    bool supported[MAX_NUM_APP_LAYERS];
+    bool updating[MAX_NUM_APP_LAYERS];
+    bool fbSetChanged = (mCachedFrame.layerCount != numAppLayers);
+    int firstUnsupported = numAppLayers;
+    int numNonDroppedLayers = 0;
+
+    mPlan.reset();
+
+    for(int i = 0; i < numAppLayers; i++) {
+        hwc_layer_1_t* layer = &list->hwLayers[i];
+        private_handle_t *hnd = (private_handle_t *)layer->handle;
+        hwc_rect_t dst = layer->displayFrame;
+
+        fetchBytes[i] = getLayerFetchBytes(layer);
+        dstPixels[i] = (uint64_t)(dst.right - dst.left) *
+                (dst.bottom - dst.top);
+        rotated[i] = hnd && has90Transform(layer) && isRotationDoable(ctx, hnd);
+        updating[i] = layerUpdating(layer);
+        supported[i] = true;
+        if(mCurrentFrame.drop[i])
+            continue;
+
+        numNonDroppedLayers++;
+        supported[i] = isSupportedForMDPComp(ctx, layer);
+        if(!supported[i] && firstUnsupported == numAppLayers)
+            firstUnsupported = i;
+        if(!fbSetChanged && (updating[i] == mCachedFrame.isFBComposed[i]))
+            fbSetChanged = true;
+    }
+
+    for(int strat = MDPCOMP_STRAT_FULL_MDP; strat <= MDPCOMP_STRAT_LOAD_MDP;
+            strat++) {
+        StrategyCost& cand = mPlan.candidates[mPlan.count++];
+        cand.strategy = (eStrategy)strat;
+        int mdpBatchSize = numNonDroppedLayers;
+        bool usesFB = false;
+
+        switch(cand.strategy) {
+        case MDPCOMP_STRAT_FULL_MDP:
+        case MDPCOMP_STRAT_FULL_MDP_PTOR:
+            if(firstUnsupported != numAppLayers)
+                cand.result = "unsupported layer";
+            else if(numNonDroppedLayers > sMaxPipesPerMixer)
+                cand.result = "exceeds pipes";
+            else if(cand.strategy == MDPCOMP_STRAT_FULL_MDP_PTOR &&
+                    (mDpy || !ctx->mCopyBit[mDpy]))
+                cand.result = "no copybit";
+            break;
+        case MDPCOMP_STRAT_CACHE_MDP:
+            if(!sEnableMixedMode)
+                cand.result = "mixed mode disabled";
+            break;
+        case MDPCOMP_STRAT_LOAD_MDP:
+            if(!sEnableMixedMode) {
+                cand.result = "mixed mode disabled";
+                break;
+            }
+            if(not isLoadBasedCompDoable(ctx)) {
+                cand.result = "not doable";
+                break;
+            }
+            //Mirror the initial batch picked by loadBasedComp
+            mdpBatchSize = stagesForMDP - 1;
+            if(firstUnsupported != numAppLayers) {
+                int dropped = 0;
+                for(int i = 0; i < firstUnsupported; i++)
+                    dropped += mCurrentFrame.drop[i];
+                mdpBatchSize = min(firstUnsupported - dropped, mdpBatchSize);
+            }
+            mdpBatchSize = min(mdpBatchSize, numNonDroppedLayers - 2);
+            if(mdpBatchSize < 1)
+                cand.result = "no MDP batch";
+            break;
+        default:
+            break;
+        }
+
+        if((cand.strategy == MDPCOMP_STRAT_FULL_MDP &&
+                (sSimulationFlags & MDPCOMP_AVOID_FULL_MDP)) ||
+                (cand.strategy == MDPCOMP_STRAT_CACHE_MDP &&
+                (sSimulationFlags & MDPCOMP_AVOID_CACHE_MDP)) ||
+                (cand.strategy == MDPCOMP_STRAT_LOAD_MDP &&
+                (sSimulationFlags & MDPCOMP_AVOID_LOAD_MDP)))
+            cand.result = "simulated failure";
+
+        if(cand.result)
+            continue;
+
+        uint64_t minDstPixels = 0;
+        for(int i = 0, mdpBatchLeft = mdpBatchSize; i < numAppLayers; i++) {
+            if(mCurrentFrame.drop[i])
+                continue;
+
+            bool onMDP = true;
+            if(cand.strategy == MDPCOMP_STRAT_CACHE_MDP) {
+                onMDP = updating[i];
+                if(onMDP && !supported[i]) {
+                    cand.result = "unsupported layer";
+                    break;
+                }
+            } else if(cand.strategy == MDPCOMP_STRAT_LOAD_MDP) {
+                onMDP = (mdpBatchLeft > 0);
+                mdpBatchLeft -= onMDP;
+            }
+
+            if(onMDP) {
+                cand.mdpBytes += fetchBytes[i];
+                cand.pipeCount++;
+                if(rotated[i]) {
+                    //Rotator reads and writes the buffer before MDP fetch
+                    cand.mdpBytes += 2 * fetchBytes[i];
+                    cand.rotCount++;
+                }
+            } else {
+                usesFB = true;
+                //Cached layers only go through GPU when the FB set changes
+                if(cand.strategy != MDPCOMP_STRAT_CACHE_MDP || fbSetChanged)
+                    cand.gpuPixels += dstPixels[i];
+            }
+            if(!minDstPixels || dstPixels[i] < minDstPixels)
+                minDstPixels = dstPixels[i];
+        }
+
+        if(cand.result)
+            continue;
+
+        //PTOR composes the overlap with the smallest layer through copybit
+        if(cand.strategy == MDPCOMP_STRAT_FULL_MDP_PTOR)
+            cand.gpuPixels += minDstPixels;
+
+        if(usesFB) {
+            cand.mdpBytes += fbBytes;
+            cand.pipeCount++;
+        }
+        cand.cost = cand.mdpBytes + (cand.gpuPixels * kGpuPixelCost) +
+                (cand.pipeCount * pipeCost);
+    }
+
+    //Order eligible candidates cheapest first. The sort is stable so equally
+    //priced candidates keep the legacy preference order.
+    for(int i = 1; i < mPlan.count; i++) {
+        StrategyCost cand = mPlan.candidates[i];
+        int j = i - 1;
+        while(j >= 0 && (mPlan.candidates[j].result ? !cand.result :
+                (!cand.result && cand.cost < mPlan.candidates[j].cost))) {
+            mPlan.candidates[j + 1] = mPlan.candidates[j];
+            j--;
+        }
+        mPlan.candidates[j + 1] = cand;
+    }
+
+    for(int i = 0; i < mPlan.count; i++) {
+        ALOGD_IF(isDebug(), "%s: dpy %d %s cost %llu %s", __FUNCTION__, mDpy,
+                getStrategyName(mPlan.candidates[i].strategy),
+                (unsigned long long)mPlan.candidates[i].cost,
+                mPlan.candidates[i].result ? mPlan.candidates[i].result : "");
+    }
+}
+
+bool MDPComp::tryStrategy(hwc_context_t *ctx, hwc_display_contents_1_t* list,
+        eStrategy strategy) {
+    switch(strategy) {
+    case MDPCOMP_STRAT_FULL_MDP:
+        return fullMDPComp(ctx, list);
+    case MDPCOMP_STRAT_FULL_MDP_PTOR:
+        return fullMDPCompWithPTOR(ctx, list);
+    case MDPCOMP_STRAT_CACHE_MDP:
+        return cacheBasedComp(ctx, list);
+    case MDPCOMP_STRAT_LOAD_MDP:
+        return loadBasedComp(ctx, list);
+    default:
         return false;
     }
+}
 
-    bool ret = false;
-    if(isSkipPresent(ctx, mDpy) or list->flags & HWC_GEOMETRY_CHANGED) {
-        //Try load based first
-        ret =   loadBasedComp(ctx, list) or
-                cacheBasedComp(ctx, list);
-    } else {
-        ret =   cacheBasedComp(ctx, list) or
-                loadBasedComp(ctx, list);
+/* 64 bit FNV-1a */
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t len) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    for(size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
     }
+    return hash;
+}
 
-    return ret;
+static const uint64_t kSignatureSeed = 0xcbf29ce484222325ULL;
+
+uint64_t MDPComp::getLayerSignature(const hwc_layer_1_t* layer) {
+    private_handle_t *hnd = (private_handle_t *)layer->handle;
+    int bufferInfo[4] = {0, 0, 0, 0};
+    if(hnd) {
+        bufferInfo[0] = hnd->format;
+        bufferInfo[1] = hnd->flags;
+        bufferInfo[2] = hnd->width;
+        bufferInfo[3] = hnd->height;
+    }
+
+    uint64_t sig = kSignatureSeed;
+    sig = hashBytes(sig, &layer->sourceCropf, sizeof(layer->sourceCropf));
+    sig = hashBytes(sig, &layer->displayFrame, sizeof(layer->displayFrame));
+    sig = hashBytes(sig, &layer->transform, sizeof(layer->transform));
+    sig = hashBytes(sig, &layer->blending, sizeof(layer->blending));
+    sig = hashBytes(sig, &layer->planeAlpha, sizeof(layer->planeAlpha));
+    sig = hashBytes(sig, &layer->flags, sizeof(layer->flags));
+    sig = hashBytes(sig, bufferInfo, sizeof(bufferInfo));
+    return sig;
+}
+
+uint64_t MDPComp::getFrameSignature(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list) {
+    const int numAppLayers = ctx->listStats[mDpy].numAppLayers;
+    uint64_t sig = hashBytes(kSignatureSeed, &numAppLayers,
+            sizeof(numAppLayers));
+    for(int i = 0; i < numAppLayers; i++) {
+        uint64_t layerSig = getLayerSignature(&list->hwLayers[i]);
+        sig = hashBytes(sig, &layerSig, sizeof(layerSig));
+    }
+    return sig;
+}
+
+bool MDPComp::tryPreviousStrategy(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list) {
+    const int numAppLayers = ctx->listStats[mDpy].numAppLayers;
+    const eStrategy strategy = mCachedFrame.strategy;
+
+    //PTOR rewrites the layer geometry while composing, always re-plan it
+    if(!mPrevModeOn || sSimulationFlags ||
+            (strategy != MDPCOMP_STRAT_FULL_MDP &&
+            strategy != MDPCOMP_STRAT_CACHE_MDP &&
+            strategy != MDPCOMP_STRAT_LOAD_MDP) ||
+            (list->flags & HWC_GEOMETRY_CHANGED) || isSkipPresent(ctx, mDpy) ||
+            (mCachedFrame.layerCount != numAppLayers) ||
+            (mCachedFrame.frameSig != mFrameSig) ||
+            memcmp(&mCachedFrame.drop, &mCurrentFrame.drop,
+            sizeof(mCurrentFrame.drop))) {
+        return false;
+    }
+
+    //A cached layer that started updating would force a GPU redraw every
+    //frame, a fresh plan can do better.
+    if(strategy == MDPCOMP_STRAT_CACHE_MDP) {
+        for(int i = 0; i < numAppLayers; i++) {
+            if(mCachedFrame.isFBComposed[i] && !mCurrentFrame.drop[i] &&
+                    layerUpdating(&list->hwLayers[i])) {
+                return false;
+            }
+        }
+    }
+
+    mCurrentFrame.reset(numAppLayers);
+    memcpy(&mCurrentFrame.isFBComposed, &mCachedFrame.isFBComposed,
+            sizeof(mCurrentFrame.isFBComposed));
+    mCurrentFrame.fbCount = mCachedFrame.fbCount;
+    mCurrentFrame.mdpCount = mCachedFrame.mdpCount;
+    mCurrentFrame.fbZ = mCachedFrame.fbZ;
+
+    if(!postHeuristicsHandling(ctx, list)) {
+        ALOGD_IF(isDebug(), "%s: previous %s failed, dpy %d", __FUNCTION__,
+                getStrategyName(strategy), mDpy);
+        reset(ctx);
+        return false;
+    }
+
+    mPlan.select(strategy, "geometry unchanged");
+    return true;
+}
+
+const char* MDPComp::getStrategyName(eStrategy strategy) {
+    switch(strategy) {
+    case MDPCOMP_STRAT_FULL_MDP:        return "FULL_MDP";
+    case MDPCOMP_STRAT_FULL_MDP_PTOR:   return "FULL_MDP_PTOR";
+    case MDPCOMP_STRAT_CACHE_MDP:       return "CACHE_MDP";
+    case MDPCOMP_STRAT_LOAD_MDP:        return "LOAD_MDP";
+    case MDPCOMP_STRAT_MDP_ONLY_LAYERS: return "MDP_ONLY_LAYERS";
+    case MDPCOMP_STRAT_VIDEO_ONLY:      return "VIDEO_ONLY";
+    default:                            return "NONE";
+    }
 }
 
 bool MDPComp::cacheBasedComp(hwc_context_t *ctx,
@@ -1319,6 +1658,17 @@ bool MDPComp::loadBasedComp(hwc_context_t *ctx,
         return false;
     }
 
+    //Skip the batch sizes that cannot pass resource checks anyway
+    const int feasibleBatchSize = getMaxFeasibleBatch(ctx, list, mdpBatchSize,
+            lastMDPSupportedIndex);
+    mLoadBasedPruned = mdpBatchSize - feasibleBatchSize;
+    fbBatchSize += mLoadBasedPruned;
+    mdpBatchSize = feasibleBatchSize;
+    if(mdpBatchSize < 1) {
+        ALOGD_IF(isDebug(), "%s: No feasible MDP batch", __FUNCTION__);
+        return false;
+    }
+
     mCurrentFrame.reset(numAppLayers);
 
     //Try with successively smaller mdp batch sizes until we succeed or reach 1
@@ -1341,6 +1691,7 @@ bool MDPComp::loadBasedComp(hwc_context_t *ctx,
                 __FUNCTION__, mdpBatchSize, fbBatchSize,
                 mCurrentFrame.dropCount);
 
+        mLoadBasedAttempts++;
         if(postHeuristicsHandling(ctx, list)) {
             ALOGD_IF(isDebug(), "%s: Postheuristics handling succeeded",
                      __FUNCTION__);
@@ -1357,6 +1708,57 @@ bool MDPComp::loadBasedComp(hwc_context_t *ctx,
     return false;
 }
 
+int MDPComp::getMaxFeasibleBatch(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list, int maxBatchSize, int lastIndex) {
+    //Demands of the k lowest non dropped layers, all of them grow with k.
+    //Bandwidth is left to validation: the driver checks it per set of
+    //overlapping layers, which a sum over the batch would overestimate.
+    int yuvCount[MAX_NUM_APP_LAYERS + 1];
+    int scaledCount[MAX_NUM_APP_LAYERS + 1];
+    int rotCount[MAX_NUM_APP_LAYERS + 1];
+    int batchSize = 0;
+
+    yuvCount[0] = scaledCount[0] = rotCount[0] = 0;
+    for(int i = 0; i < lastIndex && batchSize < maxBatchSize; i++) {
+        if(mCurrentFrame.drop[i])
+            continue;
+        hwc_layer_1_t* layer = &list->hwLayers[i];
+        private_handle_t *hnd = (private_handle_t *)layer->handle;
+        const bool yuv = isYuvBuffer(hnd);
+        yuvCount[batchSize + 1] = yuvCount[batchSize] + yuv;
+        scaledCount[batchSize + 1] = scaledCount[batchSize] +
+                (!yuv && needsScaling(layer));
+        rotCount[batchSize + 1] = rotCount[batchSize] +
+                (has90Transform(layer) && isRotationDoable(ctx, hnd));
+        batchSize++;
+    }
+
+    const int vgPipes = ctx->mOverlay->availablePipes(mDpy,
+            ovutils::OV_MDP_PIPE_VG);
+    const int rgbPipes = ctx->mOverlay->availablePipes(mDpy,
+            ovutils::OV_MDP_PIPE_RGB);
+    const int rotSessions = RotMgr::MAX_ROT_SESS -
+            ctx->mRotMgr->getNumActiveSessions();
+
+    //Largest k that still fits. Each count is a lower bound of what the
+    //hardware needs, so a rejected size could never pass validation.
+    int low = 0, high = batchSize;
+    while(low < high) {
+        const int k = (low + high + 1) / 2;
+        const bool fits = (yuvCount[k] <= vgPipes) &&
+                (yuvCount[k] + scaledCount[k] <= vgPipes + rgbPipes) &&
+                (rotCount[k] <= rotSessions);
+        if(fits)
+            low = k;
+        else
+            high = k - 1;
+    }
+
+    ALOGD_IF(isDebug(), "%s: dpy %d max batch %d feasible %d", __FUNCTION__,
+            mDpy, maxBatchSize, low);
+    return low;
+}
+
 bool MDPComp::isLoadBasedCompDoable(hwc_context_t *ctx) {
     if(mDpy or isSecurePresent(ctx, mDpy)) {
         return false;
@@ -1576,112 +1978,43 @@ bool MDPComp::isSecureRGBDoable(hwc_context_t* ctx, hwc_layer_1_t* layer) {
     return true;
 }
 
-/* starts at fromIndex and check for each layer to find
- * if it it has overlapping with any Updating layer above it in zorder
- * till the end of the batch. returns true if it finds any intersection */
-bool MDPComp::canPushBatchToTop(const hwc_display_contents_1_t* list,
-        int fromIndex, int toIndex) {
-    for(int i = fromIndex; i < toIndex; i++) {
-        if(mCurrentFrame.isFBComposed[i] && !mCurrentFrame.drop[i]) {
-            if(intersectingUpdatingLayers(list, i+1, toIndex, i)) {
-                return false;
-            }
-        }
-    }
-    return true;
-}
-
-/* Checks if given layer at targetLayerIndex has any
- * intersection with all the updating layers in beween
- * fromIndex and toIndex. Returns true if it finds intersectiion */
-bool MDPComp::intersectingUpdatingLayers(const hwc_display_contents_1_t* list,
-        int fromIndex, int toIndex, int targetLayerIndex) {
-    for(int i = fromIndex; i <= toIndex; i++) {
-        if(!mCurrentFrame.isFBComposed[i]) {
-            if(areLayersIntersecting(&list->hwLayers[i],
-                        &list->hwLayers[targetLayerIndex]))  {
-                return true;
-            }
-        }
-    }
-    return false;
-}
-
+/* Finds the largest batch of cached layers that can be composed on FB, see
+ * findFBBatch. Pairwise overlaps between cached and updating layers are
+ * computed once into a bitmatrix. Returns the z-order of the FB */
 int MDPComp::getBatch(hwc_display_contents_1_t* list,
         int& maxBatchStart, int& maxBatchEnd,
         int& maxBatchCount) {
-    int i = 0;
-    int fbZOrder =-1;
-    int droppedLayerCt = 0;
-    while (i < mCurrentFrame.layerCount) {
-        int batchCount = 0;
-        int batchStart = i;
-        int batchEnd = i;
-        /* Adjust batch Z order with the dropped layers so far */
-        int fbZ = batchStart - droppedLayerCt;
-        int firstZReverseIndex = -1;
-        int updatingLayersAbove = 0;//Updating layer count in middle of batch
-        while(i < mCurrentFrame.layerCount) {
-            if(!mCurrentFrame.isFBComposed[i]) {
-                if(!batchCount) {
-                    i++;
-                    break;
-                }
-                updatingLayersAbove++;
-                i++;
-                continue;
-            } else {
-                if(mCurrentFrame.drop[i]) {
-                    i++;
-                    droppedLayerCt++;
-                    continue;
-                } else if(updatingLayersAbove <= 0) {
-                    batchCount++;
-                    batchEnd = i;
-                    i++;
-                    continue;
-                } else { //Layer is FBComposed, not a drop & updatingLayer > 0
-
-                    // We have a valid updating layer already. If layer-i not
-                    // have overlapping with all updating layers in between
-                    // batch-start and i, then we can add layer i to batch.
-                    if(!intersectingUpdatingLayers(list, batchStart, i-1, i)) {
-                        batchCount++;
-                        batchEnd = i;
-                        i++;
-                        continue;
-                    } else if(canPushBatchToTop(list, batchStart, i)) {
-                        //If All the non-updating layers with in this batch
-                        //does not have intersection with the updating layers
-                        //above in z-order, then we can safely move the batch to
-                        //higher z-order. Increment fbZ as it is moving up.
-                        if( firstZReverseIndex < 0) {
-                            firstZReverseIndex = i;
-                        }
-                        batchCount++;
-                        batchEnd = i;
-                        fbZ += updatingLayersAbove;
-                        i++;
-                        updatingLayersAbove = 0;
-                        continue;
-                    } else {
-                        //both failed.start the loop again from here.
-                        if(firstZReverseIndex >= 0) {
-                            i = firstZReverseIndex;
-                        }
-                        break;
-                    }
-                }
+    const int layerCount = mCurrentFrame.layerCount;
+    uint32_t cachedMask = 0;
+    uint32_t updatingMask = 0;
+    uint32_t overlap[MAX_NUM_APP_LAYERS];
+
+    for(int i = 0; i < layerCount; i++) {
+        overlap[i] = 0;
+        if(mCurrentFrame.drop[i])
+            continue;
+        if(mCurrentFrame.isFBComposed[i])
+            cachedMask |= (1u << i);
+        else
+            updatingMask |= (1u << i);
+    }
+
+    //Only overlaps between cached and updating layers constrain the batch
+    for(int i = 0; i < layerCount; i++) {
+        if(!(cachedMask & (1u << i)))
+            continue;
+        for(int j = 0; j < layerCount; j++) {
+            if((updatingMask & (1u << j)) &&
+                    areLayersIntersecting(&list->hwLayers[i],
+                    &list->hwLayers[j])) {
+                overlap[i] |= (1u << j);
+                overlap[j] |= (1u << i);
             }
         }
-        if(batchCount > maxBatchCount) {
-            maxBatchCount = batchCount;
-            maxBatchStart = batchStart;
-            maxBatchEnd = batchEnd;
-            fbZOrder = fbZ;
-        }
     }
-    return fbZOrder;
+
+    return findFBBatch(layerCount, cachedMask, updatingMask, overlap,
+            maxBatchStart, maxBatchEnd, maxBatchCount);
 }
 
 bool  MDPComp::markLayersForCaching(hwc_context_t* ctx,
@@ -2144,6 +2477,8 @@ int MDPComp::prepare(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
     memset(&mCurrentFrame.drop, 0, sizeof(mCurrentFrame.drop));
     mCurrentFrame.dropCount = 0;
     mCurrentFrame.hwCursorIndex = -1;
+    mLoadBasedAttempts = 0;
+    mLoadBasedPruned = 0;
 
     //Do not cache the information for next draw cycle.
     if(numLayers > MAX_NUM_APP_LAYERS or (!numLayers)) {
@@ -2222,8 +2557,22 @@ int MDPComp::prepare(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
 
         // if tryFullFrame fails, try to push all video and secure RGB layers
         // to MDP for composition.
-        mModeOn = tryFullFrame(ctx, list) || tryMDPOnlyLayers(ctx, list) ||
-                  tryVideoOnly(ctx, list);
+        mPlan.reset();
+        mFrameSig = getFrameSignature(ctx, list);
+        mModeOn = tryFullFrame(ctx, list);
+        if(!mModeOn) {
+            if(tryMDPOnlyLayers(ctx, list)) {
+                mModeOn = true;
+                mPlan.select(MDPCOMP_STRAT_MDP_ONLY_LAYERS,
+                        "full frame strategies failed");
+            } else if(tryVideoOnly(ctx, list)) {
+                mModeOn = true;
+                mPlan.select(MDPCOMP_STRAT_VIDEO_ONLY,
+                        "full frame strategies failed");
+            } else {
+                mPlan.select(MDPCOMP_STRAT_NONE, "all strategies failed");
+            }
+        }
         if(mModeOn) {
             setMDPCompLayerFlags(ctx, list);
         } else {
@@ -2251,6 +2600,8 @@ int MDPComp::prepare(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
         }
         ALOGD_IF( isDebug(),"%s: MDP Comp not possible for this frame",
                 __FUNCTION__);
+        mPlan.reset();
+        mPlan.select(MDPCOMP_STRAT_NONE, "frame not doable");
         // Release the hw cursor
         freeHwCursor(ctx->dpyAttr[mDpy].fd, mDpy);
         ret = -1;
@@ -2270,17 +2621,29 @@ int MDPComp::prepare(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
     setPerfHint(ctx, list);
 
     mCachedFrame.updateCounts(mCurrentFrame);
+    mCachedFrame.frameSig = mFrameSig;
+    mCachedFrame.strategy = mModeOn ? mPlan.selected : MDPCOMP_STRAT_NONE;
     return ret;
 }
 
+MDPComp::MdpYUVPipeInfo& MDPComp::allocYUVPipeInfo(int mdpIndex) {
+    static_assert(sizeof(mYUVPipeInfoPool) / sizeof(mYUVPipeInfoPool[0]) ==
+            sizeof(mCurrentFrame.mdpToLayer) / sizeof(mCurrentFrame.mdpToLayer[0]),
+            "every MDP index needs a pipe info pool slot");
+    ALOG_ASSERT(mdpIndex >= 0 && mdpIndex < MAX_NUM_BLEND_STAGES,
+            "%s: MDP index %d out of the pipe info pool", __FUNCTION__, mdpIndex);
+    PipeLayerPair& info = mCurrentFrame.mdpToLayer[mdpIndex];
+    mYUVPipeInfoPool[mdpIndex] = MdpYUVPipeInfo();
+    info.pipeInfo = &mYUVPipeInfoPool[mdpIndex];
+    info.rot = NULL;
+    return mYUVPipeInfoPool[mdpIndex];
+}
+
 bool MDPComp::allocSplitVGPipes(hwc_context_t *ctx, int index) {
 
     bool bRet = true;
     int mdpIndex = mCurrentFrame.layerToMDP[index];
-    PipeLayerPair& info = mCurrentFrame.mdpToLayer[mdpIndex];
-    info.pipeInfo = new MdpYUVPipeInfo;
-    info.rot = NULL;
-    MdpYUVPipeInfo& pipe_info = *(MdpYUVPipeInfo*)info.pipeInfo;
+    MdpYUVPipeInfo& pipe_info = allocYUVPipeInfo(mdpIndex);
 
     pipe_info.lIndex = ovutils::OV_INVALID;
     pipe_info.rIndex = ovutils::OV_INVALID;
@@ -2318,6 +2681,20 @@ int MDPComp::drawOverlap(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
 }
 //=============MDPCompNonSplit==================================================
 
+MDPCompNonSplit::MdpPipeInfoNonSplit& MDPCompNonSplit::allocPipeInfo(
+        int mdpIndex) {
+    static_assert(sizeof(mPipeInfoPool) / sizeof(mPipeInfoPool[0]) ==
+            sizeof(mCurrentFrame.mdpToLayer) / sizeof(mCurrentFrame.mdpToLayer[0]),
+            "every MDP index needs a pipe info pool slot");
+    ALOG_ASSERT(mdpIndex >= 0 && mdpIndex < MAX_NUM_BLEND_STAGES,
+            "%s: MDP index %d out of the pipe info pool", __FUNCTION__, mdpIndex);
+    PipeLayerPair& info = mCurrentFrame.mdpToLayer[mdpIndex];
+    mPipeInfoPool[mdpIndex] = MdpPipeInfoNonSplit();
+    info.pipeInfo = &mPipeInfoPool[mdpIndex];
+    info.rot = NULL;
+    return mPipeInfoPool[mdpIndex];
+}
+
 void MDPCompNonSplit::adjustForSourceSplit(hwc_context_t *ctx,
         hwc_display_contents_1_t* list) {
     //If 4k2k Yuv layer split is possible,  and if
@@ -2388,11 +2765,7 @@ bool MDPCompNonSplit::allocLayerPipes(hwc_context_t *ctx,
             }
 
             int mdpIndex = mCurrentFrame.layerToMDP[index];
-            PipeLayerPair& info = mCurrentFrame.mdpToLayer[mdpIndex];
-            info.pipeInfo = new MdpPipeInfoNonSplit;
-            info.rot = NULL;
-            MdpPipeInfoNonSplit& pipe_info =
-                    *(MdpPipeInfoNonSplit*)info.pipeInfo;
+            MdpPipeInfoNonSplit& pipe_info = allocPipeInfo(mdpIndex);
 
             Overlay::PipeSpecs pipeSpecs;
             pipeSpecs.formatClass = isYuvBuffer(hnd) ?
@@ -2542,6 +2915,19 @@ bool MDPCompNonSplit::draw(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
 
 //=============MDPCompSplit===================================================
 
+MDPCompSplit::MdpPipeInfoSplit& MDPCompSplit::allocPipeInfo(int mdpIndex) {
+    static_assert(sizeof(mPipeInfoPool) / sizeof(mPipeInfoPool[0]) ==
+            sizeof(mCurrentFrame.mdpToLayer) / sizeof(mCurrentFrame.mdpToLayer[0]),
+            "every MDP index needs a pipe info pool slot");
+    ALOG_ASSERT(mdpIndex >= 0 && mdpIndex < MAX_NUM_BLEND_STAGES,
+            "%s: MDP index %d out of the pipe info pool", __FUNCTION__, mdpIndex);
+    PipeLayerPair& info = mCurrentFrame.mdpToLayer[mdpIndex];
+    mPipeInfoPool[mdpIndex] = MdpPipeInfoSplit();
+    info.pipeInfo = &mPipeInfoPool[mdpIndex];
+    info.rot = NULL;
+    return mPipeInfoPool[mdpIndex];
+}
+
 void MDPCompSplit::adjustForSourceSplit(hwc_context_t *ctx,
          hwc_display_contents_1_t* list){
     //if 4kx2k yuv layer is totally present in either in left half
@@ -2639,10 +3025,7 @@ bool MDPCompSplit::allocLayerPipes(hwc_context_t *ctx,
                     continue;
 
             int mdpIndex = mCurrentFrame.layerToMDP[index];
-            PipeLayerPair& info = mCurrentFrame.mdpToLayer[mdpIndex];
-            info.pipeInfo = new MdpPipeInfoSplit;
-            info.rot = NULL;
-            MdpPipeInfoSplit& pipe_info = *(MdpPipeInfoSplit*)info.pipeInfo;
+            MdpPipeInfoSplit& pipe_info = allocPipeInfo(mdpIndex);
 
             if(!acquireMDPPipes(ctx, layer, pipe_info)) {
                 ALOGD_IF(isDebug(), "%s: Unable to get pipe for layer %d of "\
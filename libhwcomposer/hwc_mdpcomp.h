@@ -78,6 +78,46 @@ protected:
         MDPCOMP_AVOID_MDP_ONLY_LAYERS = 0x010,
     };
 
+    //Composition strategies
+    enum eStrategy {
+        MDPCOMP_STRAT_NONE,
+        MDPCOMP_STRAT_FULL_MDP,
+        MDPCOMP_STRAT_FULL_MDP_PTOR,
+        MDPCOMP_STRAT_CACHE_MDP,
+        MDPCOMP_STRAT_LOAD_MDP,
+        MDPCOMP_STRAT_MDP_ONLY_LAYERS,
+        MDPCOMP_STRAT_VIDEO_ONLY,
+        MDPCOMP_STRAT_MAX,
+    };
+
+    /* estimated cost of a candidate strategy */
+    struct StrategyCost {
+        eStrategy strategy;
+        /* bytes fetched by MDP pipes, including the FB target */
+        uint64_t mdpBytes;
+        /* pixels composed by GPU (or copybit for PTOR) */
+        uint64_t gpuPixels;
+        int pipeCount;
+        int rotCount;
+        uint64_t cost;
+        /* NULL while the candidate is still eligible */
+        const char *result;
+    };
+
+    /* per frame strategy plan */
+    struct StrategyPlan {
+        int count;
+        StrategyCost candidates[MDPCOMP_STRAT_MAX];
+        eStrategy selected;
+        const char *reason;
+
+        /* c'tor */
+        StrategyPlan();
+        /* clear old plan */
+        void reset();
+        void select(eStrategy strategy, const char *why);
+    };
+
     /* mdp pipe data */
     struct MdpPipeInfo {
         int zOrder;
@@ -131,6 +171,12 @@ protected:
         int layerCount;
         bool isFBComposed[MAX_NUM_APP_LAYERS];
         bool drop[MAX_NUM_APP_LAYERS];
+        int fbCount;
+        int mdpCount;
+        int fbZ;
+        /* geometry signature and strategy of the last MDP composed frame */
+        uint64_t frameSig;
+        eStrategy strategy;
 
         /* c'tor */
         LayerCache();
@@ -181,8 +227,19 @@ protected:
     bool fullMDPComp(hwc_context_t *ctx, hwc_display_contents_1_t* list);
     /* Full MDP Composition with Peripheral Tiny Overlap Removal */
     bool fullMDPCompWithPTOR(hwc_context_t *ctx,hwc_display_contents_1_t* list);
-    /* check if we can use layer cache to do at least partial MDP comp */
-    bool partialMDPComp(hwc_context_t *ctx, hwc_display_contents_1_t* list);
+    /* estimates the cost of the full frame strategies and orders them */
+    void planStrategies(hwc_context_t *ctx, hwc_display_contents_1_t* list);
+    /* attempts a single strategy picked by the planner */
+    bool tryStrategy(hwc_context_t *ctx, hwc_display_contents_1_t* list,
+            eStrategy strategy);
+    static const char* getStrategyName(eStrategy strategy);
+    /* reuses the strategy of the previous frame if its geometry is same */
+    bool tryPreviousStrategy(hwc_context_t *ctx,
+            hwc_display_contents_1_t* list);
+    /* hashes everything but the buffer of a layer */
+    static uint64_t getLayerSignature(const hwc_layer_1_t* layer);
+    uint64_t getFrameSignature(hwc_context_t *ctx,
+            hwc_display_contents_1_t* list);
     /* Partial MDP comp that uses caching to save power as primary goal */
     bool cacheBasedComp(hwc_context_t *ctx, hwc_display_contents_1_t* list);
     /* Partial MDP comp that balances the load between MDP and GPU such that
@@ -192,6 +249,10 @@ protected:
     bool loadBasedComp(hwc_context_t *ctx, hwc_display_contents_1_t* list);
     /* Checks if its worth doing load based partial comp */
     bool isLoadBasedCompDoable(hwc_context_t *ctx);
+    /* Returns the largest load based MDP batch, up to maxBatchSize, that
+     * fits the available pipes and rotator sessions */
+    int getMaxFeasibleBatch(hwc_context_t *ctx, hwc_display_contents_1_t* list,
+            int maxBatchSize, int lastIndex);
     /* checks for conditions where only video can be bypassed */
     bool tryVideoOnly(hwc_context_t *ctx, hwc_display_contents_1_t* list);
     bool videoOnlyComp(hwc_context_t *ctx, hwc_display_contents_1_t* list,
@@ -222,10 +283,6 @@ protected:
     int getBatch(hwc_display_contents_1_t* list,
             int& maxBatchStart, int& maxBatchEnd,
             int& maxBatchCount);
-    bool canPushBatchToTop(const hwc_display_contents_1_t* list,
-            int fromIndex, int toIndex);
-    bool intersectingUpdatingLayers(const hwc_display_contents_1_t* list,
-            int fromIndex, int toIndex, int targetLayerIndex);
 
     /* drop other non-AIV layers from external display list.*/
     void dropNonAIVLayers(hwc_context_t* ctx, hwc_display_contents_1_t* list);
@@ -269,11 +326,22 @@ protected:
     static int sMaxSecLayers;
     static bool sIsPartialUpdateActive;
     struct FrameInfo mCurrentFrame;
+    /* backs mdpToLayer[].pipeInfo of 4kx2k split YUV layers, indexed by the
+     * MDP index, so that no pipe info is allocated per frame */
+    MdpYUVPipeInfo mYUVPipeInfoPool[MAX_NUM_BLEND_STAGES];
     struct LayerCache mCachedFrame;
+    struct StrategyPlan mPlan;
+    /* geometry signature of the frame being prepared */
+    uint64_t mFrameSig;
+    /* load based batch sizes validated and pruned in the current frame */
+    int mLoadBasedAttempts;
+    int mLoadBasedPruned;
     //Enable 4kx2k yuv layer split
     static bool sEnableYUVsplit;
     bool mModeOn; // if prepare happened
     bool allocSplitVGPipes(hwc_context_t *ctx, int index);
+    /* points mdpToLayer[mdpIndex] at its cleared YUV pipe info pool slot */
+    MdpYUVPipeInfo& allocYUVPipeInfo(int mdpIndex);
     bool mPrevModeOn; //if previous prepare happened
     //Enable Partial Update for MDP3 targets
     static bool enablePartialUpdateForMDP3;
@@ -297,6 +365,12 @@ private:
         virtual ~MdpPipeInfoNonSplit() {};
     };
 
+    /* points mdpToLayer[mdpIndex] at its cleared pipe info pool slot */
+    MdpPipeInfoNonSplit& allocPipeInfo(int mdpIndex);
+
+    /* backs mdpToLayer[].pipeInfo, indexed by the MDP index */
+    MdpPipeInfoNonSplit mPipeInfoPool[MAX_NUM_BLEND_STAGES];
+
     /* configure's overlay pipes for the frame */
     virtual int configure(hwc_context_t *ctx, hwc_layer_1_t *layer,
                           PipeLayerPair& pipeLayerPair);
@@ -337,6 +411,12 @@ protected:
         virtual ~MdpPipeInfoSplit() {};
     };
 
+    /* backs mdpToLayer[].pipeInfo, indexed by the MDP index */
+    MdpPipeInfoSplit mPipeInfoPool[MAX_NUM_BLEND_STAGES];
+
+    /* points mdpToLayer[mdpIndex] at its cleared pipe info pool slot */
+    MdpPipeInfoSplit& allocPipeInfo(int mdpIndex);
+
     virtual bool acquireMDPPipes(hwc_context_t *ctx, hwc_layer_1_t* layer,
                          MdpPipeInfoSplit& pipe_info);
 
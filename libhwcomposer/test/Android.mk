@@ -0,0 +1,11 @@
+LOCAL_PATH := $(call my-dir)
+include $(LOCAL_PATH)/../../common.mk
+include $(CLEAR_VARS)
+
+LOCAL_MODULE                  := hwc_batch_test
+LOCAL_VENDOR_MODULE           := true
+LOCAL_MODULE_TAGS             := optional
+LOCAL_C_INCLUDES              := $(LOCAL_PATH)/..
+LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"qdhwcomposer\"
+LOCAL_SRC_FILES               := hwc_batch_test.cpp
+include $(BUILD_EXECUTABLE)
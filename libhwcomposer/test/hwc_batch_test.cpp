@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2012-2013, 2015, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are retained
+ * for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Randomized test of findFBBatch, the FB batch search of MDPComp::getBatch.
+ * Random layer stacks are checked against
+ *   - the greedy batch search getBatch used before, which the new search
+ *     must never do worse than,
+ *   - an exhaustive search over every batch and FB z-order, for stacks small
+ *     enough to enumerate, which the new search must match,
+ *   - a z-order simulation, in which every pair of intersecting layers must
+ *     keep its relative order once the batch is collapsed into the FB.
+ *
+ * Usage: hwc_batch_test [iterations] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <hwc_batch.h>
+
+using namespace qhwc;
+
+namespace {
+
+const int kMaxLayers = 32;
+const int kMaxExhaustiveLayers = 10;
+const int kDefaultIterations = 200000;
+
+struct Rect {
+    int left, top, right, bottom;
+};
+
+struct Stack {
+    int count;
+    Rect rect[kMaxLayers];
+    bool isFBComposed[kMaxLayers];
+    bool drop[kMaxLayers];
+};
+
+uint32_t sSeed = 1;
+
+int randomInt(int range) {
+    //xorshift32, so that failures reproduce on every libc
+    sSeed ^= sSeed << 13;
+    sSeed ^= sSeed >> 17;
+    sSeed ^= sSeed << 5;
+    return (int)(sSeed % (uint32_t)range);
+}
+
+bool intersecting(const Stack& s, int a, int b) {
+    return s.rect[a].left < s.rect[b].right &&
+            s.rect[b].left < s.rect[a].right &&
+            s.rect[a].top < s.rect[b].bottom &&
+            s.rect[b].top < s.rect[a].bottom;
+}
+
+/* Batch search of MDPComp::getBatch before findFBBatch, kept verbatim apart
+ * from the layer list accessors */
+bool intersectingUpdatingLayers(const Stack& s, int fromIndex, int toIndex,
+        int targetLayerIndex) {
+    for(int i = fromIndex; i <= toIndex; i++) {
+        if(!s.isFBComposed[i]) {
+            if(intersecting(s, i, targetLayerIndex)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool canPushBatchToTop(const Stack& s, int fromIndex, int toIndex) {
+    for(int i = fromIndex; i < toIndex; i++) {
+        if(s.isFBComposed[i] && !s.drop[i]) {
+            if(intersectingUpdatingLayers(s, i+1, toIndex, i)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int greedyBatch(const Stack& s, int& maxBatchStart, int& maxBatchEnd,
+        int& maxBatchCount) {
+    int i = 0;
+    int fbZOrder =-1;
+    int droppedLayerCt = 0;
+    while (i < s.count) {
+        int batchCount = 0;
+        int batchStart = i;
+        int batchEnd = i;
+        int fbZ = batchStart - droppedLayerCt;
+        int firstZReverseIndex = -1;
+        int updatingLayersAbove = 0;
+        while(i < s.count) {
+            if(!s.isFBComposed[i]) {
+                if(!batchCount) {
+                    i++;
+                    break;
+                }
+                updatingLayersAbove++;
+                i++;
+                continue;
+            } else {
+                if(s.drop[i]) {
+                    i++;
+                    droppedLayerCt++;
+                    continue;
+                } else if(updatingLayersAbove <= 0) {
+                    batchCount++;
+                    batchEnd = i;
+                    i++;
+                    continue;
+                } else {
+                    if(!intersectingUpdatingLayers(s, batchStart, i-1, i)) {
+                        batchCount++;
+                        batchEnd = i;
+                        i++;
+                        continue;
+                    } else if(canPushBatchToTop(s, batchStart, i)) {
+                        if( firstZReverseIndex < 0) {
+                            firstZReverseIndex = i;
+                        }
+                        batchCount++;
+                        batchEnd = i;
+                        fbZ += updatingLayersAbove;
+                        i++;
+                        updatingLayersAbove = 0;
+                        continue;
+                    } else {
+                        if(firstZReverseIndex >= 0) {
+                            i = firstZReverseIndex;
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+        if(batchCount > maxBatchCount) {
+            maxBatchCount = batchCount;
+            maxBatchStart = batchStart;
+            maxBatchEnd = batchEnd;
+            fbZOrder = fbZ;
+        }
+    }
+    return fbZOrder;
+}
+
+/* Same inputs as MDPComp::getBatch builds from the layer list */
+int newBatch(const Stack& s, int& maxBatchStart, int& maxBatchEnd,
+        int& maxBatchCount) {
+    uint32_t cachedMask = 0;
+    uint32_t updatingMask = 0;
+    uint32_t overlap[kMaxLayers];
+
+    for(int i = 0; i < s.count; i++) {
+        overlap[i] = 0;
+        if(s.drop[i])
+            continue;
+        if(s.isFBComposed[i])
+            cachedMask |= (1u << i);
+        else
+            updatingMask |= (1u << i);
+    }
+
+    for(int i = 0; i < s.count; i++) {
+        if(!(cachedMask & (1u << i)))
+            continue;
+        for(int j = 0; j < s.count; j++) {
+            if((updatingMask & (1u << j)) && intersecting(s, i, j)) {
+                overlap[i] |= (1u << j);
+                overlap[j] |= (1u << i);
+            }
+        }
+    }
+
+    return findFBBatch(s.count, cachedMask, updatingMask, overlap,
+            maxBatchStart, maxBatchEnd, maxBatchCount);
+}
+
+bool inBatch(const Stack& s, int i, int start, int end) {
+    return s.isFBComposed[i] && i >= start && i <= end;
+}
+
+/* Collapses the cached layers of [start, end] into an FB staged at fbZ and
+ * checks that no two intersecting layers swapped their order */
+bool isLegal(const Stack& s, int start, int end, int fbZ) {
+    int z[kMaxLayers];
+    int next = 0;
+
+    for(int i = 0; i < s.count; i++) {
+        if(s.drop[i])
+            continue;
+        if(inBatch(s, i, start, end)) {
+            z[i] = fbZ;
+            continue;
+        }
+        if(next == fbZ)
+            next++;
+        z[i] = next++;
+    }
+
+    for(int i = 0; i < s.count; i++) {
+        for(int j = i + 1; j < s.count; j++) {
+            if(s.drop[i] || s.drop[j])
+                continue;
+            if(inBatch(s, i, start, end) && inBatch(s, j, start, end))
+                continue;
+            if(intersecting(s, i, j) && z[i] >= z[j])
+                return false;
+        }
+    }
+    return true;
+}
+
+int exhaustiveBatch(const Stack& s) {
+    int best = 0;
+
+    for(int start = 0; start < s.count; start++) {
+        int nonDroppedBelow = 0;
+        for(int i = 0; i < start; i++)
+            nonDroppedBelow += !s.drop[i];
+
+        for(int end = start; end < s.count; end++) {
+            int count = 0;
+            int updating = 0;
+            for(int i = start; i <= end; i++) {
+                count += s.isFBComposed[i] && !s.drop[i];
+                updating += !s.isFBComposed[i];
+            }
+            if(count <= best)
+                continue;
+            for(int k = 0; k <= updating; k++) {
+                if(isLegal(s, start, end, nonDroppedBelow + k)) {
+                    best = count;
+                    break;
+                }
+            }
+        }
+    }
+    return best;
+}
+
+void randomStack(Stack& s, int maxLayers) {
+    //Small screen so that layers overlap often
+    s.count = 1 + randomInt(maxLayers);
+    for(int i = 0; i < s.count; i++) {
+        int x = randomInt(10);
+        int y = randomInt(10);
+        s.rect[i].left = x;
+        s.rect[i].top = y;
+        s.rect[i].right = x + 1 + randomInt(5);
+        s.rect[i].bottom = y + 1 + randomInt(5);
+        //Dropped layers are always marked for FB
+        s.drop[i] = (randomInt(8) == 0);
+        s.isFBComposed[i] = s.drop[i] || (randomInt(3) != 0);
+    }
+}
+
+void printStack(const Stack& s) {
+    for(int i = 0; i < s.count; i++) {
+        printf("  layer %2d [%d %d %d %d] %s\n", i, s.rect[i].left,
+                s.rect[i].top, s.rect[i].right, s.rect[i].bottom,
+                s.drop[i] ? "dropped" :
+                (s.isFBComposed[i] ? "cached" : "updating"));
+    }
+}
+
+}; //namespace
+
+int main(int argc, char** argv) {
+    int iterations = (argc > 1) ? atoi(argv[1]) : kDefaultIterations;
+    int larger = 0;
+
+    for(int it = 0; it < iterations; it++) {
+        Stack s;
+        //Every other stack uses the full 32 bit masks
+        randomStack(s, (it & 1) ? kMaxLayers : kMaxExhaustiveLayers);
+
+        int oldStart = -1, oldEnd = -1, oldCount = 0;
+        int newStart = -1, newEnd = -1, newCount = 0;
+        greedyBatch(s, oldStart, oldEnd, oldCount);
+        int fbZ = newBatch(s, newStart, newEnd, newCount);
+
+        const char* error = NULL;
+        if(newCount && !isLegal(s, newStart, newEnd, fbZ))
+            error = "illegal batch";
+        else if(newCount < oldCount)
+            error = "smaller batch than the greedy search";
+        else if(s.count <= kMaxExhaustiveLayers &&
+                newCount != exhaustiveBatch(s))
+            error = "batch is not the largest";
+
+        if(error) {
+            printf("FAIL iteration %d: %s, batch [%d, %d] count %d fbZ %d, "
+                    "greedy count %d\n", it, error, newStart, newEnd,
+                    newCount, fbZ, oldCount);
+            printStack(s);
+            return 1;
+        }
+        larger += (newCount > oldCount);
+    }
+
+    printf("PASS %d stacks, %d with a larger batch than the greedy search\n",
+            iterations, larger);
+    return 0;
+}
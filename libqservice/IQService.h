@@ -65,6 +65,9 @@ public:
         GET_ACTIVE_CONFIG = 26, //Get the current config index
         GET_CONFIG_COUNT = 27, //Get the number of supported display configs
         GET_DISPLAY_ATTRIBUTES_FOR_CONFIG = 28, //Get attr for specified config
+        DUMP_TRACE = 29, // Enable/disable display trace or atrace output, or export it
+        RESET_DISPLAY_STATS = 30, // Reset display statistics reported in dumpsys
+        GET_DISPLAY_DUMP = 31, // Get display dump in text or compact key=value format
         COMMAND_LIST_END = 400,
     };
 
@@ -73,6 +76,19 @@ public:
         START,
     };
 
+    enum {
+        DUMP_FORMAT_TEXT,
+        DUMP_FORMAT_COMPACT,
+    };
+
+    enum {
+        TRACE_DISABLE,
+        TRACE_ENABLE,
+        TRACE_EXPORT,
+        TRACE_ATRACE_DISABLE,
+        TRACE_ATRACE_ENABLE,
+    };
+
     enum {
         DEBUG_ALL,
         DEBUG_MDPCOMP,